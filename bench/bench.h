@@ -0,0 +1,73 @@
+/**
+ * Tiny microbenchmark harness for the host build.
+ *
+ * Each benchmark is run for a number of iterations and reported as
+ * nanoseconds and (where the host has a usable cycle counter) CPU cycles per
+ * operation. Deliberately no dependencies, the numbers are only meant to be
+ * compared run to run to catch regressions.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t bench_cycles() { return __rdtsc(); }
+static const bool BENCH_HAVE_CYCLES = true;
+#else
+static inline uint64_t bench_cycles() { return 0; }
+static const bool BENCH_HAVE_CYCLES = false;
+#endif
+
+// results get written here so the compiler can't optimise the work away
+extern volatile uint32_t bench_sink;
+
+struct BenchOptions {
+    uint64_t iterations = 200000;
+    const char* filter = nullptr;
+};
+
+static inline void bench_header() {
+    printf("%-32s %12s %12s %12s\n", "benchmark", "iterations", "ns/op", "cycles/op");
+}
+
+// whether the named benchmark is to be run, for printing notes alongside
+static inline bool bench_selected(const BenchOptions& opts, const char* name) {
+    return !opts.filter || strstr(name, opts.filter);
+}
+
+/**
+ * Run fn() iterations times (scaled by weight, for the slow ones) and
+ * print a line of results.
+ */
+template <typename Fn>
+void bench_run(const BenchOptions& opts, const char* name, uint64_t weight, Fn fn) {
+    if (!bench_selected(opts, name)) {
+        return;
+    }
+    uint64_t iterations = opts.iterations / (weight ? weight : 1);
+    if (iterations == 0) iterations = 1;
+
+    // warm up caches and branch predictors
+    for (uint64_t i = 0; i < iterations / 10 + 1; i++) {
+        fn();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t cycles_start = bench_cycles();
+    for (uint64_t i = 0; i < iterations; i++) {
+        fn();
+    }
+    uint64_t cycles = bench_cycles() - cycles_start;
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    if (BENCH_HAVE_CYCLES) {
+        printf("%-32s %12llu %12.1f %12.1f\n", name, (unsigned long long)iterations, ns, (double)cycles / iterations);
+    } else {
+        printf("%-32s %12llu %12.1f %12s\n", name, (unsigned long long)iterations, ns, "-");
+    }
+}
@@ -0,0 +1,415 @@
+/**
+ * HortiTel host microbenchmarks.
+ *
+ * Runs the sampling, codec and frame handling code against the simulated
+ * hardware and reports the cost per reading and per packet.
+ *
+ * usage: hortitel_bench [-n iterations] [-f filter]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "bench.h"
+#include "adc.h"
+#include "aggregate.h"
+#include "archive.h"
+#include "batch.h"
+#include "emb_command.h"
+#include "flash_log.h"
+#include "frame.h"
+#include "frame_stream.h"
+#include "hostlink.h"
+#include "hostlink_decoder.h"
+#include "log.h"
+#include "node_stats.h"
+#include "packet.h"
+#include "profile.h"
+#include "relay.h"
+#include "report.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include "spsc_queue.h"
+#include "sim_hal.h"
+
+volatile uint32_t bench_sink;
+
+static void sink_float(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    bench_sink += u;
+}
+
+// a plausible board: ~25C, 4.1V battery, 5V USB
+static void setup_adc(SimAdc& adc) {
+    adc.set_channel(ADC_CHANNEL_TEMP, 0.703f, 3, 64);
+    adc.set_channel(ADC_CHANNEL_VBAT, 2.47f, 4, 64);
+    adc.set_channel(ADC_CHANNEL_VIN, 0.655f, 4, 64);
+}
+
+// stand-ins for sensors on VSEN, one as quick as an SHT3x on I2C and one as
+// slow as a DS18B20 on 1-Wire, neither filling anything in
+static const SensorDriver BENCH_QUICK_SENSOR = {
+    "quick", 0, true, 1000,
+    [](SensorBus&) -> uint32_t { return 15000; },
+    [](SensorBus&, struct sensor_record&) { return true; },
+};
+static const SensorDriver BENCH_SLOW_SENSOR = {
+    "slow", 0, true, 2000,
+    [](SensorBus&) -> uint32_t { return 750000; },
+    [](SensorBus&, struct sensor_record&) { return true; },
+};
+
+static struct txdata sample_txdata() {
+    struct txdata txd = {};
+    txd.options = 0;
+    txd.dest = 0xFFFF;
+    txd.readings.charge_state = 2;
+    txd.readings.mcu_temp = 24.5f;
+    txd.readings.vbat = 4.08f;
+    txd.readings.vin = 5.01f;
+    txd.readings.present = SENSOR_ALL_FIELDS;
+    return txd;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opts;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            opts.iterations = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [-n iterations] [-f filter]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bench_header();
+
+    ///////////////////////////////////////////////////////////////////////////
+    // acquisition
+    SimAdc adc;
+    setup_adc(adc);
+    bench_run(opts, "adc/readADCVoltage", 1, [&]() {
+        sink_float(readADCVoltage(adc, ADC_CHANNEL_VBAT));
+    });
+
+    static const unsigned int channels[] = { ADC_CHANNEL_TEMP, ADC_CHANNEL_VBAT, ADC_CHANNEL_VIN };
+    bench_run(opts, "adc/sample_burst_3ch", 3, [&]() {
+        AdcReading readings[3];
+        adc_sample_burst<ADC_SAMPLE_COUNT>(adc, channels, readings);
+        sink_float(readings[0].volts + readings[1].volts + readings[2].volts);
+    });
+
+    uint16_t samples[ADC_SAMPLE_COUNT];
+    AdcStats stats;
+    adc.select_input(ADC_CHANNEL_TEMP);
+    for (unsigned int i = 0; i < ADC_SAMPLE_COUNT; i++) {
+        samples[i] = adc.read();
+        stats.add(samples[i]);
+    }
+    bench_run(opts, "adc/filter_samples", 1, [&]() {
+        sink_float(adc_filter_samples(samples, stats).volts);
+    });
+
+    ///////////////////////////////////////////////////////////////////////////
+    // codec
+    struct txdata txd = sample_txdata();
+    uint8_t sendbuf[TXDATA_MAX_SIZE];
+    bench_run(opts, "codec/serialise_txdata", 1, [&]() {
+        txd.readings.charge_state++;
+        bench_sink += serialise_txdata(&txd, sendbuf);
+    });
+
+    // a complete received frame as the module would hand it over
+    SimRadio rx_radio;
+    size_t payload_len = serialise_txdata(&txd, sendbuf);
+    rx_radio.inject_rx_data(0x1234, 0xFFFF, -60, sendbuf + 4, payload_len - 4);
+    rx_radio.checkRxFifo(0);
+    uint8_t frame[EMB_MAX_FRAME];
+    size_t frame_len = rx_radio.responseLen();
+    memcpy(frame, rx_radio.response(), frame_len);
+    bench_run(opts, "codec/deseralise_rxdata", 1, [&]() {
+        struct rxdata rxd;
+        bench_sink += deseralise_rxdata(frame, frame_len, &rxd);
+        bench_sink += rxd.src;
+    });
+
+    // a full batch of slowly drifting samples a report period apart
+    SampleBatch batch;
+    for (size_t i = 0; batch.add(txd.readings, i * 5000) && !batch.full(); i++) {
+        txd.readings.mcu_temp += 0.03f;
+        txd.readings.vbat -= 0.002f;
+    }
+    size_t batch_len = batch.encode(batch.count() * 5000, sendbuf);
+    if (bench_selected(opts, "codec/encode_batch")) {
+        printf("# batch of %zu samples: %zu bytes, single record: %zu bytes\n",
+                batch.count(), batch_len, payload_len - 4);
+    }
+    bench_run(opts, "codec/encode_batch", 1, [&]() {
+        bench_sink += batch.encode(batch.count() * 5000, sendbuf);
+    });
+    bench_run(opts, "codec/deserialise_batch", 1, [&]() {
+        struct sensor_record recs[BATCH_MAX_SAMPLES];
+        uint32_t ages[BATCH_MAX_SAMPLES];
+        bench_sink += deserialise_batch(sendbuf, batch_len, recs, ages, BATCH_MAX_SAMPLES);
+    });
+
+    // deciding what of a sample is worth sending, and the receiver filling
+    // in what wasn't
+    ReportPolicy policy(300000);
+    uint32_t report_ms = 0;
+    bench_run(opts, "codec/report_check", 1, [&]() {
+        txd.readings.mcu_temp += 0.1f;
+        ReportDecision report = policy.check(txd.readings, report_ms += 5000);
+        policy.sent(txd.readings, report.mask, report_ms);
+        bench_sink += report.mask;
+    });
+    LastKnownValues last_known;
+    struct rxdata known_rxd;
+    deseralise_rxdata(frame, frame_len, &known_rxd);
+    bench_run(opts, "codec/last_known_fill", 1, [&]() {
+        known_rxd.readings[0].present = 1u << (bench_sink & 3);
+        last_known.fill(known_rxd);
+        bench_sink += known_rxd.carried[0];
+    });
+    NodeStatsTable node_stats;
+    struct rxdata stats_rxd;
+    deseralise_rxdata(frame, frame_len, &stats_rxd);
+    stats_rxd.meta.present = 1u << PACKET_SEQ;
+    uint32_t stats_ms = 0;
+    bench_run(opts, "codec/node_stats", 1, [&]() {
+        // a node's packets in order, now and again one going missing
+        stats_rxd.meta.seq += 1 + ((bench_sink & 15) == 0);
+        stats_ms += 5000;
+        node_stats.heard(stats_rxd, stats_ms);
+        bench_sink += stats_rxd.meta.seq;
+    });
+    // a reading going into its node's summary, with a minute's summaries
+    // of twelve nodes going out now and again
+    SummaryTable summaries(60000);
+    uint32_t summary_ms = 0;
+    uint32_t summary_src = 0;
+    bench_run(opts, "codec/summary_add", 1, [&]() {
+        summary_ms += 5000 / 12;
+        summary_src = (summary_src + 1) % 12;
+        summaries.add(0x1234 + summary_src, stats_rxd.readings[0], summary_ms, [&](uint16_t src, const NodeSummary& summary) {
+            struct sensor_record stats[HOSTLINK_STATS];
+            for (size_t s = 0; s < HOSTLINK_STATS; s++) {
+                summary.values((HostlinkSummaryStat)s, &stats[s]);
+            }
+            uint8_t record[HOSTLINK_RECORD_MAX];
+            bench_sink += hostlink_record_summary(src, summary_ms, 0, 60000, summary.count, stats, record);
+        });
+    });
+
+    // a relay passing on a batch, having checked it hasn't already
+    struct packet_meta relay_meta = {};
+    relay_meta.present = 1u << PACKET_SEQ;
+    SimRadio relay_radio;
+    batch_len = batch.encode(batch.count() * 5000, sendbuf, &relay_meta);
+    relay_radio.inject_rx_data(0x1234, 0xFFFF, -110, sendbuf, batch_len);
+    relay_radio.checkRxFifo(0);
+    uint8_t relay_frame[EMB_MAX_FRAME];
+    size_t relay_frame_len = relay_radio.responseLen();
+    memcpy(relay_frame, relay_radio.response(), relay_frame_len);
+    struct rxdata relay_rxd;
+    deseralise_rxdata(relay_frame, relay_frame_len, &relay_rxd);
+    DedupeCache dedupe;
+    uint32_t relay_ms = 0;
+    bench_run(opts, "codec/relay_batch", 1, [&]() {
+        // twelve nodes' packets, each heard twice
+        relay_ms += 5000 / 24;
+        relay_rxd.src = 0x1234 + (relay_ms / 417) % 12;
+        relay_rxd.meta.seq = relay_ms / 5000;
+        if (!dedupe.seen(relay_rxd, relay_ms)) {
+            bench_sink += relay_txdata(relay_frame, relay_frame_len, relay_rxd, 2, 100, sendbuf);
+        }
+    });
+
+    // the receiver's binary output to the host, and decoding it there
+    struct rxdata host_rxd;
+    deseralise_rxdata(frame, frame_len, &host_rxd);
+    uint8_t host_frame[HOSTLINK_FRAME_MAX];
+    size_t host_len = hostlink_encode_reading(&host_rxd, 0, 123456, host_frame);
+    if (bench_selected(opts, "codec/hostlink_encode")) {
+        printf("# host record: %zu bytes\n", host_len);
+    }
+    bench_run(opts, "codec/hostlink_encode", 1, [&]() {
+        bench_sink += hostlink_encode_reading(&host_rxd, 0, 123456, host_frame);
+    });
+    HostlinkDecoder host_decoder;
+    bench_run(opts, "codec/hostlink_decode", 1, [&]() {
+        struct HostRecord rec;
+        for (size_t i = 0; i < host_len; i++) {
+            bench_sink += host_decoder.push(host_frame[i], rec);
+        }
+    });
+
+    // the receiver's flash log, in and back out again as when the host has
+    // been away, page writes and erases included
+    static SimFlash log_flash(64 * 1024);
+    static FlashLog flash_log(log_flash);
+    flash_log.mount(0);
+    uint8_t host_record[HOSTLINK_RECORD_MAX];
+    size_t host_record_len = hostlink_record_reading(&host_rxd, 0, 123456, host_record);
+    uint32_t log_ms = 0;
+    bench_run(opts, "codec/flash_log_append", 1, [&]() {
+        flash_log.append(log_ms += 50, host_record, host_record_len);
+        if (flash_log.service_due(log_ms, 30000)) {
+            flash_log.service(log_ms, 30000);
+        }
+    });
+    bench_run(opts, "codec/flash_log_drain", 1, [&]() {
+        const uint8_t* record;
+        size_t len;
+        uint32_t held_ms;
+        if (flash_log.empty()) {
+            flash_log.append(log_ms, host_record, host_record_len);
+        }
+        if (flash_log.next(log_ms, &record, &len, &held_ms)) {
+            bench_sink += hostlink_restamp_record(record, len, log_ms, held_ms, host_frame);
+        }
+    });
+
+    ///////////////////////////////////////////////////////////////////////////
+    // whole packets, sample to air and air to decoded record
+    SimRadio sender_radio;
+    sender_radio.setNetworkAddress(0x1234);
+    bench_run(opts, "packet/sender", 3, [&]() {
+        struct txdata txd = sample_txdata();
+        AdcReading readings[3];
+        adc_sample_burst<ADC_SAMPLE_COUNT>(adc, channels, readings);
+        txd.readings.mcu_temp = adc_volts_to_mcu_temp(readings[0].volts);
+        txd.readings.vbat = adc_volts_to_vbat(readings[1].volts);
+        txd.readings.vin = adc_volts_to_vin(readings[2].volts);
+        uint8_t buf[TXDATA_MAX_SIZE];
+        size_t len = serialise_txdata(&txd, buf);
+        sender_radio.transmitData(buf, len);
+        sender_radio.checkRxFifo(0); // the ack
+    });
+
+    // a command and its response going through the EMB command layer
+    SimRadio cmd_radio;
+    EmbCommander emb(cmd_radio);
+    bench_run(opts, "radio/command_roundtrip", 1, [&]() {
+        bench_sink += emb.run(EMB_CMD_OUTPUT_POWER, [&]{ cmd_radio.setOutputPower(0x0a); });
+    });
+
+    SimPower power;
+    DutyCycleScheduler scheduler(power, 5000);
+    bench_run(opts, "power/schedule_cycle", 1, [&]() {
+        sim_clock_advance_us(1200); // the work
+        scheduler.sleep_until_next();
+    });
+
+    // what timing a phase costs, it should be lost in the noise of the
+    // phases it's timing
+    Profiler profiler;
+    bench_run(opts, "power/profile_span", 1, [&]() {
+        ProfileSpan span(&profiler, PROFILE_SERIALISE);
+    });
+
+    // a line of the sender's logging deferred, against formatting it as
+    // printf would, with the console away so the records are just dropped
+    float log_vbat = 4.12f;
+    int16_t log_rssi = -87;
+    sim_console_set_connected(false);
+    bench_run(opts, "log/deferred_record", 1, [&]() {
+        log_deferred(LOG_LEVEL_INFO, "Link feedback: rssi=%d vbat=%0.2fV seq=%u", log_rssi, log_vbat, bench_sink);
+        bench_sink += log_flush();
+    });
+    bench_run(opts, "log/snprintf", 1, [&]() {
+        char line[80];
+        bench_sink += snprintf(line, sizeof(line), "Link feedback: rssi=%d vbat=%0.2fV seq=%u\n",
+                log_rssi, log_vbat, (unsigned)bench_sink);
+    });
+    sim_console_set_connected(true);
+
+    // a sender's sensor cycle, the board's ADC and the two above, VSEN
+    // should only be on about as long as the slow one takes
+    static const SensorDriver* const drivers[] = {
+        &SENSOR_DRIVER_BOARD_ADC, &BENCH_QUICK_SENSOR, &BENCH_SLOW_SENSOR,
+    };
+    SimSensorPower vsen;
+    SensorBus bus = { adc, nullptr };
+    SensorSampler sensors(drivers, bus, &vsen);
+    bench_run(opts, "sensors/sample_cycle", 1, [&]() {
+        struct sensor_record rec = {};
+        bench_sink += sensors.sample(rec);
+    });
+    if (bench_selected(opts, "sensors/") && vsen.switched_on) {
+        printf("# sensors: VSEN on %lu us per cycle\n", (unsigned long)(vsen.on_us / vsen.switched_on));
+    }
+
+    SimRadio receiver_radio;
+    bench_run(opts, "packet/receiver", 1, [&]() {
+        receiver_radio.inject_raw(frame, frame_len);
+        uint8_t rxbuff[EMB_MAX_FRAME];
+        size_t rxlen = collect_rx_frame(receiver_radio, rxbuff, sizeof(rxbuff), 0);
+        struct rxdata rxd;
+        bench_sink += deseralise_rxdata(rxbuff, rxlen, &rxd);
+    });
+
+    // back to back frames through the streaming splitter, as the UART
+    // interrupt would feed them in
+    static EmbFrameStream<4096> stream;
+    bench_run(opts, "packet/receiver_stream", 1, [&]() {
+        for (size_t i = 0; i < frame_len; i++) {
+            stream.push(frame[i]);
+        }
+        EmbFrame f;
+        while (stream.next(f)) {
+            struct rxdata rxd;
+            bench_sink += deseralise_rxdata(f.data, f.len, &rxd);
+            stream.release(f);
+        }
+    });
+
+    // decoding straight into a queue slot and picking it up on the other
+    // side, as the receiver does between its cores in pipeline mode
+    static SpscQueue<struct rxdata, 8> rx_queue;
+    bench_run(opts, "pipeline/spsc_handover", 1, [&]() {
+        struct rxdata* slot = rx_queue.write_slot();
+        bench_sink += deseralise_rxdata(frame, frame_len, slot);
+        rx_queue.commit();
+        bench_sink += rx_queue.read_slot()->src;
+        rx_queue.release();
+    });
+
+    ///////////////////////////////////////////////////////////////////////////
+    // a day of one node's 5 second readings in the archive
+    const size_t day_samples = MS_PER_DAY / 5000;
+    std::vector<int64_t> day_times(day_samples);
+    std::vector<float> day_vbat(day_samples);
+    for (size_t i = 0; i < day_samples; i++) {
+        day_times[i] = 1772323200000 + i * 5000 + (i * 7 % 3);
+        day_vbat[i] = 3.7f + (i / 60 % 10) * 0.01f;
+    }
+    std::vector<uint8_t> times_col, vbat_col;
+    archive_encode_times(day_times.data(), day_samples, times_col);
+    archive_encode_floats(day_vbat.data(), day_samples, vbat_col);
+    if (bench_selected(opts, "archive/")) {
+        printf("# archive day of %zu samples: times %zu bytes, vbat %zu bytes\n",
+                day_samples, times_col.size(), vbat_col.size());
+    }
+    bench_run(opts, "archive/encode_floats_day", 2000, [&]() {
+        std::vector<uint8_t> out;
+        archive_encode_floats(day_vbat.data(), day_samples, out);
+        bench_sink += out.size();
+    });
+    bench_run(opts, "archive/decode_times_day", 2000, [&]() {
+        bench_sink += archive_decode_times(times_col.data(), times_col.size(), day_times.data(), day_samples);
+    });
+    bench_run(opts, "archive/decode_floats_day", 2000, [&]() {
+        bench_sink += archive_decode_floats(vbat_col.data(), vbat_col.size(), day_vbat.data(), day_samples);
+    });
+    bench_run(opts, "archive/reduce_day", 200, [&]() {
+        ArchiveRollup acc = {};
+        archive_reduce(day_vbat.data(), day_samples, acc);
+        bench_sink += acc.count;
+    });
+
+    return 0;
+}
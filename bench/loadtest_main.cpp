@@ -0,0 +1,254 @@
+/**
+ * HortiTel receiver load test.
+ *
+ * Feeds the simulated traffic of a whole site of senders (see
+ * src/hal/sim/sim_traffic.h) through the receiver's frame handling: the
+ * bytes into the same EmbFrameStream the UART interrupt fills, and each
+ * frame out of it decoded, de-duplicated, tracked and turned into a host
+ * record as receiver.cpp does in binary mode. The traffic runs on the
+ * simulated clock and the receiver's handling is timed for real, so minutes
+ * of a busy site go by in moments and the receiver falls behind (its ring
+ * overflows, frames wait) when and only when it would at the speed it's
+ * timed at.
+ *
+ * That's this host's speed unless -s says how many times slower the board
+ * is, which has to come from timing the board (the receiver's profile
+ * command, say), so figures for the board are only given with -s and are
+ * only as good as it. Writing the host records to the console isn't timed as there's
+ * no console here, -w gives the rate the board gets them out at, in bytes a
+ * second, to add that in. Without it the figures leave it out and say so.
+ *
+ * At the end: how much got through the air, how fast the receiver can keep
+ * up, what it lost and how long the slowest frame waited.
+ *
+ * usage: hortitel_loadtest [-n nodes] [-p period_ms] [-j jitter_ms]
+ *   [-d seconds] [-r rssi_dbm] [-R spread_db] [-f sf] [-b baud]
+ *   [-c corrupt_ppm] [-t truncate_ppm] [-s scale] [-w console_bytes_per_s]
+ *   [-S seed]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "bench.h"
+#include "adr.h"
+#include "frame_stream.h"
+#include "hostlink.h"
+#include "node_stats.h"
+#include "packet.h"
+#include "relay.h"
+#include "report.h"
+#include "sim_hal.h"
+#include "sim_traffic.h"
+
+volatile uint32_t bench_sink;
+
+// the receiver's frame handling, less the console and radio
+struct LoadReceiver {
+    EmbFrameStream<4096> stream;
+    DedupeCache dedupe;
+    LastKnownValues last_known;
+    NodeStatsTable node_stats;
+    LinkMonitor link_monitor;
+    uint32_t decoded = 0;
+    uint32_t failed = 0;
+    uint32_t duplicates = 0;
+    uint64_t console_bytes = 0; // framed host records, to go out
+
+    // one frame, as receiver.cpp's decode_rx_frame(), track_rx_packet() and
+    // print_rx_packet() do, false if it wasn't a packet of ours
+    bool handle(const EmbFrame& frame, uint32_t now_ms, struct rxdata& rxd) {
+        static uint8_t copy[EMB_MAX_FRAME];
+        memcpy(copy, frame.data, frame.len);
+        rxd = {};
+        if (copy[2] != EMB_RX_DATA || !deseralise_rxdata(copy, frame.len, &rxd)) {
+            failed++;
+            return false;
+        }
+        decoded++;
+        bool duplicate = dedupe.seen(rxd, now_ms);
+        if (!duplicate) {
+            last_known.fill(rxd);
+        }
+        if (!duplicate) {
+            node_stats.heard(rxd, now_ms);
+        }
+        if (!rxdata_relayed(rxd)) {
+            link_monitor.heard(rxd.src, rxd.rssi);
+        }
+        if (duplicate) {
+            duplicates++;
+            return true;
+        }
+        for (size_t i = 0; i < rxd.count; i++) {
+            uint8_t record[HOSTLINK_RECORD_MAX];
+            uint8_t out[HOSTLINK_FRAME_MAX];
+            size_t len = hostlink_record_reading(&rxd, i, now_ms, record);
+            console_bytes += hostlink_frame_record(record, len, out);
+        }
+        return true;
+    }
+};
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-n nodes] [-p period_ms] [-j jitter_ms] [-d seconds] [-r rssi_dbm] [-R spread_db]\n"
+            "  [-f sf] [-b baud] [-c corrupt_ppm] [-t truncate_ppm] [-s scale] [-w console_bytes_per_s] [-S seed]\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    SimTrafficConfig cfg;
+    uint32_t duration_s = 600;
+    double scale = 1.0;
+    bool board = false; // whether scale is the board's, or this host's own
+    uint32_t console_rate = 0; // bytes a second, 0 to leave the console out
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (arg[0] != '-' || !arg[1] || arg[2] || i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* val = argv[++i];
+        switch (arg[1]) {
+            case 'n': cfg.nodes = strtoul(val, nullptr, 0); break;
+            case 'p': cfg.period_ms = strtoul(val, nullptr, 0); break;
+            case 'j': cfg.jitter_ms = strtoul(val, nullptr, 0); break;
+            case 'd': duration_s = strtoul(val, nullptr, 0); break;
+            case 'r': cfg.rssi_dbm = atoi(val); break;
+            case 'R': cfg.rssi_spread_db = strtoul(val, nullptr, 0); break;
+            case 'f': cfg.sf = (RadioSpreadingFactor)atoi(val); break;
+            case 'b': cfg.uart_baud = strtoul(val, nullptr, 0); break;
+            case 'c': cfg.corrupt_ppm = strtoul(val, nullptr, 0); break;
+            case 't': cfg.truncate_ppm = strtoul(val, nullptr, 0); break;
+            case 's': scale = atof(val); board = true; break;
+            case 'w': console_rate = strtoul(val, nullptr, 0); break;
+            case 'S': cfg.seed = strtoul(val, nullptr, 0); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (cfg.sf < RADIO_SF_7 || cfg.sf > RADIO_SF_12 || cfg.period_ms == 0 || cfg.jitter_ms > cfg.period_ms
+            || cfg.uart_baud == 0 || scale <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    SimTraffic traffic(cfg);
+    std::vector<SimArrival> arrivals = traffic.generate(0, duration_s * 1000);
+    const SimTrafficStats& air = traffic.stats();
+
+    // when each intact frame arrived, to tell how long it waited
+    std::unordered_map<uint32_t, uint64_t> arrived;
+    uint32_t intact = 0;
+    for (const SimArrival& a : arrivals) {
+        if (!a.damaged) {
+            arrived[(uint32_t)a.src << 16 | a.seq] = a.time_us;
+            intact++;
+        }
+    }
+
+    static LoadReceiver rx;
+    std::vector<uint32_t> latencies;
+    latencies.reserve(intact);
+    uint64_t busy_us = 0; // on the simulated clock, when the receiver's done with what it has
+    uint64_t handle_ns = 0; // for real
+    uint64_t worst_handle_ns = 0;
+    uint64_t console_us = 0; // simulated
+    uint32_t handled = 0;
+    struct rxdata rxd;
+
+    // the receiver gets through what it has until it catches up with t_us
+    auto run_until = [&](uint64_t t_us) {
+        EmbFrame frame;
+        while (busy_us < t_us && rx.stream.next(frame)) {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t bytes_before = rx.console_bytes;
+            bool ours = rx.handle(frame, busy_us / 1000, rxd);
+            rx.stream.release(frame);
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            handle_ns += ns;
+            worst_handle_ns = std::max(worst_handle_ns, ns);
+            handled++;
+            busy_us += (uint64_t)(ns * scale / 1000);
+            if (console_rate) {
+                // the records written out as they're made, as the receiver does
+                uint64_t us = (rx.console_bytes - bytes_before) * 1000000 / console_rate;
+                console_us += us;
+                busy_us += us;
+            }
+            if (ours) {
+                auto it = arrived.find((uint32_t)rxd.src << 16 | rxd.meta.seq);
+                if (it != arrived.end()) {
+                    latencies.push_back((uint32_t)(busy_us - it->second));
+                    arrived.erase(it);
+                }
+            }
+        }
+    };
+
+    auto wall_start = std::chrono::steady_clock::now();
+    for (const SimArrival& a : arrivals) {
+        run_until(a.time_us);
+        if (rx.stream.idle() && busy_us < a.time_us) {
+            // nothing to do until now
+            busy_us = a.time_us;
+        }
+        for (uint8_t byte : a.bytes) {
+            rx.stream.push(byte);
+        }
+    }
+    run_until(UINT64_MAX);
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    uint32_t lost = intact - latencies.size();
+    double handle_s = handle_ns / 1e9;
+
+    printf("%zu nodes every %lums (+/-%lums) for %lus, SF%d, %lu baud\n", cfg.nodes, (unsigned long)cfg.period_ms,
+            (unsigned long)cfg.jitter_ms, (unsigned long)duration_s, (int)cfg.sf, (unsigned long)cfg.uart_baud);
+    if (board) {
+        printf("timed as if on the board, taken to be %.1fx slower than this host (-s, an estimate)\n", scale);
+    } else {
+        printf("timed at this host's speed, give -s to estimate the board's\n");
+    }
+    if (console_rate) {
+        printf("console: %llu bytes of host records at %lu bytes/s, %.1fs writing\n",
+                (unsigned long long)rx.console_bytes, (unsigned long)console_rate, console_us / 1e6);
+    } else {
+        printf("console: %llu bytes of host records, writing them out not included (-w to add it)\n",
+                (unsigned long long)rx.console_bytes);
+    }
+    printf("air: sent %lu, collided %lu (%.1f%%), captured %lu, reached the UART %lu at %.1f frames/s\n",
+            (unsigned long)air.sent, (unsigned long)air.collided, air.sent ? 100.0 * air.collided / air.sent : 0.0,
+            (unsigned long)air.captured, (unsigned long)air.delivered, (double)air.delivered / duration_s);
+    printf("uart: corrupted %lu, truncated %lu\n", (unsigned long)air.corrupted, (unsigned long)air.truncated);
+    printf("receiver: handled %lu frames, decoded %lu, failed %lu, duplicates %lu, resync bytes %lu, "
+            "dropped bytes %lu, nodes tracked %zu of %u, packets from untracked nodes %lu\n",
+            (unsigned long)handled, (unsigned long)rx.decoded, (unsigned long)rx.failed,
+            (unsigned long)rx.duplicates, (unsigned long)rx.stream.errors(), (unsigned long)rx.stream.dropped(),
+            rx.node_stats.nodes(), (unsigned)HORTITEL_MAX_NODES, (unsigned long)rx.node_stats.untracked());
+    printf("  intact frames lost in the receiver: %lu of %lu (%.3f%%)\n",
+            (unsigned long)lost, (unsigned long)intact, intact ? 100.0 * lost / intact : 0.0);
+    printf("  sustained %.0f frames/s on this host, %.0f ns a frame, worst %lu ns, leaving out the console\n",
+            handle_s > 0 ? handled / handle_s : 0.0, handled ? (double)handle_ns / handled : 0.0,
+            (unsigned long)worst_handle_ns);
+    if (board) {
+        // the same work at the board's speed, plus the writing if that's known
+        double board_s = handle_s * scale + console_us / 1e6;
+        printf("  estimated on the board: %.0f frames/s%s\n", board_s > 0 ? handled / board_s : 0.0,
+                console_rate ? " including the console" : ", console writes not included");
+    }
+    if (!latencies.empty()) {
+        printf("  latency, arrival to handled: p50 %lu us, p99 %lu us, worst %lu us\n",
+                (unsigned long)latencies[latencies.size() / 2],
+                (unsigned long)latencies[latencies.size() * 99 / 100], (unsigned long)latencies.back());
+    }
+    printf("simulated %lus in %.2fs, %.0fx real time\n", (unsigned long)duration_s, wall_s,
+            wall_s > 0 ? duration_s / wall_s : 0.0);
+    return 0;
+}
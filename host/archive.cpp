@@ -0,0 +1,524 @@
+#include "archive.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "schema.h"
+
+const char* const ARCHIVE_FIELD_NAMES[ARCHIVE_FIELD_COUNT] = {
+    "mcu_temp", "vbat", "vin", "charge_state", "rssi",
+};
+
+int archive_field_by_name(const char* name) {
+    for (int i = 0; i < ARCHIVE_FIELD_COUNT; i++) {
+        if (!strcmp(name, ARCHIVE_FIELD_NAMES[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ArchiveRollup::clear() {
+    min = INFINITY;
+    max = -INFINITY;
+    sum = 0;
+    count = 0;
+}
+
+void ArchiveRollup::add(float v) {
+    if (v != v) {
+        return;
+    }
+    min = count ? std::min(min, v) : v;
+    max = count ? std::max(max, v) : v;
+    sum += v;
+    count++;
+}
+
+void ArchiveRollup::merge(const ArchiveRollup& other) {
+    if (!other.count) {
+        return;
+    }
+    min = count ? std::min(min, other.min) : other.min;
+    max = count ? std::max(max, other.max) : other.max;
+    sum += other.sum;
+    count += other.count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// column codecs
+
+void archive_encode_times(const int64_t* times, size_t n, std::vector<uint8_t>& out) {
+    uint8_t buf[10];
+    int64_t prev = 0;
+    int64_t prev_delta = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i == 0) {
+            out.insert(out.end(), (const uint8_t*)&times[0], (const uint8_t*)&times[0] + 8);
+            prev = times[0];
+            continue;
+        }
+        int64_t delta = times[i] - prev;
+        out.insert(out.end(), buf, varint_put(buf, zigzag_encode(delta - prev_delta)));
+        prev_delta = delta;
+        prev = times[i];
+    }
+}
+
+bool archive_decode_times(const uint8_t* buf, size_t len, int64_t* times, size_t n) {
+    const uint8_t* end = buf + len;
+    if (n == 0) {
+        return true;
+    }
+    if (len < 8) {
+        return false;
+    }
+    memcpy(&times[0], buf, 8);
+    buf += 8;
+    int64_t delta = 0;
+    for (size_t i = 1; i < n; i++) {
+        uint64_t dod;
+        buf = varint_get(buf, end, &dod);
+        if (!buf) {
+            return false;
+        }
+        delta += zigzag_decode(dod);
+        times[i] = times[i - 1] + delta;
+    }
+    return true;
+}
+
+class BitWriter {
+public:
+    BitWriter(std::vector<uint8_t>& out) : out(out) {}
+    ~BitWriter() {
+        if (nbits) {
+            out.push_back(acc << (8 - nbits));
+        }
+    }
+    void put(uint32_t val, unsigned int bits) {
+        for (unsigned int i = bits; i-- > 0;) {
+            acc = acc << 1 | ((val >> i) & 1);
+            if (++nbits == 8) {
+                out.push_back(acc);
+                acc = 0;
+                nbits = 0;
+            }
+        }
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint8_t acc = 0;
+    unsigned int nbits = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* buf, size_t len) : buf(buf), len(len) {}
+    bool get(unsigned int bits, uint32_t* val) {
+        if (pos + bits > len * 8) {
+            return false;
+        }
+        uint32_t v = 0;
+        for (unsigned int i = 0; i < bits; i++, pos++) {
+            v = v << 1 | ((buf[pos >> 3] >> (7 - (pos & 7))) & 1);
+        }
+        *val = v;
+        return true;
+    }
+
+private:
+    const uint8_t* buf;
+    size_t len;
+    size_t pos = 0;
+};
+
+/*
+ * Each value is XORed with the one before. Identical is a single 0 bit,
+ * otherwise a 1 and then either a 0 and the meaningful bits in the same
+ * window as last time, or a 1, five bits of leading zero count, five of
+ * length - 1 and the meaningful bits.
+ */
+void archive_encode_floats(const float* values, size_t n, std::vector<uint8_t>& out) {
+    BitWriter bits(out);
+    uint32_t prev = 0;
+    unsigned int prev_lead = 33, prev_trail = 0; // no window yet
+    for (size_t i = 0; i < n; i++) {
+        uint32_t cur;
+        memcpy(&cur, &values[i], 4);
+        if (i == 0) {
+            bits.put(cur, 32);
+            prev = cur;
+            continue;
+        }
+        uint32_t x = cur ^ prev;
+        prev = cur;
+        if (x == 0) {
+            bits.put(0, 1);
+            continue;
+        }
+        unsigned int lead = std::min(__builtin_clz(x), 31);
+        unsigned int trail = __builtin_ctz(x);
+        if (prev_lead <= lead && prev_trail <= trail) {
+            bits.put(0b10, 2);
+            bits.put(x >> prev_trail, 32 - prev_lead - prev_trail);
+        } else {
+            unsigned int len = 32 - lead - trail;
+            bits.put(0b11, 2);
+            bits.put(lead, 5);
+            bits.put(len - 1, 5);
+            bits.put(x >> trail, len);
+            prev_lead = lead;
+            prev_trail = trail;
+        }
+    }
+}
+
+bool archive_decode_floats(const uint8_t* buf, size_t len, float* values, size_t n) {
+    BitReader bits(buf, len);
+    uint32_t prev = 0;
+    unsigned int lead = 0, trail = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t v;
+        if (i == 0) {
+            if (!bits.get(32, &prev)) {
+                return false;
+            }
+        } else {
+            if (!bits.get(1, &v)) {
+                return false;
+            }
+            if (v) {
+                if (!bits.get(1, &v)) {
+                    return false;
+                }
+                if (v) {
+                    uint32_t l, m;
+                    if (!bits.get(5, &l) || !bits.get(5, &m) || l + m + 1 > 32) {
+                        return false;
+                    }
+                    lead = l;
+                    trail = 32 - l - (m + 1);
+                }
+                if (!bits.get(32 - lead - trail, &v)) {
+                    return false;
+                }
+                prev ^= v << trail;
+            }
+        }
+        memcpy(&values[i], &prev, 4);
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// scanning
+
+// 16 byte vectors are what SSE and NEON both have, wider ones get split up
+// into scalars when the compiler isn't allowed AVX
+typedef float v4f __attribute__((vector_size(16)));
+typedef int32_t v4i __attribute__((vector_size(16)));
+
+struct ReduceLanes {
+    v4f min;
+    v4f max;
+    v4f sum;
+    v4i count;
+
+    void add(v4f v) {
+        v4i have = v == v; // not NaN
+        min = v < min ? v : min;
+        max = v > max ? v : max;
+        sum += have ? v : v4f{};
+        count -= have;
+    }
+};
+
+void archive_reduce(const float* values, size_t n, ArchiveRollup& acc) {
+    ArchiveRollup total;
+    total.clear();
+    const v4f zero = {};
+    // two sets so consecutive adds don't wait on each other
+    ReduceLanes lanes[2];
+    for (ReduceLanes& l : lanes) {
+        l.min = zero + INFINITY;
+        l.max = zero - INFINITY;
+        l.count = v4i{};
+    }
+    size_t i = 0;
+    while (n - i >= 8) {
+        // float sums go off after a while, so they're added up in blocks
+        lanes[0].sum = lanes[1].sum = zero;
+        size_t block_end = std::min(n - (n - i) % 8, i + 8 * 1024);
+        for (; i < block_end; i += 8) {
+            v4f a, b;
+            memcpy(&a, &values[i], sizeof(a));
+            memcpy(&b, &values[i + 4], sizeof(b));
+            lanes[0].add(a);
+            lanes[1].add(b);
+        }
+        for (const ReduceLanes& l : lanes) {
+            for (int k = 0; k < 4; k++) {
+                total.sum += l.sum[k];
+            }
+        }
+    }
+    for (const ReduceLanes& l : lanes) {
+        for (int k = 0; k < 4; k++) {
+            if (l.count[k]) {
+                total.min = std::min(total.min, l.min[k]);
+                total.max = std::max(total.max, l.max[k]);
+                total.count += l.count[k];
+            }
+        }
+    }
+    for (; i < n; i++) {
+        total.add(values[i]);
+    }
+    acc.merge(total);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// segments
+
+ArchiveSegment::~ArchiveSegment() {
+    close();
+}
+
+bool ArchiveSegment::open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ArchiveSegmentHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    data = (const uint8_t*)map;
+    size = st.st_size;
+    hdr = (const ArchiveSegmentHeader*)data;
+    bool ok = !memcmp(hdr->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    for (int c = 0; ok && c < 1 + ARCHIVE_FIELD_COUNT; c++) {
+        ok = hdr->column_offset[c] <= size && hdr->column_len[c] <= size - hdr->column_offset[c];
+    }
+    if (!ok) {
+        close();
+    }
+    return ok;
+}
+
+void ArchiveSegment::close() {
+    if (data) {
+        munmap((void*)data, size);
+    }
+    data = nullptr;
+    hdr = nullptr;
+    size = 0;
+}
+
+bool ArchiveSegment::times(std::vector<int64_t>& out) const {
+    out.resize(hdr->count);
+    return archive_decode_times(data + hdr->column_offset[0], hdr->column_len[0], out.data(), hdr->count);
+}
+
+bool ArchiveSegment::field(ArchiveField f, std::vector<float>& out) const {
+    out.resize(hdr->count);
+    return archive_decode_floats(data + hdr->column_offset[1 + f], hdr->column_len[1 + f], out.data(), hdr->count);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// the archive directory
+
+// http://howardhinnant.github.io/date_algorithms.html
+int32_t archive_day_from_civil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+void archive_civil_from_day(int32_t day, int* y, unsigned* m, unsigned* d) {
+    day += 719468;
+    int era = (day >= 0 ? day : day - 146096) / 146097;
+    unsigned doe = (unsigned)(day - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = (int)yoe + era * 400 + (*m <= 2);
+}
+
+static std::string node_dir(const char* dir, uint16_t src) {
+    char name[8];
+    snprintf(name, sizeof(name), "%04X", src);
+    return std::string(dir) + "/" + name;
+}
+
+std::string archive_segment_path(const char* dir, uint16_t src, int32_t day) {
+    int y;
+    unsigned m, d;
+    archive_civil_from_day(day, &y, &m, &d);
+    char name[32];
+    snprintf(name, sizeof(name), "/%04d%02u%02u.seg", y, m, d);
+    return node_dir(dir, src) + name;
+}
+
+std::vector<int32_t> archive_list_days(const char* dir, uint16_t src) {
+    std::vector<int32_t> days;
+    DIR* d = opendir(node_dir(dir, src).c_str());
+    if (!d) {
+        return days;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d))) {
+        int y;
+        unsigned m, dd;
+        char tail;
+        if (strlen(ent->d_name) == 12 && sscanf(ent->d_name, "%4d%2u%2u.se%c", &y, &m, &dd, &tail) == 4 && tail == 'g') {
+            days.push_back(archive_day_from_civil(y, m, dd));
+        }
+    }
+    closedir(d);
+    std::sort(days.begin(), days.end());
+    return days;
+}
+
+std::vector<uint16_t> archive_list_nodes(const char* dir) {
+    std::vector<uint16_t> nodes;
+    DIR* d = opendir(dir);
+    if (!d) {
+        return nodes;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d))) {
+        unsigned int src;
+        char extra;
+        if (strlen(ent->d_name) == 4 && sscanf(ent->d_name, "%4X%c", &src, &extra) == 1) {
+            nodes.push_back(src);
+        }
+    }
+    closedir(d);
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+}
+
+static bool load_samples(const std::string& path, std::vector<ArchiveSample>& out) {
+    ArchiveSegment seg;
+    if (!seg.open(path.c_str())) {
+        return false;
+    }
+    std::vector<int64_t> times;
+    std::vector<float> values;
+    if (!seg.times(times)) {
+        return false;
+    }
+    out.resize(times.size());
+    for (size_t i = 0; i < times.size(); i++) {
+        out[i].time_ms = times[i];
+    }
+    for (int f = 0; f < ARCHIVE_FIELD_COUNT; f++) {
+        if (!seg.field((ArchiveField)f, values)) {
+            return false;
+        }
+        for (size_t i = 0; i < values.size(); i++) {
+            out[i].values[f] = values[i];
+        }
+    }
+    return true;
+}
+
+bool archive_add_day(const char* dir, uint16_t src, int32_t day, std::vector<ArchiveSample> samples) {
+    std::string path = archive_segment_path(dir, src, day);
+    std::vector<ArchiveSample> all;
+    if (access(path.c_str(), F_OK) == 0 && !load_samples(path, all)) {
+        fprintf(stderr, "%s: damaged, not adding to it\n", path.c_str());
+        return false;
+    }
+    // new after old so where the times match the new ones are kept
+    all.insert(all.end(), samples.begin(), samples.end());
+    std::stable_sort(all.begin(), all.end(), [](const ArchiveSample& a, const ArchiveSample& b) {
+        return a.time_ms < b.time_ms;
+    });
+    size_t n = 0;
+    for (size_t i = 0; i < all.size(); i++) {
+        if (n > 0 && all[n - 1].time_ms == all[i].time_ms) {
+            all[n - 1] = all[i];
+        } else {
+            all[n++] = all[i];
+        }
+    }
+    all.resize(n);
+    if (n == 0) {
+        return true;
+    }
+
+    ArchiveSegmentHeader hdr = {};
+    memcpy(hdr.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    hdr.src = src;
+    hdr.day = day;
+    hdr.count = n;
+    hdr.first_ms = all.front().time_ms;
+    hdr.last_ms = all.back().time_ms;
+    for (int f = 0; f < ARCHIVE_FIELD_COUNT; f++) {
+        hdr.daily[f].clear();
+        for (int h = 0; h < 24; h++) {
+            hdr.hourly[h][f].clear();
+        }
+    }
+
+    std::vector<uint8_t> file(sizeof(hdr));
+    std::vector<int64_t> times(n);
+    std::vector<float> values(n);
+    for (size_t i = 0; i < n; i++) {
+        times[i] = all[i].time_ms;
+    }
+    hdr.column_offset[0] = file.size();
+    archive_encode_times(times.data(), n, file);
+    hdr.column_len[0] = file.size() - hdr.column_offset[0];
+    for (int f = 0; f < ARCHIVE_FIELD_COUNT; f++) {
+        for (size_t i = 0; i < n; i++) {
+            values[i] = all[i].values[f];
+            int hour = (int)((all[i].time_ms - (int64_t)day * MS_PER_DAY) / MS_PER_HOUR);
+            hdr.hourly[std::min(std::max(hour, 0), 23)][f].add(values[i]);
+            hdr.daily[f].add(values[i]);
+        }
+        hdr.column_offset[1 + f] = file.size();
+        archive_encode_floats(values.data(), n, file);
+        hdr.column_len[1 + f] = file.size() - hdr.column_offset[1 + f];
+    }
+    memcpy(file.data(), &hdr, sizeof(hdr));
+
+    // write it alongside and swap it in, so readers only ever see a whole one
+    mkdir(node_dir(dir, src).c_str(), 0755);
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(tmp.c_str());
+        return false;
+    }
+    bool ok = write(fd, file.data(), file.size()) == (ssize_t)file.size() && fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        perror(path.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
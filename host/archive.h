@@ -0,0 +1,127 @@
+/**
+ * Columnar time-series archive of the readings, for looking back over.
+ *
+ * The archive is a directory per node (named by its address in hex) holding
+ * a segment file per UTC day, e.g. archive/1234/20260321.seg. A segment is
+ * written in one go and never changed in place (adding to a day rewrites the
+ * file and renames it over the old one), and is read by mapping it. Each is
+ *
+ *   header: see ArchiveSegmentHeader
+ *   rollups: min/max/sum/count of each field for the whole day and for
+ *     each hour of it, so most queries never look at the samples at all
+ *   columns: the sample times, as the first time and then zig-zag varint
+ *     delta of deltas (a byte each for regular reports), then a column per
+ *     field of XOR compressed floats, as per Facebook's Gorilla paper
+ *     (mostly a bit or two per value for slowly changing readings)
+ *
+ * in host byte order. Fields a sample didn't have are stored as NaN and left
+ * out of the rollups.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum ArchiveField {
+    ARCHIVE_MCU_TEMP,
+    ARCHIVE_VBAT,
+    ARCHIVE_VIN,
+    ARCHIVE_CHARGE_STATE,
+    ARCHIVE_RSSI,
+    ARCHIVE_FIELD_COUNT
+};
+
+extern const char* const ARCHIVE_FIELD_NAMES[ARCHIVE_FIELD_COUNT];
+// the field called name, or -1
+int archive_field_by_name(const char* name);
+
+static const int64_t MS_PER_HOUR = 3600 * 1000;
+static const int64_t MS_PER_DAY = 24 * MS_PER_HOUR;
+
+struct ArchiveSample {
+    int64_t time_ms; // unix
+    float values[ARCHIVE_FIELD_COUNT];
+};
+
+// an empty one is all zeros, or clear()
+struct ArchiveRollup {
+    float min;
+    float max;
+    double sum;
+    uint32_t count;
+
+    void clear();
+    void add(float v);
+    void merge(const ArchiveRollup& other);
+    double mean() const { return count ? sum / count : 0; }
+};
+
+static const char ARCHIVE_MAGIC[4] = { 'H', 'T', 'A', '1' };
+
+struct ArchiveSegmentHeader {
+    char magic[4];
+    uint16_t src;
+    uint16_t reserved;
+    int32_t day; // since the epoch
+    uint32_t count;
+    int64_t first_ms;
+    int64_t last_ms;
+    // the times column then a column per field, from the start of the file
+    uint32_t column_offset[1 + ARCHIVE_FIELD_COUNT];
+    uint32_t column_len[1 + ARCHIVE_FIELD_COUNT];
+    ArchiveRollup daily[ARCHIVE_FIELD_COUNT];
+    ArchiveRollup hourly[24][ARCHIVE_FIELD_COUNT];
+};
+
+// column codecs, append to/decode from a byte vector
+void archive_encode_times(const int64_t* times, size_t n, std::vector<uint8_t>& out);
+bool archive_decode_times(const uint8_t* buf, size_t len, int64_t* times, size_t n);
+void archive_encode_floats(const float* values, size_t n, std::vector<uint8_t>& out);
+bool archive_decode_floats(const uint8_t* buf, size_t len, float* values, size_t n);
+
+/**
+ * Min/max/sum/count of values[0..n), NaNs skipped, added into acc. Done
+ * four at a time with the compiler's vector extensions, which become SSE or
+ * NEON.
+ */
+void archive_reduce(const float* values, size_t n, ArchiveRollup& acc);
+
+// a mapped segment file
+class ArchiveSegment {
+public:
+    ArchiveSegment() {}
+    ArchiveSegment(const ArchiveSegment&) = delete;
+    ArchiveSegment& operator=(const ArchiveSegment&) = delete;
+    ~ArchiveSegment();
+
+    bool open(const char* path);
+    void close();
+
+    const ArchiveSegmentHeader& header() const { return *hdr; }
+    bool times(std::vector<int64_t>& out) const;
+    bool field(ArchiveField f, std::vector<float>& out) const;
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const ArchiveSegmentHeader* hdr = nullptr;
+};
+
+// days since the epoch to and from calendar dates, proleptic Gregorian
+int32_t archive_day_from_civil(int y, unsigned m, unsigned d);
+void archive_civil_from_day(int32_t day, int* y, unsigned* m, unsigned* d);
+
+std::string archive_segment_path(const char* dir, uint16_t src, int32_t day);
+// the days there are segments for for src, in order
+std::vector<int32_t> archive_list_days(const char* dir, uint16_t src);
+// the nodes in the archive
+std::vector<uint16_t> archive_list_nodes(const char* dir);
+
+/**
+ * Add samples (all on the given day) to a node's segment for that day,
+ * merging with whatever is there already. Samples with the same time as one
+ * already there replace it, so adding the same thing twice is harmless.
+ */
+bool archive_add_day(const char* dir, uint16_t src, int32_t day, std::vector<ArchiveSample> samples);
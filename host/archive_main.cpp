@@ -0,0 +1,310 @@
+/**
+ * hortitel_archive, moves readings from the ingest log into the archive and
+ * asks the archive questions.
+ *
+ * usage: hortitel_archive import -a archive -w wal-dir
+ *        hortitel_archive query -a archive -f field [-s src] [-g all|day|hour]
+ *                               [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--hours H-H]
+ *
+ * import carries on from where it got to last time (kept in archive/wal.pos).
+ *
+ * query prints the count, min, max and mean of a field (mcu_temp, vbat, vin,
+ * charge_state or rssi) per node, over the whole range, per day or per hour.
+ * Dates are UTC, optionally with a time (2026-03-01T06:30), and --to is
+ * exclusive. --hours picks a window of each day,
+ * which can go past midnight, e.g. the battery voltage each night last spring:
+ *
+ *   hortitel_archive query -a archive -f vbat -g day --from 2026-03-01 --to 2026-06-01 --hours 22-6
+ *
+ * where a night is given by the date it started on. Whole hours come from the
+ * rollups, only part hours at the ends of the range need the samples.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <sys/stat.h>
+#include "archive.h"
+#include "hostlink_decoder.h"
+#include "wal.h"
+
+static int usage(const char* argv0) {
+    fprintf(stderr, "usage: %s import -a archive -w wal-dir\n", argv0);
+    fprintf(stderr, "       %s query -a archive -f field [-s src] [-g all|day|hour]\n"
+                    "           [--from YYYY-MM-DD[THH:MM]] [--to YYYY-MM-DD[THH:MM]] [--hours H-H]\n", argv0);
+    return 1;
+}
+
+// YYYY-MM-DD or YYYY-MM-DDTHH:MM
+static bool parse_date(const char* s, int64_t* ms) {
+    int y;
+    unsigned m, d, hh = 0, mm = 0;
+    int n = sscanf(s, "%d-%u-%uT%u:%u", &y, &m, &d, &hh, &mm);
+    if ((n != 3 && n != 5) || m < 1 || m > 12 || d < 1 || d > 31 || hh > 23 || mm > 59) {
+        return false;
+    }
+    *ms = archive_day_from_civil(y, m, d) * MS_PER_DAY + hh * MS_PER_HOUR + mm * 60000;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// import
+
+static int do_import(const char* archive, const char* wal_dir) {
+    std::string pos_path = std::string(archive) + "/wal.pos";
+    unsigned int from_segment = 0;
+    unsigned long from_offset = 0;
+    FILE* f = fopen(pos_path.c_str(), "r");
+    if (f) {
+        if (fscanf(f, "%u %lu", &from_segment, &from_offset) != 2) {
+            from_segment = 0;
+            from_offset = 0;
+        }
+        fclose(f);
+    }
+
+    WalReader wal;
+    if (!wal.open(wal_dir, from_segment, from_offset)) {
+        fprintf(stderr, "%s: no log here\n", wal_dir);
+        return 1;
+    }
+
+    // gather everything up by node and day, each day's segment is then
+    // rewritten just the once
+    std::map<std::pair<uint16_t, int32_t>, std::vector<ArchiveSample>> days;
+    uint64_t host_ms;
+    const uint8_t* record;
+    size_t len;
+    unsigned long count = 0;
+    while (wal.next(&host_ms, &record, &len)) {
+        HostRecord rec;
+        if (!hostlink_parse(record, len, &rec) || rec.type != HOSTLINK_READING) {
+            continue;
+        }
+        ArchiveSample sample;
+        sample.time_ms = (int64_t)host_ms - rec.age_ms;
+        const struct sensor_record& r = rec.readings;
+        sample.values[ARCHIVE_MCU_TEMP] = (r.present & (1u << SENSOR_MCU_TEMP)) ? r.mcu_temp : NAN;
+        sample.values[ARCHIVE_VBAT] = (r.present & (1u << SENSOR_VBAT)) ? r.vbat : NAN;
+        sample.values[ARCHIVE_VIN] = (r.present & (1u << SENSOR_VIN)) ? r.vin : NAN;
+        sample.values[ARCHIVE_CHARGE_STATE] = (r.present & (1u << SENSOR_CHARGE_STATE)) ? r.charge_state : NAN;
+        sample.values[ARCHIVE_RSSI] = rec.rssi;
+        int32_t day = (int32_t)(sample.time_ms / MS_PER_DAY);
+        days[{ rec.src, day }].push_back(sample);
+        count++;
+    }
+
+    mkdir(archive, 0755);
+    for (auto& entry : days) {
+        if (!archive_add_day(archive, entry.first.first, entry.first.second, std::move(entry.second))) {
+            return 1;
+        }
+    }
+
+    // only once it's all safely in
+    std::string tmp = pos_path + ".tmp";
+    f = fopen(tmp.c_str(), "w");
+    if (!f || fprintf(f, "%u %lu\n", wal.segment(), (unsigned long)wal.offset()) < 0 || fclose(f) != 0
+            || rename(tmp.c_str(), pos_path.c_str()) != 0) {
+        perror(pos_path.c_str());
+        return 1;
+    }
+    fprintf(stderr, "imported %lu readings into %zu node days\n", count, days.size());
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// query
+
+enum Grouping {
+    GROUP_ALL,
+    GROUP_DAY,
+    GROUP_HOUR,
+};
+
+struct Query {
+    int field = -1;
+    int src = -1;
+    Grouping group = GROUP_ALL;
+    int64_t from_ms = INT64_MIN / 2;
+    int64_t to_ms = INT64_MAX / 2;
+    int hour_from = 0; // window of the day, [hour_from, hour_to)
+    int hour_to = 24;
+};
+
+static bool in_window(const Query& q, int hour) {
+    if (q.hour_from <= q.hour_to) {
+        return hour >= q.hour_from && hour < q.hour_to;
+    }
+    return hour >= q.hour_from || hour < q.hour_to;
+}
+
+// the bucket an hour of a day falls in, a window past midnight counts as
+// the day it started
+static int64_t bucket_of(const Query& q, int32_t day, int hour) {
+    switch (q.group) {
+    case GROUP_HOUR:
+        return (int64_t)day * 24 + hour;
+    case GROUP_DAY:
+        return (q.hour_from > q.hour_to && hour < q.hour_to) ? day - 1 : day;
+    default:
+        return 0;
+    }
+}
+
+static void print_bucket(const Query& q, int64_t bucket) {
+    int y;
+    unsigned m, d;
+    switch (q.group) {
+    case GROUP_HOUR:
+        archive_civil_from_day((int32_t)(bucket / 24), &y, &m, &d);
+        printf("%04d-%02u-%02uT%02d", y, m, d, (int)(bucket % 24));
+        break;
+    case GROUP_DAY:
+        archive_civil_from_day((int32_t)bucket, &y, &m, &d);
+        printf("%04d-%02u-%02u", y, m, d);
+        break;
+    default:
+        printf("all");
+    }
+}
+
+static int do_query(const char* archive, const Query& q) {
+    auto start = std::chrono::steady_clock::now();
+    std::map<std::pair<uint16_t, int64_t>, ArchiveRollup> results;
+    unsigned long segments = 0, scans = 0;
+
+    std::vector<uint16_t> nodes = archive_list_nodes(archive);
+    std::vector<int64_t> times;
+    std::vector<float> values;
+    for (uint16_t src : nodes) {
+        if (q.src >= 0 && q.src != src) {
+            continue;
+        }
+        for (int32_t day : archive_list_days(archive, src)) {
+            int64_t day_ms = (int64_t)day * MS_PER_DAY;
+            if (day_ms + MS_PER_DAY <= q.from_ms || day_ms >= q.to_ms) {
+                continue;
+            }
+            ArchiveSegment seg;
+            if (!seg.open(archive_segment_path(archive, src, day).c_str())) {
+                fprintf(stderr, "%04X day %d: can't read segment\n", src, day);
+                continue;
+            }
+            segments++;
+            const ArchiveSegmentHeader& hdr = seg.header();
+            bool decoded = false;
+
+            // the whole day in one, if we can
+            bool whole_day = day_ms >= q.from_ms && day_ms + MS_PER_DAY <= q.to_ms
+                    && q.hour_from == 0 && q.hour_to == 24 && q.group != GROUP_HOUR;
+            if (whole_day) {
+                results[{ src, bucket_of(q, day, 0) }].merge(hdr.daily[q.field]);
+                continue;
+            }
+
+            for (int hour = 0; hour < 24; hour++) {
+                int64_t hour_ms = day_ms + hour * MS_PER_HOUR;
+                if (!in_window(q, hour) || hour_ms + MS_PER_HOUR <= q.from_ms || hour_ms >= q.to_ms) {
+                    continue;
+                }
+                ArchiveRollup& acc = results[{ src, bucket_of(q, day, hour) }];
+                if (hour_ms >= q.from_ms && hour_ms + MS_PER_HOUR <= q.to_ms) {
+                    acc.merge(hdr.hourly[hour][q.field]);
+                    continue;
+                }
+                // part of an hour, look at the samples themselves
+                if (!decoded) {
+                    decoded = seg.times(times) && seg.field((ArchiveField)q.field, values);
+                    if (!decoded) {
+                        fprintf(stderr, "%04X day %d: damaged segment\n", src, day);
+                        break;
+                    }
+                    scans++;
+                }
+                int64_t lo = std::max(hour_ms, q.from_ms);
+                int64_t hi = std::min(hour_ms + MS_PER_HOUR, q.to_ms);
+                size_t first = std::lower_bound(times.begin(), times.end(), lo) - times.begin();
+                size_t last = std::lower_bound(times.begin(), times.end(), hi) - times.begin();
+                archive_reduce(values.data() + first, last - first, acc);
+            }
+        }
+    }
+
+    printf("src,%s,count,min,max,mean\n", q.group == GROUP_HOUR ? "hour" : q.group == GROUP_DAY ? "day" : "range");
+    for (auto& entry : results) {
+        const ArchiveRollup& r = entry.second;
+        if (!r.count) {
+            continue;
+        }
+        printf("%04X,", entry.first.first);
+        print_bucket(q, entry.first.second);
+        printf(",%u,%g,%g,%g\n", r.count, r.min, r.max, r.mean());
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%lu segments, %lu scanned, %.2f ms\n", segments, scans, ms);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        return usage(argv[0]);
+    }
+    const char* cmd = argv[1];
+    const char* archive = nullptr;
+    const char* wal_dir = nullptr;
+    Query q;
+    for (int i = 2; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!val) {
+            return usage(argv[0]);
+        }
+        i++;
+        if (!strcmp(arg, "-a")) {
+            archive = val;
+        } else if (!strcmp(arg, "-w")) {
+            wal_dir = val;
+        } else if (!strcmp(arg, "-f")) {
+            q.field = archive_field_by_name(val);
+            if (q.field < 0) {
+                fprintf(stderr, "no field %s\n", val);
+                return 1;
+            }
+        } else if (!strcmp(arg, "-s")) {
+            q.src = strtol(val, nullptr, 16);
+        } else if (!strcmp(arg, "-g")) {
+            q.group = !strcmp(val, "hour") ? GROUP_HOUR : !strcmp(val, "day") ? GROUP_DAY : GROUP_ALL;
+        } else if (!strcmp(arg, "--from")) {
+            if (!parse_date(val, &q.from_ms)) {
+                return usage(argv[0]);
+            }
+        } else if (!strcmp(arg, "--to")) {
+            if (!parse_date(val, &q.to_ms)) {
+                return usage(argv[0]);
+            }
+        } else if (!strcmp(arg, "--hours")) {
+            if (sscanf(val, "%d-%d", &q.hour_from, &q.hour_to) != 2
+                    || q.hour_from < 0 || q.hour_from > 23 || q.hour_to < 0 || q.hour_to > 24) {
+                return usage(argv[0]);
+            }
+            if (q.hour_to == 0) {
+                q.hour_to = 24;
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    if (!strcmp(cmd, "import") && archive && wal_dir) {
+        return do_import(archive, wal_dir);
+    }
+    if (!strcmp(cmd, "query") && archive && q.field >= 0) {
+        return do_query(archive, q);
+    }
+    return usage(argv[0]);
+}
@@ -0,0 +1,186 @@
+/**
+ * hortitel_decode, turns the receiver's binary output back into text.
+ *
+ * usage: hortitel_decode [-c] [-e firmware.elf] [device or file | -w dir]
+ *
+ * Reads from the given serial device or file, or stdin, and prints one line
+ * per record as it arrives. With -w it prints what's in hortitel_ingest's
+ * log instead. With -c it's CSV: a reading is
+ * "reading,time_ms,src,dst,rssi,age_ms," then the SENSOR_FIELDS values in
+ * schema order, a status is "status,time_ms," then the status fields, and a
+ * summary is a line for each of min, max, mean and last,
+ * "summary,time_ms,src,age_ms,period_ms,count,stat," then the SENSOR_FIELDS. Fields
+ * that weren't sent are left empty. Deferred log messages (see
+ * src/core/log.h) need the firmware's ELF file, given by -e, to turn them
+ * into text, in CSV they're "log,time_ms,level," then the message quoted.
+ */
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "hostlink_decoder.h"
+#include "log_format.h"
+#include "wal.h"
+
+static void print_fields(const FieldDesc* fields, size_t n, const void* record, uint32_t present, bool csv) {
+    for (size_t i = 0; i < n; i++) {
+        const FieldDesc& field = fields[i];
+        bool have = present & (1u << i);
+        if (csv) {
+            if (!have) {
+                printf(",");
+            } else if (field.type == FIELD_FLOAT) {
+                printf(",%g", schema_get_float(field, record));
+            } else {
+                printf(",%lld", (long long)schema_get_wire(field, record));
+            }
+        } else if (have) {
+            if (field.type == FIELD_FLOAT) {
+                printf(" %s: %0.2f%s;", field.name, schema_get_float(field, record), field.unit);
+            } else {
+                printf(" %s: %lld%s;", field.name, (long long)schema_get_wire(field, record), field.unit);
+            }
+        }
+    }
+    printf("\n");
+}
+
+// the firmware's format strings, for log messages
+static LogStrings log_strings;
+
+static void print_log(const struct HostRecord& rec, bool csv) {
+    const char* fmt = log_strings.find(rec.format);
+    std::string text;
+    if (fmt) {
+        text = log_format(fmt, rec.args, rec.args_len);
+    } else {
+        char unknown[64];
+        snprintf(unknown, sizeof(unknown), "<no format at 0x%llx, wrong ELF?>", (unsigned long long)rec.format);
+        text = unknown;
+    }
+    if (csv) {
+        std::string quoted;
+        for (char c : text) {
+            quoted += c;
+            if (c == '"') {
+                quoted += c;
+            }
+        }
+        printf("log,%lu,%s,\"%s\"\n", (unsigned long)rec.time_ms, log_level_name(rec.level), quoted.c_str());
+    } else {
+        printf("%10.3f %-5s %s\n", rec.time_ms / 1000.0, log_level_name(rec.level), text.c_str());
+    }
+}
+
+static void print_record(const struct HostRecord& rec, bool csv) {
+    if (rec.type == HOSTLINK_LOG) {
+        print_log(rec, csv);
+    } else if (rec.type == HOSTLINK_SUMMARY) {
+        // a line per statistic
+        for (size_t s = 0; s < HOSTLINK_STATS; s++) {
+            const char* stat = hostlink_stat_name((HostlinkSummaryStat)s);
+            if (csv) {
+                printf("summary,%lu,%u,%lu,%lu,%lu,%s", (unsigned long)rec.time_ms, rec.src, (unsigned long)rec.age_ms,
+                        (unsigned long)rec.period_ms, (unsigned long)rec.count, stat);
+            } else {
+                printf("%10.3f 0x%04X %-4s of %lu over %lu s to %lu ms ago:", rec.time_ms / 1000.0, rec.src, stat,
+                        (unsigned long)rec.count, (unsigned long)(rec.period_ms / 1000), (unsigned long)rec.age_ms);
+            }
+            print_fields(SENSOR_FIELDS, SENSOR_FIELD_COUNT, &rec.stats[s], rec.stats[s].present, csv);
+        }
+    } else if (rec.type == HOSTLINK_READING) {
+        if (csv) {
+            printf("reading,%lu,%u,%u,%d,%lu", (unsigned long)rec.time_ms, rec.src, rec.dst, rec.rssi, (unsigned long)rec.age_ms);
+        } else {
+            printf("%10.3f 0x%04X->0x%04X %d dBm, %lu ms ago:", rec.time_ms / 1000.0, rec.src, rec.dst, rec.rssi, (unsigned long)rec.age_ms);
+        }
+        print_fields(SENSOR_FIELDS, SENSOR_FIELD_COUNT, &rec.readings, rec.readings.present, csv);
+    } else {
+        if (csv) {
+            printf("status,%lu", (unsigned long)rec.time_ms);
+        } else {
+            printf("%10.3f receiver status:", rec.time_ms / 1000.0);
+        }
+        print_fields(HOSTLINK_STATUS_FIELDS, HOSTLINK_STATUS_FIELD_COUNT, &rec.status, rec.status.present, csv);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    bool csv = false;
+    const char* path = nullptr;
+    const char* wal_dir = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c")) {
+            csv = true;
+        } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            wal_dir = argv[++i];
+        } else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+            if (!log_strings.load_elf(argv[++i])) {
+                fprintf(stderr, "%s: can't read that as an ELF file\n", argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [-c] [-e firmware.elf] [device or file | -w dir]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (wal_dir) {
+        WalReader wal;
+        if (!wal.open(wal_dir)) {
+            fprintf(stderr, "%s: no log here\n", wal_dir);
+            return 1;
+        }
+        uint64_t host_ms;
+        const uint8_t* record;
+        size_t len;
+        unsigned long count = 0, bad = 0;
+        while (wal.next(&host_ms, &record, &len)) {
+            HostRecord rec;
+            if (hostlink_parse(record, len, &rec)) {
+                print_record(rec, csv);
+                count++;
+            } else {
+                bad++;
+            }
+        }
+        fprintf(stderr, "%lu records, %lu bad\n", count, bad);
+        return 0;
+    }
+
+    int fd = STDIN_FILENO;
+    if (path) {
+        fd = open(path, O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            perror(path);
+            return 1;
+        }
+    }
+    // a serial port needs to be raw or the line discipline will mangle it
+    if (isatty(fd)) {
+        struct termios tio;
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+
+    HostlinkDecoder decoder;
+    HostRecord rec;
+    uint8_t buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (decoder.push(buf[i], rec)) {
+                print_record(rec, csv);
+            }
+        }
+    }
+
+    fprintf(stderr, "%lu records, %lu bad\n", (unsigned long)decoder.records(), (unsigned long)decoder.errors());
+    return 0;
+}
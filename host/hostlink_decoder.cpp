@@ -0,0 +1,117 @@
+#include "hostlink_decoder.h"
+
+#include <cstring>
+
+bool hostlink_decode(const uint8_t* frame, size_t len, struct HostRecord* rec) {
+    uint8_t record[HOSTLINK_FRAME_MAX];
+    if (len > sizeof(record)) {
+        return false;
+    }
+    return hostlink_parse(record, cobs_decode(frame, len, record), rec);
+}
+
+bool hostlink_parse(const uint8_t* record, size_t reclen, struct HostRecord* rec) {
+    // type, time and crc at the very least
+    if (reclen < 7) {
+        return false;
+    }
+    uint16_t crc;
+    deserialise_u16(record + reclen - 2, &crc);
+    if (crc != crc16_ccitt(record, reclen - 2)) {
+        return false;
+    }
+
+    const uint8_t* buf = record;
+    const uint8_t* end = record + reclen - 2;
+    *rec = {};
+    buf = deserialise_u8(buf, &rec->type);
+    buf = deserialise_u32(buf, &rec->time_ms);
+
+    if (rec->type == HOSTLINK_READING) {
+        if (end - buf < 6) {
+            return false;
+        }
+        buf = deserialise_u16(buf, &rec->src);
+        buf = deserialise_u16(buf, &rec->dst);
+        buf = deserialise_i16(buf, &rec->rssi);
+        uint64_t age;
+        buf = varint_get(buf, end, &age);
+        if (!buf) {
+            return false;
+        }
+        rec->age_ms = (uint32_t)age;
+        return schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, buf, end - buf, &rec->readings, &rec->readings.present);
+    }
+    if (rec->type == HOSTLINK_STATUS) {
+        return schema_decode(HOSTLINK_STATUS_FIELDS, HOSTLINK_STATUS_FIELD_COUNT, buf, end - buf, &rec->status, &rec->status.present);
+    }
+    if (rec->type == HOSTLINK_LOG) {
+        if (end - buf < 1) {
+            return false;
+        }
+        buf = deserialise_u8(buf, &rec->level);
+        buf = varint_get(buf, end, &rec->format);
+        if (!buf) {
+            return false;
+        }
+        rec->args_len = end - buf;
+        memcpy(rec->args, buf, rec->args_len);
+        return true;
+    }
+    if (rec->type == HOSTLINK_SUMMARY) {
+        if (end - buf < 2) {
+            return false;
+        }
+        buf = deserialise_u16(buf, &rec->src);
+        uint64_t age, period, count;
+        buf = varint_get(buf, end, &age);
+        buf = buf ? varint_get(buf, end, &period) : nullptr;
+        buf = buf ? varint_get(buf, end, &count) : nullptr;
+        if (!buf) {
+            return false;
+        }
+        rec->age_ms = (uint32_t)age;
+        rec->period_ms = (uint32_t)period;
+        rec->count = (uint32_t)count;
+        for (size_t s = 0; s < HOSTLINK_STATS; s++) {
+            uint64_t len;
+            buf = varint_get(buf, end, &len);
+            if (!buf || len > (uint64_t)(end - buf)
+                    || !schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, buf, len, &rec->stats[s], &rec->stats[s].present)) {
+                return false;
+            }
+            buf += len;
+        }
+        return true;
+    }
+    // a newer receiver, skip what we don't understand
+    return false;
+}
+
+bool HostlinkDecoder::push(uint8_t byte, struct HostRecord& rec) {
+    if (byte != 0) {
+        if (len < sizeof(buf)) {
+            buf[len++] = byte;
+        } else {
+            overflow = true;
+        }
+        return false;
+    }
+
+    // the end of a record, or of the text before the first one
+    bool ok = false;
+    if (len > 0) {
+        if (!overflow) {
+            raw_len = cobs_decode(buf, len, raw);
+            ok = hostlink_parse(raw, raw_len, &rec);
+        }
+        if (ok) {
+            good++;
+        } else {
+            bad++;
+        }
+    }
+    len = 0;
+    overflow = false;
+    return ok;
+}
@@ -0,0 +1,68 @@
+/**
+ * Host end of the receiver's binary output, see src/core/hostlink.h.
+ *
+ * Feed the bytes from the receiver's serial port into a HostlinkDecoder as
+ * they come and it hands back each record that arrives intact. Anything
+ * damaged or cut short is counted and skipped, it picks up again at the
+ * next record.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "hostlink.h"
+
+struct HostRecord {
+    uint8_t type; // HOSTLINK_READING, HOSTLINK_STATUS, HOSTLINK_LOG or HOSTLINK_SUMMARY
+    uint32_t time_ms; // receiver's clock
+
+    // HOSTLINK_READING, and HOSTLINK_SUMMARY
+    uint16_t src;
+    uint16_t dst;
+    int16_t rssi;
+    uint32_t age_ms; // how long before time_ms it was sampled (or the period ended)
+    struct sensor_record readings;
+
+    // HOSTLINK_STATUS
+    struct HostlinkStatus status;
+
+    // HOSTLINK_LOG, see log_format.h to turn it into text
+    uint8_t level;
+    uint64_t format; // where the format string is in the firmware
+    uint8_t args[HOSTLINK_RECORD_MAX];
+    size_t args_len;
+
+    // HOSTLINK_SUMMARY, of count readings over the period_ms up to age_ms
+    // before time_ms
+    uint32_t period_ms;
+    uint32_t count;
+    struct sensor_record stats[HOSTLINK_STATS]; // by HostlinkSummaryStat
+};
+
+// decode one record from its COBS bytes, without the terminating zero
+bool hostlink_decode(const uint8_t* frame, size_t len, struct HostRecord* rec);
+// and from the record itself, once COBS decoded, crc and all
+bool hostlink_parse(const uint8_t* record, size_t len, struct HostRecord* rec);
+
+class HostlinkDecoder {
+public:
+    // true if byte completed a good record, which is now in rec
+    bool push(uint8_t byte, struct HostRecord& rec);
+
+    // the raw bytes of the last good record, as hostlink_parse() takes them
+    const uint8_t* record() const { return raw; }
+    size_t record_len() const { return raw_len; }
+
+    uint32_t records() const { return good; }
+    // records that failed their CRC, weren't valid COBS or were too long
+    uint32_t errors() const { return bad; }
+
+private:
+    uint8_t buf[HOSTLINK_FRAME_MAX];
+    size_t len = 0;
+    uint8_t raw[HOSTLINK_FRAME_MAX];
+    size_t raw_len = 0;
+    bool overflow = false;
+    uint32_t good = 0;
+    uint32_t bad = 0;
+};
@@ -0,0 +1,249 @@
+/**
+ * hortitel_ingest, stores the receiver's binary output in a write-ahead log.
+ *
+ * usage: hortitel_ingest [-d dir] [-n batch] [-t ms] [-q] (device | -p)
+ *
+ *   -d  log directory, default ./hortitel-wal
+ *   -n  commit once this many records are waiting, default 256
+ *   -t  or once the oldest waiting record is this old, default 200ms
+ *   -q  don't print stats every ten seconds
+ *   -p  rather than a serial device make a pty and read whatever is written
+ *       to that, e.g. a capture: cat capture.bin > /dev/pts/N
+ *
+ * The receiver needs to be built with HORTITEL_BINARY_OUTPUT. The serial port
+ * is read on the main thread and records are passed to a writer thread
+ * through a fixed size queue, the reader never waits for the disk. If the
+ * disk falls that far behind records are dropped, and counted, rather than
+ * letting the serial port overrun. See wal.h for the log format.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "hostlink_decoder.h"
+#include "spsc_queue.h"
+#include "wal.h"
+
+struct IngestEntry {
+    uint64_t host_ms;
+    uint16_t len;
+    uint8_t record[HOSTLINK_FRAME_MAX];
+};
+
+// about five minutes of 5 second reports from 1000 nodes
+static const size_t INGEST_QUEUE_SIZE = 1 << 16;
+static SpscQueue<IngestEntry, INGEST_QUEUE_SIZE> ingest_queue;
+
+static volatile sig_atomic_t stopping = 0;
+static std::atomic<bool> writer_failed{false};
+static std::mutex wake_lock;
+static std::condition_variable wake;
+
+// the writer's progress, for the stats
+static std::atomic<uint64_t> committed_entries{0};
+static std::atomic<uint64_t> commit_count{0};
+static std::atomic<uint64_t> sync_us{0};
+
+static void on_signal(int) {
+    stopping = 1;
+}
+
+static uint64_t unix_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static void make_raw(int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+}
+
+/**
+ * Group commit: take everything off the queue, and sync when there's a
+ * batch's worth waiting or the oldest has waited long enough.
+ */
+static void writer_main(WalWriter* wal, size_t batch, uint32_t commit_ms) {
+    auto oldest = std::chrono::steady_clock::now();
+    while (true) {
+        bool stop = stopping;
+        IngestEntry* entry;
+        while ((entry = ingest_queue.read_slot())) {
+            if (wal->pending() == 0) {
+                oldest = std::chrono::steady_clock::now();
+            }
+            wal->append(entry->host_ms, entry->record, entry->len);
+            ingest_queue.release();
+            if (wal->pending() >= batch) {
+                break;
+            }
+        }
+
+        auto age = std::chrono::steady_clock::now() - oldest;
+        if (wal->pending() && (stop || wal->pending() >= batch || age >= std::chrono::milliseconds(commit_ms))) {
+            if (!wal->commit()) {
+                perror("wal commit");
+                writer_failed = true;
+                return;
+            }
+            committed_entries = wal->entries();
+            commit_count = wal->commits();
+            sync_us = wal->sync_us();
+        }
+        if (stop && ingest_queue.empty()) {
+            return;
+        }
+
+        // the reader doesn't take the lock to notify, a wakeup missed here
+        // just costs one timeout
+        if (ingest_queue.empty()) {
+            std::unique_lock<std::mutex> lock(wake_lock);
+            auto wait = wal->pending() ? std::chrono::milliseconds(commit_ms) - age : std::chrono::milliseconds(commit_ms);
+            wake.wait_for(lock, std::max(wait, std::chrono::steady_clock::duration(std::chrono::milliseconds(1))));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* dir = "hortitel-wal";
+    const char* path = nullptr;
+    size_t batch = 256;
+    uint32_t commit_ms = 200;
+    bool use_pty = false;
+    bool quiet = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            batch = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            commit_ms = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "-p")) {
+            use_pty = true;
+        } else if (!strcmp(argv[i], "-q")) {
+            quiet = true;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            use_pty = false;
+            break;
+        }
+    }
+    if (!path == !use_pty || batch == 0) {
+        fprintf(stderr, "usage: %s [-d dir] [-n batch] [-t ms] [-q] (device | -p)\n", argv[0]);
+        return 1;
+    }
+
+    int fd;
+    int pty_slave = -1;
+    if (use_pty) {
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+            perror("pty");
+            return 1;
+        }
+        // hold the other end open too, otherwise reads fail whenever
+        // nothing else has it open
+        pty_slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+        make_raw(pty_slave);
+        printf("reading from %s\n", ptsname(fd));
+        fflush(stdout);
+    } else {
+        fd = open(path, O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            perror(path);
+            return 1;
+        }
+        if (isatty(fd)) {
+            make_raw(fd);
+        }
+    }
+
+    WalWriter wal;
+    if (!wal.open(dir)) {
+        perror(dir);
+        return 1;
+    }
+    if (wal.torn_bytes()) {
+        fprintf(stderr, "%s: dropped %zu bytes of torn entry at the end of the log\n", dir, wal.torn_bytes());
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::thread writer(writer_main, &wal, batch, commit_ms);
+
+    HostlinkDecoder decoder;
+    HostRecord rec;
+    uint8_t buf[4096];
+    auto last_stats = std::chrono::steady_clock::now();
+    while (!stopping && !writer_failed) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 500);
+        if (ready > 0) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+                // the device went away or the file ran out
+                break;
+            }
+            bool queued = false;
+            uint64_t now = unix_ms();
+            for (ssize_t i = 0; i < n; i++) {
+                if (decoder.push(buf[i], rec)) {
+                    IngestEntry* entry = ingest_queue.write_slot();
+                    if (entry) {
+                        entry->host_ms = now;
+                        entry->len = decoder.record_len();
+                        memcpy(entry->record, decoder.record(), entry->len);
+                        ingest_queue.commit();
+                        queued = true;
+                    }
+                }
+            }
+            if (queued) {
+                wake.notify_one();
+            }
+        }
+
+        if (!quiet && std::chrono::steady_clock::now() - last_stats >= std::chrono::seconds(10)) {
+            last_stats = std::chrono::steady_clock::now();
+            uint64_t commits = commit_count;
+            fprintf(stderr, "records=%lu bad=%lu dropped=%lu committed=%llu commits=%llu avg sync=%lluus\n",
+                    (unsigned long)decoder.records(), (unsigned long)decoder.errors(),
+                    (unsigned long)ingest_queue.dropped(), (unsigned long long)committed_entries,
+                    (unsigned long long)commits, (unsigned long long)(commits ? sync_us / commits : 0));
+        }
+    }
+
+    stopping = 1;
+    wake.notify_one();
+    writer.join();
+    wal.close();
+    if (pty_slave >= 0) {
+        close(pty_slave);
+    }
+    close(fd);
+
+    fprintf(stderr, "records=%lu bad=%lu dropped=%lu committed=%llu commits=%llu\n",
+            (unsigned long)decoder.records(), (unsigned long)decoder.errors(),
+            (unsigned long)ingest_queue.dropped(), (unsigned long long)wal.entries(),
+            (unsigned long long)wal.commits());
+    return writer_failed ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+#include "log_format.h"
+
+#include <cstdio>
+#include <cstring>
+#include <elf.h>
+#include "log.h"
+#include "packet.h"
+#include "schema.h"
+
+template <typename Ehdr, typename Shdr>
+static bool elf_sections(const std::vector<char>& image, std::vector<Shdr>& out) {
+    if (image.size() < sizeof(Ehdr)) {
+        return false;
+    }
+    Ehdr ehdr;
+    memcpy(&ehdr, image.data(), sizeof(ehdr));
+    if (ehdr.e_shentsize != sizeof(Shdr)
+            || ehdr.e_shoff + (uint64_t)ehdr.e_shnum * sizeof(Shdr) > image.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < ehdr.e_shnum; i++) {
+        Shdr shdr;
+        memcpy(&shdr, image.data() + ehdr.e_shoff + i * sizeof(Shdr), sizeof(shdr));
+        out.push_back(shdr);
+    }
+    return true;
+}
+
+// the sections that are in the firmware image and have their contents in
+// the file, i.e. the ones a format string could be in
+template <typename Ehdr, typename Shdr, typename Section>
+static bool elf_loaded(const std::vector<char>& image, std::vector<Section>& sections) {
+    std::vector<Shdr> shdrs;
+    if (!elf_sections<Ehdr, Shdr>(image, shdrs)) {
+        return false;
+    }
+    for (const Shdr& shdr : shdrs) {
+        if ((shdr.sh_flags & SHF_ALLOC) && shdr.sh_type == SHT_PROGBITS
+                && shdr.sh_offset + shdr.sh_size <= image.size()) {
+            sections.push_back({ shdr.sh_addr, (size_t)shdr.sh_offset, (size_t)shdr.sh_size });
+        }
+    }
+    return true;
+}
+
+bool LogStrings::load_elf(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    image.clear();
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        image.insert(image.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    // little-endian only, which the RP2350 and anything we'd run this on are
+    sections.clear();
+    if (image.size() < EI_NIDENT || memcmp(image.data(), ELFMAG, SELFMAG) != 0
+            || image[EI_DATA] != ELFDATA2LSB) {
+        return false;
+    }
+    if (image[EI_CLASS] == ELFCLASS32) {
+        return elf_loaded<Elf32_Ehdr, Elf32_Shdr>(image, sections);
+    }
+    if (image[EI_CLASS] == ELFCLASS64) {
+        return elf_loaded<Elf64_Ehdr, Elf64_Shdr>(image, sections);
+    }
+    return false;
+}
+
+void LogStrings::add(uint64_t addr, const char* fmt) {
+    added[addr] = fmt;
+}
+
+const char* LogStrings::find(uint64_t addr) const {
+    auto it = added.find(addr);
+    if (it != added.end()) {
+        return it->second.c_str();
+    }
+    for (const Section& section : sections) {
+        if (addr >= section.addr && addr - section.addr < section.size) {
+            // it's only a string if it ends inside the section
+            const char* start = image.data() + section.offset + (addr - section.addr);
+            if (memchr(start, 0, section.size - (addr - section.addr))) {
+                return start;
+            }
+        }
+    }
+    return nullptr;
+}
+
+std::string log_format(const char* fmt, const uint8_t* args, size_t len) {
+    std::string out;
+    const uint8_t* buf = args;
+    const uint8_t* end = args + len;
+    bool short_of_args = false;
+    char text[512];
+    for (const char* p = fmt; *p; p++) {
+        if (*p != '%') {
+            out += *p;
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            out += '%';
+            continue;
+        }
+        size_t at = p - fmt;
+        bool percent;
+        LogArgClass want = log_conversion(fmt, &at, &percent);
+        // keep the flags, width and precision, the length the board used
+        // doesn't matter as we know what we've got
+        std::string spec = "%";
+        for (; p < fmt + at; p++) {
+            if (!strchr("hlzjtL", *p)) {
+                spec += *p;
+            }
+        }
+        char conv = *p;
+        if (!conv) {
+            break;
+        }
+        uint64_t val = 0;
+        if (short_of_args) {
+            out += "<?>";
+            continue;
+        }
+        if (want == LOG_ARG_SIGNED || want == LOG_ARG_UNSIGNED) {
+            buf = varint_get(buf, end, &val);
+            if (buf && conv == 'c') {
+                snprintf(text, sizeof(text), (spec + conv).c_str(), (int)val);
+            } else if (buf && want == LOG_ARG_SIGNED) {
+                snprintf(text, sizeof(text), (spec + "ll" + conv).c_str(), (long long)zigzag_decode(val));
+            } else if (buf) {
+                snprintf(text, sizeof(text), (spec + "ll" + conv).c_str(), (unsigned long long)val);
+            }
+        } else if (want == LOG_ARG_FLOAT) {
+            if (end - buf >= 4) {
+                uint32_t bits;
+                float f;
+                buf = deserialise_u32(buf, &bits);
+                memcpy(&f, &bits, sizeof(f));
+                snprintf(text, sizeof(text), (spec + conv).c_str(), (double)f);
+            } else {
+                buf = nullptr;
+            }
+        } else if (want == LOG_ARG_STRING || want == LOG_ARG_BYTES) {
+            buf = varint_get(buf, end, &val);
+            if (buf && val <= (uint64_t)(end - buf)) {
+                if (want == LOG_ARG_STRING) {
+                    std::string str((const char*)buf, val);
+                    snprintf(text, sizeof(text), (spec + 's').c_str(), str.c_str());
+                } else {
+                    text[0] = 0;
+                    for (size_t i = 0; i < val && i * 5 + 6 < sizeof(text); i++) {
+                        snprintf(text + i * 5, 6, "0x%02X ", buf[i]);
+                    }
+                }
+                buf += val;
+            } else {
+                buf = nullptr;
+            }
+        } else {
+            // nothing the board would have let through
+            out += "<?>";
+            continue;
+        }
+        if (!buf) {
+            // cut short for want of room in the record
+            short_of_args = true;
+            out += "<?>";
+            continue;
+        }
+        out += text;
+    }
+    return out;
+}
+
+const char* log_level_name(uint8_t level) {
+    switch (level) {
+    case LOG_LEVEL_ERROR:
+        return "ERROR";
+    case LOG_LEVEL_WARN:
+        return "WARN";
+    case LOG_LEVEL_INFO:
+        return "INFO";
+    case LOG_LEVEL_DEBUG:
+        return "DEBUG";
+    }
+    return "?";
+}
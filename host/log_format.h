@@ -0,0 +1,42 @@
+/**
+ * Turning the boards' deferred log records (see src/core/log.h) back into
+ * text.
+ *
+ * A record only says where its format string is in the firmware, so the
+ * strings are read out of the ELF file the board was flashed with, the
+ * sender.elf or receiver.elf next to the .uf2. It has to be that exact build,
+ * any other and the addresses will point at the wrong strings, or at none.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+class LogStrings {
+public:
+    // the loaded sections of a 32 or 64 bit ELF file, false if it isn't one
+    bool load_elf(const char* path);
+    // a string at a known address, e.g. when the logging's in this process
+    void add(uint64_t addr, const char* fmt);
+
+    // the string at addr, nullptr if there isn't one
+    const char* find(uint64_t addr) const;
+
+private:
+    struct Section {
+        uint64_t addr;
+        size_t offset; // into image
+        size_t size;
+    };
+    std::vector<char> image;
+    std::vector<Section> sections;
+    std::map<uint64_t, std::string> added;
+};
+
+// fmt filled in with the arguments from a log record, as printf would have
+std::string log_format(const char* fmt, const uint8_t* args, size_t len);
+
+const char* log_level_name(uint8_t level);
@@ -0,0 +1,246 @@
+#include "wal.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hostlink.h"
+
+static void segment_name(char* buf, size_t buflen, uint32_t seq) {
+    snprintf(buf, buflen, "wal-%08u.log", seq);
+}
+
+static bool read_file(int dir_fd, const char* name, std::vector<uint8_t>& out) {
+    int fd = openat(dir_fd, name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    out.clear();
+    uint8_t buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        out.insert(out.end(), buf, buf + n);
+    }
+    ::close(fd);
+    return n == 0;
+}
+
+static bool write_all(int fd, const uint8_t* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+std::vector<uint32_t> wal_list_segments(const char* dir) {
+    std::vector<uint32_t> segments;
+    DIR* d = opendir(dir);
+    if (!d) {
+        return segments;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d))) {
+        unsigned int seq;
+        char tail;
+        if (sscanf(ent->d_name, "wal-%8u.lo%c", &seq, &tail) == 2 && tail == 'g') {
+            segments.push_back(seq);
+        }
+    }
+    closedir(d);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+size_t wal_valid_length(const uint8_t* data, size_t len) {
+    size_t pos = 0;
+    while (len - pos >= WAL_ENTRY_HEADER) {
+        uint16_t reclen, crc;
+        deserialise_u16(data + pos, &reclen);
+        deserialise_u16(data + pos + 2, &crc);
+        if (len - pos - WAL_ENTRY_HEADER < reclen
+                || crc != crc16_ccitt(data + pos + 4, 8 + reclen)) {
+            break;
+        }
+        pos += WAL_ENTRY_HEADER + reclen;
+    }
+    return pos;
+}
+
+WalWriter::~WalWriter() {
+    close();
+}
+
+bool WalWriter::open(const char* dir, size_t segment_bytes) {
+    close();
+    segment_limit = segment_bytes;
+    mkdir(dir, 0755);
+    dir_fd = ::open(dir, O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) {
+        return false;
+    }
+
+    std::vector<uint32_t> segments = wal_list_segments(dir);
+    if (segments.empty()) {
+        return open_segment(1, true);
+    }
+
+    // carry on from the end of the last segment, less anything torn
+    uint32_t seq = segments.back();
+    char name[32];
+    segment_name(name, sizeof(name), seq);
+    std::vector<uint8_t> data;
+    if (!read_file(dir_fd, name, data) || !open_segment(seq, false)) {
+        return false;
+    }
+    size_t valid = wal_valid_length(data.data(), data.size());
+    torn = data.size() - valid;
+    if (torn && (ftruncate(fd, valid) != 0 || fdatasync(fd) != 0)) {
+        return false;
+    }
+    segment_size = valid;
+    lseek(fd, valid, SEEK_SET);
+    return true;
+}
+
+bool WalWriter::open_segment(uint32_t seq, bool create) {
+    char name[32];
+    segment_name(name, sizeof(name), seq);
+    fd = openat(dir_fd, name, O_WRONLY | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (fd < 0) {
+        return false;
+    }
+    segment_seq = seq;
+    segment_size = 0;
+    // make sure the new file itself survives a crash
+    return !create || fsync(dir_fd) == 0;
+}
+
+void WalWriter::close() {
+    if (fd >= 0) {
+        commit();
+        ::close(fd);
+        fd = -1;
+    }
+    if (dir_fd >= 0) {
+        ::close(dir_fd);
+        dir_fd = -1;
+    }
+}
+
+void WalWriter::append(uint64_t host_ms, const uint8_t* record, size_t len) {
+    size_t start = buffer.size();
+    buffer.resize(start + WAL_ENTRY_HEADER + len);
+    uint8_t* entry = &buffer[start];
+    serialise_u16(entry, len);
+    serialise_u32(entry + 4, host_ms >> 32);
+    serialise_u32(entry + 8, (uint32_t)host_ms);
+    memcpy(entry + WAL_ENTRY_HEADER, record, len);
+    serialise_u16(entry + 2, crc16_ccitt(entry + 4, 8 + len));
+    pending_entries++;
+}
+
+bool WalWriter::commit() {
+    if (pending_entries == 0) {
+        return true;
+    }
+    if (fd < 0) {
+        errno = EBADF;
+        return false;
+    }
+    // entries never straddle segments, but one segment can go over the
+    // limit by a commit's worth rather than split a commit
+    if (segment_size > 0 && segment_size + buffer.size() > segment_limit) {
+        ::close(fd);
+        if (!open_segment(segment_seq + 1, true)) {
+            return false;
+        }
+    }
+    if (!write_all(fd, buffer.data(), buffer.size())) {
+        // don't leave half a commit in there to be written after
+        int err = errno;
+        if (ftruncate(fd, segment_size) == 0) {
+            lseek(fd, segment_size, SEEK_SET);
+        }
+        errno = err;
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (fdatasync(fd) != 0) {
+        return false;
+    }
+    total_sync_us += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    segment_size += buffer.size();
+    committed_entries += pending_entries;
+    commit_count++;
+    pending_entries = 0;
+    buffer.clear();
+    return true;
+}
+
+bool WalReader::open(const char* dir, uint32_t from_segment, size_t from_offset) {
+    this->dir = dir;
+    segments = wal_list_segments(dir);
+    segment_idx = 0;
+    while (segment_idx < segments.size() && segments[segment_idx] < from_segment) {
+        segment_idx++;
+    }
+    data.clear();
+    pos = 0;
+    if (segment_idx >= segments.size() || !load_segment()) {
+        return false;
+    }
+    if (segments[segment_idx] == from_segment) {
+        pos = std::min(from_offset, data.size());
+    }
+    return true;
+}
+
+bool WalReader::load_segment() {
+    char name[32];
+    segment_name(name, sizeof(name), segments[segment_idx]);
+    int dir_fd = ::open(dir, O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) {
+        return false;
+    }
+    bool ok = read_file(dir_fd, name, data);
+    ::close(dir_fd);
+    data.resize(wal_valid_length(data.data(), data.size()));
+    pos = 0;
+    return ok;
+}
+
+bool WalReader::next(uint64_t* host_ms, const uint8_t** record, size_t* len) {
+    while (pos >= data.size()) {
+        // stay at the end of the last one for position()
+        if (segment_idx + 1 >= segments.size()) {
+            return false;
+        }
+        segment_idx++;
+        if (!load_segment()) {
+            return false;
+        }
+    }
+    uint16_t reclen;
+    uint32_t hi, lo;
+    deserialise_u16(&data[pos], &reclen);
+    deserialise_u32(&data[pos + 4], &hi);
+    deserialise_u32(&data[pos + 8], &lo);
+    *host_ms = (uint64_t)hi << 32 | lo;
+    *record = &data[pos + WAL_ENTRY_HEADER];
+    *len = reclen;
+    pos += WAL_ENTRY_HEADER + reclen;
+    return true;
+}
@@ -0,0 +1,91 @@
+/**
+ * Append-only write-ahead log of the records the receiver sends the host.
+ *
+ * The log is a directory of segment files, wal-00000001.log and so on, each
+ * just a run of entries
+ *
+ *   length (u16): of the record
+ *   crc (u16): CRC-16/CCITT of the host time and the record
+ *   host time (u64): unix ms when the host got the record
+ *   record: as sent by the receiver, crc and all, see hostlink.h
+ *
+ * all big-endian. Entries are buffered by append() and written and synced to
+ * disk in one go by commit(), so the cost of the fsync is shared by however
+ * many came in since the last one. A crash can leave a torn entry at the end
+ * of the last segment, that's found by its CRC and cut off when the log is
+ * next opened for writing.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+static const size_t WAL_ENTRY_HEADER = 2 + 2 + 8;
+static const size_t WAL_SEGMENT_BYTES = 64 * 1024 * 1024;
+
+class WalWriter {
+public:
+    ~WalWriter();
+
+    // open (creating if need be) the log in dir, false with errno set if not
+    bool open(const char* dir, size_t segment_bytes = WAL_SEGMENT_BYTES);
+    void close();
+
+    void append(uint64_t host_ms, const uint8_t* record, size_t len);
+    // write out and sync everything appended, false with errno set on error
+    bool commit();
+
+    size_t pending() const { return pending_entries; }
+    uint64_t entries() const { return committed_entries; }
+    uint64_t commits() const { return commit_count; }
+    uint64_t sync_us() const { return total_sync_us; } // time spent syncing
+    // bytes cut off the end when the log was opened
+    size_t torn_bytes() const { return torn; }
+
+private:
+    bool open_segment(uint32_t seq, bool create);
+
+    int dir_fd = -1;
+    int fd = -1;
+    uint32_t segment_seq = 0;
+    size_t segment_size = 0;
+    size_t segment_limit = WAL_SEGMENT_BYTES;
+    std::vector<uint8_t> buffer;
+    size_t pending_entries = 0;
+    uint64_t committed_entries = 0;
+    uint64_t commit_count = 0;
+    uint64_t total_sync_us = 0;
+    size_t torn = 0;
+};
+
+/**
+ * Reads a log back, oldest entry first, stopping at the first torn or
+ * damaged entry in each segment.
+ */
+class WalReader {
+public:
+    // start from the beginning, or from a position() saved earlier
+    bool open(const char* dir, uint32_t from_segment = 0, size_t from_offset = 0);
+
+    // false at the end of the log
+    bool next(uint64_t* host_ms, const uint8_t** record, size_t* len);
+
+    // where the next entry will come from, to carry on from later
+    uint32_t segment() const { return segment_idx < segments.size() ? segments[segment_idx] : 0; }
+    size_t offset() const { return pos; }
+
+private:
+    bool load_segment();
+
+    const char* dir = nullptr;
+    std::vector<uint32_t> segments;
+    size_t segment_idx = 0;
+    std::vector<uint8_t> data;
+    size_t pos = 0;
+};
+
+// the sequence numbers of the segments in dir, in order
+std::vector<uint32_t> wal_list_segments(const char* dir);
+// how many bytes from the start of a segment are whole, good entries
+size_t wal_valid_length(const uint8_t* data, size_t len);
@@ -0,0 +1,62 @@
+#include "adc.h"
+
+AdcReading adc_filter_samples(const uint16_t* samples, const AdcStats& stats) {
+    AdcReading reading = { 0.0f, 0 };
+    if ( stats.count == 0 ) {
+        return reading;
+    }
+
+    // Everything is scaled up by the sample count n to stay in integers:
+    //   n^2 * variance = n * sum(x^2) - sum(x)^2
+    //   n * (x - mean) = n * x - sum(x)
+    // so |x - mean| > 3 sd becomes (n * x - sum)^2 > 9 * n^2 * variance
+    const int64_t n = stats.count;
+    const uint64_t var_n2 = n * stats.sum_sq - (uint64_t)stats.sum * stats.sum;
+    const uint64_t limit = 9 * var_n2;
+
+    uint32_t kept_sum = 0;
+    uint32_t kept = 0;
+    for ( uint32_t i = 0; i < stats.count; ++i ) {
+        int64_t dev = n * samples[i] - (int64_t)stats.sum;
+        if ( (uint64_t)(dev * dev) > limit ) {
+            reading.rejected++;
+        } else {
+            kept_sum += samples[i];
+            kept++;
+        }
+    }
+
+    // convert the average of remaining values to pin voltage, there is
+    // always at least one sample within 3 sd of the mean so kept is never 0
+    reading.volts = ((float)kept_sum / kept) * ADC_VOLTS_PER_COUNT;
+    return reading;
+}
+
+void adc_deinterleave(const uint16_t* raw, unsigned int nch, unsigned int rounds, uint16_t* const* per_channel, AdcStats* stats) {
+    for ( unsigned int r = 0; r < rounds; ++r ) {
+        for ( unsigned int ch = 0; ch < nch; ++ch ) {
+            uint16_t val = *raw++;
+            per_channel[ch][r] = val;
+            stats[ch].add( val );
+        }
+    }
+}
+
+float readADCVoltage( AdcChannels& adc, unsigned int channel ) {
+    return adc_sample<ADC_SAMPLE_COUNT>( adc, channel ).volts;
+}
+
+// values from RP2350 documentation
+float adc_volts_to_mcu_temp( float volts ) {
+    return 27.0 - ((volts - 0.706) / 0.001721);
+}
+
+// measured values of the voltage divider on the battery sense line
+float adc_volts_to_vbat( float volts ) {
+    return (volts * (98600 + 149100)) / 149100;
+}
+
+// measured values of the voltage divider on the supply sense line
+float adc_volts_to_vin( float volts ) {
+    return (volts * (98600 + 14890)) / 14890;
+}
@@ -0,0 +1,131 @@
+/**
+ * ADC sampling and conversion of raw readings to useful units.
+ */
+#pragma once
+
+#include <cstdint>
+#include "hal.h"
+#include "profile.h"
+
+// The number of times to take an ADC reading to get an average ADC reading,
+// can be overridden at build time
+#ifndef HORTITEL_ADC_SAMPLE_COUNT
+#define HORTITEL_ADC_SAMPLE_COUNT 16
+#endif
+static const unsigned int ADC_SAMPLE_COUNT = HORTITEL_ADC_SAMPLE_COUNT;
+
+// ADC channels used on the Perpetuo board
+static const unsigned int ADC_CHANNEL_VBAT = 0; // GPIO 26, battery voltage sense
+static const unsigned int ADC_CHANNEL_VIN = 1; // GPIO 27, supply voltage sense
+static const unsigned int ADC_CHANNEL_TEMP = 4; // RP2350 internal temperature sensor
+
+// full scale of the 12 bit ADC against the 3.3V reference
+static const float ADC_VOLTS_PER_COUNT = 3.3f / (1 << 12);
+
+/**
+ * Running integer sums over a set of raw samples, enough to get the mean
+ * and variance without a second pass or any floating point.
+ */
+struct AdcStats {
+    uint32_t count = 0;
+    uint32_t sum = 0;
+    uint64_t sum_sq = 0;
+
+    void add(uint16_t val) {
+        count++;
+        sum += val;
+        sum_sq += (uint32_t)val * val;
+    }
+};
+
+struct AdcReading {
+    float volts; // average pin voltage of the samples that passed the filter
+    uint16_t rejected; // number of samples thrown out as outliers
+};
+
+/**
+ * Average a set of raw samples after dropping any more than 3 standard
+ * deviations from the mean. stats must have been accumulated over exactly
+ * these samples.
+ */
+AdcReading adc_filter_samples(const uint16_t* samples, const AdcStats& stats);
+
+/**
+ * Take N readings of an ADC channel and filter them as above. The samples
+ * live on the stack and the stats are gathered as they're read, so this
+ * doesn't allocate and only goes over the samples once more to filter them.
+ */
+template <unsigned int N>
+AdcReading adc_sample(AdcChannels& adc, unsigned int channel) {
+    static_assert(N > 0 && N <= 4096, "ADC sample count must be 1-4096");
+
+    uint16_t samples[N];
+    AdcStats stats;
+    adc.select_input( channel );
+    for ( unsigned int i = 0; i < N; ++i ) {
+        samples[i] = adc.read();
+        stats.add( samples[i] );
+    }
+    return adc_filter_samples( samples, stats );
+}
+
+/**
+ * Split round-robin samples of nch channels back out into one buffer per
+ * channel, gathering the stats for each as we go. per_channel[i] and
+ * stats[i] are for the i'th lowest channel number in the capture.
+ */
+void adc_deinterleave(const uint16_t* raw, unsigned int nch, unsigned int rounds, uint16_t* const* per_channel, AdcStats* stats);
+
+/**
+ * Sample all the given channels N times in a single round-robin burst (by
+ * DMA on the boards, so the CPU can sleep through it) and filter each as per
+ * adc_sample(). out[i] is the reading for channels[i]. The capture and the
+ * filtering are timed separately into profiler if there is one.
+ */
+template <unsigned int N, unsigned int C>
+void adc_sample_burst(AdcChannels& adc, const unsigned int (&channels)[C], AdcReading (&out)[C],
+        Profiler* profiler = nullptr) {
+    static_assert(N > 0 && N <= 4096, "ADC sample count must be 1-4096");
+
+    uint32_t mask = 0;
+    for ( unsigned int i = 0; i < C; ++i ) {
+        mask |= 1u << channels[i];
+    }
+    const unsigned int nch = __builtin_popcount( mask );
+
+    uint16_t raw[N * C];
+    ProfileSpan capture( profiler, PROFILE_ADC );
+    adc.capture_round_robin( mask, raw, N );
+    capture.end();
+    ProfileSpan filter( profiler, PROFILE_FILTER );
+
+    uint16_t samples[C][N];
+    uint16_t* per_channel[C];
+    AdcStats stats[C];
+    for ( unsigned int i = 0; i < nch; ++i ) {
+        per_channel[i] = samples[i];
+    }
+    adc_deinterleave( raw, nch, N, per_channel, stats );
+
+    // the capture is in channel order, find where each requested one ended up
+    for ( unsigned int i = 0; i < C; ++i ) {
+        unsigned int slot = __builtin_popcount( mask & ((1u << channels[i]) - 1) );
+        out[i] = adc_filter_samples( samples[slot], stats[slot] );
+    }
+}
+
+/**
+ * Read a given ADC value, returns a voltage value.
+ *
+ * Actually reads ADC_SAMPLE_COUNT values and returns an average after an
+ * outlier elimination filter. I don't know how necessary this is on the
+ * RP2350 platform, but also it probably doesn't hurt aside from a little
+ * more power usage I guess.
+ */
+float readADCVoltage( AdcChannels& adc, unsigned int channel );
+
+// Conversions from ADC pin voltage, see the comments in adc.cpp for where
+// the constants come from
+float adc_volts_to_mcu_temp( float volts );
+float adc_volts_to_vbat( float volts );
+float adc_volts_to_vin( float volts );
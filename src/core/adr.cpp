@@ -0,0 +1,134 @@
+#include "adr.h"
+
+#include "frame.h"
+
+int adr_sensitivity_dbm(RadioSpreadingFactor sf, RadioBandwidth bw) {
+    // SX1272 datasheet figures at 125kHz, each doubling of the bandwidth
+    // costs 3dB
+    static const int sf_sensitivity[] = { -124, -127, -130, -133, -135, -137 };
+    int dbm = sf_sensitivity[sf - RADIO_SF_7];
+    if (bw == RADIO_BW_250) {
+        dbm += 3;
+    } else if (bw == RADIO_BW_500) {
+        dbm += 6;
+    }
+    return dbm;
+}
+
+size_t serialise_link_feedback(const struct LinkFeedback* fb, uint16_t dest, uint8_t* buf) {
+    uint8_t* bufptr = buf;
+    bufptr = serialise_u16(bufptr, 0);
+    bufptr = serialise_u16(bufptr, dest);
+    bufptr = serialise_u8(bufptr, PAYLOAD_FORMAT_LINK);
+    bufptr = serialise_u16(bufptr, (uint16_t)fb->rssi);
+    bufptr = serialise_u16(bufptr, (uint16_t)fb->rssi_min);
+    bufptr = serialise_u16(bufptr, fb->heard);
+    return bufptr - buf;
+}
+
+bool deserialise_link_feedback(const uint8_t* buf, size_t len, struct LinkFeedback* fb) {
+    // the received data header, then our payload without the options and
+    // dest, then the checksum
+    if (len != RXDATA_HEADER_SIZE + LINK_FEEDBACK_SIZE - 4 + 1 || buf[2] != EMB_RX_DATA) {
+        return false;
+    }
+    uint16_t length;
+    deserialise_u16(buf, &length);
+    if (length != len || buf[len - 1] != emb_checksum(buf, len - 1)
+            || buf[RXDATA_HEADER_SIZE] != PAYLOAD_FORMAT_LINK) {
+        return false;
+    }
+    const uint8_t* bufptr = buf + RXDATA_HEADER_SIZE + 1;
+    bufptr = deserialise_i16(bufptr, &fb->rssi);
+    bufptr = deserialise_i16(bufptr, &fb->rssi_min);
+    deserialise_u16(bufptr, &fb->heard);
+    return true;
+}
+
+void LinkMonitor::heard(uint16_t src, int16_t rssi) {
+    LinkStats* stats = table.get(src);
+    if (!stats) {
+        return;
+    }
+    if (!stats->have_rssi) {
+        stats->rssi_x16 = rssi * 16;
+        stats->rssi_min = rssi;
+        stats->have_rssi = true;
+    } else {
+        // moving average over about the last eight
+        stats->rssi_x16 += rssi * 2 - stats->rssi_x16 / 8;
+        if (rssi < stats->rssi_min) {
+            stats->rssi_min = rssi;
+        }
+    }
+    stats->heard++;
+}
+
+bool LinkMonitor::feedback(uint16_t src, struct LinkFeedback* fb) {
+    LinkStats* stats = table.find(src);
+    if (!stats || !stats->have_rssi) {
+        return false;
+    }
+    fb->rssi = (int16_t)((stats->rssi_x16 + (stats->rssi_x16 < 0 ? -8 : 8)) / 16);
+    fb->rssi_min = stats->rssi_min;
+    fb->heard = stats->heard;
+    // the next minimum starts from where things are now, so it's never
+    // left with nothing in it
+    stats->rssi_min = fb->rssi;
+    return true;
+}
+
+void AdrController::sent(bool check) {
+    sent_count++;
+    if (check) {
+        sent_at_check = sent_count;
+    }
+}
+
+bool AdrController::set_power(int power) {
+    if (power < ADR_POWER_MIN) {
+        power = ADR_POWER_MIN;
+    } else if (power > ADR_POWER_MAX) {
+        power = ADR_POWER_MAX;
+    }
+    if (power == tx_power) {
+        return false;
+    }
+    tx_power = (uint8_t)power;
+    return true;
+}
+
+bool AdrController::feedback(const struct LinkFeedback& fb) {
+    misses = 0;
+    // anything lost since the last answer? Counts wrap, and if the
+    // receiver has restarted its count goes backwards, just start again
+    // from here then.
+    uint16_t sent_delta = sent_at_check - base_sent;
+    uint16_t heard_delta = fb.heard - base_heard;
+    bool lossy = have_baseline && heard_delta <= sent_delta
+            && (uint32_t)heard_delta * 4 < (uint32_t)sent_delta * 3;
+    have_baseline = true;
+    base_sent = sent_at_check;
+    base_heard = fb.heard;
+
+    // go by the weakest it's been lately, a single strong packet doesn't
+    // mean it'll always get through
+    last_margin = fb.rssi_min - adr_sensitivity_dbm(sf, bw) - ADR_TARGET_MARGIN_DB;
+    if (lossy) {
+        return set_power(tx_power + (last_margin < 0 ? -last_margin : 0) + ADR_BACKOFF_DB);
+    }
+    if (last_margin < 0 || last_margin >= ADR_HYSTERESIS_DB) {
+        return set_power(tx_power - last_margin);
+    }
+    return false;
+}
+
+bool AdrController::missed() {
+    if (misses < ADR_MISSES_TO_MAX) {
+        misses++;
+    }
+    if (misses >= ADR_MISSES_TO_MAX) {
+        return set_power(ADR_POWER_MAX);
+    }
+    return set_power(tx_power + ADR_BACKOFF_DB);
+}
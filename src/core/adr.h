@@ -0,0 +1,113 @@
+/**
+ * Adaptive transmit power, driven by what the receiver hears.
+ *
+ * Every so often a sender marks an uplink as a link check (the
+ * PAYLOAD_FLAG_LISTENING bit on its format byte) and keeps its radio awake
+ * for a moment afterwards. The receiver answers it with a LinkFeedback
+ * downlink: how strongly it has been hearing that node, and how many of its
+ * packets it has heard in all. From that the sender works out how much
+ * margin it has over what the receiver can still make out at the current
+ * spreading factor, and turns its power down until it's left with
+ * ADR_TARGET_MARGIN_DB, or back up again if it hasn't got that. Losing
+ * packets, or not getting an answer at all, pushes it back up regardless,
+ * so a node that's fallen off the edge finds its way back.
+ *
+ * Unlike LoRaWAN gateways the receiver's module only listens at the one
+ * spreading factor it's set to, so that stays the same for the whole
+ * network and it's just the power each sender uses that's adapted.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "hal.h"
+#include "node_table.h"
+#include "packet.h"
+
+// dB above the receiver's sensitivity we aim to keep, against fading, wet
+// leaves and the like
+static const int ADR_TARGET_MARGIN_DB = 10;
+// don't turn down for less than this, so it isn't forever fiddling
+static const int ADR_HYSTERESIS_DB = 3;
+// a step up on losing packets or hearing nothing back
+static const int ADR_BACKOFF_DB = 3;
+// link checks in a row with no answer before going straight to full power
+static const uint8_t ADR_MISSES_TO_MAX = 2;
+// the module's output power range, dBm
+static const uint8_t ADR_POWER_MIN = 2;
+static const uint8_t ADR_POWER_MAX = 14;
+
+// what the receiver can just about make out, dBm
+int adr_sensitivity_dbm(RadioSpreadingFactor sf, RadioBandwidth bw);
+
+// the receiver's answer to a link check
+struct LinkFeedback {
+    int16_t rssi; // smoothed RSSI of the sender's packets, dBm
+    int16_t rssi_min; // weakest since the last feedback
+    uint16_t heard; // packets heard from the sender since boot, wraps
+};
+
+// options, dest, format and the feedback, ready for transmitData()
+static const size_t LINK_FEEDBACK_SIZE = 4 + 1 + 6;
+
+size_t serialise_link_feedback(const struct LinkFeedback* fb, uint16_t dest, uint8_t* buf);
+// decode a received data frame holding feedback, false if it isn't one
+bool deserialise_link_feedback(const uint8_t* buf, size_t len, struct LinkFeedback* fb);
+
+/**
+ * The receiver's side, how well it's hearing each node.
+ */
+class LinkMonitor {
+public:
+    // a packet from src arrived at rssi
+    void heard(uint16_t src, int16_t rssi);
+    // the feedback for src, starting a new rssi_min, false if we've no
+    // record of it
+    bool feedback(uint16_t src, struct LinkFeedback* fb);
+
+    size_t nodes() const { return table.size(); }
+
+private:
+    struct LinkStats {
+        int32_t rssi_x16; // smoothed, in 1/16 dB
+        int16_t rssi_min;
+        uint16_t heard;
+        bool have_rssi;
+    };
+    NodeTable<LinkStats> table;
+};
+
+/**
+ * The sender's side, picking the power to transmit at.
+ */
+class AdrController {
+public:
+    AdrController(RadioSpreadingFactor sf, RadioBandwidth bw, uint8_t power)
+        : sf(sf), bw(bw), tx_power(power) {}
+
+    // an uplink went out, check is whether it asked for feedback
+    void sent(bool check);
+    // the answer to the last check, true if the power should change
+    bool feedback(const struct LinkFeedback& fb);
+    // no answer to the last check, true if the power should change
+    bool missed();
+
+    uint8_t power() const { return tx_power; }
+    // margin over the target at the last feedback, dB
+    int margin() const { return last_margin; }
+
+private:
+    bool set_power(int power);
+
+    RadioSpreadingFactor sf;
+    RadioBandwidth bw;
+    uint8_t tx_power;
+    uint16_t sent_count = 0;
+    uint16_t sent_at_check = 0;
+    // what was sent and heard as of the last answered check
+    bool have_baseline = false;
+    uint16_t base_sent = 0;
+    uint16_t base_heard = 0;
+    uint8_t misses = 0;
+    int last_margin = 0;
+};
@@ -0,0 +1,69 @@
+#include "aggregate.h"
+
+#include <cstdio>
+
+void SummaryTable::add(NodeSummary& node, const struct sensor_record& rec) {
+    node.count++;
+    for (size_t i = 0; i < SENSOR_FIELD_COUNT; i++) {
+        if (!(rec.present & (1u << i))) {
+            continue;
+        }
+        FieldSummary& f = node.fields[i];
+        int64_t val = schema_get_wire(SENSOR_FIELDS[i], &rec);
+        if (f.count == 0 || val < f.min) {
+            f.min = val;
+        }
+        if (f.count == 0 || val > f.max) {
+            f.max = val;
+        }
+        f.sum += val;
+        f.last = val;
+        f.count++;
+    }
+}
+
+void NodeSummary::values(HostlinkSummaryStat stat, struct sensor_record* out) const {
+    *out = {};
+    for (size_t i = 0; i < SENSOR_FIELD_COUNT; i++) {
+        const FieldSummary& f = fields[i];
+        if (f.count == 0) {
+            continue;
+        }
+        int64_t val = f.last;
+        if (stat == HOSTLINK_STAT_MIN) {
+            val = f.min;
+        } else if (stat == HOSTLINK_STAT_MAX) {
+            val = f.max;
+        } else if (stat == HOSTLINK_STAT_MEAN) {
+            // rounded half away from zero
+            int64_t half = f.count / 2;
+            val = (f.sum >= 0 ? f.sum + half : f.sum - half) / (int64_t)f.count;
+        }
+        schema_set_wire(SENSOR_FIELDS[i], out, val);
+        out->present |= 1u << i;
+    }
+}
+
+void print_summary(uint16_t src, const NodeSummary& summary, uint32_t period_ms) {
+    struct sensor_record stats[HOSTLINK_STATS];
+    for (size_t s = 0; s < HOSTLINK_STATS; s++) {
+        summary.values((HostlinkSummaryStat)s, &stats[s]);
+    }
+    printf( "Summary for 0x%04X, %lu readings over %lu s:\n", src, (unsigned long)summary.count,
+            (unsigned long)(period_ms / 1000) );
+    for (size_t i = 0; i < SENSOR_FIELD_COUNT; i++) {
+        if (!(stats[0].present & (1u << i))) {
+            continue;
+        }
+        const FieldDesc& field = SENSOR_FIELDS[i];
+        printf( "  %s:", field.name );
+        for (size_t s = 0; s < HOSTLINK_STATS; s++) {
+            if (field.type == FIELD_FLOAT) {
+                printf( " %s %0.2f", hostlink_stat_name((HostlinkSummaryStat)s), schema_get_float(field, &stats[s]) );
+            } else {
+                printf( " %s %lld", hostlink_stat_name((HostlinkSummaryStat)s), (long long)schema_get_wire(field, &stats[s]) );
+            }
+        }
+        printf( "%s\n", field.unit );
+    }
+}
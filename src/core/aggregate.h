@@ -0,0 +1,111 @@
+/**
+ * Receiver-side summaries of each node's readings.
+ *
+ * A dashboard showing the last week doesn't need every 5 second sample from
+ * every node, so the receiver can boil them down itself: for each node, over
+ * each period (a minute, an hour, ...) the min, max, mean and last value of
+ * each field, plus how many readings went into it. Periods are on the
+ * receiver's clock, aligned to multiples of the period, so every node's
+ * summaries for a period come out together. A node that wasn't heard from in
+ * a period doesn't get one.
+ *
+ * Each reading counts towards the period it was taken in, which for a batch
+ * (or a packet held up by a relay) can be well before it arrived, so the
+ * readings have to be added oldest first. One from an earlier period than
+ * the node's current one is too late: it's left out, and counted. If that
+ * node's period has already gone out and nothing's come in since, a late
+ * reading starts its own period. That period gets another summary, so the
+ * host can get more than one for the same node and period, each with its own
+ * count.
+ *
+ * Everything is kept as the values go over the air (see schema_get_wire()),
+ * so it's all integer sums in a fixed table, and a mean is exact to the
+ * field's resolution.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "hostlink.h"
+#include "node_table.h"
+#include "packet.h"
+
+struct FieldSummary {
+    uint32_t count;
+    int64_t min;
+    int64_t max;
+    int64_t sum;
+    int64_t last;
+};
+
+struct NodeSummary {
+    uint32_t start_ms; // when the period began, it ends start_ms + period
+    uint32_t count; // readings in it
+    FieldSummary fields[SENSOR_FIELD_COUNT];
+
+    // one of the statistics for every field that had a reading, as a record
+    void values(HostlinkSummaryStat stat, struct sensor_record* out) const;
+};
+
+class SummaryTable {
+public:
+    SummaryTable(uint32_t period_ms) : period_ms(period_ms) {}
+
+    uint32_t period() const { return period_ms; }
+
+    /**
+     * A reading from src taken at time_ms. If it's from a later period than
+     * that node's current one, the current one is passed to emit(src,
+     * summary) first, and a new one started. If it's from an earlier one it's
+     * late, see above.
+     */
+    template <typename Emit>
+    void add(uint16_t src, const struct sensor_record& rec, uint32_t time_ms, Emit emit) {
+        NodeSummary* node = table.get(src);
+        if (!node) {
+            return;
+        }
+        if (node->count && over(*node, time_ms)) {
+            emit(src, (const NodeSummary&)*node);
+            node->count = 0;
+        }
+        if (node->count && (int32_t)(time_ms - node->start_ms) < 0) {
+            late_count++;
+            return;
+        }
+        if (node->count == 0) {
+            *node = {};
+            node->start_ms = time_ms - time_ms % period_ms;
+        }
+        add(*node, rec);
+    }
+
+    // hand every period that's over by now_ms to emit(src, summary)
+    template <typename Emit>
+    void close_due(uint32_t now_ms, Emit emit) {
+        table.for_each([&](uint16_t src, NodeSummary& node) {
+            if (node.count && over(node, now_ms)) {
+                emit(src, (const NodeSummary&)node);
+                node.count = 0;
+            }
+        });
+    }
+
+    // readings from nodes that didn't fit in the table
+    uint32_t untracked() const { return table.overflowed(); }
+    // and that came too late for their period
+    uint32_t late() const { return late_count; }
+
+private:
+    bool over(const NodeSummary& node, uint32_t now_ms) const {
+        return (int32_t)(now_ms - node.start_ms) >= (int32_t)period_ms;
+    }
+    static void add(NodeSummary& node, const struct sensor_record& rec);
+
+    uint32_t period_ms;
+    uint32_t late_count = 0;
+    NodeTable<NodeSummary> table;
+};
+
+// the summary as text, for the receiver's console
+void print_summary(uint16_t src, const NodeSummary& summary, uint32_t period_ms);
@@ -0,0 +1,172 @@
+#include "batch.h"
+
+#include <cstring>
+
+bool SampleBatch::add(const struct sensor_record& rec, uint32_t time_ms) {
+    if (full()) {
+        return false;
+    }
+    samples[n] = rec;
+    times[n] = time_ms;
+    n++;
+
+    // leaving room for the packet fields
+    uint8_t scratch[BATCH_MAX_PAYLOAD + BATCH_MAX_SAMPLES * SCHEMA_MAX_FIELD_SIZE * (SENSOR_FIELD_COUNT + 1)];
+    if (encode(time_ms, scratch) + PACKET_META_MAX_SIZE > BATCH_MAX_PAYLOAD) {
+        n--;
+        return false;
+    }
+    return true;
+}
+
+size_t SampleBatch::encode(uint32_t now_ms, uint8_t* buf, const struct packet_meta* meta) const {
+    uint8_t* bufptr = serialise_u8(buf, PAYLOAD_FORMAT_BATCH);
+    bufptr = serialise_u8(bufptr, n);
+    if (n == 0) {
+        return bufptr - buf;
+    }
+
+    // sample ages, delta of delta
+    int64_t prev_age = now_ms - times[0];
+    int64_t prev_delta = 0;
+    bufptr = varint_put(bufptr, prev_age);
+    for (size_t i = 1; i < n; i++) {
+        int64_t age = now_ms - times[i];
+        int64_t delta = age - prev_age;
+        bufptr = varint_put(bufptr, zigzag_encode(delta - prev_delta));
+        prev_age = age;
+        prev_delta = delta;
+    }
+
+    // only fields every sample has
+    uint32_t mask = SENSOR_ALL_FIELDS;
+    for (size_t i = 0; i < n; i++) {
+        mask &= samples[i].present;
+    }
+
+    for (size_t f = 0; f < SENSOR_FIELD_COUNT; f++) {
+        if (!(mask & (1u << f))) {
+            continue;
+        }
+        const FieldDesc& field = SENSOR_FIELDS[f];
+
+        // encode the column after a gap for its length, then close the gap
+        uint8_t column[BATCH_MAX_SAMPLES * SCHEMA_MAX_FIELD_SIZE];
+        uint8_t* colptr = column;
+        int64_t first = schema_get_wire(field, &samples[0]);
+        colptr = varint_put(colptr, zigzag_encode(first));
+        for (size_t i = 1; i < n; i++) {
+            colptr = varint_put(colptr, zigzag_encode(schema_get_wire(field, &samples[i]) - first));
+        }
+
+        *bufptr++ = (field.tag << 3) | WIRE_BYTES;
+        bufptr = varint_put(bufptr, colptr - column);
+        memcpy(bufptr, column, colptr - column);
+        bufptr += colptr - column;
+    }
+
+    if (meta) {
+        bufptr += serialise_batch_meta(meta, bufptr);
+    }
+    return bufptr - buf;
+}
+
+size_t serialise_batch_meta(const struct packet_meta* meta, uint8_t* buf) {
+    uint8_t* bufptr = buf;
+    for (size_t f = 0; f < PACKET_FIELD_COUNT; f++) {
+        if (!(meta->present & (1u << f))) {
+            continue;
+        }
+        uint8_t column[SCHEMA_MAX_FIELD_SIZE];
+        uint8_t* colptr = varint_put(column, zigzag_encode(schema_get_wire(PACKET_FIELDS[f], meta)));
+        *bufptr++ = (PACKET_FIELDS[f].tag << 3) | WIRE_BYTES;
+        bufptr = varint_put(bufptr, colptr - column);
+        memcpy(bufptr, column, colptr - column);
+        bufptr += colptr - column;
+    }
+    return bufptr - buf;
+}
+
+size_t deserialise_batch(const uint8_t* buf, size_t len, struct sensor_record* out, uint32_t* age_ms, size_t max,
+        struct packet_meta* meta) {
+    const uint8_t* end = buf + len;
+    if (len < 2 || (buf[0] & ~PAYLOAD_FLAG_LISTENING) != PAYLOAD_FORMAT_BATCH) {
+        return 0;
+    }
+    size_t count = buf[1];
+    buf += 2;
+    if (count == 0 || count > max) {
+        return 0;
+    }
+
+    uint64_t val;
+    if (!(buf = varint_get(buf, end, &val))) {
+        return 0;
+    }
+    int64_t age = val;
+    int64_t delta = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            if (!(buf = varint_get(buf, end, &val))) {
+                return 0;
+            }
+            delta += zigzag_decode(val);
+            age += delta;
+        }
+        age_ms[i] = age;
+        out[i].present = 0;
+    }
+
+    while (buf < end) {
+        uint8_t tag = *buf >> 3;
+        uint8_t wire = *buf & 0x07;
+        buf++;
+        if (wire != WIRE_BYTES || !(buf = varint_get(buf, end, &val)) || (uint64_t)(end - buf) < val) {
+            return 0;
+        }
+        const uint8_t* colend = buf + val;
+
+        // unknown columns are skipped
+        for (size_t f = 0; f < SENSOR_FIELD_COUNT; f++) {
+            if (SENSOR_FIELDS[f].tag != tag) {
+                continue;
+            }
+            const uint8_t* colptr = buf;
+            int64_t first = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (!(colptr = varint_get(colptr, colend, &val))) {
+                    return 0;
+                }
+                int64_t v = zigzag_decode(val);
+                if (i == 0) {
+                    first = v;
+                } else {
+                    v += first;
+                }
+                schema_set_wire(SENSOR_FIELDS[f], &out[i], v);
+                out[i].present |= 1u << f;
+            }
+            break;
+        }
+        for (size_t f = 0; meta && f < PACKET_FIELD_COUNT; f++) {
+            if (PACKET_FIELDS[f].tag == tag) {
+                if (!varint_get(buf, colend, &val)) {
+                    return 0;
+                }
+                schema_set_wire(PACKET_FIELDS[f], meta, zigzag_decode(val));
+                meta->present |= 1u << f;
+            }
+        }
+        buf = colend;
+    }
+    return count;
+}
+
+size_t serialise_txbatch(uint16_t options, uint16_t dest, const SampleBatch& batch, uint32_t now_ms, uint8_t* buf,
+        const struct packet_meta* meta) {
+    uint8_t* bufptr = buf;
+    bufptr = serialise_u16(bufptr, options);
+    bufptr = serialise_u16(bufptr, dest);
+    bufptr += batch.encode(now_ms, bufptr, meta);
+    return (bufptr - buf);
+}
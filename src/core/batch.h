@@ -0,0 +1,74 @@
+/**
+ * Batched, delta-compressed multi-sample payloads.
+ *
+ * Rather than one transmission per sample the sender can hold on to a
+ * number of samples and send them in one go, amortising the preamble,
+ * header and module wake-up across all of them. The payload is
+ *
+ *   format (u8): PAYLOAD_FORMAT_BATCH
+ *   count (u8)
+ *   sample ages: the age of the first sample in ms when the batch was
+ *     encoded (varint), then the zig-zag varint delta of delta of the rest,
+ *     so evenly spaced samples cost a byte each
+ *   then a column per field present in every sample:
+ *     key (u8): tag << 3 | WIRE_BYTES
+ *     column length (varint)
+ *     the first sample's value as per the schema (zig-zag varint), then
+ *     each following sample as the zig-zag varint delta against the first
+ *   then a column per packet field (see PACKET_FIELDS), of just the one
+ *     value
+ *
+ * Columns carry their length so a receiver can skip fields it doesn't know,
+ * same as for the single record format. Ages are relative to when the batch
+ * was sent so the sender and receiver clocks needn't agree.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "packet.h"
+
+class SampleBatch {
+public:
+    SampleBatch(size_t capacity = BATCH_MAX_SAMPLES)
+        : capacity(capacity < BATCH_MAX_SAMPLES ? capacity : BATCH_MAX_SAMPLES) {}
+
+    /**
+     * Add a sample taken at time_ms. Returns false, leaving the batch as it
+     * was, if it would no longer encode into BATCH_MAX_PAYLOAD bytes or the
+     * batch is full, in which case send it first.
+     */
+    bool add(const struct sensor_record& rec, uint32_t time_ms);
+
+    size_t count() const { return n; }
+    bool full() const { return n >= capacity; }
+    void clear() { n = 0; }
+
+    // encode as a payload as of now_ms, with meta if given, buf needs
+    // BATCH_MAX_PAYLOAD bytes
+    size_t encode(uint32_t now_ms, uint8_t* buf, const struct packet_meta* meta = nullptr) const;
+
+private:
+    size_t capacity;
+    size_t n = 0;
+    struct sensor_record samples[BATCH_MAX_SAMPLES];
+    uint32_t times[BATCH_MAX_SAMPLES];
+};
+
+// the packet fields in meta->present as the one value columns that end a
+// batch, buf needs PACKET_META_MAX_SIZE
+size_t serialise_batch_meta(const struct packet_meta* meta, uint8_t* buf);
+
+/**
+ * Expand a batch payload (starting at the format byte) back into records,
+ * up to max of them. age_ms[i] is how long before the batch was sent
+ * out[i] was sampled, and the packet fields go in meta if given. Returns
+ * the number of records, or 0 if malformed.
+ */
+size_t deserialise_batch(const uint8_t* buf, size_t len, struct sensor_record* out, uint32_t* age_ms, size_t max,
+        struct packet_meta* meta = nullptr);
+
+// header (options, dest) and batch ready for transmitData(), buf must be
+// TXDATA_MAX_SIZE
+size_t serialise_txbatch(uint16_t options, uint16_t dest, const SampleBatch& batch, uint32_t now_ms, uint8_t* buf,
+        const struct packet_meta* meta = nullptr);
@@ -0,0 +1,46 @@
+/**
+ * Commands typed at the console, put together a line at a time from the
+ * characters as they arrive. Backspace works, anything past the end of the
+ * buffer is dropped.
+ */
+#pragma once
+
+#include <cstddef>
+
+class ConsoleLine {
+public:
+    // add a character, true once it's finished a line, which is then in
+    // line() until the next push()
+    bool push(int c) {
+        if (complete) {
+            len = 0;
+            complete = false;
+        }
+        if (c == '\r' || c == '\n') {
+            // \r\n is one line ending, not an empty line as well
+            if (len == 0 && c == '\n' && last == '\r') {
+                last = c;
+                return false;
+            }
+            last = c;
+            buf[len] = 0;
+            complete = true;
+            return true;
+        }
+        last = c;
+        if ((c == '\b' || c == 0x7f) && len > 0) {
+            len--;
+        } else if (c >= ' ' && c < 0x7f && len < sizeof(buf) - 1) {
+            buf[len++] = (char)c;
+        }
+        return false;
+    }
+
+    const char* line() const { return buf; }
+
+private:
+    char buf[64];
+    size_t len = 0;
+    bool complete = false;
+    int last = 0;
+};
@@ -0,0 +1,63 @@
+#include "emb_command.h"
+
+#include <cstring>
+
+const char* emb_status_str(EmbStatus status) {
+    switch (status) {
+        case EMB_OK: return "OK";
+        case EMB_PENDING: return "pending";
+        case EMB_ERROR: return "error";
+        case EMB_TIMEOUT: return "timeout";
+    }
+    return "?";
+}
+
+// most responses lead with a status byte, 0 is success, the device info
+// response is just the info
+static bool response_has_status(uint8_t cmd) {
+    return cmd != EMB_CMD_DEVICE_INFO;
+}
+
+void EmbCommander::begin(uint8_t cmd, uint32_t timeout_ms) {
+    outstanding = cmd;
+    status = EMB_PENDING;
+    last_response_len = 0;
+    started_us = hal_time_us();
+    deadline_us = started_us + (uint64_t)timeout_ms * 1000;
+}
+
+EmbStatus EmbCommander::poll() {
+    if (radio.checkRxFifo(status == EMB_PENDING ? EMB_POLL_SLICE_MS : 0)) {
+        const uint8_t* data = radio.response();
+        size_t len = radio.responseLen();
+        for (size_t i = 0; i < len; i++) {
+            if (parser.push(data[i])) {
+                handle_frame(parser.frame(), parser.frame_len());
+            }
+        }
+    }
+    if (status == EMB_PENDING && hal_time_us() >= deadline_us) {
+        status = EMB_TIMEOUT;
+        elapsed = hal_time_us() - started_us;
+    }
+    return status;
+}
+
+EmbStatus EmbCommander::wait() {
+    while (poll() == EMB_PENDING) {
+    }
+    return status;
+}
+
+void EmbCommander::handle_frame(const uint8_t* frame, size_t len) {
+    uint8_t type = frame[2];
+    if (status == EMB_PENDING && type == (outstanding | EMB_RESPONSE_FLAG)) {
+        memcpy(last_response, frame, len);
+        last_response_len = len;
+        bool failed = response_has_status(outstanding) && len > EMB_FRAME_OVERHEAD && frame[3] != 0;
+        status = failed ? EMB_ERROR : EMB_OK;
+        elapsed = hal_time_us() - started_us;
+    } else if (unsolicited) {
+        unsolicited(frame, len, unsolicited_ctx);
+    }
+}
@@ -0,0 +1,89 @@
+/**
+ * Response-driven LoRaEMB command completion.
+ *
+ * Rather than sending a command and then sleeping for long enough that the
+ * answer has probably turned up, we note which command is outstanding and
+ * parse whatever the module sends back as it arrives. As soon as the matching
+ * response frame is in we're done, and if nothing turns up within the timeout
+ * we say so rather than carrying on regardless.
+ *
+ * begin()/poll() don't block so other work can carry on while the module is
+ * busy, run() is the blocking version for the simple cases.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "hal.h"
+#include "frame.h"
+
+enum EmbStatus {
+    EMB_OK, // got a response with a success status
+    EMB_PENDING, // still waiting
+    EMB_ERROR, // got a response with a failure status
+    EMB_TIMEOUT, // nothing back in time
+};
+
+const char* emb_status_str(EmbStatus status);
+
+// default timeouts, transmit has to allow for the time on air at SF12
+static const uint32_t EMB_CMD_TIMEOUT_MS = 300;
+static const uint32_t EMB_TX_TIMEOUT_MS = 3000;
+
+// how long each poll() waits on the module for more data
+static const uint32_t EMB_POLL_SLICE_MS = 1;
+
+// called for any complete frame that isn't the response we're waiting for
+typedef void (*EmbFrameHandler)(const uint8_t* frame, size_t len, void* ctx);
+
+class EmbCommander {
+public:
+    EmbCommander(Radio& radio) : radio(radio) {}
+
+    void set_unsolicited_handler(EmbFrameHandler handler, void* ctx) {
+        unsolicited = handler;
+        unsolicited_ctx = ctx;
+    }
+
+    // note cmd as outstanding, the caller then sends it via the Radio
+    void begin(uint8_t cmd, uint32_t timeout_ms = EMB_CMD_TIMEOUT_MS);
+    // check for a response without waiting more than EMB_POLL_SLICE_MS
+    EmbStatus poll();
+    // poll() until the command completes or times out
+    EmbStatus wait();
+
+    /**
+     * Send a command and wait for it to complete, send is whatever actually
+     * sends cmd, e.g. [&]{ radio.stopNetwork(); }
+     */
+    template <typename Fn>
+    EmbStatus run(uint8_t cmd, Fn send, uint32_t timeout_ms = EMB_CMD_TIMEOUT_MS) {
+        begin(cmd, timeout_ms);
+        send();
+        return wait();
+    }
+
+    // the last response frame, for when we care what's in it
+    const uint8_t* response() const { return last_response; }
+    size_t response_len() const { return last_response_len; }
+
+    // how long the last command took to complete
+    uint32_t elapsed_us() const { return elapsed; }
+
+private:
+    void handle_frame(const uint8_t* frame, size_t len);
+
+    Radio& radio;
+    EmbFrameParser parser;
+    EmbFrameHandler unsolicited = nullptr;
+    void* unsolicited_ctx = nullptr;
+
+    uint8_t outstanding = 0;
+    EmbStatus status = EMB_OK;
+    uint64_t started_us = 0;
+    uint64_t deadline_us = 0;
+    uint32_t elapsed = 0;
+
+    uint8_t last_response[EMB_MAX_FRAME];
+    size_t last_response_len = 0;
+};
@@ -0,0 +1,256 @@
+#include "flash_log.h"
+
+#include <cstring>
+
+static const size_t PAGES_PER_SECTOR = FlashStore::SECTOR_SIZE / FlashStore::PAGE_SIZE;
+
+// where things are in a page header
+static const size_t PAGE_SEQ = 0;
+static const size_t PAGE_LAST = 4;
+static const size_t PAGE_USED = 8;
+static const size_t PAGE_COUNT = 10;
+static const size_t PAGE_SENT = 11;
+static const size_t PAGE_CRC = 12;
+
+static uint16_t page_crc(const uint8_t* page, size_t used) {
+    uint16_t crc = crc16_ccitt(page, PAGE_SENT);
+    return crc16_ccitt(page + FLASH_LOG_PAGE_HEADER, used, crc);
+}
+
+bool FlashLog::read_page_info(size_t page, PageInfo& info, uint8_t* buf) {
+    flash.read(page * FlashStore::PAGE_SIZE, buf, FlashStore::PAGE_SIZE);
+    uint16_t crc;
+    deserialise_u32(buf + PAGE_SEQ, &info.seq);
+    deserialise_u32(buf + PAGE_LAST, &info.last_ms);
+    deserialise_u16(buf + PAGE_USED, &info.used);
+    deserialise_u8(buf + PAGE_COUNT, &info.count);
+    deserialise_u16(buf + PAGE_CRC, &crc);
+    info.sent = buf[PAGE_SENT] != 0xFF;
+    info.valid = info.seq != 0xFFFFFFFF && info.used <= FLASH_LOG_PAGE_DATA && crc == page_crc(buf, info.used);
+    return info.valid;
+}
+
+bool FlashLog::page_blank(size_t page) {
+    flash.read(page * FlashStore::PAGE_SIZE, read_page, FlashStore::PAGE_SIZE);
+    for (size_t i = 0; i < FlashStore::PAGE_SIZE; i++) {
+        if (read_page[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FlashLog::mount(uint32_t now_ms) {
+    bool any = false, any_unsent = false;
+    uint32_t newest_seq = 0, oldest_unsent_seq = 0, newest_last = 0;
+    size_t newest = 0, oldest_unsent = 0;
+    pending_count = 0;
+    for (size_t page = 0; page < page_count(); page++) {
+        PageInfo info;
+        if (!read_page_info(page, info, read_page)) {
+            continue;
+        }
+        if (!any || info.seq > newest_seq) {
+            any = true;
+            newest = page;
+            newest_seq = info.seq;
+            newest_last = info.last_ms;
+        }
+        if (!info.sent) {
+            pending_count += info.count;
+            if (!any_unsent || info.seq < oldest_unsent_seq) {
+                any_unsent = true;
+                oldest_unsent = page;
+                oldest_unsent_seq = info.seq;
+            }
+        }
+    }
+    next_seq = newest_seq + 1;
+    // carry on the log's clock from the newest record
+    log_base = any ? newest_last - now_ms : 0;
+
+    // carry on after the newest page, past anything that was only half
+    // written when the power went
+    head = any ? next_page(newest) : 0;
+    tail = any_unsent ? oldest_unsent : head;
+    while (!page_blank(head)) {
+        head = next_page(head);
+        if (head % PAGES_PER_SECTOR == 0) {
+            erase_sector_at(head);
+            break;
+        }
+    }
+    if (!any_unsent) {
+        tail = head;
+    }
+
+    size_t spare = (head / PAGES_PER_SECTOR + 1) % (page_count() / PAGES_PER_SECTOR) * PAGES_PER_SECTOR;
+    spare_erased = true;
+    for (size_t page = spare; spare_erased && page < spare + PAGES_PER_SECTOR; page++) {
+        spare_erased = page_blank(page);
+    }
+    read_loaded = false;
+    ram_used = ram_sent = ram_count = 0;
+}
+
+// erase the sector page is in, anything unsent in it is lost
+void FlashLog::erase_sector_at(size_t page) {
+    size_t sector = page / PAGES_PER_SECTOR;
+    bool moved = false;
+    while (tail != head && tail / PAGES_PER_SECTOR == sector) {
+        uint32_t n = 0;
+        PageInfo info;
+        if (read_loaded && !moved) {
+            n = read_left;
+        } else if (read_page_info(tail, info, read_page) && !info.sent) {
+            n = info.count;
+        }
+        lost_count += n;
+        pending_count -= n;
+        tail = next_page(tail);
+        moved = true;
+    }
+    if (moved) {
+        read_loaded = false;
+    }
+    if (!flash.erase_sector(sector * FlashStore::SECTOR_SIZE)) {
+        error_count++;
+    }
+}
+
+void FlashLog::write_page() {
+    // anything already sent from RAM doesn't need keeping
+    if (ram_sent) {
+        memmove(ram_page + FLASH_LOG_PAGE_HEADER, ram_page + FLASH_LOG_PAGE_HEADER + ram_sent, ram_used - ram_sent);
+        ram_used -= ram_sent;
+        ram_sent = 0;
+    }
+    if (ram_count == 0) {
+        ram_used = 0;
+        return;
+    }
+
+    uint8_t* p = serialise_u32(ram_page + PAGE_SEQ, next_seq++);
+    p = serialise_u32(p, ram_last_ms);
+    p = serialise_u16(p, ram_used);
+    p = serialise_u8(p, ram_count);
+    p = serialise_u8(p, 0xFF);
+    p = serialise_u16(p, page_crc(ram_page, ram_used));
+    serialise_u16(p, 0xFFFF);
+    memset(ram_page + FLASH_LOG_PAGE_HEADER + ram_used, 0xFF, FLASH_LOG_PAGE_DATA - ram_used);
+    if (flash.program_page(head * FlashStore::PAGE_SIZE, ram_page)) {
+        page_writes++;
+    } else {
+        error_count++;
+        lost_count += ram_count;
+        pending_count -= ram_count;
+    }
+    ram_used = 0;
+    ram_count = 0;
+
+    // the next sector should have been erased already, but if not it has to
+    // be done now, before head gets there
+    size_t next = next_page(head);
+    if (next % PAGES_PER_SECTOR == 0) {
+        if (!spare_erased) {
+            erase_sector_at(next);
+            stall_count++;
+        }
+        spare_erased = false;
+    }
+    head = next;
+}
+
+void FlashLog::mark_sent(size_t page) {
+    memset(read_page, 0xFF, sizeof(read_page));
+    read_page[PAGE_SENT] = 0;
+    if (!flash.program_page(page * FlashStore::PAGE_SIZE, read_page)) {
+        error_count++;
+    }
+}
+
+void FlashLog::append(uint32_t now_ms, const uint8_t* record, size_t len) {
+    if (len > HOSTLINK_RECORD_MAX) {
+        return;
+    }
+    if (ram_count == 0) {
+        // all sent, start again
+        ram_used = ram_sent = 0;
+        ram_first_ms = now_ms;
+    }
+    if (ram_used + FLASH_LOG_ENTRY_HEADER + len > FLASH_LOG_PAGE_DATA) {
+        write_page();
+        ram_first_ms = now_ms;
+    }
+    ram_last_ms = log_now(now_ms);
+    uint8_t* p = ram_page + FLASH_LOG_PAGE_HEADER + ram_used;
+    p = serialise_u8(p, len);
+    p = serialise_u32(p, ram_last_ms);
+    memcpy(p, record, len);
+    ram_used += FLASH_LOG_ENTRY_HEADER + len;
+    ram_count++;
+    pending_count++;
+}
+
+bool FlashLog::service_due(uint32_t now_ms, uint32_t flush_ms) const {
+    return !spare_erased || (ram_count && now_ms - ram_first_ms >= flush_ms);
+}
+
+void FlashLog::service(uint32_t now_ms, uint32_t flush_ms) {
+    // one slow thing at a time
+    if (!spare_erased) {
+        size_t sectors = page_count() / PAGES_PER_SECTOR;
+        erase_sector_at((head / PAGES_PER_SECTOR + 1) % sectors * PAGES_PER_SECTOR);
+        spare_erased = true;
+    } else if (ram_count && now_ms - ram_first_ms >= flush_ms) {
+        write_page();
+    }
+}
+
+bool FlashLog::next(uint32_t now_ms, const uint8_t** record, size_t* len, uint32_t* held_ms) {
+    // everything in flash is older than anything in RAM
+    while (tail != head) {
+        if (!read_loaded) {
+            PageInfo info;
+            if (!read_page_info(tail, info, read_page) || info.sent) {
+                tail = next_page(tail);
+                continue;
+            }
+            read_loaded = true;
+            read_pos = FLASH_LOG_PAGE_HEADER;
+            read_used = info.used;
+            read_left = info.count;
+        }
+        size_t end = FLASH_LOG_PAGE_HEADER + read_used;
+        if (read_left && read_pos + FLASH_LOG_ENTRY_HEADER + read_page[read_pos] <= end) {
+            uint32_t logged_ms;
+            deserialise_u32(read_page + read_pos + 1, &logged_ms);
+            *len = read_page[read_pos];
+            *record = read_page + read_pos + FLASH_LOG_ENTRY_HEADER;
+            *held_ms = log_now(now_ms) - logged_ms;
+            read_pos += FLASH_LOG_ENTRY_HEADER + *len;
+            read_left--;
+            pending_count--;
+            return true;
+        }
+        // that's the page done with
+        pending_count -= read_left;
+        mark_sent(tail);
+        read_loaded = false;
+        tail = next_page(tail);
+    }
+
+    if (ram_count) {
+        const uint8_t* p = ram_page + FLASH_LOG_PAGE_HEADER + ram_sent;
+        uint32_t logged_ms;
+        deserialise_u32(p + 1, &logged_ms);
+        *len = p[0];
+        *record = p + FLASH_LOG_ENTRY_HEADER;
+        *held_ms = log_now(now_ms) - logged_ms;
+        ram_sent += FLASH_LOG_ENTRY_HEADER + *len;
+        ram_count--;
+        pending_count--;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,136 @@
+/**
+ * Store-and-forward log in flash, for keeping the receiver's records while
+ * there's no host to send them to.
+ *
+ * The flash region is used as a ring of pages, each
+ *
+ *   seq (u32): page sequence number, counting up for ever
+ *   last (u32): log time of the newest entry
+ *   used (u16): bytes of entries
+ *   count (u8): number of entries
+ *   sent (u8): 0xFF, programmed to 0 once the entries have gone to the host
+ *   crc (u16): CRC-16/CCITT of the above (bar sent) and the entries
+ *   reserved (u16)
+ *   entries: length (u8), log time (u32), record (hostlink.h, unframed)
+ *
+ * big-endian. Entries are gathered in RAM and a page is only programmed when
+ * it's full (or has been waiting long enough, see service()), so a flash
+ * write is a fraction of a ms every few packets. Erasing is the slow part,
+ * tens of ms, and on the Pico nothing else runs while flash is being written
+ * or erased, interrupts included, so bytes from the radio module that come
+ * in meanwhile overflow the UART and whatever frame they were part of is
+ * lost. To make that less likely the sector after the one being filled is
+ * erased ahead of time from service(), which the receiver only calls when
+ * nothing is coming in, but a packet can still arrive in the middle of it.
+ * Those losses are counted (PicoFlash::rx_overruns(), in the status) rather
+ * than prevented. Going round the ring wears every sector evenly. When the
+ * ring is full the oldest sector is erased anyway, and what was in it is
+ * lost.
+ *
+ * Log time is ms since boot carried on from where the log left off, so the
+ * time records were held can be worked out across a reboot (give or take
+ * however long it was off for). All that's kept across a reboot is what made
+ * it into a page.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "hal.h"
+#include "hostlink.h"
+
+static const size_t FLASH_LOG_PAGE_HEADER = 4 + 4 + 2 + 1 + 1 + 2 + 2;
+static const size_t FLASH_LOG_ENTRY_HEADER = 1 + 4;
+static const size_t FLASH_LOG_PAGE_DATA = FlashStore::PAGE_SIZE - FLASH_LOG_PAGE_HEADER;
+static_assert(FLASH_LOG_ENTRY_HEADER + HOSTLINK_RECORD_MAX <= FLASH_LOG_PAGE_DATA, "records must fit a page");
+
+class FlashLog {
+public:
+    FlashLog(FlashStore& flash) : flash(flash) {}
+
+    // find where the log got to, now_ms is ms since boot
+    void mount(uint32_t now_ms);
+
+    // add a record (whole, crc included), on to flash once there's a page
+    void append(uint32_t now_ms, const uint8_t* record, size_t len);
+
+    /**
+     * Housekeeping for when there's nothing else to do: erase the next sector
+     * ahead of time, and write out a partly filled page once the oldest
+     * record in it has waited flush_ms.
+     */
+    void service(uint32_t now_ms, uint32_t flush_ms);
+    // whether service() has anything to do
+    bool service_due(uint32_t now_ms, uint32_t flush_ms) const;
+
+    /**
+     * The oldest record not yet sent, false if there are none. held_ms is
+     * how long it has been in the log. The record is only valid until the
+     * log is next used, and counts as sent from then. A page partly sent
+     * when the receiver restarts is sent again in full.
+     */
+    bool next(uint32_t now_ms, const uint8_t** record, size_t* len, uint32_t* held_ms);
+
+    // records waiting to be sent
+    uint32_t pending() const { return pending_count; }
+    bool empty() const { return pending_count == 0; }
+
+    // records lost to the ring filling up
+    uint32_t lost() const { return lost_count; }
+    // erases that had to be done there and then, not ahead of time in
+    // service(), and so maybe while a frame was coming in
+    uint32_t stalls() const { return stall_count; }
+    uint32_t pages_written() const { return page_writes; }
+    uint32_t flash_errors() const { return error_count; }
+
+private:
+    struct PageInfo {
+        bool valid;
+        bool sent;
+        uint32_t seq;
+        uint32_t last_ms;
+        uint16_t used;
+        uint8_t count;
+    };
+
+    size_t page_count() const { return flash.size() / FlashStore::PAGE_SIZE; }
+    size_t next_page(size_t page) const { return (page + 1) % page_count(); }
+    bool read_page_info(size_t page, PageInfo& info, uint8_t* buf);
+    bool page_blank(size_t page);
+    void erase_sector_at(size_t page);
+    void write_page();
+    void mark_sent(size_t page);
+    uint32_t log_now(uint32_t now_ms) const { return log_base + now_ms; }
+
+    FlashStore& flash;
+
+    // the ring: unsent pages from tail up to (not including) head, which is
+    // the next to be written, and the rest of head's sector is erased
+    size_t head = 0;
+    size_t tail = 0;
+    uint32_t next_seq = 1;
+    bool spare_erased = false; // the sector after head's
+    uint32_t log_base = 0;
+
+    // the page being gathered in RAM, entries before ram_sent have already
+    // gone to the host straight from here
+    uint8_t ram_page[FlashStore::PAGE_SIZE];
+    size_t ram_used = 0;
+    size_t ram_sent = 0;
+    uint8_t ram_count = 0; // not yet sent
+    uint32_t ram_first_ms = 0; // ms since boot the oldest entry came in
+    uint32_t ram_last_ms = 0;  // log time of the newest
+
+    // the page being sent, read out of flash
+    uint8_t read_page[FlashStore::PAGE_SIZE];
+    bool read_loaded = false;
+    size_t read_pos = 0;
+    uint16_t read_used = 0;
+    uint8_t read_left = 0;
+
+    uint32_t pending_count = 0;
+    uint32_t lost_count = 0;
+    uint32_t stall_count = 0;
+    uint32_t page_writes = 0;
+    uint32_t error_count = 0;
+};
@@ -0,0 +1,119 @@
+#include "frame.h"
+
+#include <cstdio>
+
+uint8_t emb_checksum(const uint8_t* buf, size_t len) {
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < len; i++) {
+        checksum += buf[i];
+    }
+    return checksum & 0x000000ff;
+}
+
+bool EmbFrameParser::push(uint8_t byte) {
+    if (complete) {
+        reset();
+    }
+    buf[len++] = byte;
+    return check();
+}
+
+// see if what we've got so far is a bad frame, a good frame or not enough
+bool EmbFrameParser::check() {
+    while (len >= 2) {
+        size_t frame_len = ((size_t)buf[0] << 8) | buf[1];
+        if (frame_len < EMB_FRAME_OVERHEAD || frame_len > EMB_MAX_FRAME) {
+            resync();
+            continue;
+        }
+        if (len < frame_len) {
+            return false;
+        }
+        if (buf[frame_len - 1] != emb_checksum(buf, frame_len - 1)) {
+            resync();
+            continue;
+        }
+        complete = true;
+        return true;
+    }
+    return false;
+}
+
+// drop the first byte and go again from the next one, anything left over
+// still needs checking so shuffle it down
+void EmbFrameParser::resync() {
+    error_count++;
+    for (size_t i = 1; i < len; i++) {
+        buf[i - 1] = buf[i];
+    }
+    len--;
+}
+
+size_t emb_build_frame(uint8_t type, const uint8_t* payload, size_t len, uint8_t* out) {
+    size_t frame_len = len + EMB_FRAME_OVERHEAD;
+    uint8_t* bufptr = serialise_u16(out, frame_len);
+    bufptr = serialise_u8(bufptr, type);
+    for (size_t i = 0; i < len; i++) {
+        bufptr[i] = payload[i];
+    }
+    bufptr += len;
+    serialise_u8(bufptr, emb_checksum(out, frame_len - 1));
+    return frame_len;
+}
+
+size_t collect_rx_frame(Radio& radio, uint8_t* buf, size_t buflen, uint32_t timeout_ms) {
+    size_t rxbuff_ptr = 0;
+    while (radio.checkRxFifo(timeout_ms)) { // Keep checking the FIFO for new data
+        const uint8_t* response = radio.response();
+        for (size_t i = 0; i < radio.responseLen(); i++) {
+            if (rxbuff_ptr < buflen) {
+                buf[rxbuff_ptr] = response[i];
+            }
+            // more data than buffer holds received, we just ignore it
+            rxbuff_ptr++;
+        }
+    }
+    return rxbuff_ptr;
+}
+
+void print_rx_frame(const uint8_t* frame, size_t len, const struct rxdata* rxd, bool hex) {
+    printf( "Received Data Info:\n  length=%zu\n", len );
+    if (hex) {
+        printf( "  data={" );
+        for (size_t i = 0; i < len; i++) {
+            printf("0x%02X ", frame[i]);
+        }
+        printf("}\n");
+    }
+    printf( "  checksum=%02X\n", len ? emb_checksum(frame, len - 1) : 0 );
+
+    printf( "Deserialised Packet Info:\n" );
+    printf( "  Data Length: %u bytes\n", rxd->length );
+    printf( "  Options: 0x%08X (bitfield)\n", rxd->options );
+    printf( "  WTF: 0x%02X (undocumented field?)\n", rxd->wtf );
+    printf( "  Signal Strength: %d dBm\n", rxd->rssi );
+    printf( "  Source Addr: 0x%04X\n", rxd->src );
+    if (rxd->meta.present & (1u << PACKET_HOPS)) {
+        printf( "  Relayed: by 0x%04X, %u hops\n", rxd->via, (unsigned)rxd->meta.hops );
+    }
+    printf( "  Dest Addr: 0x%04X (0xFFFF is broadcast)\n", rxd->dst );
+    printf( "  Payload: (format 0x%02X, %u samples)\n", rxd->format, rxd->count );
+    for (size_t s = 0; s < rxd->count; s++) {
+        const struct sensor_record* rec = &rxd->readings[s];
+        if (rxd->count > 1) {
+            printf( "   Sample %zu (%lu ms before sending):\n", s, (unsigned long)rxd->age_ms[s] );
+        }
+        for (size_t i = 0; i < SENSOR_FIELD_COUNT; i++) {
+            if (rec->present & (1u << i)) {
+                const FieldDesc& field = SENSOR_FIELDS[i];
+                const char* note = (rxd->carried[s] & (1u << i)) ? " (unchanged)" : "";
+                if (field.type == FIELD_FLOAT) {
+                    printf( "    %s: %0.2f%s%s\n", field.name, schema_get_float(field, rec), field.unit, note );
+                } else {
+                    printf( "    %s: %lld%s%s\n", field.name, (long long)schema_get_wire(field, rec), field.unit, note );
+                }
+            }
+        }
+    }
+    printf( "  Checksum: %02X\n", rxd->checksum );
+}
@@ -0,0 +1,86 @@
+/**
+ * LoRaEMB frame handling.
+ *
+ * Everything the module sends us is a frame of the form:
+ *
+ *   length (u16, big-endian, whole frame including itself and the checksum)
+ *   message type (u8)
+ *   payload
+ *   checksum (u8, low byte of the sum of all the previous bytes)
+ *
+ * see: https://www.embit.eu/wp-content/uploads/2020/10/ebi-LoRa_rev1.0.1.pdf
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "hal.h"
+#include "packet.h"
+
+// length + type + checksum
+static const size_t EMB_FRAME_OVERHEAD = 4;
+
+// EMB message types, the module answers a command with the command type
+// OR'ed with EMB_RESPONSE_FLAG
+static const uint8_t EMB_CMD_DEVICE_INFO = 0x01;
+static const uint8_t EMB_CMD_OUTPUT_POWER = 0x10;
+static const uint8_t EMB_CMD_OPERATING_CHANNEL = 0x11;
+static const uint8_t EMB_CMD_ENERGY_SAVE = 0x13;
+static const uint8_t EMB_CMD_NETWORK_ADDRESS = 0x21;
+static const uint8_t EMB_CMD_NETWORK_ID = 0x22;
+static const uint8_t EMB_CMD_NETWORK_PREFERENCES = 0x25;
+static const uint8_t EMB_CMD_NETWORK_START = 0x30;
+static const uint8_t EMB_CMD_NETWORK_STOP = 0x31;
+static const uint8_t EMB_CMD_SEND_DATA = 0x50;
+static const uint8_t EMB_RX_DATA = 0x60;
+static const uint8_t EMB_RESPONSE_FLAG = 0x80;
+
+// biggest frame we'll accept, the module's own limit is well under this
+static const size_t EMB_MAX_FRAME = 256;
+
+// calculate the checksum of the first len bytes of buf
+uint8_t emb_checksum(const uint8_t* buf, size_t len);
+
+/**
+ * Incremental frame parser. Bytes from the module are pushed in one at a
+ * time as they arrive, push() returns true once they add up to a complete
+ * frame with a good checksum, which can then be looked at with frame() and
+ * frame_len() until the next push(). Garbage, bad lengths and bad checksums
+ * are skipped over a byte at a time until we're back in sync.
+ */
+class EmbFrameParser {
+public:
+    bool push(uint8_t byte);
+
+    const uint8_t* frame() const { return buf; }
+    size_t frame_len() const { return complete ? len : 0; }
+
+    uint32_t errors() const { return error_count; }
+    void reset() { len = 0; complete = false; }
+
+private:
+    bool check();
+    void resync();
+
+    uint8_t buf[EMB_MAX_FRAME];
+    size_t len = 0;
+    bool complete = false;
+    uint32_t error_count = 0;
+};
+
+/**
+ * Build a frame of the given type around payload into out, returns the
+ * frame length. out must have room for len + EMB_FRAME_OVERHEAD bytes.
+ */
+size_t emb_build_frame(uint8_t type, const uint8_t* payload, size_t len, uint8_t* out);
+
+/**
+ * Drain whatever the radio has received into buf, waiting up to timeout_ms
+ * for each chunk. Returns the number of bytes the radio gave us, which may
+ * be more than buflen in which case the excess was dropped.
+ */
+size_t collect_rx_frame(Radio& radio, uint8_t* buf, size_t buflen, uint32_t timeout_ms);
+
+// dump a received frame and its decoded contents to the console, the frame
+// itself in hex only if asked
+void print_rx_frame(const uint8_t* frame, size_t len, const struct rxdata* rxd, bool hex = true);
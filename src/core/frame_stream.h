@@ -0,0 +1,79 @@
+/**
+ * Streaming LoRaEMB frame splitter on top of a ByteRing.
+ *
+ * Bytes from the module go in at one end (typically from the UART
+ * interrupt), complete frames with a good checksum come out of the other,
+ * however they were chunked on the way in, back to back or not. Frames are
+ * handed out as pointers into the ring, valid until release(), rather than
+ * being copied out.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "frame.h"
+#include "ring_buffer.h"
+
+struct EmbFrame {
+    uint8_t* data;
+    size_t len;
+};
+
+template <size_t SIZE>
+class EmbFrameStream {
+public:
+    // producer side
+    bool push(uint8_t byte) { return ring.push(byte); }
+
+    /**
+     * Find the next complete frame, skipping any rubbish in front of it.
+     * Returns false if there isn't a whole frame yet. Each frame must be
+     * release()d before asking for the next one.
+     */
+    bool next(EmbFrame& frame) {
+        while (true) {
+            size_t avail = ring.available();
+            idle_avail = avail;
+            if (avail < 2) {
+                return false;
+            }
+            uint8_t* p = ring.read_ptr();
+            size_t len = ((size_t)p[0] << 8) | p[1];
+            if (len < EMB_FRAME_OVERHEAD || len > EMB_MAX_FRAME) {
+                skip();
+                continue;
+            }
+            if (avail < len) {
+                return false;
+            }
+            if (p[len - 1] != emb_checksum(p, len - 1)) {
+                skip();
+                continue;
+            }
+            frame.data = p;
+            frame.len = len;
+            frame_count++;
+            return true;
+        }
+    }
+
+    void release(const EmbFrame& frame) { ring.consume(frame.len); }
+
+    // true if nothing has arrived since next() last ran out of frames
+    bool idle() const { return ring.available() == idle_avail; }
+
+    uint32_t frames() const { return frame_count; }
+    uint32_t errors() const { return error_count; } // bytes skipped to resync
+    uint32_t dropped() const { return ring.dropped(); } // bytes lost to overflow
+
+private:
+    void skip() {
+        error_count++;
+        ring.consume(1);
+    }
+
+    ByteRing<SIZE, EMB_MAX_FRAME> ring;
+    size_t idle_avail = 0;
+    uint32_t frame_count = 0;
+    uint32_t error_count = 0;
+};
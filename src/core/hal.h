@@ -0,0 +1,153 @@
+/**
+ * HortiTel hardware abstraction layer.
+ *
+ * The core code (sampling, packet codec, frame handling) only talks to the
+ * hardware through the interfaces declared here. On the boards these are
+ * implemented on top of the Pico SDK and the MeloperoPerpetuo library (see
+ * src/hal/pico), on a Linux host they are simulated (see src/hal/sim) so the
+ * core can be built, profiled and poked at without flashing anything.
+ *
+ * The Radio interface deliberately mirrors the subset of MeloperoPerpetuo
+ * that the sender and receiver use, so the main loops read the same either
+ * way.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// microseconds since boot (or since the simulation started)
+uint64_t hal_time_us();
+void hal_sleep_ms(uint32_t ms);
+void hal_sleep_us(uint64_t us);
+// write bytes to the console exactly as they are, no newline translation
+void hal_console_write(const uint8_t* data, size_t len);
+// whether anyone is at the other end of the console to read what's written
+bool hal_console_connected();
+
+/**
+ * Low power sleep. now_us() has to keep counting through a deep sleep, which
+ * the normal microsecond timer doesn't on the boards.
+ */
+class PowerControl {
+public:
+    virtual ~PowerControl() {}
+
+    virtual uint64_t now_us() { return hal_time_us(); }
+    // sleep as deeply as possible until now_us() reaches wake_us
+    virtual void deep_sleep_until(uint64_t wake_us) = 0;
+};
+
+/**
+ * The ADC. Channel numbers are as per the RP2350 datasheet, i.e. 0-3 are
+ * GPIO 26-29 and 4 is the internal temperature sensor.
+ */
+class AdcChannels {
+public:
+    virtual ~AdcChannels() {}
+
+    virtual void select_input(unsigned int channel) = 0;
+    virtual uint16_t read() = 0;
+
+    /**
+     * Capture rounds samples of every channel set in mask into out, which
+     * must have room for rounds * (channels in mask) entries. The samples
+     * are interleaved round by round in ascending channel order, which is
+     * how the RP2350 round-robin hardware produces them. This default just
+     * reads them one at a time, the Pico implementation does it by DMA.
+     */
+    virtual void capture_round_robin(uint32_t mask, uint16_t* out, unsigned int rounds) {
+        for ( unsigned int r = 0; r < rounds; ++r ) {
+            for ( uint32_t m = mask; m; m &= m - 1 ) {
+                select_input( __builtin_ctz( m ) );
+                *out++ = read();
+            }
+        }
+    }
+};
+
+// the switched supply to the external sensors, VSEN on the Perpetuo board
+class SensorPower {
+public:
+    virtual ~SensorPower() {}
+
+    virtual void set(bool on) = 0;
+};
+
+/**
+ * A region of flash set aside for our own use. Flash is erased a sector at a
+ * time, to all ones, and programmed a page at a time, which can only clear
+ * bits. Programming a page again with 0xFF everywhere except a few bytes
+ * being cleared is fine, that just leaves the rest as it was.
+ */
+class FlashStore {
+public:
+    static const size_t PAGE_SIZE = 256;
+    static const size_t SECTOR_SIZE = 4096;
+
+    virtual ~FlashStore() {}
+
+    // bytes, a whole number of sectors
+    virtual size_t size() const = 0;
+    virtual void read(size_t offset, uint8_t* buf, size_t len) = 0;
+    // offsets are from the start of the region and must be page/sector
+    // aligned, false if it couldn't be done
+    virtual bool program_page(size_t offset, const uint8_t* data) = 0;
+    virtual bool erase_sector(size_t offset) = 0;
+};
+
+// LoRaEMB radio parameters, mapped to the MeloperoPerpetuo constants by the
+// Pico implementation
+enum RadioSpreadingFactor {
+    RADIO_SF_7 = 7,
+    RADIO_SF_8,
+    RADIO_SF_9,
+    RADIO_SF_10,
+    RADIO_SF_11,
+    RADIO_SF_12,
+};
+enum RadioBandwidth {
+    RADIO_BW_125,
+    RADIO_BW_250,
+    RADIO_BW_500,
+};
+enum RadioCodingRate {
+    RADIO_CR_4_5,
+    RADIO_CR_4_6,
+    RADIO_CR_4_7,
+    RADIO_CR_4_8,
+};
+enum RadioEnergySaveMode {
+    RADIO_ENERGY_SAVE_ALWAYS_ON,
+    RADIO_ENERGY_SAVE_TX_ONLY,
+};
+
+/**
+ * The LoRaEMB module on the Perpetuo board.
+ *
+ * The configuration calls just send the relevant EMB command. The response
+ * frame can be collected with checkRxFifo(), after which it is available via
+ * response()/responseLen(), or read and dumped to the console with
+ * printResponse().
+ */
+class Radio {
+public:
+    virtual ~Radio() {}
+
+    virtual void sendCmd(uint8_t cmd) = 0;
+    virtual void stopNetwork() = 0;
+    virtual void startNetwork() = 0;
+    virtual void setNetworkPreferences(bool protocol, bool auto_ack, bool cca) = 0;
+    virtual void setOutputPower(uint8_t power) = 0;
+    virtual void setOperatingChannel(uint8_t channel, RadioSpreadingFactor sf, RadioBandwidth bw, RadioCodingRate cr) = 0;
+    virtual void setNetworkAddress(uint16_t address) = 0;
+    virtual void setNetworkId(uint8_t* id, size_t len) = 0;
+    virtual void setEnergySaveMode(RadioEnergySaveMode mode) = 0;
+    virtual void transmitData(uint8_t* data, size_t len) = 0;
+
+    // wait up to timeout_ms for data from the module, true if some arrived
+    virtual bool checkRxFifo(uint32_t timeout_ms) = 0;
+    virtual const uint8_t* response() const = 0;
+    virtual size_t responseLen() const = 0;
+    virtual void printResponse() = 0;
+};
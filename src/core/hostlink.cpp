@@ -0,0 +1,142 @@
+#include "hostlink.h"
+
+#include <cstring>
+
+uint16_t crc16_ccitt(const uint8_t* buf, size_t len, uint16_t crc) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)buf[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+size_t cobs_encode(const uint8_t* in, size_t len, uint8_t* out) {
+    uint8_t* code_ptr = out;
+    uint8_t* outptr = out + 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            *code_ptr = code;
+            code_ptr = outptr++;
+            code = 1;
+            continue;
+        }
+        *outptr++ = in[i];
+        if (++code == 0xFF) {
+            *code_ptr = code;
+            code_ptr = outptr++;
+            code = 1;
+        }
+    }
+    *code_ptr = code;
+    return outptr - out;
+}
+
+size_t cobs_decode(const uint8_t* in, size_t len, uint8_t* out) {
+    const uint8_t* end = in + len;
+    uint8_t* outptr = out;
+    while (in < end) {
+        uint8_t code = *in++;
+        if (code == 0 || in + code - 1 > end) {
+            return 0;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            if (*in == 0) {
+                return 0;
+            }
+            *outptr++ = *in++;
+        }
+        // a full block of 254 doesn't imply a zero, nor does the last one
+        if (code != 0xFF && in < end) {
+            *outptr++ = 0;
+        }
+    }
+    return outptr - out;
+}
+
+size_t hostlink_frame_record(const uint8_t* record, size_t len, uint8_t* out) {
+    len = cobs_encode(record, len, out);
+    out[len++] = 0;
+    return len;
+}
+
+// add the crc, COBS it and terminate
+static size_t hostlink_frame(uint8_t* record, uint8_t* recptr, uint8_t* out) {
+    recptr = serialise_u16(recptr, crc16_ccitt(record, recptr - record));
+    return hostlink_frame_record(record, recptr - record, out);
+}
+
+size_t hostlink_record_reading(const struct rxdata* rxd, size_t i, uint32_t time_ms, uint8_t* record) {
+    uint8_t* recptr = serialise_u8(record, HOSTLINK_READING);
+    recptr = serialise_u32(recptr, time_ms);
+    recptr = serialise_u16(recptr, rxd->src);
+    recptr = serialise_u16(recptr, rxd->dst);
+    recptr = serialise_u16(recptr, (uint16_t)rxd->rssi);
+    recptr = varint_put(recptr, rxd->age_ms[i]);
+    recptr += schema_encode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, &rxd->readings[i], rxd->readings[i].present, recptr);
+    return serialise_u16(recptr, crc16_ccitt(record, recptr - record)) - record;
+}
+
+size_t hostlink_encode_reading(const struct rxdata* rxd, size_t i, uint32_t time_ms, uint8_t* out) {
+    uint8_t record[HOSTLINK_RECORD_MAX];
+    return hostlink_frame_record(record, hostlink_record_reading(rxd, i, time_ms, record), out);
+}
+
+size_t hostlink_restamp_record(const uint8_t* record, size_t len, uint32_t time_ms, uint32_t held_ms, uint8_t* out) {
+    if (len < 1 || len > HOSTLINK_RECORD_MAX) {
+        return 0;
+    }
+    size_t offset = record[0] == HOSTLINK_READING ? HOSTLINK_READING_AGE_OFFSET
+            : record[0] == HOSTLINK_SUMMARY ? HOSTLINK_SUMMARY_AGE_OFFSET : 0;
+    if (!offset || len < offset + 1 + 2 || crc16_ccitt(record, len) != 0) {
+        return 0;
+    }
+    const uint8_t* end = record + len - 2;
+    uint64_t age;
+    const uint8_t* rest = varint_get(record + offset, end, &age);
+    if (!rest || offset + 5 + (end - rest) + 2 > HOSTLINK_RECORD_MAX) {
+        return 0;
+    }
+    // ages are u32, so kept to that the record still fits HOSTLINK_RECORD_MAX
+    uint8_t restamped[HOSTLINK_RECORD_MAX];
+    memcpy(restamped, record, offset);
+    serialise_u32(restamped + 1, time_ms);
+    age = age + held_ms > UINT32_MAX ? UINT32_MAX : age + held_ms;
+    uint8_t* recptr = varint_put(restamped + offset, age);
+    memcpy(recptr, rest, end - rest);
+    recptr += end - rest;
+    return hostlink_frame(restamped, recptr, out);
+}
+
+size_t hostlink_encode_status(const struct HostlinkStatus* status, uint32_t time_ms, uint8_t* out) {
+    uint8_t record[HOSTLINK_RECORD_MAX];
+    uint8_t* recptr = serialise_u8(record, HOSTLINK_STATUS);
+    recptr = serialise_u32(recptr, time_ms);
+    recptr += schema_encode(HOSTLINK_STATUS_FIELDS, HOSTLINK_STATUS_FIELD_COUNT, status, status->present, recptr);
+    return hostlink_frame(record, recptr, out);
+}
+
+const char* hostlink_stat_name(HostlinkSummaryStat stat) {
+    static const char* const names[HOSTLINK_STATS] = { "min", "max", "mean", "last" };
+    return stat < HOSTLINK_STATS ? names[stat] : "?";
+}
+
+size_t hostlink_record_summary(uint16_t src, uint32_t time_ms, uint32_t age_ms, uint32_t period_ms, uint32_t count,
+        const struct sensor_record* stats, uint8_t* record) {
+    uint8_t* recptr = serialise_u8(record, HOSTLINK_SUMMARY);
+    recptr = serialise_u32(recptr, time_ms);
+    recptr = serialise_u16(recptr, src);
+    recptr = varint_put(recptr, age_ms);
+    recptr = varint_put(recptr, period_ms);
+    recptr = varint_put(recptr, count);
+    for (size_t s = 0; s < HOSTLINK_STATS; s++) {
+        // under 128 bytes, so the length is one byte
+        static_assert(SENSOR_FIELD_COUNT * SCHEMA_MAX_FIELD_SIZE < 128, "summary lengths are one byte");
+        uint8_t* fields = recptr + 1;
+        size_t len = schema_encode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, &stats[s], stats[s].present, fields);
+        recptr = varint_put(recptr, len) + len;
+    }
+    return serialise_u16(recptr, crc16_ccitt(record, recptr - record)) - record;
+}
@@ -0,0 +1,144 @@
+/**
+ * Binary receiver to host output.
+ *
+ * Instead of printing every packet for a human the receiver can send the
+ * host one compact record per sample. Each record is
+ *
+ *   type (u8): HOSTLINK_READING, HOSTLINK_STATUS, HOSTLINK_LOG or
+ *     HOSTLINK_SUMMARY
+ *   time (u32): receiver ms since boot when it arrived/was made
+ *   for a reading:
+ *     src, dst (u16), rssi (i16)
+ *     age (varint): ms before time that the sample was taken
+ *     the sensor_record fields as per SENSOR_FIELDS (see schema.h)
+ *   for a status: the HostlinkStatus fields as per HOSTLINK_STATUS_FIELDS
+ *   for a log message: as described in log.h
+ *   for a summary of a node's readings over a period (see aggregate.h):
+ *     src (u16)
+ *     age (varint): ms before time that the period ended
+ *     period (varint): the ms it covers
+ *     count (varint): how many readings that was
+ *     then for each of min, max, mean and last (HostlinkSummaryStat), a
+ *       length (varint) and the sensor_record fields as for a reading
+ *   crc (u16): CRC-16/CCITT-FALSE of everything before it
+ *
+ * all big-endian, then COBS encoded and terminated by a zero byte, so the
+ * host can always find the start of the next record whatever it missed.
+ * The decoder for the host end is in host/.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "packet.h"
+#include "schema.h"
+
+static const uint8_t HOSTLINK_READING = 0x01;
+static const uint8_t HOSTLINK_STATUS = 0x02;
+static const uint8_t HOSTLINK_LOG = 0x03;
+static const uint8_t HOSTLINK_SUMMARY = 0x04;
+
+enum HostlinkSummaryStat {
+    HOSTLINK_STAT_MIN,
+    HOSTLINK_STAT_MAX,
+    HOSTLINK_STAT_MEAN,
+    HOSTLINK_STAT_LAST,
+    HOSTLINK_STATS
+};
+
+// "min", "max", "mean" or "last"
+const char* hostlink_stat_name(HostlinkSummaryStat stat);
+
+// where a reading record's age is, after the type, time, src, dst and rssi
+static const size_t HOSTLINK_READING_AGE_OFFSET = 1 + 4 + 2 + 2 + 2;
+// and a summary's, after the type, time and src
+static const size_t HOSTLINK_SUMMARY_AGE_OFFSET = 1 + 4 + 2;
+
+// the receiver's own state, sent once a second
+struct HostlinkStatus {
+    uint32_t rx_frames;
+    uint32_t rx_errors;  // resync bytes
+    uint32_t rx_dropped; // bytes and packets lost to full buffers
+    uint8_t charge_state;
+    float mcu_temp;
+    uint32_t log_pending; // records held in the flash log, see flash_log.h
+    uint32_t log_lost;    // and lost from it when it filled up
+    uint32_t nodes;       // senders being tracked, up to HORTITEL_MAX_NODES
+    uint32_t untracked;   // packets from senders there was no room for
+    uint32_t log_overruns; // times the module's UART overran while the flash log was writing
+    uint32_t present;
+};
+
+enum HostlinkStatusField {
+    HOSTLINK_STATUS_RX_FRAMES,
+    HOSTLINK_STATUS_RX_ERRORS,
+    HOSTLINK_STATUS_RX_DROPPED,
+    HOSTLINK_STATUS_CHARGE_STATE,
+    HOSTLINK_STATUS_MCU_TEMP,
+    HOSTLINK_STATUS_LOG_PENDING,
+    HOSTLINK_STATUS_LOG_LOST,
+    HOSTLINK_STATUS_NODES,
+    HOSTLINK_STATUS_UNTRACKED,
+    HOSTLINK_STATUS_LOG_OVERRUNS,
+    HOSTLINK_STATUS_FIELD_COUNT
+};
+
+constexpr FieldDesc HOSTLINK_STATUS_FIELDS[HOSTLINK_STATUS_FIELD_COUNT] = {
+    { 1, FIELD_U32, offsetof(HostlinkStatus, rx_frames), 1, "RX Frames", "" },
+    { 2, FIELD_U32, offsetof(HostlinkStatus, rx_errors), 1, "RX Resync Bytes", "" },
+    { 3, FIELD_U32, offsetof(HostlinkStatus, rx_dropped), 1, "RX Dropped", "" },
+    { 4, FIELD_U8, offsetof(HostlinkStatus, charge_state), 1, "Charge State", "" },
+    { 5, FIELD_FLOAT, offsetof(HostlinkStatus, mcu_temp), 100, "RP2350 Temperature", " C" },
+    { 6, FIELD_U32, offsetof(HostlinkStatus, log_pending), 1, "Log Pending", "" },
+    { 7, FIELD_U32, offsetof(HostlinkStatus, log_lost), 1, "Log Lost", "" },
+    { 8, FIELD_U32, offsetof(HostlinkStatus, nodes), 1, "Nodes", "" },
+    { 9, FIELD_U32, offsetof(HostlinkStatus, untracked), 1, "Untracked Node Packets", "" },
+    { 10, FIELD_U32, offsetof(HostlinkStatus, log_overruns), 1, "RX Overruns In Flash Writes", "" },
+};
+static_assert(schema_valid(HOSTLINK_STATUS_FIELDS), "bad hostlink status schema");
+
+static const size_t HOSTLINK_READING_MAX = 1 + 4 + 6 + 5 + SENSOR_FIELD_COUNT * SCHEMA_MAX_FIELD_SIZE + 2;
+static const size_t HOSTLINK_STATUS_MAX = 1 + 4 + HOSTLINK_STATUS_FIELD_COUNT * SCHEMA_MAX_FIELD_SIZE + 2;
+static const size_t HOSTLINK_SUMMARY_MAX = 1 + 4 + 2 + 5 + 5 + 5 + HOSTLINK_STATS * (1 + SENSOR_FIELD_COUNT * SCHEMA_MAX_FIELD_SIZE) + 2;
+constexpr size_t hostlink_max(size_t a, size_t b) { return a > b ? a : b; }
+static const size_t HOSTLINK_RECORD_MAX = hostlink_max(hostlink_max(HOSTLINK_READING_MAX, HOSTLINK_STATUS_MAX), HOSTLINK_SUMMARY_MAX);
+// COBS adds a byte per 254 and there's the terminating zero
+static const size_t HOSTLINK_FRAME_MAX = HOSTLINK_RECORD_MAX + HOSTLINK_RECORD_MAX / 254 + 2;
+
+uint16_t crc16_ccitt(const uint8_t* buf, size_t len, uint16_t crc = 0xFFFF);
+
+// COBS encode len bytes into out, which needs len + len / 254 + 1 bytes, and
+// return the encoded length, not including a terminating zero
+size_t cobs_encode(const uint8_t* in, size_t len, uint8_t* out);
+// decode in place of or into out (which can be in), returns the decoded
+// length or 0 if it isn't valid COBS
+size_t cobs_decode(const uint8_t* in, size_t len, uint8_t* out);
+
+/**
+ * Frame sample i of a received packet that arrived at time_ms, out must have
+ * HOSTLINK_FRAME_MAX bytes. Returns the length including the terminator.
+ */
+size_t hostlink_encode_reading(const struct rxdata* rxd, size_t i, uint32_t time_ms, uint8_t* out);
+size_t hostlink_encode_status(const struct HostlinkStatus* status, uint32_t time_ms, uint8_t* out);
+
+/**
+ * The record for a summary of count readings from src over the period_ms up
+ * to age_ms before time_ms, stats[s] being the HostlinkSummaryStat s of each
+ * field. As hostlink_record_reading(), so it can go in the flash log too.
+ */
+size_t hostlink_record_summary(uint16_t src, uint32_t time_ms, uint32_t age_ms, uint32_t period_ms, uint32_t count,
+        const struct sensor_record* stats, uint8_t* record);
+
+// the record for sample i without the framing, crc included, record must
+// have HOSTLINK_RECORD_MAX bytes, returns the length
+size_t hostlink_record_reading(const struct rxdata* rxd, size_t i, uint32_t time_ms, uint8_t* record);
+// frame a whole record (as above), returns the length including the terminator
+size_t hostlink_frame_record(const uint8_t* record, size_t len, uint8_t* out);
+
+/**
+ * For a reading or summary record that has been held back: make the time
+ * time_ms and add held_ms to the age, so the sample's (or period's) time
+ * still works out the same, and frame it into out. Returns 0 if it isn't a
+ * good reading or summary record.
+ */
+size_t hostlink_restamp_record(const uint8_t* record, size_t len, uint32_t time_ms, uint32_t held_ms, uint8_t* out);
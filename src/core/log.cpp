@@ -0,0 +1,86 @@
+#include "log.h"
+
+#include <cstring>
+
+// framed records, oldest first, log_flush() always takes the lot so this
+// never has to wrap
+static uint8_t log_buffer[LOG_BUFFER_SIZE];
+static size_t log_len = 0;
+static uint32_t log_dropped_count = 0;
+
+uint8_t* log_put_unsigned(uint8_t* buf, const uint8_t* end, uint64_t val) {
+    uint8_t tmp[10];
+    size_t len = varint_put(tmp, val) - tmp;
+    if ((size_t)(end - buf) < len) {
+        return nullptr;
+    }
+    memcpy(buf, tmp, len);
+    return buf + len;
+}
+
+uint8_t* log_put_float(uint8_t* buf, const uint8_t* end, float val) {
+    if (end - buf < 4) {
+        return nullptr;
+    }
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return serialise_u32(buf, bits);
+}
+
+uint8_t* log_put_bytes(uint8_t* buf, const uint8_t* end, const uint8_t* data, size_t len) {
+    // as much as there's room for, a length under 128 is one byte
+    if (end - buf < 1) {
+        return nullptr;
+    }
+    size_t room = end - buf - 1;
+    if (len > room) {
+        len = room;
+    }
+    if (len > 127) {
+        len = 127;
+    }
+    buf = varint_put(buf, len);
+    memcpy(buf, data, len);
+    return buf + len;
+}
+
+uint8_t* log_record_start(uint8_t* record, uint8_t level, const char* fmt) {
+    uint8_t* buf = serialise_u8(record, HOSTLINK_LOG);
+    buf = serialise_u32(buf, (uint32_t)(hal_time_us() / 1000));
+    buf = serialise_u8(buf, level);
+    return varint_put(buf, (uintptr_t)fmt);
+}
+
+void log_record_end(uint8_t* record, uint8_t* end) {
+    end = serialise_u16(end, crc16_ccitt(record, end - record));
+    uint8_t frame[HOSTLINK_FRAME_MAX];
+    size_t len = hostlink_frame_record(record, end - record, frame);
+    if (log_len + len > LOG_BUFFER_SIZE) {
+        log_dropped_count++;
+        return;
+    }
+    memcpy(log_buffer + log_len, frame, len);
+    log_len += len;
+}
+
+size_t log_flush() {
+    size_t sent = 0;
+    if (log_len && hal_console_connected()) {
+        hal_console_write(log_buffer, log_len);
+        sent = log_len;
+    }
+    log_len = 0;
+    return sent;
+}
+
+uint32_t log_dropped() {
+    return log_dropped_count;
+}
+
+void log_print_hex(const char* label, const uint8_t* data, size_t len) {
+    printf( "%s={", label );
+    for (size_t i = 0; i < len; i++) {
+        printf( "0x%02X ", data[i] );
+    }
+    printf( "}\n" );
+}
@@ -0,0 +1,261 @@
+/**
+ * Logging from the main loops, as text or deferred to the host.
+ *
+ * LOG_ERROR(), LOG_WARN(), LOG_INFO() and LOG_DEBUG() take a printf format
+ * (without the newline) and its arguments. Anything above HORTITEL_LOG_LEVEL
+ * isn't compiled in at all, arguments included, so a release build's debug
+ * logging costs nothing.
+ *
+ * Normally they're just printf(). Built with HORTITEL_DEFERRED_LOG nothing
+ * is formatted on the board, as defmt does it: each message is a small
+ * binary record of the address of its format string and the arguments as
+ * they are, which goes into a buffer and out to the console as a hostlink
+ * record (see hostlink.h) when the main loop calls log_flush(), or is thrown
+ * away if nothing's listening. The format strings never leave the firmware,
+ * the host reads them out of its ELF file to put the text back together,
+ * e.g. hortitel_decode -e sender.elf /dev/ttyACM0.
+ *
+ * The board encodes each argument by its type and the host decodes it by
+ * the conversion in the format, so the two are checked against each other
+ * at compile time. %d and %i take signed integers, %u %x %X %o and %c
+ * unsigned ones, %f %e and %g floats (sent as a float, even a double), and
+ * %s a string. No * widths. LOG_HEX() dumps a buffer in hex.
+ *
+ * Only for the main loop, not interrupts or the other core. The settings
+ * differ from one firmware to the next, so a core source that logs has to be
+ * in HORTITEL_CORE_LOGGING_SOURCES (src/core/CMakeLists.txt) to be built with
+ * each firmware's own, not once in hortitel_core.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <type_traits>
+#include "hal.h"
+#include "hostlink.h"
+#include "schema.h"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef HORTITEL_LOG_LEVEL
+#define HORTITEL_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#ifndef HORTITEL_DEFERRED_LOG
+#define HORTITEL_DEFERRED_LOG 0
+#endif
+
+// a log record, after the type and time as for any hostlink record:
+//   level (u8)
+//   format (varint): the address of the format string
+//   the arguments: integers as varints, signed ones zig-zagged, floats as a
+//     big-endian IEEE 754 float, strings and %H byte arrays as a varint
+//     length then the bytes
+// Anything that doesn't fit is cut short.
+static const size_t LOG_RECORD_MAX = HOSTLINK_RECORD_MAX;
+// framed records waiting for log_flush(), more than that and they're dropped
+static const size_t LOG_BUFFER_SIZE = 2048;
+
+// a buffer for LOG_HEX(), %H in a deferred format
+struct LogHex {
+    const uint8_t* data;
+    size_t len;
+};
+
+enum LogArgClass {
+    LOG_ARG_SIGNED,
+    LOG_ARG_UNSIGNED,
+    LOG_ARG_FLOAT,
+    LOG_ARG_STRING,
+    LOG_ARG_BYTES,
+    LOG_ARG_UNKNOWN,
+};
+
+template <typename T>
+constexpr LogArgClass log_arg_class() {
+    typedef typename std::decay<T>::type U;
+    if constexpr (std::is_same<U, bool>::value) {
+        return LOG_ARG_UNSIGNED;
+    } else if constexpr (std::is_enum<U>::value) {
+        return std::is_signed<typename std::underlying_type<U>::type>::value ? LOG_ARG_SIGNED : LOG_ARG_UNSIGNED;
+    } else if constexpr (std::is_integral<U>::value) {
+        return std::is_signed<U>::value ? LOG_ARG_SIGNED : LOG_ARG_UNSIGNED;
+    } else if constexpr (std::is_floating_point<U>::value) {
+        return LOG_ARG_FLOAT;
+    } else if constexpr (std::is_same<U, const char*>::value || std::is_same<U, char*>::value) {
+        return LOG_ARG_STRING;
+    } else if constexpr (std::is_same<U, LogHex>::value) {
+        return LOG_ARG_BYTES;
+    }
+    return LOG_ARG_UNKNOWN;
+}
+
+/**
+ * The class of argument the conversion at fmt[*i] (just past the %) wants,
+ * moving *i on to its last character. LOG_ARG_UNKNOWN for one we can't do,
+ * and for %% as that doesn't take one.
+ */
+constexpr LogArgClass log_conversion(const char* fmt, size_t* i, bool* percent) {
+    *percent = fmt[*i] == '%';
+    if (*percent) {
+        return LOG_ARG_UNKNOWN;
+    }
+    // flags, width, precision and length, which the host works out itself
+    for (;; (*i)++) {
+        char c = fmt[*i];
+        bool skip = c == '-' || c == '+' || c == ' ' || c == '#' || c == '.' || (c >= '0' && c <= '9')
+                || c == 'h' || c == 'l' || c == 'z' || c == 'j' || c == 't' || c == 'L';
+        if (!skip) {
+            break;
+        }
+    }
+    switch (fmt[*i]) {
+    case 'd': case 'i':
+        return LOG_ARG_SIGNED;
+    case 'u': case 'x': case 'X': case 'o': case 'c':
+        return LOG_ARG_UNSIGNED;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+        return LOG_ARG_FLOAT;
+    case 's':
+        return LOG_ARG_STRING;
+    case 'H':
+        return LOG_ARG_BYTES;
+    }
+    return LOG_ARG_UNKNOWN;
+}
+
+// whether the arguments are what fmt's conversions take, one for one
+constexpr bool log_format_matches(const char* fmt, const LogArgClass* args, size_t nargs) {
+    size_t n = 0;
+    for (size_t i = 0; fmt[i]; i++) {
+        if (fmt[i] != '%') {
+            continue;
+        }
+        i++;
+        bool percent = false;
+        LogArgClass want = log_conversion(fmt, &i, &percent);
+        if (percent) {
+            continue;
+        }
+        if (want == LOG_ARG_UNKNOWN || n >= nargs) {
+            return false;
+        }
+        if (args[n] != want) {
+            return false;
+        }
+        n++;
+    }
+    return n == nargs;
+}
+
+template <typename... Args>
+struct LogTypes {};
+// only ever used in decltype, to get at the argument types in a macro
+template <typename... Args>
+LogTypes<Args...> log_types(const Args&...);
+
+template <typename... Args>
+constexpr bool log_format_ok(LogTypes<Args...>, const char* fmt) {
+    const LogArgClass classes[] = { log_arg_class<Args>()..., LOG_ARG_UNKNOWN };
+    return log_format_matches(fmt, classes, sizeof...(Args));
+}
+
+// encoding the arguments, each returns nullptr if it didn't fit
+uint8_t* log_put_unsigned(uint8_t* buf, const uint8_t* end, uint64_t val);
+uint8_t* log_put_float(uint8_t* buf, const uint8_t* end, float val);
+uint8_t* log_put_bytes(uint8_t* buf, const uint8_t* end, const uint8_t* data, size_t len);
+
+template <typename T>
+uint8_t* log_put(uint8_t* buf, const uint8_t* end, const T& val) {
+    if (!buf) {
+        return nullptr;
+    }
+    constexpr LogArgClass cls = log_arg_class<T>();
+    if constexpr (cls == LOG_ARG_SIGNED) {
+        return log_put_unsigned(buf, end, zigzag_encode((int64_t)val));
+    } else if constexpr (cls == LOG_ARG_UNSIGNED) {
+        return log_put_unsigned(buf, end, (uint64_t)val);
+    } else if constexpr (cls == LOG_ARG_FLOAT) {
+        return log_put_float(buf, end, (float)val);
+    } else if constexpr (cls == LOG_ARG_STRING) {
+        size_t len = 0;
+        while (val[len]) {
+            len++;
+        }
+        return log_put_bytes(buf, end, (const uint8_t*)val, len);
+    } else {
+        return log_put_bytes(buf, end, val.data, val.len);
+    }
+}
+
+// the type, time, level and format, returns where the arguments go
+uint8_t* log_record_start(uint8_t* record, uint8_t level, const char* fmt);
+// add the crc and frame it into the buffer, dropping it if there's no room
+void log_record_end(uint8_t* record, uint8_t* end);
+
+template <typename... Args>
+void log_deferred(uint8_t level, const char* fmt, const Args&... args) {
+    uint8_t record[LOG_RECORD_MAX];
+    // leaving room for the crc
+    [[maybe_unused]] const uint8_t* end = record + LOG_RECORD_MAX - 2;
+    uint8_t* buf = log_record_start(record, level, fmt);
+    uint8_t* last = buf;
+    ((buf = log_put(buf, end, args), last = buf ? buf : last), ...);
+    log_record_end(record, last);
+}
+
+// send what's been logged to the console, or throw it away if there's no one
+// there, returns how many bytes went
+size_t log_flush();
+// records lost to a full buffer
+uint32_t log_dropped();
+
+// as text
+void log_print_hex(const char* label, const uint8_t* data, size_t len);
+
+// the format's checked either way, so a build at another level or deferred
+// doesn't turn up any surprises
+#define LOG_CHECK(fmt, ...) \
+        static_assert(log_format_ok(decltype(log_types(__VA_ARGS__)){}, fmt), "log arguments don't match " fmt)
+#if HORTITEL_DEFERRED_LOG
+#define LOG_AT(level, fmt, ...) do { \
+        LOG_CHECK(fmt, ##__VA_ARGS__); \
+        log_deferred(level, fmt, ##__VA_ARGS__); \
+    } while (0)
+#define LOG_HEX_AT(level, label, data, len) LOG_AT(level, label "={%H}", LogHex{ (data), (len) })
+#else
+#define LOG_AT(level, fmt, ...) do { \
+        LOG_CHECK(fmt, ##__VA_ARGS__); \
+        printf(fmt "\n", ##__VA_ARGS__); \
+    } while (0)
+#define LOG_HEX_AT(level, label, data, len) log_print_hex(label, (data), (len))
+#endif
+// compiled out, the arguments are only looked at, never evaluated
+#define LOG_OFF(fmt, ...) do { LOG_CHECK(fmt, ##__VA_ARGS__); } while (0)
+
+#if HORTITEL_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) LOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) LOG_OFF(fmt, ##__VA_ARGS__)
+#endif
+#if HORTITEL_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) LOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) LOG_OFF(fmt, ##__VA_ARGS__)
+#endif
+#if HORTITEL_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) LOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) LOG_OFF(fmt, ##__VA_ARGS__)
+#endif
+#if HORTITEL_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_HEX(label, data, len) LOG_HEX_AT(LOG_LEVEL_DEBUG, label, data, len)
+#else
+#define LOG_DEBUG(fmt, ...) LOG_OFF(fmt, ##__VA_ARGS__)
+#define LOG_HEX(label, data, len) LOG_OFF(label "={%H}", LogHex{ (data), (len) })
+#endif
@@ -0,0 +1,145 @@
+#include "node_stats.h"
+
+#include <cstdio>
+#include "relay.h"
+
+float NodeStats::loss_percent() const {
+    uint32_t expected = packets - duplicates + lost;
+    return expected ? 100.0f * lost / expected : 0.0f;
+}
+
+static size_t rssi_bucket(int16_t rssi) {
+    int bucket = (rssi - NODE_RSSI_BASE_DBM) / NODE_RSSI_BUCKET_DB;
+    if (rssi < NODE_RSSI_BASE_DBM || bucket < 0) {
+        return 0;
+    }
+    return (size_t)bucket < NODE_RSSI_BUCKETS - 1 ? bucket : NODE_RSSI_BUCKETS - 1;
+}
+
+void NodeStatsTable::heard(const struct rxdata& rxd, uint32_t now_ms) {
+    NodeStats* stats = table.get(rxd.src);
+    if (!stats) {
+        return;
+    }
+    bool first = stats->packets == 0;
+    stats->packets++;
+
+    if (rxd.meta.present & (1u << PACKET_SEQ)) {
+        uint16_t seq = rxd.meta.seq;
+        uint16_t gap = seq - stats->last_seq;
+        if (!stats->have_seq) {
+            stats->have_seq = true;
+        } else if (gap == 0) {
+            stats->duplicates++;
+            return;
+        } else if (gap < 0x8000) {
+            stats->lost += gap - 1;
+        } else if ((uint16_t)-gap <= NODE_SEQ_LATE_WINDOW) {
+            // turned up after some that were sent later, so it wasn't lost
+            // after all (or if nothing was, it's an old one again)
+            if (stats->lost > 0) {
+                stats->lost--;
+                stats->late++;
+            } else {
+                stats->duplicates++;
+            }
+            seq = stats->last_seq;
+        } else {
+            stats->restarts++;
+        }
+        stats->last_seq = seq;
+    }
+
+    if (first) {
+        stats->first_seen_ms = now_ms;
+    } else {
+        // as RFC 3550 does jitter, averaging over about the last 16
+        uint32_t gap_x16 = (now_ms - stats->last_seen_ms) * 16;
+        if (stats->interval_x16 == 0) {
+            stats->interval_x16 = gap_x16;
+        } else {
+            int32_t d = (int32_t)(gap_x16 - stats->interval_x16);
+            stats->interval_x16 += d / 16;
+            uint32_t deviation = d < 0 ? -d : d;
+            stats->jitter_x16 += ((int32_t)deviation - (int32_t)stats->jitter_x16) / 16;
+        }
+    }
+    stats->last_seen_ms = now_ms;
+
+    if (rxdata_relayed(rxd)) {
+        stats->relayed++;
+        return;
+    }
+    if (!stats->have_rssi) {
+        stats->have_rssi = true;
+        stats->rssi_min = rxd.rssi;
+        stats->rssi_max = rxd.rssi;
+    }
+    stats->rssi_last = rxd.rssi;
+    if (rxd.rssi < stats->rssi_min) {
+        stats->rssi_min = rxd.rssi;
+    }
+    if (rxd.rssi > stats->rssi_max) {
+        stats->rssi_max = rxd.rssi;
+    }
+    uint16_t& count = stats->rssi_hist[rssi_bucket(rxd.rssi)];
+    if (count < UINT16_MAX) {
+        count++;
+    }
+}
+
+void NodeStatsTable::print_summary(uint32_t now_ms) {
+    printf( "Nodes: %u", (unsigned)table.size() );
+    if (table.overflowed()) {
+        printf( " (and %lu packets from nodes there was no room for)", (unsigned long)table.overflowed() );
+    }
+    printf( "\n  node    packets   lost  loss%%  dups  late  restarts  interval  jitter  rssi last/min/max  last seen\n" );
+    table.for_each([&](uint16_t src, NodeStats& s) {
+        printf( "  0x%04X %8lu %6lu %5.1f%% %5lu %5lu %9lu %7lums %5lums %6d/%d/%d %8lus ago\n",
+                src, (unsigned long)s.packets, (unsigned long)s.lost, s.loss_percent(),
+                (unsigned long)s.duplicates, (unsigned long)s.late, (unsigned long)s.restarts,
+                (unsigned long)(s.interval_x16 / 16), (unsigned long)(s.jitter_x16 / 16),
+                s.rssi_last, s.rssi_min, s.rssi_max, (unsigned long)((now_ms - s.last_seen_ms) / 1000) );
+    });
+}
+
+bool NodeStatsTable::print_node(uint16_t src, uint32_t now_ms) {
+    const NodeStats* s = table.find(src);
+    if (!s) {
+        return false;
+    }
+    printf( "Node 0x%04X:\n", src );
+    printf( "  Packets: %lu, lost %lu (%.1f%%), duplicates %lu, late %lu, restarts %lu\n",
+            (unsigned long)s->packets, (unsigned long)s->lost, s->loss_percent(),
+            (unsigned long)s->duplicates, (unsigned long)s->late, (unsigned long)s->restarts );
+    if (s->relayed) {
+        printf( "  Relayed: %lu\n", (unsigned long)s->relayed );
+    }
+    if (s->have_seq) {
+        printf( "  Last sequence number: %u\n", (unsigned)s->last_seq );
+    } else {
+        printf( "  No sequence numbers, loss can't be told\n" );
+    }
+    printf( "  Interval: %lums, jitter %lums\n",
+            (unsigned long)(s->interval_x16 / 16), (unsigned long)(s->jitter_x16 / 16) );
+    printf( "  First seen %lus ago, last seen %lus ago\n",
+            (unsigned long)((now_ms - s->first_seen_ms) / 1000), (unsigned long)((now_ms - s->last_seen_ms) / 1000) );
+    if (!s->have_rssi) {
+        printf( "  Only heard through relays\n" );
+        return true;
+    }
+    printf( "  RSSI: last %d, min %d, max %d dBm\n", s->rssi_last, s->rssi_min, s->rssi_max );
+    for (size_t i = 0; i < NODE_RSSI_BUCKETS; i++) {
+        int from = NODE_RSSI_BASE_DBM + (int)i * NODE_RSSI_BUCKET_DB;
+        char range[24];
+        if (i == 0) {
+            snprintf( range, sizeof(range), "below %d", from + NODE_RSSI_BUCKET_DB );
+        } else if (i == NODE_RSSI_BUCKETS - 1) {
+            snprintf( range, sizeof(range), "%d and up", from );
+        } else {
+            snprintf( range, sizeof(range), "%d to %d", from, from + NODE_RSSI_BUCKET_DB );
+        }
+        printf( "    %-13s %u\n", range, (unsigned)s->rssi_hist[i] );
+    }
+    return true;
+}
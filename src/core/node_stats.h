@@ -0,0 +1,77 @@
+/**
+ * What the receiver has seen of each sender.
+ *
+ * Senders number their packets (PACKET_SEQ, see packet.h), so a gap in the
+ * numbers is packets lost on the way, the same number again is a duplicate,
+ * and one a little behind the last is a late arrival that was counted lost
+ * and now isn't. A big jump backwards is the sender having restarted. With
+ * that, how often packets turn up and how steadily, and a histogram of how
+ * strongly they were heard, it's enough to tell a node that's gone quiet
+ * from one whose packets aren't making it, and to see where moving a node
+ * or changing the radio settings would help.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "node_table.h"
+#include "packet.h"
+
+// RSSI histogram buckets, NODE_RSSI_BUCKET_DB wide, the first is everything
+// below NODE_RSSI_BASE_DBM + NODE_RSSI_BUCKET_DB and the last everything
+// from NODE_RSSI_BASE_DBM + (NODE_RSSI_BUCKETS - 1) * NODE_RSSI_BUCKET_DB up
+static const size_t NODE_RSSI_BUCKETS = 8;
+static const int NODE_RSSI_BASE_DBM = -130;
+static const int NODE_RSSI_BUCKET_DB = 10;
+// how far behind the last a sequence number can be and still be late
+// rather than the sender having started again
+static const uint16_t NODE_SEQ_LATE_WINDOW = 64;
+
+struct NodeStats {
+    // everything heard, bar the copies by other paths the receiver's
+    // DedupeCache caught (see relay.h), so duplicates are the same packet
+    // again from further back than that remembers
+    uint32_t packets;
+    uint32_t lost;
+    uint32_t duplicates;
+    uint32_t late;
+    uint32_t restarts;
+    uint32_t relayed; // came through a relay, see relay.h
+    uint16_t last_seq;
+    bool have_seq;
+
+    uint32_t first_seen_ms;
+    uint32_t last_seen_ms;
+    // moving averages of the time between packets and how far each gap is
+    // from that, in 1/16 ms
+    uint32_t interval_x16;
+    uint32_t jitter_x16;
+
+    // only for packets heard direct, a relayed one's is the relay's
+    bool have_rssi;
+    int16_t rssi_last;
+    int16_t rssi_min;
+    int16_t rssi_max;
+    uint16_t rssi_hist[NODE_RSSI_BUCKETS];
+
+    // lost as a percentage of what should have arrived
+    float loss_percent() const;
+};
+
+class NodeStatsTable {
+public:
+    // a decoded packet arrived at now_ms
+    void heard(const struct rxdata& rxd, uint32_t now_ms);
+
+    const NodeStats* find(uint16_t src) { return table.find(src); }
+    size_t nodes() const { return table.size(); }
+    // packets from nodes heard that there was no room to track
+    uint32_t untracked() const { return table.overflowed(); }
+
+    // a line per node, and everything about the one node
+    void print_summary(uint32_t now_ms);
+    bool print_node(uint16_t src, uint32_t now_ms);
+
+private:
+    NodeTable<NodeStats> table;
+};
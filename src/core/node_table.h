@@ -0,0 +1,99 @@
+/**
+ * Fixed size table of per-node state, keyed by network address.
+ *
+ * Open addressing with linear probing, no allocation and a lookup is usually
+ * one or two probes. Entries are never removed, a receiver hears from the
+ * same set of nodes for ever, so once it's full newcomers just aren't
+ * tracked (and are counted). There's a third again as many slots as nodes so
+ * it's never more than three quarters full, past that probing gets long.
+ *
+ * Every table of nodes the receiver keeps holds HORTITEL_MAX_NODES of them,
+ * set for the core library as a whole so everything agrees on it (see
+ * src/core/CMakeLists.txt).
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#ifndef HORTITEL_MAX_NODES
+#define HORTITEL_MAX_NODES 500
+#endif
+
+#if HORTITEL_MAX_NODES < 1 || HORTITEL_MAX_NODES > 49152
+#error "HORTITEL_MAX_NODES must be from 1 to 49152"
+#endif
+
+template <typename T, size_t NODES = HORTITEL_MAX_NODES>
+class NodeTable {
+public:
+    static const size_t CAPACITY = NODES;
+
+    // the entry for addr, nullptr if there isn't one
+    T* find(uint16_t addr) {
+        for (size_t i = hash(addr), n = 0; n < SIZE; i = next(i), n++) {
+            if (!used[i]) {
+                return nullptr;
+            }
+            if (keys[i] == addr) {
+                return &values[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // the entry for addr, made (value initialised) if need be, nullptr if
+    // the table is full
+    T* get(uint16_t addr) {
+        size_t i = hash(addr);
+        for (size_t n = 0; n < SIZE; i = next(i), n++) {
+            if (!used[i]) {
+                break;
+            }
+            if (keys[i] == addr) {
+                return &values[i];
+            }
+        }
+        if (count >= CAPACITY) {
+            overflow_count++;
+            return nullptr;
+        }
+        used[i] = true;
+        keys[i] = addr;
+        values[i] = T();
+        count++;
+        return &values[i];
+    }
+
+    size_t size() const { return count; }
+    // lookups for nodes that didn't get an entry because it was full
+    uint32_t overflowed() const { return overflow_count; }
+
+    // call fn(addr, value) for each entry, in no particular order
+    template <typename Fn>
+    void for_each(Fn fn) {
+        for (size_t i = 0; i < SIZE; i++) {
+            if (used[i]) {
+                fn(keys[i], values[i]);
+            }
+        }
+    }
+
+private:
+    static const size_t SIZE = NODES + NODES / 3 + 1;
+
+    // Fibonacci hashing, addresses tend to be sequential
+    static size_t hash(uint16_t addr) {
+        return (size_t)((addr * 40503u) & 0xFFFF) * SIZE >> 16;
+    }
+
+    static size_t next(size_t i) {
+        return i + 1 == SIZE ? 0 : i + 1;
+    }
+
+    bool used[SIZE] = {};
+    uint16_t keys[SIZE];
+    T values[SIZE];
+    size_t count = 0;
+    uint32_t overflow_count = 0;
+};
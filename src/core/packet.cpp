@@ -0,0 +1,115 @@
+#include "packet.h"
+#include "batch.h"
+
+uint8_t* serialise_u8(uint8_t* buf, uint8_t val) {
+    buf[0] = val;
+    return buf + 1;
+}
+uint8_t* serialise_u16(uint8_t* buf, uint16_t val) {
+    buf[0] = val >> 8;
+    buf[1] = val;
+    return buf + 2;
+}
+uint8_t* serialise_u32(uint8_t* buf, uint32_t val) {
+    buf[0] = (val & 0xff000000) >> 24;
+    buf[1] = (val & 0x00ff0000) >> 16;
+    buf[2] = (val & 0x0000ff00) >> 8;
+    buf[3] = (val & 0x000000ff);
+    return buf + 4;
+}
+size_t serialise_payload(const struct sensor_record* rec, uint32_t mask, uint8_t* buf) {
+    uint8_t* bufptr = serialise_u8(buf, PAYLOAD_FORMAT_RECORD);
+    bufptr += schema_encode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, rec, mask & rec->present, bufptr);
+    return (bufptr - buf);
+}
+size_t serialise_meta(const struct packet_meta* meta, uint8_t* buf) {
+    return schema_encode(PACKET_FIELDS, PACKET_FIELD_COUNT, meta, meta->present, buf);
+}
+size_t serialise_txdata(const struct txdata* txd, uint8_t* buf) {
+    uint8_t* bufptr = buf;
+    bufptr = serialise_u16(bufptr, txd->options);
+    bufptr = serialise_u16(bufptr, txd->dest);
+    bufptr += serialise_payload(&txd->readings, SENSOR_ALL_FIELDS, bufptr);
+    bufptr += serialise_meta(&txd->meta, bufptr);
+    return (bufptr - buf);
+}
+
+const uint8_t * deserialise_i16(const uint8_t * buf, int16_t * val) {
+    uint16_t uval = 0;
+    uval |= ((uint16_t)buf[0]) << 8;
+    uval |= (uint16_t)buf[1];
+    *val = (int16_t)uval;
+    return buf + 2;
+}
+const uint8_t * deserialise_u16(const uint8_t * buf, uint16_t * val) {
+    *val = 0; // just to be sure
+    *val |= ((uint16_t)buf[0]) << 8;
+    *val |= (uint16_t)buf[1];
+    return buf + 2;
+}
+const uint8_t * deserialise_u32(const uint8_t * buf, uint32_t * val) {
+    *val = ((uint32_t)buf[0]) << 24;
+    *val |= ((uint32_t)buf[1]) << 16;
+    *val |= ((uint32_t)buf[2]) << 8;
+    *val |= (uint32_t)buf[3];
+    return buf + 4;
+}
+const uint8_t * deserialise_u8(const uint8_t * buf, uint8_t * val) {
+    *val = (uint8_t)buf[0];
+    return buf + 1;
+}
+// a relay's source address is its own, the sender's is in the payload
+static void set_origin(struct rxdata* rxd) {
+    rxd->via = rxd->src;
+    if (rxd->meta.present & (1u << PACKET_ORIGIN)) {
+        rxd->src = rxd->meta.origin;
+    }
+}
+
+bool deseralise_rxdata(const uint8_t * buf, size_t len, struct rxdata *rxd) {
+    // header, format byte and checksum at the very least
+    if (len < RXDATA_HEADER_SIZE + 2) {
+        return false;
+    }
+    const uint8_t* end = buf + len - 1;
+    uint32_t checksum = 0;
+    for (const uint8_t* p = buf; p < end; p++) {
+        checksum += *p;
+    }
+
+    buf = deserialise_u16(buf, &(rxd->length));
+    buf = deserialise_u16(buf, &(rxd->options));
+    buf = deserialise_u8(buf, &(rxd->wtf));
+    buf = deserialise_i16(buf, &(rxd->rssi));
+    buf = deserialise_u16(buf, &(rxd->src));
+    buf = deserialise_u16(buf, &(rxd->dst));
+    buf = deserialise_u8(buf, &(rxd->format));
+    deserialise_u8(end, &(rxd->checksum));
+    rxd->listening = rxd->format & PAYLOAD_FLAG_LISTENING;
+    rxd->format &= ~PAYLOAD_FLAG_LISTENING;
+    if (rxd->length != len || rxd->checksum != (checksum & 0xff)) {
+        return false;
+    }
+
+    rxd->meta.present = 0;
+    if (rxd->format == PAYLOAD_FORMAT_BATCH) {
+        rxd->count = deserialise_batch(buf - 1, end - buf + 1, rxd->readings, rxd->age_ms, BATCH_MAX_SAMPLES, &rxd->meta);
+        for (size_t i = 0; i < rxd->count; i++) {
+            rxd->carried[i] = 0;
+        }
+        set_origin(rxd);
+        return rxd->count > 0;
+    }
+    if (rxd->format != PAYLOAD_FORMAT_RECORD) {
+        rxd->count = 0;
+        return false;
+    }
+    rxd->count = 1;
+    rxd->age_ms[0] = 0;
+    rxd->carried[0] = 0;
+    rxd->readings[0].present = 0;
+    bool ok = schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, buf, end - buf, &rxd->readings[0], &rxd->readings[0].present)
+        && schema_decode(PACKET_FIELDS, PACKET_FIELD_COUNT, buf, end - buf, &rxd->meta, &rxd->meta.present);
+    set_origin(rxd);
+    return ok;
+}
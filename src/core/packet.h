@@ -0,0 +1,166 @@
+/**
+ * The sensor data packet as sent by the sender and received by the receiver,
+ * plus the (de)serialisation of it to/from the bytes sent over the air.
+ *
+ * The payload is a format byte followed by the readings encoded as per the
+ * SENSOR_FIELDS schema (see schema.h), so to add a sensor add a member to
+ * sensor_record and a line to SENSOR_FIELDS with a new tag.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "schema.h"
+
+// The readings from a sender node
+struct sensor_record {
+    uint8_t charge_state; // the charge status as supplied by Melopero library
+    float mcu_temp; // the internal RPi temperature sensor value
+    float vbat; // battery circuit voltage - charging voltage or battery
+    float vin; // supply voltage, i.e. USB, solar, or battery
+
+    // which of the above are set (or were received), bit per SENSOR_FIELDS
+    // entry
+    uint32_t present;
+};
+
+enum SensorField {
+    SENSOR_CHARGE_STATE,
+    SENSOR_MCU_TEMP,
+    SENSOR_VBAT,
+    SENSOR_VIN,
+    SENSOR_FIELD_COUNT
+};
+
+// tags are forever, never reuse one for something else
+constexpr FieldDesc SENSOR_FIELDS[SENSOR_FIELD_COUNT] = {
+    { 1, FIELD_U8, offsetof(sensor_record, charge_state), 1, "Charge State", "" },
+    { 2, FIELD_FLOAT, offsetof(sensor_record, mcu_temp), 100, "RP2350 Temperature", " C" },
+    { 3, FIELD_FLOAT, offsetof(sensor_record, vbat), 1000, "Battery Voltage", "V" },
+    { 4, FIELD_FLOAT, offsetof(sensor_record, vin), 1000, "Supply Voltage", "V" },
+};
+static_assert(schema_valid(SENSOR_FIELDS), "bad SENSOR_FIELDS schema");
+
+static const uint32_t SENSOR_ALL_FIELDS = (1u << SENSOR_FIELD_COUNT) - 1;
+
+// About the packet rather than any one sample in it. These go in the same
+// payload as the readings, after them, encoded the same way, so they're
+// skipped by receivers that don't know them. Tags from 24 up are kept for
+// these.
+struct packet_meta {
+    uint16_t seq; // one more for each packet a sender sends, wraps
+    // added by relays, see relay.h
+    uint16_t origin; // the sender, as the source address is the relay's
+    uint8_t hops; // how many relays it's been through
+
+    uint32_t present;
+};
+
+enum PacketField {
+    PACKET_SEQ,
+    PACKET_ORIGIN,
+    PACKET_HOPS,
+    PACKET_FIELD_COUNT
+};
+
+constexpr FieldDesc PACKET_FIELDS[PACKET_FIELD_COUNT] = {
+    { 31, FIELD_U16, offsetof(packet_meta, seq), 1, "Sequence", "" },
+    { 30, FIELD_U16, offsetof(packet_meta, origin), 1, "Origin", "" },
+    { 29, FIELD_U8, offsetof(packet_meta, hops), 1, "Hops", "" },
+};
+static_assert(schema_valid(PACKET_FIELDS), "bad PACKET_FIELDS schema");
+static_assert(schema_disjoint(SENSOR_FIELDS, PACKET_FIELDS), "SENSOR_FIELDS using a packet tag");
+
+static const uint32_t PACKET_ALL_FIELDS = (1u << PACKET_FIELD_COUNT) - 1;
+// the most they can add to a payload, in a batch each is a one value column
+static const size_t PACKET_META_MAX_SIZE = PACKET_FIELD_COUNT * (SCHEMA_MAX_FIELD_SIZE + 1);
+
+// first byte of the payload, what follows it
+static const uint8_t PAYLOAD_FORMAT_RECORD = 0x01; // one sensor_record
+static const uint8_t PAYLOAD_FORMAT_BATCH = 0x02; // several, see batch.h
+static const uint8_t PAYLOAD_FORMAT_LINK = 0x03; // receiver to sender, see adr.h
+static const uint8_t PAYLOAD_FORMAT_BEACON = 0x04; // receiver to all, see tdma.h
+// set on the format byte of an uplink when the sender is listening for a
+// LinkFeedback straight after it, see adr.h
+static const uint8_t PAYLOAD_FLAG_LISTENING = 0x80;
+
+static const size_t RECORD_MAX_PAYLOAD = 1 + SENSOR_FIELD_COUNT * SCHEMA_MAX_FIELD_SIZE + PACKET_META_MAX_SIZE;
+
+// most samples in a batch, and keep the whole thing comfortably inside one
+// LoRaEMB data frame
+static const size_t BATCH_MAX_SAMPLES = 16;
+static const size_t BATCH_MAX_PAYLOAD = 200;
+
+static const size_t PAYLOAD_MAX_SIZE = RECORD_MAX_PAYLOAD > BATCH_MAX_PAYLOAD ? RECORD_MAX_PAYLOAD : BATCH_MAX_PAYLOAD;
+
+// This is our data transfer/packet struct
+struct txdata {
+    uint16_t options; // options as defined page 42: https://www.embit.eu/wp-content/uploads/2020/10/ebi-LoRa_rev1.0.1.pdf
+    uint16_t dest; // destination id, 0xFFFF for broadcast
+    struct sensor_record readings;
+    struct packet_meta meta;
+};
+
+// options and dest, then the payload
+static const size_t TXDATA_HEADER_SIZE = 4;
+static const size_t TXDATA_MAX_SIZE = TXDATA_HEADER_SIZE + PAYLOAD_MAX_SIZE;
+// where the format byte ends up in a serialised txdata, for setting
+// PAYLOAD_FLAG_LISTENING on it after the fact
+static const size_t TXDATA_FORMAT_OFFSET = TXDATA_HEADER_SIZE;
+
+// this is the structure of the received data
+struct rxdata {
+    // the "header"
+    // see LoRaEMB on page 42: https://www.embit.eu/wp-content/uploads/2020/10/ebi-LoRa_rev1.0.1.pdf
+    uint16_t length;
+    uint16_t options;
+    uint8_t wtf; // possibly an extra byte in the received data here? what is it? padding?
+    int16_t rssi;
+    uint16_t src; // the sender, for a relayed packet the one it started from
+    uint16_t dst;
+    uint16_t via; // who we heard it from, a relay or the same as src
+
+    // our data starts here, one record or a batch of them which is expanded
+    // out here, age_ms[i] is how long before sending readings[i] was taken
+    uint8_t format; // without PAYLOAD_FLAG_LISTENING
+    bool listening; // the sender wants a LinkFeedback
+    uint8_t count;
+    struct sensor_record readings[BATCH_MAX_SAMPLES];
+    uint32_t age_ms[BATCH_MAX_SAMPLES];
+    // fields of readings[i] that weren't sent but filled in from the last
+    // value heard, see report.h
+    uint32_t carried[BATCH_MAX_SAMPLES];
+    struct packet_meta meta;
+
+    // 1 byte checksum, simply the low byte of the sum of the previous bytes
+    uint8_t checksum;
+};
+
+// the bytes of the EMB received data frame before our payload
+static const size_t RXDATA_HEADER_SIZE = 11;
+
+// Serialisation functions
+uint8_t* serialise_u8(uint8_t* buf, uint8_t val);
+uint8_t* serialise_u16(uint8_t* buf, uint16_t val);
+uint8_t* serialise_u32(uint8_t* buf, uint32_t val);
+
+// encode just the payload, only the fields in mask (that are present)
+size_t serialise_payload(const struct sensor_record* rec, uint32_t mask, uint8_t* buf);
+// and the packet fields in meta->present
+size_t serialise_meta(const struct packet_meta* meta, uint8_t* buf);
+// encode the whole lot ready for transmitData(), buf must be TXDATA_MAX_SIZE
+size_t serialise_txdata(const struct txdata* txd, uint8_t* buf);
+
+// Deserialisation functions
+const uint8_t * deserialise_i16(const uint8_t * buf, int16_t * val);
+const uint8_t * deserialise_u16(const uint8_t * buf, uint16_t * val);
+const uint8_t * deserialise_u32(const uint8_t * buf, uint32_t * val);
+const uint8_t * deserialise_u8(const uint8_t * buf, uint8_t * val);
+
+/**
+ * Decode a complete received data frame of len bytes. Returns false if it's
+ * too short, the length or checksum is wrong or the payload can't be made
+ * sense of, in which case rxd may be partly filled in. A packet that came
+ * through a relay has the original sender as its src.
+ */
+bool deseralise_rxdata(const uint8_t * buf, size_t len, struct rxdata *rxd);
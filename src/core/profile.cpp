@@ -0,0 +1,84 @@
+#include "profile.h"
+
+#include <cstdio>
+
+// What the board draws in each phase, in uA. These are rough datasheet
+// figures, not measurements: the RP2350 running flat out at 150MHz is about
+// 20mA, the Embit module about 12mA awake or receiving and 44mA sending at
+// 14dBm, and the board about 0.3mA with the RP2350 dormant and the module
+// in energy save. Transmitting at lower power draws less than this says.
+static const struct {
+    const char* name;
+    uint32_t current_ua;
+} PROFILE_PHASES[PROFILE_PHASE_COUNT] = {
+    { "boot", 32000 },
+    { "adc", 20500 },
+    { "filter", 20000 },
+    { "serialise", 20000 },
+    { "tx", 32000 },
+    { "tx wait", 64000 },
+    { "listen", 32000 },
+    { "rx parse", 20000 },
+    { "console", 20000 },
+    { "sleep", 300 },
+};
+
+void Profiler::reset() {
+    for (size_t i = 0; i < PROFILE_PHASE_COUNT; i++) {
+        phases[i] = {};
+    }
+    packets = 0;
+}
+
+uint32_t Profiler::percentile_us(ProfilePhase phase, unsigned int pct) const {
+    const ProfileStats& s = phases[phase];
+    uint64_t want = ((uint64_t)s.count * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < PROFILE_BUCKETS; i++) {
+        seen += s.hist[i];
+        if (seen >= want && seen > 0) {
+            // the top of the bucket, but nothing took longer than the max
+            uint64_t top = (2ull << i) - 1;
+            return top < s.max_us ? (uint32_t)top : s.max_us;
+        }
+    }
+    return s.max_us;
+}
+
+float Profiler::charge_uah(ProfilePhase phase) const {
+    // uA for so many us, there are 3.6e9 of those to a uAh
+    return (float)((double)phases[phase].total_us * PROFILE_PHASES[phase].current_ua / 3.6e9);
+}
+
+float Profiler::uah_per_packet() const {
+    float total = 0;
+    for (size_t i = 0; i < PROFILE_PHASE_COUNT; i++) {
+        total += charge_uah((ProfilePhase)i);
+    }
+    return packets ? total / packets : 0;
+}
+
+void Profiler::print() const {
+    printf( "Profile (us):\n  %-10s %8s %10s %10s %10s %10s %12s %10s\n",
+            "phase", "count", "mean", "p50", "p99", "max", "total ms", "uAh" );
+    for (size_t i = 0; i < PROFILE_PHASE_COUNT; i++) {
+        const ProfileStats& s = phases[i];
+        if (s.count == 0) {
+            continue;
+        }
+        ProfilePhase phase = (ProfilePhase)i;
+        printf( "  %-10s %8lu %10lu %10lu %10lu %10lu %12lu %10.3f\n", PROFILE_PHASES[i].name,
+                (unsigned long)s.count, (unsigned long)(s.total_us / s.count),
+                (unsigned long)percentile_us(phase, 50), (unsigned long)percentile_us(phase, 99),
+                (unsigned long)s.max_us, (unsigned long)(s.total_us / 1000), charge_uah(phase) );
+        // only the buckets anything landed in, by where they start
+        printf( "  %10s", "" );
+        for (size_t b = 0; b < PROFILE_BUCKETS; b++) {
+            if (s.hist[b]) {
+                printf( " %lu+:%lu", b ? 1ul << b : 0ul, (unsigned long)s.hist[b] );
+            }
+        }
+        printf( "\n" );
+    }
+    printf( "Energy: %.3f uAh per packet over %lu packets (estimated)\n", uah_per_packet(), (unsigned long)packets );
+}
@@ -0,0 +1,104 @@
+/**
+ * Where the time (and so the battery) goes.
+ *
+ * The main loops mark out each phase of their work, sampling, encoding,
+ * transmitting and so on, with a ProfileSpan, and the Profiler keeps a count,
+ * total, maximum and histogram of how long each took. The histogram buckets
+ * are powers of two of microseconds, so a fixed 28 of them cover everything
+ * from a couple of microseconds to minutes asleep, and adding to one is a
+ * count leading zeros, nothing that'd show up in the timings themselves.
+ *
+ * From the time spent in each phase and roughly what the board draws during
+ * it (see profile.cpp) it also works out the charge used, per packet. These
+ * are estimates, datasheet currents rather than anything measured, but
+ * they're the same estimates every time so they're good for telling whether
+ * a change made things better or worse.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "hal.h"
+
+enum ProfilePhase {
+    PROFILE_BOOT, // power on to the start of the main loop, once
+    PROFILE_ADC, // capturing the samples
+    PROFILE_FILTER, // averaging them and converting to units
+    PROFILE_SERIALISE, // deciding what to send and encoding it
+    PROFILE_TX, // handing a packet to the radio module
+    PROFILE_TX_WAIT, // waiting for it to say it's gone, i.e. time on air
+    PROFILE_LISTEN, // the radio listening, for a downlink or for packets
+    PROFILE_RX_PARSE, // decoding a received frame and noting who sent it
+    PROFILE_CONSOLE, // printing, or the binary output to the host
+    PROFILE_SLEEP, // asleep between reports
+    PROFILE_PHASE_COUNT
+};
+
+// bucket 0 is under 2us, bucket i from 2^i us up to 2^(i+1), the last
+// everything from 2^27 us (a couple of minutes) up
+static const size_t PROFILE_BUCKETS = 28;
+
+struct ProfileStats {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t hist[PROFILE_BUCKETS];
+};
+
+class Profiler {
+public:
+    Profiler() { reset(); }
+
+    void record(ProfilePhase phase, uint32_t us) {
+        ProfileStats& s = phases[phase];
+        s.count++;
+        s.total_us += us;
+        if (us > s.max_us) {
+            s.max_us = us;
+        }
+        size_t bucket = us < 2 ? 0 : 31 - __builtin_clz(us);
+        s.hist[bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1]++;
+    }
+    // a packet went out (or came in), what the charge is shared over
+    void packet() { packets++; }
+    void reset();
+
+    const ProfileStats& stats(ProfilePhase phase) const { return phases[phase]; }
+    // at least pct percent took no longer than this, to within a bucket
+    uint32_t percentile_us(ProfilePhase phase, unsigned int pct) const;
+    // estimated charge used in the phase so far, and in all of them per packet
+    float charge_uah(ProfilePhase phase) const;
+    float uah_per_packet() const;
+
+    // a line per phase with its histogram, then the energy
+    void print() const;
+
+private:
+    ProfileStats phases[PROFILE_PHASE_COUNT];
+    uint32_t packets;
+};
+
+/**
+ * Times from construction to end() (or going out of scope) into phase. With
+ * no profiler it does nothing, not even read the clock. Uses hal_time_us(),
+ * which stops when the boards are dormant, so sleeps have to be timed by the
+ * PowerControl clock and recorded directly.
+ */
+class ProfileSpan {
+public:
+    ProfileSpan(Profiler* profiler, ProfilePhase phase)
+        : profiler(profiler), phase(phase), start_us(profiler ? hal_time_us() : 0) {}
+    ~ProfileSpan() { end(); }
+
+    void end() {
+        if (profiler) {
+            profiler->record(phase, (uint32_t)(hal_time_us() - start_us));
+            profiler = nullptr;
+        }
+    }
+
+private:
+    Profiler* profiler;
+    ProfilePhase phase;
+    uint64_t start_us;
+};
@@ -0,0 +1,178 @@
+#include "radio_config.h"
+
+#include "log.h"
+
+RadioConfig radio_config_defaults() {
+    RadioConfig cfg = {};
+    cfg.network_id[0] = 0x00;  // Example network ID
+    cfg.network_id[1] = 0x01;
+    cfg.output_power = 0x0a;  // Example power level
+    cfg.channel = 1;  // Example channel
+    cfg.sf = RADIO_SF_7;
+    cfg.bw = RADIO_BW_125;
+    cfg.cr = RADIO_CR_4_5;
+    cfg.energy_save = RADIO_ENERGY_SAVE_TX_ONLY;
+    cfg.protocol = false;
+    cfg.auto_ack = false;
+    cfg.cca = false;
+    return cfg;
+}
+
+static bool report(const char* what, EmbStatus status, EmbCommander& emb) {
+    if (status == EMB_OK) {
+        LOG_INFO("response to %s: %s (%lu us)", what, emb_status_str(status), (unsigned long)emb.elapsed_us());
+    } else {
+        LOG_WARN("response to %s: %s (%lu us)", what, emb_status_str(status), (unsigned long)emb.elapsed_us());
+    }
+    return status == EMB_OK;
+}
+
+// a different value if RadioConfig changes, so a cache left by other firmware
+// isn't taken for ours
+static const uint32_t RADIO_CACHE_MAGIC = 0x52434600 | sizeof(RadioConfig);
+
+static uint32_t fnv1a(uint32_t hash, uint32_t val, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        hash = (hash ^ ((val >> (8 * i)) & 0xFF)) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t radio_config_hash(const RadioConfig& cfg) {
+    uint32_t hash = 2166136261u;
+    hash = fnv1a(hash, cfg.network_address, 2);
+    hash = fnv1a(hash, cfg.network_id[0], 1);
+    hash = fnv1a(hash, cfg.network_id[1], 1);
+    hash = fnv1a(hash, cfg.output_power, 1);
+    hash = fnv1a(hash, cfg.channel, 1);
+    hash = fnv1a(hash, cfg.sf, 1);
+    hash = fnv1a(hash, cfg.bw, 1);
+    hash = fnv1a(hash, cfg.cr, 1);
+    hash = fnv1a(hash, cfg.energy_save, 1);
+    hash = fnv1a(hash, cfg.protocol | cfg.auto_ack << 1 | cfg.cca << 2, 1);
+    return hash;
+}
+
+const RadioConfig* RadioConfigCache::get() const {
+    if (magic != RADIO_CACHE_MAGIC || hash != radio_config_hash(cfg)) {
+        return nullptr;
+    }
+    return &cfg;
+}
+
+void RadioConfigCache::put(const RadioConfig& c) {
+    cfg = c;
+    hash = radio_config_hash(cfg);
+    magic = RADIO_CACHE_MAGIC;
+}
+
+void RadioConfigCache::forget() {
+    magic = 0;
+}
+
+bool radio_configure(EmbCommander& emb, Radio& radio, const RadioConfig& cfg, RadioConfigCache* cache) {
+    bool ok = true;
+    // what the module has already, if we know, and then not until it's done
+    RadioConfig was = {};
+    bool warm = cache && cache->get();
+    if (warm) {
+        was = *cache->get();
+        cache->forget();
+    }
+
+    EmbStatus status = emb.run(EMB_CMD_DEVICE_INFO, [&]{ radio.sendCmd(EMB_CMD_DEVICE_INFO); });
+    ok &= report("deviceId", status, emb);
+    if (status == EMB_OK) {
+        LOG_HEX("device info", emb.response(), emb.response_len());
+    } else {
+        // it might have been reset, or swapped, start from scratch
+        warm = false;
+    }
+
+    bool prefs = !warm || was.protocol != cfg.protocol || was.auto_ack != cfg.auto_ack || was.cca != cfg.cca;
+    bool power = !warm || was.output_power != cfg.output_power;
+    bool channel = !warm || was.channel != cfg.channel || was.sf != cfg.sf || was.bw != cfg.bw || was.cr != cfg.cr;
+    bool address = !warm || was.network_address != cfg.network_address;
+    bool id = !warm || was.network_id[0] != cfg.network_id[0] || was.network_id[1] != cfg.network_id[1];
+    bool energy_save = !warm || was.energy_save != cfg.energy_save;
+    // the network settings need it stopped to take them
+    bool restart = prefs || channel || address || id;
+    if (warm) {
+        LOG_INFO("radio already configured, %s", restart || power || energy_save ? "updating" : "unchanged");
+    }
+
+    if (restart) {
+        ok &= report("stopNetwork", emb.run(EMB_CMD_NETWORK_STOP, [&]{
+            radio.stopNetwork();
+        }), emb);
+    }
+    if (prefs) {
+        ok &= report("setNetworkPreferences", emb.run(EMB_CMD_NETWORK_PREFERENCES, [&]{
+            radio.setNetworkPreferences(cfg.protocol, cfg.auto_ack, cfg.cca);
+        }), emb);
+    }
+    if (power) {
+        ok &= report("setOutputPower", emb.run(EMB_CMD_OUTPUT_POWER, [&]{
+            radio.setOutputPower(cfg.output_power);
+        }), emb);
+    }
+    if (channel) {
+        ok &= report("setOperatingChannel", emb.run(EMB_CMD_OPERATING_CHANNEL, [&]{
+            radio.setOperatingChannel(cfg.channel, cfg.sf, cfg.bw, cfg.cr);
+        }), emb);
+    }
+    if (address) {
+        ok &= report("setNetworkAddress", emb.run(EMB_CMD_NETWORK_ADDRESS, [&]{
+            radio.setNetworkAddress(cfg.network_address);
+        }), emb);
+    }
+    if (id) {
+        ok &= report("setNetworkId", emb.run(EMB_CMD_NETWORK_ID, [&]{
+            uint8_t network_id[] = { cfg.network_id[0], cfg.network_id[1] };
+            radio.setNetworkId(network_id, sizeof(network_id));
+        }), emb);
+    }
+    if (energy_save) {
+        ok &= report("setEnergySaveMode", emb.run(EMB_CMD_ENERGY_SAVE, [&]{
+            radio.setEnergySaveMode(cfg.energy_save);
+        }), emb);
+    }
+    if (restart) {
+        ok &= report("startNetwork", emb.run(EMB_CMD_NETWORK_START, [&]{
+            radio.startNetwork();
+        }), emb);
+    }
+
+    if (ok && cache) {
+        cache->put(cfg);
+    }
+    return ok;
+}
+
+EmbStatus radio_set_output_power(EmbCommander& emb, Radio& radio, uint8_t power, RadioConfigCache* cache) {
+    const RadioConfig* was = cache ? cache->get() : nullptr;
+    RadioConfig cfg = was ? *was : RadioConfig{};
+    if (cache) {
+        cache->forget();
+    }
+    EmbStatus status = emb.run(EMB_CMD_OUTPUT_POWER, [&]{ radio.setOutputPower(power); });
+    if (was && status == EMB_OK) {
+        cfg.output_power = power;
+        cache->put(cfg);
+    }
+    return status;
+}
+
+EmbStatus radio_set_energy_save(EmbCommander& emb, Radio& radio, RadioEnergySaveMode mode, RadioConfigCache* cache) {
+    const RadioConfig* was = cache ? cache->get() : nullptr;
+    RadioConfig cfg = was ? *was : RadioConfig{};
+    if (cache) {
+        cache->forget();
+    }
+    EmbStatus status = emb.run(EMB_CMD_ENERGY_SAVE, [&]{ radio.setEnergySaveMode(mode); });
+    if (was && status == EMB_OK) {
+        cfg.energy_save = mode;
+        cache->put(cfg);
+    }
+    return status;
+}
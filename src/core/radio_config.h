@@ -0,0 +1,78 @@
+/**
+ * LoRaEMB operating mode configuration, shared by the sender and receiver.
+ */
+#pragma once
+
+#include <cstdint>
+#include "hal.h"
+#include "emb_command.h"
+
+struct RadioConfig {
+    uint16_t network_address;
+    uint8_t network_id[2];
+    uint8_t output_power;
+    uint8_t channel;
+    RadioSpreadingFactor sf;
+    RadioBandwidth bw;
+    RadioCodingRate cr;
+    RadioEnergySaveMode energy_save;
+    // network preferences
+    bool protocol;
+    bool auto_ack;
+    bool cca;
+};
+
+// the settings we've been using so far, just the address and energy save
+// mode need filling in
+RadioConfig radio_config_defaults();
+
+/**
+ * What the module was last set to, kept somewhere that survives the MCU
+ * rebooting while the module stays powered, i.e. RAM the C runtime doesn't
+ * clear at startup (see __uninitialized_ram() on the boards). After a power
+ * cut it's garbage, which the hash over it catches, so there's no need to
+ * initialise it.
+ */
+class RadioConfigCache {
+public:
+    // the module's configuration, nullptr if we don't know it
+    const RadioConfig* get() const;
+    void put(const RadioConfig& cfg);
+    void forget();
+
+private:
+    uint32_t magic;
+    uint32_t hash;
+    RadioConfig cfg;
+};
+
+// FNV-1a over the settings (not the struct, so padding doesn't matter)
+uint32_t radio_config_hash(const RadioConfig& cfg);
+
+/**
+ * Query the device ID and run the configuration sequence:
+ *
+ *   Stop Network
+ *   Set Network preferences
+ *   Set Output power
+ *   Set Operating channel
+ *   Set Network address
+ *   Set Network ID
+ *   Set Energy save mode
+ *   Start Network
+ *
+ * Each step moves on as soon as the module acknowledges it. Returns false if
+ * any step failed or timed out, it still attempts the rest.
+ *
+ * Given a cache that knows what the module is already set to (a warm boot)
+ * only the settings that differ are sent, and the network is only stopped
+ * and started again if one of those needs it. Output power and energy save
+ * mode don't. If nothing differs that's just the device ID query, to check
+ * the module is there and answering. The cache is updated to match once the
+ * module's taken it all, and forgotten if it didn't.
+ */
+bool radio_configure(EmbCommander& emb, Radio& radio, const RadioConfig& cfg, RadioConfigCache* cache = nullptr);
+
+// the settings that change as the node runs, keeping the cache in step
+EmbStatus radio_set_output_power(EmbCommander& emb, Radio& radio, uint8_t power, RadioConfigCache* cache);
+EmbStatus radio_set_energy_save(EmbCommander& emb, Radio& radio, RadioEnergySaveMode mode, RadioConfigCache* cache);
@@ -0,0 +1,133 @@
+#include "relay.h"
+
+#include <cstring>
+#include "batch.h"
+#include "frame.h"
+
+bool DedupeCache::seen(const struct rxdata& rxd, uint32_t now_ms) {
+    if (!(rxd.meta.present & (1u << PACKET_SEQ))) {
+        return false;
+    }
+    size_t oldest = 0;
+    for (size_t i = 0; i < used; i++) {
+        Entry& e = entries[i];
+        if (e.src == rxd.src && e.seq == rxd.meta.seq) {
+            bool recent = now_ms - e.time_ms < DEDUPE_WINDOW_MS;
+            e.time_ms = now_ms;
+            dups += recent;
+            return recent;
+        }
+        if (now_ms - e.time_ms > now_ms - entries[oldest].time_ms) {
+            oldest = i;
+        }
+    }
+    size_t slot = used < DEDUPE_ENTRIES ? used++ : oldest;
+    entries[slot] = { rxd.src, rxd.meta.seq, now_ms };
+    return false;
+}
+
+// copy the fields or columns from in to end across to out, leaving out the
+// relay's own, returns where out got to or nullptr if they don't make sense
+static uint8_t* copy_fields(const uint8_t* in, const uint8_t* end, uint8_t* out) {
+    while (in < end) {
+        const uint8_t* start = in;
+        uint8_t tag = *in >> 3;
+        uint8_t wire = *in & 0x07;
+        in++;
+        uint64_t val;
+        switch (wire) {
+            case WIRE_VARINT:
+                in = varint_get(in, end, &val);
+                break;
+            case WIRE_FIXED32:
+                in = (end - in >= 4) ? in + 4 : nullptr;
+                break;
+            case WIRE_BYTES:
+                in = varint_get(in, end, &val);
+                in = (in && (uint64_t)(end - in) >= val) ? in + val : nullptr;
+                break;
+            default:
+                return nullptr;
+        }
+        if (!in) {
+            return nullptr;
+        }
+        if (tag != PACKET_FIELDS[PACKET_ORIGIN].tag && tag != PACKET_FIELDS[PACKET_HOPS].tag) {
+            memcpy(out, start, in - start);
+            out += in - start;
+        }
+    }
+    return out;
+}
+
+// nothing to send, and why
+static size_t relay_fail(RelayStatus* status, RelayStatus why) {
+    if (status) {
+        *status = why;
+    }
+    return 0;
+}
+
+size_t relay_txdata(const uint8_t* frame, size_t len, const struct rxdata& rxd, uint8_t max_hops, uint32_t held_ms,
+        uint8_t* buf, RelayStatus* status) {
+    uint8_t hops = (rxd.meta.present & (1u << PACKET_HOPS)) ? rxd.meta.hops : 0;
+    if (hops >= max_hops || hops >= RELAY_MAX_HOPS) {
+        return relay_fail(status, RELAY_HOP_LIMIT);
+    }
+    if (rxd.format != PAYLOAD_FORMAT_RECORD && rxd.format != PAYLOAD_FORMAT_BATCH) {
+        return relay_fail(status, RELAY_NOT_UPLINK);
+    }
+    if (len < RXDATA_HEADER_SIZE + 2) {
+        return relay_fail(status, RELAY_MALFORMED);
+    }
+    const uint8_t* in = frame + RXDATA_HEADER_SIZE;
+    const uint8_t* end = frame + len - 1; // the checksum
+
+    // put together somewhere roomier first, what we've added might not fit
+    uint8_t out[4 + EMB_MAX_FRAME + PACKET_META_MAX_SIZE];
+    uint8_t* outptr = serialise_u16(out, 0); // options, as the senders
+    outptr = serialise_u16(outptr, 0xFFFF); // broadcast
+    outptr = serialise_u8(outptr, rxd.format);
+    in++;
+
+    struct packet_meta meta = {};
+    meta.origin = rxd.src;
+    meta.hops = hops + 1;
+    meta.present = (1u << PACKET_ORIGIN) | (1u << PACKET_HOPS);
+
+    if (rxd.format == PAYLOAD_FORMAT_BATCH) {
+        // the count, then the ages which are as of when it's sent on, so the
+        // first, that the rest are relative to, is held_ms older
+        uint64_t val;
+        if (in >= end) {
+            return relay_fail(status, RELAY_MALFORMED);
+        }
+        size_t count = *in;
+        outptr = serialise_u8(outptr, *in++);
+        for (size_t i = 0; i < count; i++) {
+            if (!(in = varint_get(in, end, &val))) {
+                return relay_fail(status, RELAY_MALFORMED);
+            }
+            outptr = varint_put(outptr, i == 0 ? val + held_ms : val);
+        }
+        if (!(outptr = copy_fields(in, end, outptr))) {
+            return relay_fail(status, RELAY_MALFORMED);
+        }
+        outptr += serialise_batch_meta(&meta, outptr);
+    } else {
+        if (!(outptr = copy_fields(in, end, outptr))) {
+            return relay_fail(status, RELAY_MALFORMED);
+        }
+        outptr += serialise_meta(&meta, outptr);
+    }
+
+    size_t out_len = outptr - out;
+    if (out_len > TXDATA_MAX_SIZE) {
+        return relay_fail(status, RELAY_TOO_BIG);
+    }
+    memcpy(buf, out, out_len);
+    if (status) {
+        *status = RELAY_OK;
+    }
+    return out_len;
+}
@@ -0,0 +1,88 @@
+/**
+ * Passing senders' packets on, for nodes out of the receiver's reach.
+ *
+ * A relay is a spare board that listens like the receiver does and
+ * broadcasts every uplink it hears again, with two packet fields added (see
+ * packet.h): PACKET_ORIGIN, the sender's address, as the source address is
+ * now the relay's own, and PACKET_HOPS, how many relays it's been through.
+ * Relays pass on what other relays send too, up to a limit on the hops, so
+ * a chain of them can reach across a bigger site and the far nodes needn't
+ * shout.
+ *
+ * With relays about the same packet arrives more than once, direct and by
+ * way of one or more relays. The relays and the receiver each keep a
+ * DedupeCache of the (sender, sequence number) pairs they've seen lately,
+ * a relay so it doesn't pass on what it already has (two relays in earshot
+ * of each other would otherwise bounce everything back and forth until it
+ * ran out of hops) and the receiver so each packet only counts once. A
+ * packet without a sequence number can't be told from another, so it's only
+ * the hop limit that stops those.
+ *
+ * Only uplinks go through relays, the receiver's link feedback and beacons
+ * don't, so a sender that can only reach a relay can't use HORTITEL_ADR or
+ * HORTITEL_TDMA. Relays clear PAYLOAD_FLAG_LISTENING on what they pass on
+ * for the same reason, and the receiver leaves relayed packets out of its
+ * idea of how well it hears the sender.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "packet.h"
+
+// most relays a packet can go through, whatever a relay's set to
+static const uint8_t RELAY_MAX_HOPS = 8;
+
+// (sender, sequence number) pairs remembered, and for how long. Long enough
+// for a packet to make its way through every relay, not so long that a
+// sender that's restarted has its new packets taken for old ones.
+static const size_t DEDUPE_ENTRIES = 64;
+static const uint32_t DEDUPE_WINDOW_MS = 30000;
+
+class DedupeCache {
+public:
+    /**
+     * Whether the packet has been seen in the last DEDUPE_WINDOW_MS, noting
+     * that it has as of now_ms either way. Always false for one without a
+     * sequence number. When it's full the least recently seen is forgotten.
+     */
+    bool seen(const struct rxdata& rxd, uint32_t now_ms);
+
+    // packets seen() said had been, ever
+    uint32_t duplicates() const { return dups; }
+
+private:
+    struct Entry {
+        uint16_t src;
+        uint16_t seq;
+        uint32_t time_ms;
+    };
+    Entry entries[DEDUPE_ENTRIES];
+    size_t used = 0;
+    uint32_t dups = 0;
+};
+
+// whether a packet came through a relay rather than straight from the sender
+static inline bool rxdata_relayed(const struct rxdata& rxd) {
+    return rxd.meta.present & (1u << PACKET_HOPS);
+}
+
+// why relay_txdata() did or didn't give something to send
+enum RelayStatus {
+    RELAY_OK,
+    RELAY_HOP_LIMIT, // been through max_hops relays already
+    RELAY_NOT_UPLINK, // a beacon, link feedback or some other format
+    RELAY_MALFORMED, // the payload didn't make sense
+    RELAY_TOO_BIG, // no room for the relay fields
+};
+
+/**
+ * The uplink in a received data frame (of len bytes, decoded into rxd)
+ * ready for transmitData() to broadcast again: the payload with the
+ * listening flag cleared and the relay fields set for one more hop.
+ * held_ms, how long it's been since it arrived, is added to a batch's
+ * sample ages. buf must be TXDATA_MAX_SIZE. Returns 0 if there's nothing to
+ * send, with the reason in status if given.
+ */
+size_t relay_txdata(const uint8_t* frame, size_t len, const struct rxdata& rxd, uint8_t max_hops, uint32_t held_ms,
+        uint8_t* buf, RelayStatus* status = nullptr);
@@ -0,0 +1,83 @@
+#include "report.h"
+
+#include <cstdlib>
+
+ReportDecision ReportPolicy::check(const struct sensor_record& rec, uint32_t now_ms) const {
+    ReportDecision decision = { 0, false };
+    if (!have_sent || (int32_t)(now_ms - heartbeat_due_ms) >= 0) {
+        decision.mask = rec.present;
+        return decision;
+    }
+    for (size_t i = 0; i < SENSOR_FIELD_COUNT; i++) {
+        uint32_t bit = 1u << i;
+        if (!(rec.present & bit)) {
+            continue;
+        }
+        const FieldDesc& field = SENSOR_FIELDS[i];
+        const ReportRule& rule = rules[i];
+        if (!(last_present & bit)) {
+            // not had this one before, e.g. a sensor plugged in
+            decision.mask |= bit;
+            decision.urgent = true;
+            continue;
+        }
+        int64_t wire = schema_get_wire(field, &rec);
+        int64_t last = last_wire[i];
+        if (wire == last) {
+            continue;
+        }
+        if (llabs(wire - last) >= llroundf(rule.deadband * field.scale)) {
+            decision.mask |= bit;
+            decision.urgent |= rule.urgent;
+        }
+        if (!std::isnan(rule.threshold)) {
+            int64_t threshold = llroundf(rule.threshold * field.scale);
+            if ((wire < threshold) != (last < threshold)) {
+                decision.mask |= bit;
+                decision.urgent = true;
+            }
+        }
+    }
+    return decision;
+}
+
+void ReportPolicy::sent(const struct sensor_record& rec, uint32_t mask, uint32_t now_ms) {
+    mask &= rec.present;
+    for (size_t i = 0; i < SENSOR_FIELD_COUNT; i++) {
+        if (mask & (1u << i)) {
+            last_wire[i] = schema_get_wire(SENSOR_FIELDS[i], &rec);
+        }
+    }
+    last_present |= mask;
+    // a full report puts off the next heartbeat
+    if (!have_sent || (mask & rec.present) == rec.present) {
+        have_sent = true;
+        heartbeat_due_ms = now_ms + heartbeat_ms;
+    }
+}
+
+uint32_t LastKnownValues::fill(uint16_t src, struct sensor_record& rec) {
+    struct sensor_record* last = table.get(src);
+    if (!last) {
+        return 0;
+    }
+    uint32_t filled = last->present & ~rec.present;
+    for (size_t i = 0; i < SENSOR_FIELD_COUNT; i++) {
+        const FieldDesc& field = SENSOR_FIELDS[i];
+        if (filled & (1u << i)) {
+            schema_set_wire(field, &rec, schema_get_wire(field, last));
+        } else if (rec.present & (1u << i)) {
+            schema_set_wire(field, last, schema_get_wire(field, &rec));
+        }
+    }
+    last->present |= rec.present;
+    rec.present |= filled;
+    return filled;
+}
+
+void LastKnownValues::fill(struct rxdata& rxd) {
+    // a batch is oldest first
+    for (size_t i = 0; i < rxd.count; i++) {
+        rxd.carried[i] = fill(rxd.src, rxd.readings[i]);
+    }
+}
@@ -0,0 +1,90 @@
+/**
+ * Change-driven reporting.
+ *
+ * Rather than every field every cycle the sender only sends what has moved
+ * since it was last sent, by more than that field's deadband, plus all of it
+ * every so often as a heartbeat (so the receiver knows the node is alive,
+ * and to put right anything it missed). A sample where nothing moved isn't
+ * sent at all. Some changes shouldn't wait for a batch to fill up, e.g. the
+ * charger reporting a fault, or the battery dropping past a threshold, those
+ * are flagged as urgent.
+ *
+ * Comparisons are done on the values as they go over the air (see
+ * schema_get_wire()), i.e. what the receiver last saw, so the two ends agree
+ * on what counts as a change.
+ *
+ * The receiver keeps the last value it heard of each field from each node,
+ * see LastKnownValues, and fills in whatever wasn't sent.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include "node_table.h"
+#include "packet.h"
+
+struct ReportRule {
+    // send once the value has moved this far from what was last sent, in
+    // the field's own units, 0 for any change at all
+    float deadband;
+    // crossing this, either way, is urgent, NAN for none
+    float threshold;
+    // any change is urgent
+    bool urgent;
+};
+
+// one per SENSOR_FIELDS entry, in the same order
+constexpr ReportRule SENSOR_REPORT_RULES[SENSOR_FIELD_COUNT] = {
+    { 0, NAN, true },        // charge state: changes are what it's for
+    { 1.0f, NAN, false },    // RP2350 temperature
+    { 0.05f, 3.4f, false },  // battery, and it getting low
+    { 0.25f, 1.0f, false },  // supply, and it going away or coming back
+};
+
+struct ReportDecision {
+    uint32_t mask; // fields to send, 0 for don't bother
+    bool urgent;   // send now rather than waiting for a batch to fill
+};
+
+class ReportPolicy {
+public:
+    ReportPolicy(uint32_t heartbeat_ms, const ReportRule* rules = SENSOR_REPORT_RULES)
+        : rules(rules), heartbeat_ms(heartbeat_ms) {}
+
+    // what of rec (taken at now_ms) is worth sending
+    ReportDecision check(const struct sensor_record& rec, uint32_t now_ms) const;
+    // the fields in mask of rec went out at now_ms
+    void sent(const struct sensor_record& rec, uint32_t mask, uint32_t now_ms);
+
+    // samples not sent as nothing had changed
+    uint32_t skipped() const { return skip_count; }
+    void skip() { skip_count++; }
+
+private:
+    const ReportRule* rules;
+    uint32_t heartbeat_ms;
+    bool have_sent = false;
+    uint32_t heartbeat_due_ms = 0;
+    uint32_t last_present = 0;
+    int64_t last_wire[SENSOR_FIELD_COUNT] = {};
+    uint32_t skip_count = 0;
+};
+
+/**
+ * The receiver's view of each node, the last value heard for every field.
+ */
+class LastKnownValues {
+public:
+    /**
+     * Fill in the fields rec is missing from what was last heard from src,
+     * and remember the ones it has. Returns the mask of the fields filled in.
+     */
+    uint32_t fill(uint16_t src, struct sensor_record& rec);
+    // the same for every sample of a received packet, setting rxd->carried
+    void fill(struct rxdata& rxd);
+
+    size_t nodes() const { return table.size(); }
+
+private:
+    NodeTable<struct sensor_record> table;
+};
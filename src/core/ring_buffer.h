@@ -0,0 +1,62 @@
+/**
+ * Lock-free single producer, single consumer byte ring buffer.
+ *
+ * Meant for an interrupt handler (or the other core) pushing bytes in while
+ * the main loop takes them out, no locks or disabling interrupts needed as
+ * each side only ever writes its own index.
+ *
+ * The first MIRROR bytes of the buffer are also written to a copy just past
+ * the end of it, so any run of up to MIRROR bytes can be read in place as one
+ * contiguous block even if it wraps around. That lets the frame parser hand
+ * out frames without copying them anywhere.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+template <size_t SIZE, size_t MIRROR>
+class ByteRing {
+    static_assert((SIZE & (SIZE - 1)) == 0, "ring size must be a power of two");
+    static_assert(MIRROR <= SIZE, "mirror can't be bigger than the ring");
+
+public:
+    // producer side, returns false (and drops the byte) if we're full
+    bool push(uint8_t byte) {
+        uint32_t w = write_idx.load(std::memory_order_relaxed);
+        if (w - read_idx.load(std::memory_order_acquire) >= SIZE) {
+            dropped_count++;
+            return false;
+        }
+        size_t pos = w & (SIZE - 1);
+        storage[pos] = byte;
+        if (pos < MIRROR) {
+            storage[SIZE + pos] = byte;
+        }
+        write_idx.store(w + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    size_t available() const {
+        return write_idx.load(std::memory_order_acquire) - read_idx.load(std::memory_order_relaxed);
+    }
+    // the next unread byte, the following min(available(), MIRROR) bytes
+    // are contiguous from here
+    uint8_t* read_ptr() {
+        return &storage[read_idx.load(std::memory_order_relaxed) & (SIZE - 1)];
+    }
+    void consume(size_t n) {
+        read_idx.store(read_idx.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // bytes thrown away because the consumer didn't keep up
+    uint32_t dropped() const { return dropped_count; }
+
+private:
+    uint8_t storage[SIZE + MIRROR];
+    std::atomic<uint32_t> write_idx{0};
+    std::atomic<uint32_t> read_idx{0};
+    volatile uint32_t dropped_count = 0;
+};
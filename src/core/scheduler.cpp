@@ -0,0 +1,18 @@
+#include "scheduler.h"
+
+// move on to the next slot on the grid, skipping any we've already missed,
+// returns the current time
+uint64_t DutyCycleScheduler::advance() {
+    uint64_t now = power.now_us();
+    if (period_us == 0) {
+        next_us = now;
+        return now;
+    }
+    next_us += period_us;
+    if (next_us <= now) {
+        uint64_t behind = (now - next_us) / period_us + 1;
+        missed_count += behind;
+        next_us += behind * period_us;
+    }
+    return now;
+}
@@ -0,0 +1,69 @@
+/**
+ * Duty-cycle scheduling for battery/solar powered nodes.
+ *
+ * Reports go out on a fixed grid of period_ms, measured start to start, so
+ * the time spent doing the work doesn't make the period drift. In between the
+ * node is put into the deepest sleep the PowerControl offers, with hooks to
+ * switch peripherals off beforehand and back on again after waking. If the
+ * gap is too short for a deep sleep to be worth the wake-up cost we just do
+ * a normal sleep instead.
+ */
+#pragma once
+
+#include <cstdint>
+#include "hal.h"
+
+// below this a deep sleep costs more than it saves
+static const uint32_t DEEP_SLEEP_MIN_MS = 50;
+
+class DutyCycleScheduler {
+public:
+    DutyCycleScheduler(PowerControl& power, uint32_t period_ms)
+        : power(power), period_us((uint64_t)period_ms * 1000), next_us(power.now_us()) {}
+
+    void set_period_ms(uint32_t period_ms) { period_us = (uint64_t)period_ms * 1000; }
+    uint32_t period_ms() const { return period_us / 1000; }
+
+    // reports skipped because a cycle overran its period
+    uint32_t missed() const { return missed_count; }
+
+    /**
+     * Sleep until the next report is due. before_sleep() and after_wake()
+     * are only called if we actually go into a deep sleep.
+     */
+    template <typename Before, typename After>
+    void sleep_until_next(Before before_sleep, After after_wake) {
+        advance();
+        sleep_until(next_us, before_sleep, after_wake);
+    }
+
+    // the same but until wake_us, off the grid, e.g. to fit in with
+    // someone else's schedule
+    template <typename Before, typename After>
+    void sleep_until(uint64_t wake_us, Before before_sleep, After after_wake) {
+        uint64_t now = power.now_us();
+        if (wake_us <= now) {
+            return;
+        }
+        uint64_t remaining = wake_us - now;
+        if (remaining >= (uint64_t)DEEP_SLEEP_MIN_MS * 1000) {
+            before_sleep();
+            power.deep_sleep_until(wake_us);
+            after_wake();
+        } else {
+            hal_sleep_ms(remaining / 1000);
+        }
+    }
+
+    void sleep_until_next() {
+        sleep_until_next([]{}, []{});
+    }
+
+private:
+    uint64_t advance();
+
+    PowerControl& power;
+    uint64_t period_us;
+    uint64_t next_us;
+    uint32_t missed_count = 0;
+};
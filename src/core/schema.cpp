@@ -0,0 +1,114 @@
+#include "schema.h"
+
+#include <cmath>
+#include <cstring>
+
+uint8_t* varint_put(uint8_t* buf, uint64_t val) {
+    while (val >= 0x80) {
+        *buf++ = (uint8_t)val | 0x80;
+        val >>= 7;
+    }
+    *buf++ = (uint8_t)val;
+    return buf;
+}
+
+const uint8_t* varint_get(const uint8_t* buf, const uint8_t* end, uint64_t* val) {
+    uint64_t result = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (buf >= end) {
+            return nullptr;
+        }
+        uint8_t byte = *buf++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *val = result;
+            return buf;
+        }
+    }
+    return nullptr;
+}
+
+int64_t schema_get_wire(const FieldDesc& field, const void* record) {
+    const uint8_t* p = (const uint8_t*)record + field.offset;
+    switch (field.type) {
+        case FIELD_U8: return *p;
+        case FIELD_U16: { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case FIELD_U32: { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case FIELD_FLOAT: { float v; memcpy(&v, p, sizeof(v)); return llroundf(v * field.scale); }
+    }
+    return 0;
+}
+
+void schema_set_wire(const FieldDesc& field, void* record, int64_t val) {
+    uint8_t* p = (uint8_t*)record + field.offset;
+    switch (field.type) {
+        case FIELD_U8: *p = (uint8_t)val; break;
+        case FIELD_U16: { uint16_t v = val; memcpy(p, &v, sizeof(v)); break; }
+        case FIELD_U32: { uint32_t v = val; memcpy(p, &v, sizeof(v)); break; }
+        case FIELD_FLOAT: { float v = (float)val / field.scale; memcpy(p, &v, sizeof(v)); break; }
+    }
+}
+
+float schema_get_float(const FieldDesc& field, const void* record) {
+    if (field.type == FIELD_FLOAT) {
+        float v;
+        memcpy(&v, (const uint8_t*)record + field.offset, sizeof(v));
+        return v;
+    }
+    return (float)schema_get_wire(field, record);
+}
+
+size_t schema_encode(const FieldDesc* fields, size_t n, const void* record, uint32_t mask, uint8_t* buf) {
+    uint8_t* bufptr = buf;
+    for (size_t i = 0; i < n; i++) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        *bufptr++ = (fields[i].tag << 3) | WIRE_VARINT;
+        bufptr = varint_put(bufptr, zigzag_encode(schema_get_wire(fields[i], record)));
+    }
+    return bufptr - buf;
+}
+
+bool schema_decode(const FieldDesc* fields, size_t n, const uint8_t* buf, size_t len, void* record, uint32_t* present) {
+    const uint8_t* end = buf + len;
+    while (buf < end) {
+        uint8_t tag = *buf >> 3;
+        uint8_t wire = *buf & 0x07;
+        buf++;
+
+        uint64_t val = 0;
+        switch (wire) {
+            case WIRE_VARINT:
+                buf = varint_get(buf, end, &val);
+                break;
+            case WIRE_FIXED32:
+                buf = (end - buf >= 4) ? buf + 4 : nullptr;
+                wire = 0xff; // nothing of ours, skip it
+                break;
+            case WIRE_BYTES:
+                buf = varint_get(buf, end, &val);
+                buf = (buf && (uint64_t)(end - buf) >= val) ? buf + val : nullptr;
+                wire = 0xff;
+                break;
+            default:
+                // no way of knowing how long it is so can't skip it
+                return false;
+        }
+        if (!buf) {
+            return false;
+        }
+        if (wire != WIRE_VARINT) {
+            continue;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if (fields[i].tag == tag) {
+                schema_set_wire(fields[i], record, zigzag_decode(val));
+                *present |= 1u << i;
+                break;
+            }
+        }
+    }
+    return true;
+}
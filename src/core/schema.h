@@ -0,0 +1,110 @@
+/**
+ * Schema-driven compact payload encoding.
+ *
+ * A record struct is described by a constexpr table of FieldDescs, and the
+ * same table drives both the encoder and the decoder so the two ends can't
+ * drift apart the way hand-kept mirror structs do. On the wire each field is
+ *
+ *   key (u8): tag << 3 | wire type
+ *   value: for WIRE_VARINT, the zig-zag varint of the (scaled) value
+ *
+ * Floats are sent as fixed point, round(value * scale), so e.g. a battery
+ * voltage with a scale of 1000 goes as millivolts in two bytes rather than a
+ * four byte float. Fields can be left out, and a decoder skips any tags it
+ * doesn't know by their wire type, so sensors can be added to a sender
+ * without breaking older receivers. Tags must never be reused for anything
+ * else once they've been used.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+enum FieldType {
+    FIELD_U8,
+    FIELD_U16,
+    FIELD_U32,
+    FIELD_FLOAT, // sent as fixed point, see scale
+};
+
+enum WireType {
+    WIRE_VARINT = 0,
+    WIRE_FIXED32 = 1, // not generated by us, but skippable
+    WIRE_BYTES = 2, // varint length then that many bytes
+};
+
+struct FieldDesc {
+    uint8_t tag; // 1-31, unique within the schema
+    FieldType type;
+    size_t offset; // offsetof() the member in the record struct
+    int32_t scale; // fixed point multiplier for FIELD_FLOAT
+    const char* name;
+    const char* unit;
+};
+
+// a key plus the longest 64 bit varint
+static const size_t SCHEMA_MAX_FIELD_SIZE = 11;
+
+// check a schema at compile time: tags in range and no duplicates, and at
+// most 32 fields as records track presence in a 32 bit mask
+template <size_t N>
+constexpr bool schema_valid(const FieldDesc (&fields)[N]) {
+    if (N > 32) {
+        return false;
+    }
+    for (size_t i = 0; i < N; i++) {
+        if (fields[i].tag < 1 || fields[i].tag > 31 || fields[i].scale < 1) {
+            return false;
+        }
+        for (size_t j = i + 1; j < N; j++) {
+            if (fields[i].tag == fields[j].tag) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// and that two schemas that share a payload don't share any tags
+template <size_t N, size_t M>
+constexpr bool schema_disjoint(const FieldDesc (&a)[N], const FieldDesc (&b)[M]) {
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < M; j++) {
+            if (a[i].tag == b[j].tag) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// zig-zag and LEB128 varints, as per protobuf
+static inline uint64_t zigzag_encode(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+static inline int64_t zigzag_decode(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+uint8_t* varint_put(uint8_t* buf, uint64_t val);
+// returns nullptr if the varint runs past end or is too long
+const uint8_t* varint_get(const uint8_t* buf, const uint8_t* end, uint64_t* val);
+
+// a field's value as (scaled) integer, the form it goes on the wire in
+int64_t schema_get_wire(const FieldDesc& field, const void* record);
+void schema_set_wire(const FieldDesc& field, void* record, int64_t val);
+// and as a float, for display and the like
+float schema_get_float(const FieldDesc& field, const void* record);
+
+/**
+ * Encode the fields of record picked out by mask (bit i for fields[i]) into
+ * buf, which needs n * SCHEMA_MAX_FIELD_SIZE bytes at worst. Returns the
+ * number of bytes used.
+ */
+size_t schema_encode(const FieldDesc* fields, size_t n, const void* record, uint32_t mask, uint8_t* buf);
+
+/**
+ * Decode len bytes into record, setting bit i of *present for each of
+ * fields[i] found. Fields not in the data are left alone. Returns false if
+ * the data is malformed.
+ */
+bool schema_decode(const FieldDesc* fields, size_t n, const uint8_t* buf, size_t len, void* record, uint32_t* present);
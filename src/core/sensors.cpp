@@ -0,0 +1,77 @@
+#include "sensors.h"
+
+#include "adc.h"
+
+static bool board_adc_read(SensorBus& bus, struct sensor_record& rec) {
+    static const unsigned int channels[] = { ADC_CHANNEL_TEMP, ADC_CHANNEL_VBAT, ADC_CHANNEL_VIN };
+    AdcReading readings[3];
+    adc_sample_burst<ADC_SAMPLE_COUNT>( bus.adc, channels, readings, bus.profiler );
+    rec.mcu_temp = adc_volts_to_mcu_temp( readings[0].volts );
+    rec.vbat = adc_volts_to_vbat( readings[1].volts );
+    rec.vin = adc_volts_to_vin( readings[2].volts );
+    return true;
+}
+
+const SensorDriver SENSOR_DRIVER_BOARD_ADC = {
+    "board adc",
+    (1u << SENSOR_MCU_TEMP) | (1u << SENSOR_VBAT) | (1u << SENSOR_VIN),
+    false, 0,
+    nullptr, board_adc_read,
+};
+
+uint32_t SensorSampler::sample(struct sensor_record& rec) {
+    uint64_t rail_on = hal_time_us();
+    rail_us = 0;
+    size_t powered = 0;
+    for (size_t i = 0; i < count; i++) {
+        powered += drivers[i]->powered;
+    }
+    if (powered && power) {
+        power->set(true);
+    }
+
+    // when each can next be started or read, the ones off VSEN straight away
+    uint64_t due[SENSOR_DRIVERS_MAX];
+    bool started[SENSOR_DRIVERS_MAX] = {};
+    bool done[SENSOR_DRIVERS_MAX] = {};
+    for (size_t i = 0; i < count; i++) {
+        due[i] = rail_on + (drivers[i]->powered ? drivers[i]->warmup_us : 0);
+    }
+
+    uint32_t fields = 0;
+    for (size_t left = count; left; ) {
+        // whatever's due first
+        size_t next = count;
+        for (size_t i = 0; i < count; i++) {
+            if (!done[i] && (next == count || due[i] < due[next])) {
+                next = i;
+            }
+        }
+        const SensorDriver& driver = *drivers[next];
+        uint64_t now = hal_time_us();
+        if (due[next] > now) {
+            hal_sleep_us(due[next] - now);
+        }
+        if (!started[next]) {
+            started[next] = true;
+            uint32_t wait_us = driver.start ? driver.start(bus) : 0;
+            due[next] = hal_time_us() + wait_us;
+            continue;
+        }
+
+        if (driver.read(bus, rec)) {
+            fields |= driver.fields;
+        } else {
+            failed++;
+        }
+        done[next] = true;
+        left--;
+        if (driver.powered && --powered == 0 && power) {
+            // the last one that needed it
+            power->set(false);
+            rail_us = (uint32_t)(hal_time_us() - rail_on);
+        }
+    }
+    rec.present |= fields;
+    return fields;
+}
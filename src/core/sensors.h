@@ -0,0 +1,81 @@
+/**
+ * The sender's sensors, read through a table of drivers.
+ *
+ * Each driver is a SensorDriver descriptor, a constant, saying which of the
+ * SENSOR_FIELDS it fills in, whether it runs off the switched sensor supply
+ * (VSEN, GPIO 0) and how long that has to be on before it'll answer. Reading
+ * is split in two for the sensors that need time to do a conversion (a
+ * DS18B20 on 1-Wire takes up to 750ms, an SHT3x on I2C about 15ms): start()
+ * kicks it off and says how long to wait, read() collects the result.
+ *
+ * SensorSampler goes through the lot each cycle. VSEN goes on first, so the
+ * powered sensors warm up while the ones that don't need it (the board's own
+ * ADC channels) are read, then everything is started as soon as it's warm
+ * and read as soon as it's done, earliest first, so the conversions overlap.
+ * VSEN goes off again the moment the last powered sensor has been read. The
+ * rail is then on for about as long as the slowest sensor takes, not the
+ * total of them all, and not at all if none of them need it.
+ *
+ * To add a sensor give it a field in packet.h, write its driver and add it
+ * to SENSOR_DRIVERS in sender.cpp.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "hal.h"
+#include "packet.h"
+#include "profile.h"
+
+// what the drivers talk to the sensors through, the I2C and 1-Wire buses go
+// in here as and when there are sensors on them
+struct SensorBus {
+    AdcChannels& adc;
+    Profiler* profiler;
+};
+
+struct SensorDriver {
+    const char* name;
+    uint32_t fields; // bits of SENSOR_FIELDS it fills in
+    bool powered; // runs off VSEN
+    uint32_t warmup_us; // from VSEN coming on until it can be started
+    // start a reading, returns how many us until it can be read, can be
+    // nullptr if read() does it all
+    uint32_t (*start)(SensorBus& bus);
+    // the reading into rec, false if there wasn't one
+    bool (*read)(SensorBus& bus, struct sensor_record& rec);
+};
+
+// the RP2350 temperature, battery and supply voltages, in one ADC burst
+extern const SensorDriver SENSOR_DRIVER_BOARD_ADC;
+
+static const size_t SENSOR_DRIVERS_MAX = 16;
+
+class SensorSampler {
+public:
+    // power can be nullptr if nothing's on VSEN
+    template <size_t N>
+    SensorSampler(const SensorDriver* const (&drivers)[N], SensorBus& bus, SensorPower* power)
+        : SensorSampler(drivers, N, bus, power) {
+        static_assert(N <= SENSOR_DRIVERS_MAX, "too many sensor drivers");
+    }
+    SensorSampler(const SensorDriver* const* drivers, size_t count, SensorBus& bus, SensorPower* power)
+        : drivers(drivers), count(count), bus(bus), power(power) {}
+
+    // read every sensor into rec, marking what was read as present, and
+    // returns that
+    uint32_t sample(struct sensor_record& rec);
+
+    // how long VSEN was on for the last sample()
+    uint32_t rail_on_us() const { return rail_us; }
+    // readings that failed, ever
+    uint32_t failures() const { return failed; }
+
+private:
+    const SensorDriver* const* drivers;
+    size_t count;
+    SensorBus& bus;
+    SensorPower* power;
+    uint32_t rail_us = 0;
+    uint32_t failed = 0;
+};
@@ -0,0 +1,77 @@
+/**
+ * Lock-free single producer, single consumer queue of fixed size slots.
+ *
+ * For handing samples or decoded packets from one core to the other. Like
+ * ByteRing each side only writes its own index. The slots are filled and
+ * emptied in place (write_slot()/commit(), read_slot()/release()) so a
+ * big struct never has to be built on the stack and then copied in or out.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+template <typename T, size_t SIZE>
+class SpscQueue {
+    static_assert((SIZE & (SIZE - 1)) == 0, "queue size must be a power of two");
+
+public:
+    // producer side: the slot to fill, or nullptr (counted as a drop) if
+    // the queue is full, then commit() to pass it over
+    T* write_slot() {
+        uint32_t w = write_idx.load(std::memory_order_relaxed);
+        if (w - read_idx.load(std::memory_order_acquire) >= SIZE) {
+            dropped_count++;
+            return nullptr;
+        }
+        return &slots[w & (SIZE - 1)];
+    }
+    void commit() {
+        write_idx.store(write_idx.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    bool push(const T& item) {
+        T* slot = write_slot();
+        if (!slot) {
+            return false;
+        }
+        *slot = item;
+        commit();
+        return true;
+    }
+
+    // consumer side: the oldest slot, or nullptr if empty, then release()
+    // once done with it
+    T* read_slot() {
+        uint32_t r = read_idx.load(std::memory_order_relaxed);
+        if (write_idx.load(std::memory_order_acquire) == r) {
+            return nullptr;
+        }
+        return &slots[r & (SIZE - 1)];
+    }
+    void release() {
+        read_idx.store(read_idx.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    bool pop(T& item) {
+        T* slot = read_slot();
+        if (!slot) {
+            return false;
+        }
+        item = *slot;
+        release();
+        return true;
+    }
+
+    bool empty() const {
+        return write_idx.load(std::memory_order_acquire) == read_idx.load(std::memory_order_relaxed);
+    }
+
+    // items thrown away because the consumer didn't keep up
+    uint32_t dropped() const { return dropped_count; }
+
+private:
+    T slots[SIZE];
+    std::atomic<uint32_t> write_idx{0};
+    std::atomic<uint32_t> read_idx{0};
+    volatile uint32_t dropped_count = 0;
+};
@@ -0,0 +1,144 @@
+#include "tdma.h"
+
+#include "frame.h"
+
+size_t serialise_beacon(const struct TdmaBeacon* beacon, uint8_t* buf) {
+    uint8_t* bufptr = buf;
+    bufptr = serialise_u16(bufptr, 0);
+    bufptr = serialise_u16(bufptr, 0xFFFF); // to everyone
+    bufptr = serialise_u8(bufptr, PAYLOAD_FORMAT_BEACON);
+    bufptr = serialise_u16(bufptr, beacon->seq);
+    bufptr = serialise_u32(bufptr, beacon->frame_ms);
+    bufptr = serialise_u16(bufptr, beacon->slot_ms);
+    bufptr = serialise_u8(bufptr, beacon->slots);
+    return bufptr - buf;
+}
+
+bool deserialise_beacon(const uint8_t* buf, size_t len, struct TdmaBeacon* beacon) {
+    // the received data header, then our payload without the options and
+    // dest, then the checksum
+    if (len != RXDATA_HEADER_SIZE + TDMA_BEACON_SIZE - 4 + 1 || buf[2] != EMB_RX_DATA) {
+        return false;
+    }
+    uint16_t length;
+    deserialise_u16(buf, &length);
+    if (length != len || buf[len - 1] != emb_checksum(buf, len - 1)
+            || buf[RXDATA_HEADER_SIZE] != PAYLOAD_FORMAT_BEACON) {
+        return false;
+    }
+    const uint8_t* bufptr = buf + RXDATA_HEADER_SIZE + 1;
+    bufptr = deserialise_u16(bufptr, &beacon->seq);
+    bufptr = deserialise_u32(bufptr, &beacon->frame_ms);
+    bufptr = deserialise_u16(bufptr, &beacon->slot_ms);
+    deserialise_u8(bufptr, &beacon->slots);
+    // nothing we could make a schedule out of
+    return beacon->slots > 0 && beacon->slot_ms > 0
+            && (uint64_t)beacon->slot_ms * (beacon->slots + 1) <= beacon->frame_ms;
+}
+
+struct TdmaBeacon tdma_beacon(uint16_t seq, uint32_t frame_ms, uint8_t slots) {
+    struct TdmaBeacon beacon;
+    beacon.seq = seq;
+    beacon.frame_ms = frame_ms;
+    beacon.slot_ms = frame_ms / (slots + 1);
+    beacon.slots = slots;
+    return beacon;
+}
+
+TdmaSync::TdmaSync(uint16_t address, int slot, uint32_t resync, uint32_t report_ms, uint64_t now_us)
+    : address(address), fixed_slot(slot), resync(resync ? resync : 1), report_ms(report_ms) {
+    // start off listening for a bit longer than a frame's likely to be
+    listen_start_us = now_us;
+    listen_end_us = now_us + (uint64_t)report_ms * 1100;
+}
+
+uint64_t TdmaSync::frame_us() const {
+    return (uint64_t)last.frame_ms * (1000000 + drift) / 1000;
+}
+
+uint64_t TdmaSync::frame_start_us(uint16_t seq) const {
+    return anchor_us + (uint16_t)(seq - last.seq) * frame_us();
+}
+
+void TdmaSync::schedule_listen(uint16_t seq) {
+    listen_seq = seq;
+    uint64_t start = frame_start_us(seq);
+    uint64_t ppm = have_drift ? TDMA_DRIFT_PPM_CORRECTED : TDMA_DRIFT_PPM_UNKNOWN;
+    uint64_t guard = (uint64_t)TDMA_GUARD_MS * 1000 + (start - anchor_us) * ppm / 1000000;
+    if (guard > frame_us() / 2) {
+        guard = frame_us() / 2;
+    }
+    listen_start_us = start - guard;
+    listen_end_us = start + guard;
+}
+
+void TdmaSync::beacon(const struct TdmaBeacon& beacon, uint64_t now_us) {
+    if (in_sync && beacon.frame_ms == last.frame_ms) {
+        // how long those frames took by our clock against how long they
+        // should have, averaged over the last few
+        uint16_t frames = beacon.seq - last.seq;
+        if (frames > 0 && frames < 0x8000) {
+            int64_t nominal = (int64_t)frames * last.frame_ms * 1000;
+            int64_t ppm = ((int64_t)(now_us - anchor_us) - nominal) * 1000000 / nominal;
+            if (ppm > (int64_t)TDMA_DRIFT_PPM_UNKNOWN) {
+                ppm = TDMA_DRIFT_PPM_UNKNOWN;
+            } else if (ppm < -(int64_t)TDMA_DRIFT_PPM_UNKNOWN) {
+                ppm = -(int64_t)TDMA_DRIFT_PPM_UNKNOWN;
+            }
+            drift = have_drift ? (int32_t)((drift * 3 + ppm) / 4) : (int32_t)ppm;
+            have_drift = true;
+        }
+    }
+    last = beacon;
+    anchor_us = now_us;
+    in_sync = true;
+    misses = 0;
+    my_slot = (fixed_slot >= 0 ? (unsigned)fixed_slot : address) % beacon.slots;
+    // until we know how far out the clock is the very next one, that's
+    // enough to tell
+    schedule_listen(beacon.seq + (have_drift ? resync : 1));
+}
+
+void TdmaSync::missed() {
+    if (misses < TDMA_MAX_MISSES) {
+        misses++;
+    }
+    if (in_sync && misses < TDMA_MAX_MISSES) {
+        // try again next frame
+        schedule_listen(listen_seq + 1);
+        return;
+    }
+    // lost it, carry on as we are and have another go every so often
+    in_sync = false;
+    have_drift = false;
+    drift = 0;
+    uint64_t period_us = (uint64_t)report_ms * 1000;
+    listen_start_us = listen_end_us + resync * period_us;
+    listen_end_us = listen_start_us + period_us * 11 / 10;
+}
+
+uint64_t TdmaSync::next_send_us(uint64_t now_us) const {
+    uint64_t period_us = (uint64_t)report_ms * 1000;
+    if (!in_sync) {
+        uint64_t at = have_sent ? last_send_us + period_us : now_us;
+        return at < now_us ? now_us : at;
+    }
+    // a report period on, less a bit so it's the frames that decide, then
+    // the first of our slots after that
+    uint64_t earliest = have_sent ? last_send_us + period_us - frame_us() / 2 : now_us;
+    if (earliest < now_us) {
+        earliest = now_us;
+    }
+    uint64_t offset_us = (uint64_t)(my_slot + 1) * last.slot_ms * (1000000 + drift) / 1000;
+    uint64_t first = anchor_us + offset_us;
+    if (earliest <= first) {
+        return first;
+    }
+    uint64_t frames = (earliest - first + frame_us() - 1) / frame_us();
+    return first + frames * frame_us();
+}
+
+void TdmaSync::sending(uint64_t at_us) {
+    last_send_us = at_us;
+    have_sent = true;
+}
@@ -0,0 +1,109 @@
+/**
+ * Time slotted transmission, so senders take turns rather than talking over
+ * each other.
+ *
+ * The receiver broadcasts a beacon at the start of every frame of frame_ms,
+ * which is split into slots + 1 slots of slot_ms, the first being the
+ * beacon's own. Each sender has a slot, by default its network address
+ * modulo the slot count (addresses tend to be handed out in sequence), and
+ * only transmits in that. With a slot each nothing collides, however many
+ * nodes there are, whereas with everyone sending when they like (ALOHA)
+ * collisions go up with the square of the traffic.
+ *
+ * The sender's radio is asleep most of the time so it doesn't hear every
+ * beacon, only listening for one every so often. In between it keeps time
+ * by its own clock, which on the RP2350 can run a few percent out when
+ * dormant, so the gap between beacons is used to work out how far out it is
+ * and correct for it. The longer since the last beacon the wider the window
+ * it listens over. If the beacons stop coming it carries on sending when it
+ * would have done, and only tries for one every so often.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "packet.h"
+
+struct TdmaBeacon {
+    uint16_t seq; // frame number, wraps
+    uint32_t frame_ms;
+    uint16_t slot_ms;
+    uint8_t slots; // for senders, not counting the beacon's
+};
+
+// options, dest, format and the beacon, ready for transmitData()
+static const size_t TDMA_BEACON_SIZE = 4 + 1 + 9;
+
+size_t serialise_beacon(const struct TdmaBeacon* beacon, uint8_t* buf);
+// decode a received data frame holding a beacon, false if it isn't one
+bool deserialise_beacon(const uint8_t* buf, size_t len, struct TdmaBeacon* beacon);
+
+// the beacon the receiver sends at the start of frame seq
+struct TdmaBeacon tdma_beacon(uint16_t seq, uint32_t frame_ms, uint8_t slots);
+
+// listen this long either side of when the beacon's expected, plus however
+// far the clock might have wandered since the last
+static const uint32_t TDMA_GUARD_MS = 20;
+// how far out we reckon the clock might be once corrected, and before that
+static const uint32_t TDMA_DRIFT_PPM_CORRECTED = 1000;
+static const uint32_t TDMA_DRIFT_PPM_UNKNOWN = 50000;
+// beacons missed in a row before we count ourselves out of sync
+static const uint8_t TDMA_MAX_MISSES = 4;
+
+class TdmaSync {
+public:
+    /**
+     * slot < 0 takes it from the address. resync is how many frames to go
+     * between listening for beacons, and report_ms the report period to use
+     * until we've heard one (and to send every so many frames after). It
+     * starts off listening from now_us.
+     */
+    TdmaSync(uint16_t address, int slot, uint32_t resync, uint32_t report_ms, uint64_t now_us);
+
+    // a beacon arrived at now_us
+    void beacon(const struct TdmaBeacon& beacon, uint64_t now_us);
+    // listened from listen_at_us() to listen_until_us() and heard nothing
+    void missed();
+
+    // when to next listen for a beacon, and until when
+    uint64_t listen_at_us() const { return listen_start_us; }
+    uint64_t listen_until_us() const { return listen_end_us; }
+
+    /**
+     * When to next send, after now_us. In sync that's the next of our slots
+     * a report period on from the last, otherwise just a report period on.
+     */
+    uint64_t next_send_us(uint64_t now_us) const;
+    // we're going to send (or at least wake up to) at at_us, whether or not
+    // anything actually goes out
+    void sending(uint64_t at_us);
+
+    bool synced() const { return in_sync; }
+    uint8_t slot() const { return my_slot; }
+    // how fast our clock runs compared to the receiver's, parts per million
+    int32_t drift_ppm() const { return drift; }
+
+private:
+    // where frame seq starts, by our clock
+    uint64_t frame_start_us(uint16_t seq) const;
+    uint64_t frame_us() const;
+    void schedule_listen(uint16_t seq);
+
+    uint16_t address;
+    int fixed_slot;
+    uint32_t resync;
+    uint32_t report_ms;
+
+    bool in_sync = false;
+    bool have_drift = false;
+    uint8_t my_slot = 0;
+    struct TdmaBeacon last = {};
+    uint64_t anchor_us = 0; // when beacon last.seq arrived
+    int32_t drift = 0;
+    uint8_t misses = 0;
+    uint16_t listen_seq = 0;
+    uint64_t listen_start_us = 0;
+    uint64_t listen_end_us = 0;
+    uint64_t last_send_us = 0;
+    bool have_sent = false;
+};
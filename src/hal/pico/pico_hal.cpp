@@ -0,0 +1,339 @@
+#include "pico_hal.h"
+
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "pico/multicore.h"
+#include "pico/stdio_usb.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+
+#if HORTITEL_HAVE_DORMANT
+#include "pico/sleep.h"
+#include "pico/aon_timer.h"
+#endif
+
+#ifndef HORTITEL_ADC_DMA
+#define HORTITEL_ADC_DMA 1
+#endif
+
+// the UART the LoRaEMB module is on, this must match what MeloperoPerpetuo uses
+#ifndef HORTITEL_EMB_UART
+#define HORTITEL_EMB_UART 0
+#endif
+
+// ADC clock divider for round-robin captures, 0 is flat out (500ksps)
+#ifndef HORTITEL_ADC_CLKDIV
+#define HORTITEL_ADC_CLKDIV 0
+#endif
+
+uint64_t hal_time_us() {
+    return time_us_64();
+}
+
+void hal_sleep_ms(uint32_t ms) {
+    sleep_ms(ms);
+}
+
+void hal_sleep_us(uint64_t us) {
+    sleep_us(us);
+}
+
+void hal_console_write(const uint8_t* data, size_t len) {
+    stdio_put_string((const char*)data, (int)len, false, false);
+}
+
+bool hal_console_connected() {
+    // i.e. something has the USB serial port open
+    return stdio_usb_connected();
+}
+
+PicoSensorPower::PicoSensorPower(unsigned int gpio) : gpio(gpio) {
+    gpio_init(gpio);
+    gpio_put(gpio, 0);
+    gpio_set_dir(gpio, GPIO_OUT);
+}
+
+void PicoSensorPower::set(bool on) {
+    gpio_put(gpio, on);
+}
+
+PicoPower::PicoPower(bool dormant) : dormant(dormant) {
+#if HORTITEL_HAVE_DORMANT
+    if (dormant) {
+        // we only care about elapsed time so start it from zero
+        struct timespec ts = { 0, 0 };
+        aon_timer_start(&ts);
+    }
+#endif
+}
+
+uint64_t PicoPower::now_us() {
+#if HORTITEL_HAVE_DORMANT
+    if (!dormant) {
+        return time_us_64();
+    }
+    // the normal timer stops when dormant, the always-on timer doesn't
+    struct timespec ts;
+    aon_timer_get_time(&ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return time_us_64();
+#endif
+}
+
+void PicoPower::deep_sleep_until(uint64_t wake_us) {
+#if HORTITEL_HAVE_DORMANT
+    if (!dormant) {
+        sleep_until(from_us_since_boot(wake_us));
+        return;
+    }
+    uint64_t now = now_us();
+    if (wake_us <= now) {
+        return;
+    }
+    struct timespec ts;
+    aon_timer_get_time(&ts);
+    uint64_t ns = (uint64_t)ts.tv_nsec + (wake_us - now) * 1000;
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+
+    // flush any console output before the clocks go away
+    stdio_flush();
+    sleep_run_from_lposc();
+    sleep_goto_dormant_until(&ts, nullptr);
+    // and back to the normal clocks
+    sleep_power_up();
+#else
+    sleep_until(from_us_since_boot(wake_us));
+#endif
+}
+
+// nothing to do but empty the FIFO, waking up was the point
+static void core_doorbell_irq_handler() {
+    multicore_fifo_drain();
+    multicore_fifo_clear_irq();
+}
+
+void core_doorbell_listen() {
+    uint irq = SIO_FIFO_IRQ_NUM(get_core_num());
+    irq_set_exclusive_handler(irq, core_doorbell_irq_handler);
+    irq_set_enabled(irq, true);
+}
+
+void core_doorbell_ring() {
+    // if the FIFO is full the other core has a wakeup pending already
+    if (multicore_fifo_wready()) {
+        multicore_fifo_push_blocking(0);
+    }
+}
+
+PicoFlash::PicoFlash(size_t bytes) : base(PICO_FLASH_SIZE_BYTES - bytes), bytes(bytes) {
+}
+
+void PicoFlash::read(size_t offset, uint8_t* buf, size_t len) {
+    // around the cache, there's no point pushing code out of it for this
+    memcpy(buf, (const uint8_t*)(XIP_NOCACHE_NOALLOC_BASE + base + offset), len);
+}
+
+struct FlashOp {
+    uint32_t offset;
+    const uint8_t* data;
+};
+
+static void flash_program_op(void* param) {
+    const FlashOp* op = (const FlashOp*)param;
+    flash_range_program(op->offset, op->data, FLASH_PAGE_SIZE);
+}
+
+static void flash_erase_op(void* param) {
+    const FlashOp* op = (const FlashOp*)param;
+    flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+}
+
+// overruns of the module's UART, as the interrupt finds them
+static volatile uint32_t emb_uart_overruns = 0;
+
+// Interrupts are off on this core (and the other core is parked) for the
+// whole of the operation, so nothing reads the module's UART. If it overran
+// the interrupt says so as soon as they're back on, i.e. before this returns.
+static bool flash_op(void (*func)(void*), FlashOp* op, uint32_t* overruns) {
+    uint32_t before = emb_uart_overruns;
+    bool ok = flash_safe_execute(func, op, 100) == PICO_OK;
+    *overruns += emb_uart_overruns - before;
+    return ok;
+}
+
+bool PicoFlash::program_page(size_t offset, const uint8_t* data) {
+    FlashOp op = { base + (uint32_t)offset, data };
+    return flash_op(flash_program_op, &op, &overruns);
+}
+
+bool PicoFlash::erase_sector(size_t offset) {
+    FlashOp op = { base + (uint32_t)offset, nullptr };
+    return flash_op(flash_erase_op, &op, &overruns);
+}
+
+void PicoAdc::select_input(unsigned int channel) {
+    adc_select_input(channel);
+}
+
+uint16_t PicoAdc::read() {
+    return adc_read();
+}
+
+// the DMA channel we're waiting on, the interrupt is only there to wake us
+static volatile int adc_dma_irq_chan = -1;
+static void adc_dma_irq_handler() {
+    int chan = adc_dma_irq_chan;
+    if (chan >= 0 && dma_channel_get_irq0_status(chan)) {
+        dma_channel_acknowledge_irq0(chan);
+    }
+}
+
+void PicoAdc::capture_round_robin(uint32_t mask, uint16_t* out, unsigned int rounds) {
+    if (!HORTITEL_ADC_DMA || mask == 0) {
+        AdcChannels::capture_round_robin(mask, out, rounds);
+        return;
+    }
+
+    if (dma_chan < 0) {
+        dma_chan = dma_claim_unused_channel(true);
+        adc_dma_irq_chan = dma_chan;
+        irq_add_shared_handler(DMA_IRQ_0, adc_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+        dma_channel_set_irq0_enabled(dma_chan, true);
+    }
+
+    // the round robin starts from the selected input and works up the mask
+    adc_select_input(__builtin_ctz(mask));
+    adc_set_round_robin(mask);
+    adc_set_clkdiv(HORTITEL_ADC_CLKDIV);
+    adc_fifo_setup(true, true, 1, false, false); // FIFO on, DREQ on each sample, no error bit or byte shift
+    adc_fifo_drain();
+
+    dma_channel_config cfg = dma_channel_get_default_config(dma_chan);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_dreq(&cfg, DREQ_ADC);
+    dma_channel_configure(dma_chan, &cfg, out, &adc_hw->fifo, rounds * __builtin_popcount(mask), true);
+
+    adc_run(true);
+
+    // Sleep until the DMA completes. Interrupts are masked around the check
+    // so the completion can't sneak in between it and the WFI, a pending
+    // interrupt still wakes the WFI.
+    while (true) {
+        uint32_t save = save_and_disable_interrupts();
+        bool busy = dma_channel_is_busy(dma_chan);
+        if (busy) {
+            __wfi();
+        }
+        restore_interrupts(save);
+        if (!busy) {
+            break;
+        }
+    }
+
+    adc_run(false);
+    adc_fifo_drain();
+    adc_set_round_robin(0);
+    adc_fifo_setup(false, false, 0, false, false);
+}
+
+void MeloperoRadio::sendCmd(uint8_t cmd) {
+    melopero.sendCmd(cmd);
+}
+
+void MeloperoRadio::stopNetwork() {
+    melopero.stopNetwork();
+}
+
+void MeloperoRadio::startNetwork() {
+    melopero.startNetwork();
+}
+
+void MeloperoRadio::setNetworkPreferences(bool protocol, bool auto_ack, bool cca) {
+    melopero.setNetworkPreferences(protocol, auto_ack, cca);
+}
+
+void MeloperoRadio::setOutputPower(uint8_t power) {
+    melopero.setOutputPower(power);
+}
+
+void MeloperoRadio::setOperatingChannel(uint8_t channel, RadioSpreadingFactor sf, RadioBandwidth bw, RadioCodingRate cr) {
+    static const uint8_t sf_map[] = {
+        SPREADING_FACTOR_7, SPREADING_FACTOR_8, SPREADING_FACTOR_9,
+        SPREADING_FACTOR_10, SPREADING_FACTOR_11, SPREADING_FACTOR_12,
+    };
+    static const uint8_t bw_map[] = { BANDWIDTH_125, BANDWIDTH_250, BANDWIDTH_500 };
+    static const uint8_t cr_map[] = { CODING_RATE_4_5, CODING_RATE_4_6, CODING_RATE_4_7, CODING_RATE_4_8 };
+    melopero.setOperatingChannel(channel, sf_map[sf - RADIO_SF_7], bw_map[bw], cr_map[cr]);
+}
+
+void MeloperoRadio::setNetworkAddress(uint16_t address) {
+    melopero.setNetworkAddress(address);
+}
+
+void MeloperoRadio::setNetworkId(uint8_t* id, size_t len) {
+    melopero.setNetworkId(id, len);
+}
+
+void MeloperoRadio::setEnergySaveMode(RadioEnergySaveMode mode) {
+    if (mode == RADIO_ENERGY_SAVE_TX_ONLY) {
+        melopero.setEnergySaveMode(ENERGY_SAVE_MODE_TX_ONLY);
+    } else {
+        melopero.setEnergySaveMode(ENERGY_SAVE_MODE_ALWAYS_ON);
+    }
+}
+
+void MeloperoRadio::transmitData(uint8_t* data, size_t len) {
+    melopero.transmitData(data, len);
+}
+
+static UartByteHandler uart_rx_handler = nullptr;
+
+static void emb_uart_irq_handler() {
+    uart_inst_t* uart = uart_get_instance(HORTITEL_EMB_UART);
+    while (uart_is_readable(uart)) {
+        // the byte and its error flags, overrun is set on the first byte
+        // after those that didn't fit in the FIFO
+        uint32_t dr = uart_get_hw(uart)->dr;
+        if (dr & UART_UARTDR_OE_BITS) {
+            emb_uart_overruns++;
+        }
+        uart_rx_handler((uint8_t)dr);
+    }
+}
+
+void MeloperoRadio::start_rx_interrupt(UartByteHandler on_byte) {
+    uart_inst_t* uart = uart_get_instance(HORTITEL_EMB_UART);
+    uint irq = UART_IRQ_NUM(uart);
+    uart_rx_handler = on_byte;
+    // with the FIFO on the interrupt fires when it's half full or has gone
+    // quiet for a few character times, so not one per byte
+    uart_set_fifo_enabled(uart, true);
+    irq_set_exclusive_handler(irq, emb_uart_irq_handler);
+    irq_set_enabled(irq, true);
+    uart_set_irq_enables(uart, true, false);
+}
+
+bool MeloperoRadio::checkRxFifo(uint32_t timeout_ms) {
+    return melopero.checkRxFifo(timeout_ms);
+}
+
+const uint8_t* MeloperoRadio::response() const {
+    return melopero.response;
+}
+
+size_t MeloperoRadio::responseLen() const {
+    return melopero.responseLen;
+}
+
+void MeloperoRadio::printResponse() {
+    melopero.printResponse();
+}
@@ -0,0 +1,122 @@
+/**
+ * Pico SDK / MeloperoPerpetuo implementations of the HortiTel HAL.
+ */
+#pragma once
+
+#include "hal.h"
+#include "MeloperoPerpetuo.h"
+
+// the RP2350 ADC via the Pico SDK
+class PicoAdc : public AdcChannels {
+public:
+    void select_input(unsigned int channel) override;
+    uint16_t read() override;
+
+    // round-robin by DMA into out, sleeping until it's done, unless built
+    // with HORTITEL_ADC_DMA=0 in which case this falls back to reading
+    void capture_round_robin(uint32_t mask, uint16_t* out, unsigned int rounds) override;
+
+private:
+    int dma_chan = -1;
+};
+
+// VSEN, the sensor supply, switched by a GPIO
+class PicoSensorPower : public SensorPower {
+public:
+    PicoSensorPower(unsigned int gpio = 0);
+
+    void set(bool on) override;
+
+private:
+    unsigned int gpio;
+};
+
+/**
+ * Deep sleep via pico-extras when it's available (HORTITEL_HAVE_DORMANT):
+ * the clocks are switched to the low power oscillator and the chip goes
+ * dormant until the always-on timer alarm wakes it. Without pico-extras, or
+ * with dormant false, it's just a normal sleep. Dormant stops both cores so
+ * it's no good when the other one has work to do.
+ */
+class PicoPower : public PowerControl {
+public:
+    PicoPower(bool dormant = true);
+
+    uint64_t now_us() override;
+    void deep_sleep_until(uint64_t wake_us) override;
+
+private:
+    bool dormant;
+};
+
+/**
+ * Waking one core from the other. Whatever is being handed over goes through
+ * shared memory (see spsc_queue.h), this just pokes a word into the inter-core
+ * FIFO so the listening core gets an interrupt and drops out of __wfi(). Call
+ * core_doorbell_listen() on the core to be woken after multicore_launch_core1()
+ * as that uses the FIFO itself.
+ */
+void core_doorbell_listen();
+void core_doorbell_ring();
+
+/**
+ * The last bytes of the board's flash, which had better be well clear of the
+ * program. Nothing can run from flash while it's being programmed or erased,
+ * so that's done with interrupts off (and the other core parked, if it has
+ * been set up for that) by flash_safe_execute(). An erase takes tens of ms.
+ */
+class PicoFlash : public FlashStore {
+public:
+    PicoFlash(size_t bytes);
+
+    size_t size() const override { return bytes; }
+    void read(size_t offset, uint8_t* buf, size_t len) override;
+    bool program_page(size_t offset, const uint8_t* data) override;
+    bool erase_sector(size_t offset) override;
+
+    /**
+     * Times the module's UART overran while we had interrupts off to write
+     * to flash, each time at least one frame from it lost. An erase takes
+     * tens of ms and the UART's FIFO only holds 32 bytes, about 3ms worth.
+     */
+    uint32_t rx_overruns() const { return overruns; }
+
+private:
+    uint32_t base; // from the start of flash
+    size_t bytes;
+    uint32_t overruns = 0;
+};
+
+typedef void (*UartByteHandler)(uint8_t byte);
+
+// the LoRaEMB module via the Melopero library
+class MeloperoRadio : public Radio {
+public:
+    MeloperoRadio(MeloperoPerpetuo& melopero) : melopero(melopero) {}
+
+    /**
+     * Take over reception from the Melopero library: from here on every byte
+     * from the module is passed to on_byte from the UART interrupt as soon as
+     * it arrives, and checkRxFifo() won't see anything.
+     */
+    void start_rx_interrupt(UartByteHandler on_byte);
+
+    void sendCmd(uint8_t cmd) override;
+    void stopNetwork() override;
+    void startNetwork() override;
+    void setNetworkPreferences(bool protocol, bool auto_ack, bool cca) override;
+    void setOutputPower(uint8_t power) override;
+    void setOperatingChannel(uint8_t channel, RadioSpreadingFactor sf, RadioBandwidth bw, RadioCodingRate cr) override;
+    void setNetworkAddress(uint16_t address) override;
+    void setNetworkId(uint8_t* id, size_t len) override;
+    void setEnergySaveMode(RadioEnergySaveMode mode) override;
+    void transmitData(uint8_t* data, size_t len) override;
+
+    bool checkRxFifo(uint32_t timeout_ms) override;
+    const uint8_t* response() const override;
+    size_t responseLen() const override;
+    void printResponse() override;
+
+private:
+    MeloperoPerpetuo& melopero;
+};
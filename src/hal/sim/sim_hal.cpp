@@ -0,0 +1,227 @@
+#include "sim_hal.h"
+
+#include <cstdio>
+#include <cstring>
+#include "frame.h"
+#include "packet.h"
+
+static uint64_t sim_now_us = 0;
+static bool sim_console_connected = true;
+
+uint64_t hal_time_us() {
+    return sim_now_us;
+}
+
+void hal_sleep_ms(uint32_t ms) {
+    sim_now_us += (uint64_t)ms * 1000;
+}
+
+void hal_sleep_us(uint64_t us) {
+    sim_now_us += us;
+}
+
+void hal_console_write(const uint8_t* data, size_t len) {
+    fwrite(data, 1, len, stdout);
+}
+
+bool hal_console_connected() {
+    return sim_console_connected;
+}
+
+void sim_clock_advance_us(uint64_t us) {
+    sim_now_us += us;
+}
+
+void sim_console_set_connected(bool connected) {
+    sim_console_connected = connected;
+}
+
+void SimPower::deep_sleep_until(uint64_t wake_us) {
+    uint64_t now = now_us();
+    if (wake_us > now) {
+        sleeps++;
+        slept_us += wake_us - now;
+        sim_clock_advance_us(wake_us - now);
+    }
+}
+
+void SimSensorPower::set(bool on_now) {
+    if (on_now && !on) {
+        switched_on++;
+        since_us = hal_time_us();
+    } else if (!on_now && on) {
+        on_us += hal_time_us() - since_us;
+    }
+    on = on_now;
+}
+
+SimFlash::SimFlash(size_t bytes)
+        : contents(bytes / SECTOR_SIZE * SECTOR_SIZE, 0xFF), erase_counts(bytes / SECTOR_SIZE, 0) {
+}
+
+void SimFlash::read(size_t offset, uint8_t* buf, size_t len) {
+    memcpy(buf, &contents[offset], len);
+}
+
+bool SimFlash::program_page(size_t offset, const uint8_t* data) {
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        contents[offset + i] &= data[i];
+    }
+    programs++;
+    return true;
+}
+
+bool SimFlash::erase_sector(size_t offset) {
+    memset(&contents[offset], 0xFF, SECTOR_SIZE);
+    erase_counts[offset / SECTOR_SIZE]++;
+    return true;
+}
+
+SimAdc::SimAdc(uint32_t seed) : selected(0), rng(seed) {
+    for (unsigned int i = 0; i < CHANNELS; i++) {
+        channels[i] = { 0, 0, 0 };
+    }
+}
+
+void SimAdc::set_channel(unsigned int channel, float volts, uint16_t noise, uint32_t spike_one_in) {
+    if (channel >= CHANNELS) {
+        return;
+    }
+    float raw = volts * (1 << 12) / 3.3f;
+    if (raw < 0) raw = 0;
+    if (raw > 4095) raw = 4095;
+    channels[channel] = { (uint16_t)raw, noise, spike_one_in };
+}
+
+void SimAdc::select_input(unsigned int channel) {
+    selected = channel < CHANNELS ? channel : 0;
+}
+
+uint16_t SimAdc::read() {
+    const Channel& ch = channels[selected];
+    if (ch.spike_one_in && rng.below(ch.spike_one_in) == 0) {
+        return rng.below(1 << 12);
+    }
+    int32_t val = ch.raw;
+    if (ch.noise) {
+        val += (int32_t)rng.below(2 * ch.noise + 1) - ch.noise;
+    }
+    if (val < 0) val = 0;
+    if (val > 4095) val = 4095;
+    return val;
+}
+
+void SimRadio::link(SimRadio* peer, int16_t rssi) {
+    this->peer = peer;
+    peer_rssi = rssi;
+}
+
+std::vector<uint8_t> sim_rx_data_frame(uint16_t src, uint16_t dst, int16_t rssi, const uint8_t* data, size_t len) {
+    // options, rssi, src, dst then our data, as described by struct rxdata
+    // (which lumps the message type in with the options)
+    std::vector<uint8_t> payload(8 + len);
+    uint8_t* bufptr = serialise_u16(payload.data(), 0);
+    bufptr = serialise_u16(bufptr, (uint16_t)rssi);
+    bufptr = serialise_u16(bufptr, src);
+    bufptr = serialise_u16(bufptr, dst);
+    for (size_t i = 0; i < len; i++) {
+        bufptr[i] = data[i];
+    }
+    std::vector<uint8_t> frame(payload.size() + EMB_FRAME_OVERHEAD);
+    emb_build_frame(EMB_RX_DATA, payload.data(), payload.size(), frame.data());
+    return frame;
+}
+
+void SimRadio::inject_rx_data(uint16_t src, uint16_t dst, int16_t rssi, const uint8_t* data, size_t len) {
+    rx_queue.push_back(sim_rx_data_frame(src, dst, rssi, data, len));
+}
+
+void SimRadio::inject_raw(const uint8_t* bytes, size_t len) {
+    rx_queue.push_back(std::vector<uint8_t>(bytes, bytes + len));
+}
+
+void SimRadio::acknowledge(uint8_t cmd) {
+    sent_cmds.push_back(cmd);
+    if (muted || cmd == ignored) {
+        return;
+    }
+    uint8_t frame[EMB_FRAME_OVERHEAD + 1];
+    size_t len = emb_build_frame(cmd | EMB_RESPONSE_FLAG, &ack_status, 1, frame);
+    inject_raw(frame, len);
+}
+
+void SimRadio::sendCmd(uint8_t cmd) {
+    acknowledge(cmd);
+}
+
+void SimRadio::stopNetwork() {
+    acknowledge(EMB_CMD_NETWORK_STOP);
+}
+
+void SimRadio::startNetwork() {
+    acknowledge(EMB_CMD_NETWORK_START);
+}
+
+void SimRadio::setNetworkPreferences(bool, bool, bool) {
+    acknowledge(EMB_CMD_NETWORK_PREFERENCES);
+}
+
+void SimRadio::setOutputPower(uint8_t) {
+    acknowledge(EMB_CMD_OUTPUT_POWER);
+}
+
+void SimRadio::setOperatingChannel(uint8_t, RadioSpreadingFactor, RadioBandwidth, RadioCodingRate) {
+    acknowledge(EMB_CMD_OPERATING_CHANNEL);
+}
+
+void SimRadio::setNetworkAddress(uint16_t address) {
+    network_address = address;
+    acknowledge(EMB_CMD_NETWORK_ADDRESS);
+}
+
+void SimRadio::setNetworkId(uint8_t*, size_t) {
+    acknowledge(EMB_CMD_NETWORK_ID);
+}
+
+void SimRadio::setEnergySaveMode(RadioEnergySaveMode) {
+    acknowledge(EMB_CMD_ENERGY_SAVE);
+}
+
+void SimRadio::transmitData(uint8_t* data, size_t len) {
+    last_tx.assign(data, data + len);
+    tx_count++;
+    acknowledge(EMB_CMD_SEND_DATA);
+    // first four bytes are the options and destination, the rest goes on air
+    if (peer && len >= 4) {
+        uint16_t dest = ((uint16_t)data[2] << 8) | data[3];
+        peer->inject_rx_data(network_address, dest, peer_rssi, data + 4, len - 4);
+    }
+}
+
+bool SimRadio::checkRxFifo(uint32_t timeout_ms) {
+    current.clear();
+    if (rx_queue.empty()) {
+        // nothing turned up in time
+        hal_sleep_ms(timeout_ms);
+        return false;
+    }
+    current.swap(rx_queue.front());
+    rx_queue.pop_front();
+    return true;
+}
+
+const uint8_t* SimRadio::response() const {
+    return current.data();
+}
+
+size_t SimRadio::responseLen() const {
+    return current.size();
+}
+
+void SimRadio::printResponse() {
+    checkRxFifo(0);
+    for (size_t i = 0; i < current.size(); i++) {
+        printf("0x%02X ", current[i]);
+    }
+    printf("\n");
+}
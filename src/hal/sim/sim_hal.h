@@ -0,0 +1,171 @@
+/**
+ * Simulated implementations of the HortiTel HAL for building and profiling
+ * the core on a host.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include "hal.h"
+
+// The simulated clock behind hal_time_us(), it only moves when something
+// sleeps or waits, or when it's explicitly advanced, so runs are repeatable
+// and go as fast as the host can manage.
+void sim_clock_advance_us(uint64_t us);
+// what hal_console_connected() says, connected to start with
+void sim_console_set_connected(bool connected);
+
+// small deterministic PRNG (xorshift32) so simulated runs are repeatable
+class SimRandom {
+public:
+    SimRandom(uint32_t seed = 0x2545f491) : state(seed ? seed : 1) {}
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    // uniform in [0, n)
+    uint32_t below(uint32_t n) { return n ? next() % n : 0; }
+private:
+    uint32_t state;
+};
+
+// Simulated deep sleep, skips the clock forward and keeps count
+class SimPower : public PowerControl {
+public:
+    void deep_sleep_until(uint64_t wake_us) override;
+
+    uint32_t sleeps = 0;
+    uint64_t slept_us = 0;
+};
+
+// Simulated sensor supply, keeping count of how long it's been on
+class SimSensorPower : public SensorPower {
+public:
+    void set(bool on) override;
+
+    bool on = false;
+    uint32_t switched_on = 0;
+    uint64_t on_us = 0;
+
+private:
+    uint64_t since_us = 0;
+};
+
+/**
+ * Simulated ADC. Each channel returns its configured raw value plus some
+ * uniform noise, with the occasional spike thrown in so the outlier filter
+ * has something to do.
+ */
+class SimAdc : public AdcChannels {
+public:
+    static const unsigned int CHANNELS = 5;
+
+    SimAdc(uint32_t seed = 1);
+
+    // volts is the pin voltage, noise is +/- raw counts, spike_one_in is the
+    // chance of a reading being a spike (0 for never)
+    void set_channel(unsigned int channel, float volts, uint16_t noise, uint32_t spike_one_in = 0);
+
+    void select_input(unsigned int channel) override;
+    uint16_t read() override;
+
+private:
+    struct Channel {
+        uint16_t raw;
+        uint16_t noise;
+        uint32_t spike_one_in;
+    };
+    Channel channels[CHANNELS];
+    unsigned int selected;
+    SimRandom rng;
+};
+
+/**
+ * Simulated flash, starting out erased. Programming ANDs the data in as the
+ * real thing does, and erases are counted per sector to see the wear.
+ */
+class SimFlash : public FlashStore {
+public:
+    SimFlash(size_t bytes);
+
+    size_t size() const override { return contents.size(); }
+    void read(size_t offset, uint8_t* buf, size_t len) override;
+    bool program_page(size_t offset, const uint8_t* data) override;
+    bool erase_sector(size_t offset) override;
+
+    // the raw contents, e.g. to tear a write
+    std::vector<uint8_t> contents;
+    std::vector<uint32_t> erase_counts;
+    uint32_t programs = 0;
+};
+
+// a received data frame from src to dst, as the module would present it
+std::vector<uint8_t> sim_rx_data_frame(uint16_t src, uint16_t dst, int16_t rssi, const uint8_t* data, size_t len);
+
+/**
+ * Simulated LoRaEMB module. Every command is acknowledged with a success
+ * response frame, and data transmitted can be delivered to a linked peer as
+ * a received data frame, so a sender and receiver can be wired together.
+ */
+class SimRadio : public Radio {
+public:
+    SimRadio() {}
+
+    // deliver everything we transmit to peer, as received at the given rssi
+    void link(SimRadio* peer, int16_t rssi);
+
+    // queue up a received data frame as the module would present it
+    void inject_rx_data(uint16_t src, uint16_t dst, int16_t rssi, const uint8_t* data, size_t len);
+    // queue up arbitrary raw bytes (i.e. something already framed)
+    void inject_raw(const uint8_t* bytes, size_t len);
+
+    // status byte to put in the responses to subsequent commands, 0 is OK
+    void set_ack_status(uint8_t status) { ack_status = status; }
+    // stop answering commands entirely, i.e. a hung module
+    void set_mute(bool mute) { muted = mute; }
+    // stop answering just cmd, e.g. a lost device info query, 0 for none
+    void set_ignore(uint8_t cmd) { ignored = cmd; }
+
+    // every command sent so far, in order, to see what a sequence did
+    const std::vector<uint8_t>& commands() const { return sent_cmds; }
+    void clear_commands() { sent_cmds.clear(); }
+
+    uint16_t address() const { return network_address; }
+    const std::vector<uint8_t>& last_transmit() const { return last_tx; }
+    size_t transmit_count() const { return tx_count; }
+
+    void sendCmd(uint8_t cmd) override;
+    void stopNetwork() override;
+    void startNetwork() override;
+    void setNetworkPreferences(bool protocol, bool auto_ack, bool cca) override;
+    void setOutputPower(uint8_t power) override;
+    void setOperatingChannel(uint8_t channel, RadioSpreadingFactor sf, RadioBandwidth bw, RadioCodingRate cr) override;
+    void setNetworkAddress(uint16_t address) override;
+    void setNetworkId(uint8_t* id, size_t len) override;
+    void setEnergySaveMode(RadioEnergySaveMode mode) override;
+    void transmitData(uint8_t* data, size_t len) override;
+
+    bool checkRxFifo(uint32_t timeout_ms) override;
+    const uint8_t* response() const override;
+    size_t responseLen() const override;
+    void printResponse() override;
+
+private:
+    void acknowledge(uint8_t cmd);
+
+    std::deque<std::vector<uint8_t> > rx_queue;
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> last_tx;
+    size_t tx_count = 0;
+    uint8_t ack_status = 0;
+    bool muted = false;
+    uint8_t ignored = 0;
+    std::vector<uint8_t> sent_cmds;
+    uint16_t network_address = 0;
+    SimRadio* peer = nullptr;
+    int16_t peer_rssi = 0;
+};
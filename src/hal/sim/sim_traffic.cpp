@@ -0,0 +1,141 @@
+#include "sim_traffic.h"
+
+#include <algorithm>
+#include "packet.h"
+
+// what the module adds to our data on air, its own addressing and so on,
+// not documented so a guess
+static const size_t LORA_MODULE_OVERHEAD = 8;
+static const unsigned int LORA_PREAMBLE_SYMBOLS = 8;
+
+uint32_t lora_airtime_us(size_t len, RadioSpreadingFactor sf, RadioBandwidth bw, RadioCodingRate cr) {
+    // as in Semtech's SX127x datasheet, explicit header and CRC on
+    static const uint32_t bw_hz[] = { 125000, 250000, 500000 };
+    int sfn = (int)sf;
+    int de = sfn >= 11 && bw == RADIO_BW_125; // low data rate optimisation
+    double symbol_us = (double)(1u << sfn) * 1e6 / bw_hz[bw];
+    int num = 8 * (int)(len + LORA_MODULE_OVERHEAD) - 4 * sfn + 28 + 16;
+    int den = 4 * (sfn - 2 * de);
+    int payload_symbols = 8 + std::max((num + den - 1) / den * ((int)cr + 5), 0);
+    return (uint32_t)((LORA_PREAMBLE_SYMBOLS + 4.25 + payload_symbols) * symbol_us);
+}
+
+namespace {
+
+struct Transmission {
+    uint64_t start_us;
+    uint64_t end_us;
+    uint16_t src;
+    uint16_t seq;
+    int16_t rssi;
+    int16_t strongest_other; // of those it overlapped
+    bool overlapped;
+    std::vector<uint8_t> payload;
+};
+
+struct Node {
+    uint64_t next_us;
+    uint16_t seq;
+    int16_t rssi;
+    struct sensor_record readings;
+};
+
+}
+
+std::vector<SimArrival> SimTraffic::generate(uint64_t start_us, uint32_t duration_ms) {
+    SimRandom rng(cfg.seed);
+    uint64_t end_us = start_us + (uint64_t)duration_ms * 1000;
+    uint32_t period_us = cfg.period_ms * 1000;
+    uint32_t jitter_us = cfg.jitter_ms * 1000;
+
+    // every node's packets, each as a sender would make it
+    std::vector<Node> nodes(cfg.nodes);
+    for (Node& node : nodes) {
+        node.next_us = start_us + rng.below(period_us);
+        node.seq = 0;
+        node.rssi = cfg.rssi_dbm - cfg.rssi_spread_db / 2 + (int16_t)rng.below(cfg.rssi_spread_db + 1);
+        node.readings.mcu_temp = 15.0f + rng.below(100) / 10.0f;
+        node.readings.vbat = 3.6f + rng.below(50) / 100.0f;
+        node.readings.vin = 5.0f;
+        node.readings.present = SENSOR_ALL_FIELDS;
+    }
+    std::vector<Transmission> txs;
+    for (size_t n = 0; n < nodes.size(); n++) {
+        Node& node = nodes[n];
+        while (node.next_us < end_us) {
+            struct txdata txd = {};
+            txd.dest = 0xFFFF;
+            txd.readings = node.readings;
+            txd.meta.seq = node.seq++;
+            txd.meta.present = 1u << PACKET_SEQ;
+            uint8_t buf[TXDATA_MAX_SIZE];
+            size_t len = serialise_txdata(&txd, buf);
+
+            Transmission tx;
+            tx.start_us = node.next_us;
+            tx.end_us = node.next_us + lora_airtime_us(len - 4, cfg.sf, cfg.bw, cfg.cr);
+            tx.src = cfg.first_address + n;
+            tx.seq = txd.meta.seq;
+            tx.rssi = node.rssi - cfg.rssi_fade_db + (int16_t)rng.below(2 * cfg.rssi_fade_db + 1);
+            tx.strongest_other = INT16_MIN;
+            tx.overlapped = false;
+            tx.payload.assign(buf + 4, buf + len);
+            txs.push_back(tx);
+
+            node.readings.mcu_temp += ((int)rng.below(21) - 10) / 100.0f;
+            node.readings.vbat -= rng.below(3) / 1000.0f;
+            node.next_us += period_us - jitter_us + rng.below(2 * jitter_us + 1);
+        }
+    }
+    totals.sent += txs.size();
+
+    // which overlapped which, and what each was up against
+    std::sort(txs.begin(), txs.end(), [](const Transmission& a, const Transmission& b) {
+        return a.start_us < b.start_us;
+    });
+    for (size_t i = 0; i < txs.size(); i++) {
+        for (size_t j = i + 1; j < txs.size() && txs[j].start_us < txs[i].end_us; j++) {
+            txs[i].overlapped = txs[j].overlapped = true;
+            txs[i].strongest_other = std::max(txs[i].strongest_other, txs[j].rssi);
+            txs[j].strongest_other = std::max(txs[j].strongest_other, txs[i].rssi);
+        }
+    }
+
+    // what got through, onto the UART one after another
+    std::sort(txs.begin(), txs.end(), [](const Transmission& a, const Transmission& b) {
+        return a.end_us < b.end_us;
+    });
+    std::vector<SimArrival> arrivals;
+    uint64_t uart_free_us = 0;
+    for (Transmission& tx : txs) {
+        if (tx.overlapped) {
+            if (tx.rssi < tx.strongest_other + cfg.capture_db) {
+                totals.collided++;
+                continue;
+            }
+            totals.captured++;
+        }
+        SimArrival arrival;
+        arrival.src = tx.src;
+        arrival.seq = tx.seq;
+        arrival.damaged = false;
+        arrival.bytes = sim_rx_data_frame(tx.src, 0xFFFF, tx.rssi, tx.payload.data(), tx.payload.size());
+        // ten bits a byte
+        uint64_t uart_us = (uint64_t)arrival.bytes.size() * 10 * 1000000 / cfg.uart_baud;
+        uart_free_us = std::max(uart_free_us, tx.end_us) + uart_us;
+        arrival.time_us = uart_free_us;
+
+        if (cfg.corrupt_ppm && rng.below(1000000) < cfg.corrupt_ppm) {
+            arrival.bytes[rng.below(arrival.bytes.size())] ^= 1 + rng.below(255);
+            arrival.damaged = true;
+            totals.corrupted++;
+        } else if (cfg.truncate_ppm && rng.below(1000000) < cfg.truncate_ppm) {
+            arrival.bytes.resize(1 + rng.below(arrival.bytes.size() - 1));
+            arrival.damaged = true;
+            totals.truncated++;
+        }
+        totals.delivered++;
+        arrivals.push_back(std::move(arrival));
+    }
+    return arrivals;
+}
@@ -0,0 +1,83 @@
+/**
+ * Simulated radio traffic from a whole site of senders, for load testing
+ * the receiver on a host.
+ *
+ * Each virtual node reports every period_ms, give or take jitter_ms, from a
+ * random start, sending a record with a sequence number as a real sender
+ * would. It has its own signal strength somewhere in the spread around
+ * rssi_dbm, varying a few dB packet to packet. Each packet is on air for as
+ * long as LoRa takes at the spreading factor and bandwidth given, and
+ * packets that overlap collide: as real LoRa radios do, the receiver still
+ * gets one that's capture_db stronger than everything it overlapped, the
+ * rest are lost. What gets through turns up as a received data frame on the
+ * module's UART once the last byte of it has, with now and again a byte
+ * corrupted or the frame cut short, as noise on the serial line would.
+ *
+ * Everything is worked out up front on the simulated clock from the seed,
+ * so a run is repeatable and goes as fast as whatever takes the frames can.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "hal.h"
+#include "sim_hal.h"
+
+struct SimTrafficConfig {
+    size_t nodes = 50;
+    uint16_t first_address = 0x2000; // then one up for each node
+    uint32_t period_ms = 5000;
+    uint32_t jitter_ms = 250;
+    int16_t rssi_dbm = -95; // nodes are spread evenly either side of this
+    uint16_t rssi_spread_db = 30;
+    uint16_t rssi_fade_db = 3; // packet to packet, either way
+    uint16_t capture_db = 6;
+    RadioSpreadingFactor sf = RADIO_SF_7;
+    RadioBandwidth bw = RADIO_BW_125;
+    RadioCodingRate cr = RADIO_CR_4_5;
+    uint32_t uart_baud = 115200; // module to Pico
+    // chance of a frame that got through being damaged on the UART, in
+    // parts per million
+    uint32_t corrupt_ppm = 0;
+    uint32_t truncate_ppm = 0;
+    uint32_t seed = 1;
+};
+
+// a frame arriving on the module's UART
+struct SimArrival {
+    uint64_t time_us; // when its last byte arrives
+    uint16_t src;
+    uint16_t seq;
+    bool damaged; // corrupted or truncated on the way
+    std::vector<uint8_t> bytes;
+};
+
+struct SimTrafficStats {
+    uint32_t sent;
+    uint32_t collided; // lost on air
+    uint32_t captured; // overlapped but strong enough to get through
+    uint32_t corrupted;
+    uint32_t truncated;
+    uint32_t delivered; // reached the UART, damaged or not
+};
+
+// how long a LoRa packet with a payload of len bytes is on air, in us
+uint32_t lora_airtime_us(size_t len, RadioSpreadingFactor sf, RadioBandwidth bw, RadioCodingRate cr);
+
+class SimTraffic {
+public:
+    SimTraffic(const SimTrafficConfig& cfg) : cfg(cfg) {}
+
+    /**
+     * Everything that reaches the UART in the duration_ms from start_us, in
+     * the order it arrives.
+     */
+    std::vector<SimArrival> generate(uint64_t start_us, uint32_t duration_ms);
+
+    const SimTrafficStats& stats() const { return totals; }
+
+private:
+    SimTrafficConfig cfg;
+    SimTrafficStats totals = {};
+};
@@ -20,298 +20,613 @@
  * https://yvan.seth.id.au/tag/lora.html
  */
 #include <cstdio>
-#include <vector>
-#include <numeric>
-#include <cmath>
-#include <algorithm>
+#include <cstring>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/gpio.h"
 #include "hardware/adc.h"
+#include "hardware/sync.h"
 #include "MeloperoPerpetuo.h"
+#include "pico_hal.h"
+#include "adc.h"
+#include "adr.h"
+#include "aggregate.h"
+#include "console.h"
+#include "emb_command.h"
+#include "flash_log.h"
+#include "frame.h"
+#include "frame_stream.h"
+#include "hostlink.h"
+#include "log.h"
+#include "node_stats.h"
+#include "packet.h"
+#include "profile.h"
+#include "radio_config.h"
+#include "relay.h"
+#include "report.h"
+#include "spsc_queue.h"
+#include "tdma.h"
+
+// Pipeline mode: core1 takes the UART interrupt, splits and decodes the
+// frames and hands the packets to core0 which does all the console output,
+// so a slow console can't hold up reception.
+#ifndef HORTITEL_PIPELINE
+#define HORTITEL_PIPELINE 0
+#endif
+// Binary output: rather than printing for a human send the host compact
+// framed records, see hostlink.h, and host/ for the other end
+#ifndef HORTITEL_BINARY_OUTPUT
+#define HORTITEL_BINARY_OUTPUT 0
+#endif
+// Deferred logging: the log messages go to the host as records too, see log.h,
+// otherwise text would only get in the way of binary output so there's none
+#ifndef HORTITEL_DEFERRED_LOG
+#define HORTITEL_DEFERRED_LOG 0
+#endif
+#if HORTITEL_DEFERRED_LOG && ! HORTITEL_BINARY_OUTPUT
+#error "HORTITEL_DEFERRED_LOG needs HORTITEL_BINARY_OUTPUT on the receiver"
+#endif
+// log.h has been included by now so it's too late to turn the logging off
+// here, src/CMakeLists.txt does it
+#if HORTITEL_BINARY_OUTPUT && ! HORTITEL_DEFERRED_LOG && HORTITEL_LOG_LEVEL != LOG_LEVEL_NONE
+#error "text logging would get mixed up with the binary output, build with HORTITEL_LOG_LEVEL=0"
+#endif
+// Flash log: in binary mode, keep the records in a ring at the end of flash
+// while the host isn't there and send them on once it's back, see flash_log.h
+#ifndef HORTITEL_FLASH_LOG
+#define HORTITEL_FLASH_LOG 0
+#endif
+#ifndef HORTITEL_FLASH_LOG_BYTES
+#define HORTITEL_FLASH_LOG_BYTES (256 * 1024)
+#endif
+// write out a partly filled page after this long, it's all that's lost if
+// the power goes
+#ifndef HORTITEL_FLASH_LOG_FLUSH_MS
+#define HORTITEL_FLASH_LOG_FLUSH_MS 30000
+#endif
+
+// TDMA: broadcast a beacon every frame so senders can take turns, see
+// tdma.h, the frame is split into a slot for the beacon plus this many
+#ifndef HORTITEL_TDMA
+#define HORTITEL_TDMA 0
+#endif
+#ifndef HORTITEL_TDMA_FRAME_MS
+#define HORTITEL_TDMA_FRAME_MS 5000
+#endif
+#ifndef HORTITEL_TDMA_SLOTS
+#define HORTITEL_TDMA_SLOTS 16
+#endif
+
+// Summaries: every this many ms send (or print) each node's min, max, mean
+// and last of each field over that time, see aggregate.h, 0 for none
+#ifndef HORTITEL_SUMMARY_MS
+#define HORTITEL_SUMMARY_MS 0
+#endif
+// and only those, not every reading
+#ifndef HORTITEL_SUMMARY_ONLY
+#define HORTITEL_SUMMARY_ONLY 0
+#endif
+
+#if HORTITEL_SUMMARY_ONLY && ! HORTITEL_SUMMARY_MS
+#error "HORTITEL_SUMMARY_ONLY needs HORTITEL_SUMMARY_MS"
+#endif
+#if HORTITEL_FLASH_LOG && ! HORTITEL_BINARY_OUTPUT
+#error "the flash log keeps binary records, it needs HORTITEL_BINARY_OUTPUT"
+#endif
+// core1 would have to be parked whilst writing to flash and the doorbell
+// interrupt gets in the way of doing that
+#if HORTITEL_FLASH_LOG && HORTITEL_PIPELINE
+#error "the flash log doesn't work with HORTITEL_PIPELINE yet"
+#endif
+
+// Everything the module sends us goes straight into here from the UART
+// interrupt, the main loop picks complete frames out of it
+static const size_t RX_RING_SIZE = 4096;
+static EmbFrameStream<RX_RING_SIZE> rx_stream;
+
+static void on_rx_byte(uint8_t byte) {
+    rx_stream.push(byte);
+}
 
-static const int SAMPLES = 16;
+// the board state is printed once a second
+static volatile bool status_due = true;
 
-float readADCVoltage( int adc ) {
-    std::vector<uint16_t> values;
+static bool status_timer_callback(repeating_timer_t*) {
+    status_due = true;
+    return true;
+}
 
-    // get ADC readings
-    adc_select_input( adc );
-    for ( int i = 0; i < SAMPLES; ++i ) {
-        uint16_t adc_val = adc_read(); 
-        values.push_back( adc_val );
-    }
+// and in TDMA mode a beacon at the start of every frame
+static volatile bool beacon_due = false;
 
-    // calculate standard deviation
-    float avg = std::accumulate( values.begin(), values.end(), (float)0.0 ) / values.size();
-    float sd = 0.0;
-    for ( int i = 0; i < values.size(); ++i ) {
-        sd += pow( values[i] - avg, 2);
-    }
-
-    std::vector<uint16_t> filtered;
-    if ( 0 == sd ) {
-        filtered = values;
-    } else {
-        // eliminate outliers here
-        std::copy_if( values.begin(), values.end(), std::back_inserter(filtered), [=](uint16_t val) {
-                bool pass = abs( (float)val - avg ) < (3 * sd);
-                if ( ! pass ) {
-                    printf( "rejected: %d\n", val );
-                }
-                return pass;
-        });
+#if HORTITEL_TDMA
+static bool beacon_timer_callback(repeating_timer_t*) {
+    beacon_due = true;
+    return true;
+}
+#endif
+
+// set the LED colour code for the battery charging state, and describe it
+static const char* update_charger_led(MeloperoPerpetuo& melopero) {
+    if (melopero.isCharging()) { 
+        // yellow
+        melopero.setWs2812Color(255, 255, 0, 0.1);  
+        return "charging";
+    } 
+    else if (melopero.isFullyCharged()) {
+        // green
+        melopero.setWs2812Color(0, 255, 0, 0.05); 
+        return "charged";
+    } 
+    else if (melopero.hasRecoverableFault()) {
+        // blue
+        melopero.setWs2812Color(0, 0, 255, 0.05);  
+        return "fault: recoverable";
+    } 
+    else if (melopero.hasNonRecoverableFault()) {
+        // red
+        melopero.setWs2812Color(255, 0, 0, 0.1);  
+        return "fault: non-recoverable";
     }
 
-    // calculate the average of remaining values
-    float adc_avg = std::accumulate( filtered.begin(), filtered.end(), 0.0 ) / filtered.size();
-
-    // convert to pin voltage
-    float adc_volts = adc_avg * (3.3f / (1 << 12));
-
-    return adc_volts;
+    // Note: If there is no battery plugged in this just flips between
+    // charging and charged status. If there it a battery but no input
+    // power then it seems to always report 'fully charged' so I think for
+    // full power state awareness you also need to be able to check supply
+    // voltage and ideally also battery/charge voltage.  I have experienced
+    // some slight oddness from the charging circuit where it sometimes
+    // never fully charges, hits a timeout, and reports
+    // non-recoverable-error... this status is reset by flipping the
+    // external power off-and-on-again.
+    return "unknown";
 }
 
-// this is the structure of the received data
-// TODO: we should support the core real data being a variable-length array
-//   perhaps like: null-terminated-label, int-type-code, value-length-dep-on-type
-//   or just do what normal folks do these days and make it a text format
-struct rxdata {
-    // the "header"
-    // see LoRaEMB on page 42: https://www.embit.eu/wp-content/uploads/2020/10/ebi-LoRa_rev1.0.1.pdf
-    uint16_t length; 
-    uint16_t options;
-    uint8_t wtf; // possibly an extra byte in the received data here? what is it? padding?
-    int16_t rssi;
-    uint16_t src;
-    uint16_t dst;
-
-    // our data starts here
-    uint8_t charge_state; // the charge status as supplied by Melopero library - actual struct +3 bytes padding/alignment
-    float mcu_temp; // the internal RPi temperature sensor value
-    float vbat; // battery circuit voltage - charging voltage or battery
-    float vin; // supply voltage, i.e. USB, solar, or battery
-
-    // 1 byte checksum, simply the low byte of the sum of the previous bytes
-    // not documented in the above doc for some reason, I suspect it's not our problem to validate it
-    uint8_t checksum; 
+#if HORTITEL_FLASH_LOG
+static PicoFlash log_flash(HORTITEL_FLASH_LOG_BYTES);
+static FlashLog flash_log(log_flash);
+
+// send the host some of the backlog, a block at a time so the radio still
+// gets seen to in between
+static void drain_flash_log() {
+    static uint8_t out[2048];
+    size_t out_len = 0;
+    uint32_t now_ms = hal_time_us() / 1000;
+    const uint8_t* record;
+    size_t len;
+    uint32_t held_ms;
+    while (out_len + HOSTLINK_FRAME_MAX <= sizeof(out) && flash_log.next(now_ms, &record, &len, &held_ms)) {
+        out_len += hostlink_restamp_record(record, len, now_ms, held_ms, out + out_len);
+    }
+    hal_console_write(out, out_len);
+}
+#endif
+
+#if HORTITEL_BINARY_OUTPUT
+// a record for the host. With no one to send it to, or a backlog still to
+// send, it goes on the end of the log so everything reaches the host in order
+static void send_record(const uint8_t* record, size_t len, uint32_t time_ms) {
+#if HORTITEL_FLASH_LOG
+    if ( ! hal_console_connected() || ! flash_log.empty() ) {
+        flash_log.append(time_ms, record, len);
+        return;
+    }
+#else
+    (void)time_ms;
+#endif
+    uint8_t out[HOSTLINK_FRAME_MAX];
+    hal_console_write(out, hostlink_frame_record(record, len, out));
+}
+#endif
+
+// a received frame and what we made of it
+struct RxPacket {
+    uint8_t frame[EMB_MAX_FRAME];
+    size_t len;
+    uint32_t time_ms; // when it arrived
+    bool decoded;
+    bool duplicate; // already had it, by another path, see relay.h
+    struct rxdata rxd;
 };
 
-// FIXME: error detection - format, length, etc - this code is **UNSAFE**
-uint8_t * deserialise_i16(uint8_t * buf, int16_t * val) {
-    uint16_t uval = 0;
-    uval |= ((uint16_t)buf[0]) << 8;
-    uval |= (uint16_t)buf[1];
-    *val = (int16_t)uval;
-    return buf + 2;
+// how long everything takes. With the pipeline core1 does the rx parse
+// phase and core0 the rest, so they don't trip over each other.
+static Profiler profiler;
+
+// senders only send what has changed, this fills in the rest, only
+// decode_rx_frame() touches it so it lives on whichever core that runs on
+static LastKnownValues last_known;
+// and the same for the packets we've had, so one heard both direct and
+// through relays is only dealt with once
+static DedupeCache rx_dedupe;
+
+// copy out and decode a frame, the frame is only valid until released
+static void decode_rx_frame(const EmbFrame& frame, struct RxPacket& pkt) {
+    ProfileSpan span(&profiler, PROFILE_RX_PARSE);
+    memcpy(pkt.frame, frame.data, frame.len);
+    pkt.len = frame.len;
+    pkt.time_ms = hal_time_us() / 1000;
+    pkt.rxd = {};
+    pkt.decoded = frame.data[2] == EMB_RX_DATA && deseralise_rxdata(pkt.frame, pkt.len, &pkt.rxd);
+    pkt.duplicate = pkt.decoded && rx_dedupe.seen(pkt.rxd, pkt.time_ms);
+    if (pkt.decoded && ! pkt.duplicate) {
+        last_known.fill(pkt.rxd);
+    }
 }
-uint8_t * deserialise_u16(uint8_t * buf, uint16_t * val) {
-    *val = 0; // just to be sure
-    *val |= ((uint16_t)buf[0]) << 8;
-    *val |= (uint16_t)buf[1];
-    return buf + 2;
+
+// how well each sender is heard, for answering their link checks
+static LinkMonitor link_monitor;
+// and everything else about them, for the nodes command
+static NodeStatsTable node_stats;
+
+#if HORTITEL_SUMMARY_MS
+static SummaryTable summaries(HORTITEL_SUMMARY_MS);
+
+// a node's period is over, the summary goes out as a reading would
+static void emit_summary(uint16_t src, const NodeSummary& summary) {
+    ProfileSpan span(&profiler, PROFILE_CONSOLE);
+#if HORTITEL_BINARY_OUTPUT
+    uint32_t now_ms = hal_time_us() / 1000;
+    struct sensor_record stats[HOSTLINK_STATS];
+    for (size_t s = 0; s < HOSTLINK_STATS; s++) {
+        summary.values((HostlinkSummaryStat)s, &stats[s]);
+    }
+    uint32_t age_ms = now_ms - (summary.start_ms + summaries.period());
+    uint8_t record[HOSTLINK_RECORD_MAX];
+    send_record(record, hostlink_record_summary(src, now_ms, age_ms, summaries.period(), summary.count, stats, record),
+            now_ms);
+#else
+    printf("\n============================================\n");
+    print_summary(src, summary, summaries.period());
+#endif
 }
-uint8_t * deserialise_u8(uint8_t * buf, uint8_t * val) {
-    *val = (uint8_t)buf[0];
-    return buf + 1;
+#endif
+
+// note who a packet came from and how it got here. A sender asking how well
+// it's heard is listening for the answer now, so that goes straight back
+// before anything else, see adr.h. Only what's heard direct says how well
+// that is, and the direct one can turn up after a relayed copy. Another copy
+// of one already had says nothing about what the sender's lost though, a
+// late one would look like a lost packet turning up.
+static void track_rx_packet(Radio& radio, const struct RxPacket& pkt) {
+    if ( ! pkt.decoded ) {
+        return;
+    }
+    profiler.packet();
+    if ( ! pkt.duplicate ) {
+        node_stats.heard(pkt.rxd, pkt.time_ms);
+    }
+    if ( ! rxdata_relayed(pkt.rxd) ) {
+        link_monitor.heard(pkt.rxd.src, pkt.rxd.rssi);
+        struct LinkFeedback fb;
+        if ( pkt.rxd.listening && link_monitor.feedback(pkt.rxd.src, &fb) ) {
+            uint8_t buf[LINK_FEEDBACK_SIZE];
+            ProfileSpan span(&profiler, PROFILE_TX);
+            radio.transmitData(buf, serialise_link_feedback(&fb, pkt.rxd.src, buf));
+            span.end();
+            LOG_INFO( "Link check from 0x%04X: rssi=%d min=%d heard=%u",
+                    pkt.rxd.src, fb.rssi, fb.rssi_min, (unsigned)fb.heard );
+        }
+    }
+#if HORTITEL_SUMMARY_MS
+    // by when they were taken, a batch's oldest first as it was filled
+    for (size_t i = 0; ! pkt.duplicate && i < pkt.rxd.count; i++) {
+        summaries.add(pkt.rxd.src, pkt.rxd.readings[i], pkt.time_ms - pkt.rxd.age_ms[i], emit_summary);
+    }
+#endif
 }
-// not cross-plaform, but my application doesn't need to be
-uint8_t * deserialise_float(uint8_t * buf, float * val) {
-    *val = 0; // just to be sure
-    *((uint32_t*)val) |= ((uint32_t)buf[0]) << 24;
-    *((uint32_t*)val) |= ((uint32_t)buf[1]) << 16;
-    *((uint32_t*)val) |= ((uint32_t)buf[2]) << 8;
-    *((uint32_t*)val) |= (uint32_t)buf[3];
-    return buf + 4;
+
+// print for a human or, in binary mode, send a record per sample to the
+// host, anything that isn't our data is left out of the binary output
+static void print_rx_packet(const struct RxPacket& pkt) {
+    ProfileSpan span(&profiler, PROFILE_CONSOLE);
+    if (pkt.frame[2] == (EMB_CMD_SEND_DATA | EMB_RESPONSE_FLAG)) {
+        // the module saying it's sent a link feedback
+        return;
+    }
+    if (pkt.frame[2] != EMB_RX_DATA) {
+        LOG_WARN( "Unexpected frame: type=0x%02X length=%zu", pkt.frame[2], pkt.len );
+        return;
+    }
+    if ( ! pkt.decoded ) {
+        LOG_WARN( "bad frame: couldn't decode our data" );
+    }
+    if (pkt.duplicate) {
+        LOG_DEBUG( "Duplicate from 0x%04X via 0x%04X: seq=%u", pkt.rxd.src, pkt.rxd.via, (unsigned)pkt.rxd.meta.seq );
+        return;
+    }
+#if HORTITEL_SUMMARY_ONLY
+    // they're in the summaries
+#elif HORTITEL_BINARY_OUTPUT
+    for (size_t i = 0; pkt.decoded && i < pkt.rxd.count; i++) {
+        uint8_t record[HOSTLINK_RECORD_MAX];
+        send_record(record, hostlink_record_reading(&pkt.rxd, i, pkt.time_ms, record), pkt.time_ms);
+    }
+#else
+    // the raw frame is only for debugging
+    print_rx_frame(pkt.frame, pkt.len, &pkt.rxd, HORTITEL_LOG_LEVEL >= LOG_LEVEL_DEBUG);
+#endif
 }
-void deseralise_rxdata(uint8_t * buf, struct rxdata *rxd) {
-    buf = deserialise_u16(buf, &(rxd->length));
-    buf = deserialise_u16(buf, &(rxd->options));
-    buf = deserialise_u8(buf, &(rxd->wtf));
-    buf = deserialise_i16(buf, &(rxd->rssi));
-    buf = deserialise_u16(buf, &(rxd->src));
-    buf = deserialise_u16(buf, &(rxd->dst));
-    buf = deserialise_u8(buf, &(rxd->charge_state));
-    buf = deserialise_float(buf, &(rxd->mcu_temp));
-    buf = deserialise_float(buf, &(rxd->vbat));
-    buf = deserialise_float(buf, &(rxd->vin));
-    buf = deserialise_u8(buf, &(rxd->checksum));
+
+#if ! HORTITEL_BINARY_OUTPUT
+static ConsoleLine console_line;
+
+// something typed at the console
+static void handle_command(const char* line) {
+    uint32_t now_ms = hal_time_us() / 1000;
+    unsigned int addr;
+    if (strcmp(line, "nodes") == 0) {
+        node_stats.print_summary(now_ms);
+    } else if (sscanf(line, "node %x", &addr) == 1) {
+        if ( ! node_stats.print_node(addr, now_ms) ) {
+            printf( "Never heard from 0x%04X\n", addr );
+        }
+    } else if (strcmp(line, "profile") == 0) {
+        profiler.print();
+    } else if (strcmp(line, "profile reset") == 0) {
+        profiler.reset();
+    } else if (line[0]) {
+        printf( "commands:\n  nodes: what's been heard from each sender\n  node <address in hex>: all about the one\n"
+                "  profile: how long everything takes\n  profile reset: start again\n" );
+    }
 }
+#endif
+
+#if HORTITEL_PIPELINE
+static SpscQueue<struct RxPacket, 8> rx_queue;
+static MeloperoRadio* rx_radio;
+
+// core1: take the bytes from the module, turn them into packets for core0
+static void rx_core_main() {
+    // the UART interrupt goes to the core that enables it
+    rx_radio->start_rx_interrupt(on_rx_byte);
+    while (1) {
+        EmbFrame frame;
+        while (rx_stream.next(frame)) {
+            struct RxPacket* pkt = rx_queue.write_slot();
+            if (pkt) {
+                decode_rx_frame(frame, *pkt);
+                rx_queue.commit();
+                core_doorbell_ring();
+            }
+            rx_stream.release(frame);
+        }
+        uint32_t save = save_and_disable_interrupts();
+        if ( rx_stream.idle() ) {
+            __wfi();
+        }
+        restore_interrupts(save);
+    }
+}
+#endif
+
+// what the radio module's set to, kept through a reboot so a warm start only
+// has to send it what's changed, see radio_config.h
+static RadioConfigCache __uninitialized_ram(radio_cache);
 
 // Main function
 int main() {
+    uint64_t boot_us = hal_time_us();
     stdio_init_all();  // Initialize all standard IO
 
     MeloperoPerpetuo melopero;
 
     melopero.init();  // Initialize the board and peripherals
+    MeloperoRadio radio(melopero);
+    PicoAdc adc;
 
     melopero.led_init();
     melopero.blink_led(3, 250);
 
-    melopero.sendCmd(0x01);
-    sleep_ms(500);
-    printf("response to deviceId\n");
-    melopero.printResponse();
-    
     // LoRaEMB operating mode configuration
-    melopero.stopNetwork();
-    sleep_ms(500);
-    printf("response to stopNetwork\n");
-    melopero.printResponse();
-    
-    melopero.setNetworkPreferences(false, false, false);
-    sleep_ms(500);
-    printf("response to setNetworkPreferences\n");
-    melopero.printResponse();
-
-    melopero.setOutputPower(0x0a);  // Example power level
-    sleep_ms(500);
-    printf("response to setOutputPower\n");
-    melopero.printResponse();
-
-    melopero.setOperatingChannel(1, SPREADING_FACTOR_7, BANDWIDTH_125, CODING_RATE_4_5);  // Example channel
-    sleep_ms(500);
-    printf("response to setOperatingChannel\n");
-    melopero.printResponse();
-    
-    melopero.setNetworkAddress(0x1235);  // Example network address
-    sleep_ms(500);
-    printf("response to setNetworkAddress\n");
-    melopero.printResponse();
-
-    uint8_t network_id[] = {0x00, 0x01};  // Example network ID
-    melopero.setNetworkId(network_id, sizeof(network_id));
-    sleep_ms(500);
-    printf("response to setNetworkId\n");
-    melopero.printResponse();
-
-    melopero.setEnergySaveMode(ENERGY_SAVE_MODE_ALWAYS_ON);
-    sleep_ms(500);
-    printf("response to setEnergySaveModeRxAlways\n");
-    melopero.printResponse();
-
-    melopero.startNetwork();
-    sleep_ms(500);
-    printf("response to startNetwork\n");
-    melopero.printResponse();
+    EmbCommander emb(radio);
+    RadioConfig radio_cfg = radio_config_defaults();
+    radio_cfg.network_address = 0x1235;  // Example network address
+    radio_cfg.energy_save = RADIO_ENERGY_SAVE_ALWAYS_ON;
+    if ( ! radio_configure(emb, radio, radio_cfg, &radio_cache) ) {
+        LOG_WARN("radio configuration incomplete, carrying on regardless");
+    }
+
+    // from now on we get the module's output by interrupt, as it arrives,
+    // on this core or core1
+#if HORTITEL_PIPELINE
+    rx_radio = &radio;
+    multicore_launch_core1(rx_core_main);
+    core_doorbell_listen();
+#else
+    radio.start_rx_interrupt(on_rx_byte);
+#endif
+
+#if HORTITEL_FLASH_LOG
+    flash_log.mount(hal_time_us() / 1000);
+#endif
 
     adc_init();
     adc_set_temp_sensor_enabled(true);
     melopero.enablelWs2812(true);
+#if HORTITEL_BINARY_OUTPUT
+    // the end of the text, the host can start looking for records after it
+    static const uint8_t delimiter = 0;
+    printf("switching to binary output\n");
+    stdio_flush();
+    hal_console_write(&delimiter, 1);
+#endif
+    repeating_timer_t status_timer;
+    add_repeating_timer_ms(1000, status_timer_callback, nullptr, &status_timer);
+#if HORTITEL_TDMA
+    // negative so it's start to start and the frames don't drift
+    repeating_timer_t beacon_timer;
+    add_repeating_timer_ms(-HORTITEL_TDMA_FRAME_MS, beacon_timer_callback, nullptr, &beacon_timer);
+    uint16_t beacon_seq = 0;
+#endif
+    profiler.record(PROFILE_BOOT, (uint32_t)(hal_time_us() - boot_us));
     while (1) {
-       
-        // simple LED on whilst loop body is executing
-        gpio_put(23, 1);
-
-        printf("\n============================================\n");
-        printf( "MCU Board State:\n" );
 
+#if HORTITEL_TDMA
         ///////////////////////////////////////////////////////////////////////
-        // print out the battery charging state, also set LED colour code
-        printf("  Battery: %d (", melopero.getChargerStatus());
-        if (melopero.isCharging()) { 
-            printf("charging)\n");
-            // yellow
-            melopero.setWs2812Color(255, 255, 0, 0.1);  
-        } 
-        else if (melopero.isFullyCharged()) {
-            printf("charged)\n");
-            // green
-            melopero.setWs2812Color(0, 255, 0, 0.05); 
-        } 
-        else if (melopero.hasRecoverableFault()) {
-            printf("fault: recoverable)\n");
-            // blue
-            melopero.setWs2812Color(0, 0, 255, 0.05);  
-        } 
-        else if (melopero.hasNonRecoverableFault()) {
-            printf("fault: non-recoverable)\n");
-            // red
-            melopero.setWs2812Color(255, 0, 0, 0.1);  
+        // the beacon first, the senders' slots are timed from it
+        if (beacon_due) {
+            beacon_due = false;
+            struct TdmaBeacon beacon = tdma_beacon(beacon_seq++, HORTITEL_TDMA_FRAME_MS, HORTITEL_TDMA_SLOTS);
+            uint8_t buf[TDMA_BEACON_SIZE];
+            ProfileSpan span(&profiler, PROFILE_TX);
+            radio.transmitData(buf, serialise_beacon(&beacon, buf));
         }
-
-        // Note: If there is no battery plugged in this just flips between
-        // charging and charged status. If there it a battery but no input
-        // power then it seems to always report 'fully charged' so I think for
-        // full power state awareness you also need to be able to check supply
-        // voltage and ideally also battery/charge voltage.  I have experienced
-        // some slight oddness from the charging circuit where it sometimes
-        // never fully charges, hits a timeout, and reports
-        // non-recoverable-error... this status is reset by flipping the
-        // external power off-and-on-again.
-
+#endif
 
         ///////////////////////////////////////////////////////////////////////
-        // check the temperature of the RP2350
-        float voltage = readADCVoltage( 4 );
-        float temp = 27.0 - ((voltage - 0.706) / 0.001721); // values from RP2350 documentation
-        printf( "  RP2350 Temperature: %0.2f C\n", temp );
-
+        // deal with all the received LoRa data that's come in
+#if HORTITEL_PIPELINE
+        struct RxPacket* pkt;
+        while ((pkt = rx_queue.read_slot())) {
+            // simple LED on whilst handling data
+            gpio_put(23, 1);
+#if ! HORTITEL_BINARY_OUTPUT && ! HORTITEL_SUMMARY_ONLY
+            printf("\n============================================\n");
+#endif
+            track_rx_packet(radio, *pkt);
+            print_rx_packet(*pkt);
+            rx_queue.release();
+            gpio_put(23, 0);
+        }
+#else
+        EmbFrame frame;
+        while (rx_stream.next(frame)) {
+            static struct RxPacket pkt;
+            // simple LED on whilst handling data
+            gpio_put(23, 1);
+#if ! HORTITEL_BINARY_OUTPUT && ! HORTITEL_SUMMARY_ONLY
+            printf("\n============================================\n");
+#endif
+            decode_rx_frame(frame, pkt);
+            rx_stream.release(frame);
+            track_rx_packet(radio, pkt);
+            print_rx_packet(pkt);
+            gpio_put(23, 0);
+        }
+#endif
 
+#if ! HORTITEL_BINARY_OUTPUT
         ///////////////////////////////////////////////////////////////////////
-        // read received LoRa data, and if available print receive data
-        uint8_t rxbuff[sizeof(struct rxdata)]; // at least big enough for our *expected* data
-        size_t rxbuff_ptr = 0;
-        bool verbose = false; 
-        if (melopero.checkRxFifo(500)) { // if there is data received...
-            // TODO: this really needs some sort of validation
-            do {
-                if (verbose) printf("rx: ");
-                for (size_t i = 0; i < melopero.responseLen; i++) {
-                    if (rxbuff_ptr < sizeof(rxbuff)) {
-                        rxbuff[rxbuff_ptr] = melopero.response[i];
-                        if (verbose) printf("0x%02X ", rxbuff[rxbuff_ptr]);
-                    } else {
-                        // more data than buffer holds received, we just ignore it
-                        if (verbose) {
-                            printf("(0x%02X) ", melopero.response[i]);
-                        } else {
-                            break;
-                        }
-                    } 
-                    rxbuff_ptr++;
-                }
-                if (verbose) printf("\n");
-            } while (melopero.checkRxFifo(500)); // Keep checking the FIFO for new data
-                                             
-            // NOTE: the rxbuff_ptr could be < or > actual buffer length
-            printf( "Received Data Info:\n  length=%d (buflen=%d)\n  data={", rxbuff_ptr, sizeof(rxbuff) );
-            uint32_t checksum = 0;
-            size_t safelen = (rxbuff_ptr < sizeof(rxbuff)) ? rxbuff_ptr : sizeof(rxbuff);
-            for (size_t i = 0; i < safelen ; i++) {
-                if ( i < (safelen - 1) ) checksum += rxbuff[i];
-                printf("0x%02X ", rxbuff[i]);
+        // anything typed at the console, in binary mode it's all ours
+        int c;
+        while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+            if (console_line.push(c)) {
+                handle_command(console_line.line());
             }
-            printf("}\n");
-            checksum &= 0x000000ff;
-            printf( "  checksum=%02X\n", checksum );
-
-            struct rxdata rxd = {};
-            deseralise_rxdata( rxbuff, &rxd );
-
-            printf( "Deserialised Packet Info:\n" );
-            printf( "  Data Length: %u bytes\n", rxd.length );
-            printf( "  Options: 0x%08X (bitfield)\n", rxd.options );
-            printf( "  WTF: 0x%02X (undocumented field?)\n", rxd.wtf );
-            printf( "  Signal Strength: %d dBm\n", rxd.rssi );
-            printf( "  Source Addr: 0x%04X\n", rxd.src );
-            printf( "  Dest Addr: 0x%04X (0xFFFF is broadcast)\n", rxd.dst );
-            printf( "  Payload: \n" );
-            printf( "    RP2350 Temperature: %0.2f C\n", rxd.mcu_temp );
-            printf( "    Charge State: %u\n", rxd.charge_state );
-            printf( "    Battery Voltage: %0.2fV\n", rxd.vbat );
-            printf( "    Supply Voltage: %0.2fV\n", rxd.vin );
-            printf( "  Checksum: %02X\n", rxd.checksum );
-
-        } else {
-            printf("nothing in the rx fifo\n");
         }
+#endif
 
-        // simple LED off
-        gpio_put(23, 0);
+#if HORTITEL_SUMMARY_MS
+        summaries.close_due(hal_time_us() / 1000, emit_summary);
+#endif
 
-        // check every second for recieved data
-        sleep_ms(1000);
+#if HORTITEL_FLASH_LOG
+        if ( hal_console_connected() && ! flash_log.empty() ) {
+            drain_flash_log();
+        }
+#endif
+
+        if (status_due) {
+            status_due = false;
+            gpio_put(23, 1);
+            ProfileSpan span(&profiler, PROFILE_CONSOLE);
+
+            ///////////////////////////////////////////////////////////////////
+            // the battery charging state, also set LED colour code
+            uint8_t charge_state = melopero.getChargerStatus();
+            const char* charge_desc = update_charger_led(melopero);
+
+            ///////////////////////////////////////////////////////////////////
+            // check the temperature of the RP2350
+            float voltage = readADCVoltage( adc, ADC_CHANNEL_TEMP );
+            float temp = adc_volts_to_mcu_temp( voltage );
+
+            uint32_t rx_dropped = rx_stream.dropped();
+#if HORTITEL_PIPELINE
+            rx_dropped += rx_queue.dropped();
+#endif
+
+#if HORTITEL_BINARY_OUTPUT
+            (void)charge_desc;
+            struct HostlinkStatus status = {};
+            status.rx_frames = rx_stream.frames();
+            status.rx_errors = rx_stream.errors();
+            status.rx_dropped = rx_dropped;
+            status.charge_state = charge_state;
+            status.mcu_temp = temp;
+            status.nodes = node_stats.nodes();
+            status.untracked = node_stats.untracked();
+            status.present = ((1u << HOSTLINK_STATUS_LOG_PENDING) - 1)
+                    | (1u << HOSTLINK_STATUS_NODES) | (1u << HOSTLINK_STATUS_UNTRACKED);
+#if HORTITEL_FLASH_LOG
+            status.log_pending = flash_log.pending();
+            status.log_lost = flash_log.lost();
+            status.log_overruns = log_flash.rx_overruns();
+            status.present |= (1u << HOSTLINK_STATUS_LOG_PENDING) | (1u << HOSTLINK_STATUS_LOG_LOST)
+                    | (1u << HOSTLINK_STATUS_LOG_OVERRUNS);
+#endif
+            uint8_t out[HOSTLINK_FRAME_MAX];
+            hal_console_write(out, hostlink_encode_status(&status, hal_time_us() / 1000, out));
+#else
+            printf("\n============================================\n");
+            printf( "MCU Board State:\n" );
+            printf( "  Battery: %d (%s)\n", charge_state, charge_desc );
+            printf( "  RP2350 Temperature: %0.2f C\n", temp );
+            printf( "  RX: frames=%lu resync bytes=%lu dropped=%lu duplicates=%lu\n",
+                    (unsigned long)rx_stream.frames(), (unsigned long)rx_stream.errors(),
+                    (unsigned long)rx_dropped, (unsigned long)rx_dedupe.duplicates() );
+            printf( "  Nodes: tracked=%u of %u, packets from untracked=%lu\n", (unsigned)node_stats.nodes(),
+                    (unsigned)HORTITEL_MAX_NODES, (unsigned long)node_stats.untracked() );
+#if HORTITEL_SUMMARY_MS
+            printf( "  Summaries: readings too late for their period=%lu\n", (unsigned long)summaries.late() );
+#endif
+#if HORTITEL_TDMA
+            printf( "  TDMA: beacons sent=%u\n", (unsigned)beacon_seq );
+#endif
+#endif
+
+            gpio_put(23, 0);
+        }
+
+#if HORTITEL_FLASH_LOG
+        // the slow flash work only when there's nothing else, as it stops
+        // everything (the module's UART included) while it's going on. A
+        // frame that starts arriving meanwhile is lost all the same, see
+        // PicoFlash::rx_overruns().
+        uint32_t now_ms = hal_time_us() / 1000;
+        if ( rx_stream.idle() && flash_log.service_due(now_ms, HORTITEL_FLASH_LOG_FLUSH_MS) ) {
+            flash_log.service(now_ms, HORTITEL_FLASH_LOG_FLUSH_MS);
+        }
+        bool draining = hal_console_connected() && ! flash_log.empty();
+#else
+        bool draining = false;
+#endif
+
+#if HORTITEL_DEFERRED_LOG
+        // and this time round's logging, before sleeping
+        ProfileSpan flush_span(&profiler, PROFILE_CONSOLE);
+        log_flush();
+        flush_span.end();
+#endif
+
+        // sleep until either more data comes in or the status or a beacon is due,
+        // interrupts are off around the check so neither can slip past
+        // the radio listening all the while
+        uint64_t idle_us = hal_time_us();
+        bool idle = false;
+        uint32_t save = save_and_disable_interrupts();
+#if HORTITEL_PIPELINE
+        if ( rx_queue.empty() && ! status_due && ! beacon_due && ! draining ) {
+#else
+        if ( rx_stream.idle() && ! status_due && ! beacon_due && ! draining ) {
+#endif
+            __wfi();
+            idle = true;
+        }
+        restore_interrupts(save);
+        if (idle) {
+            profiler.record(PROFILE_LISTEN, (uint32_t)(hal_time_us() - idle_us));
+        }
     }
 
     // technically this is unreachable?
@@ -0,0 +1,210 @@
+/**
+ * Melopero Perpetuo LoRa - Allotment Telemetry Relay
+ *
+ * This code began life as the Melopero sample code the Perpetuo LoRa board.
+ * This can be found here: https://github.com/melopero/Melopero_Perpetuo_Lora
+ *
+ * As per their code I choose to continue the MIT licencing for this.
+ *
+ * This is the code for a LoRa relay node, a spare board placed between the
+ * receiver and sender nodes too far away for it to hear. It listens all the
+ * time and broadcasts whatever the senders (and other relays) send again,
+ * marked with where it came from and how many hops it's had, so the
+ * receiver can put it down to the right node. See src/core/relay.h.
+ *
+ * DISCLAIMER: The code is in no way warranted to be fit for any purpose at
+ * all. In fact it is almost certainly "buggy as hell". You have been warned.
+ *
+ * Yvan Seth <allotment.sensors@seth.id.au>
+ * https://yvan.seth.id.au/tag/lora.html
+ */
+#include <cstdio>
+#include <cstring>
+#include "pico/stdlib.h"
+#include "pico/rand.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "MeloperoPerpetuo.h"
+#include "pico_hal.h"
+#include "emb_command.h"
+#include "frame.h"
+#include "frame_stream.h"
+#include "log.h"
+#include "packet.h"
+#include "radio_config.h"
+#include "relay.h"
+
+// per relay settings, e.g. cmake -DHORTITEL_RELAY_ADDRESS=0x12F1 ...
+#ifndef HORTITEL_RELAY_ADDRESS
+#define HORTITEL_RELAY_ADDRESS 0x12F0
+#endif
+// don't pass on anything that's been through this many relays already
+#ifndef HORTITEL_RELAY_MAX_HOPS
+#define HORTITEL_RELAY_MAX_HOPS 2
+#endif
+// wait up to this long, at random, before passing a packet on, so relays
+// that heard the same one don't all talk over each other
+#ifndef HORTITEL_RELAY_JITTER_MS
+#define HORTITEL_RELAY_JITTER_MS 250
+#endif
+#ifndef HORTITEL_DEFERRED_LOG
+#define HORTITEL_DEFERRED_LOG 0
+#endif
+
+#if HORTITEL_RELAY_MAX_HOPS < 1 || HORTITEL_RELAY_MAX_HOPS > 8
+#error "HORTITEL_RELAY_MAX_HOPS must be from 1 to RELAY_MAX_HOPS (8)"
+#endif
+
+// Everything the module sends us goes straight into here from the UART
+// interrupt, the main loop picks complete frames out of it
+static const size_t RX_RING_SIZE = 4096;
+static EmbFrameStream<RX_RING_SIZE> rx_stream;
+
+static void on_rx_byte(uint8_t byte) {
+    rx_stream.push(byte);
+}
+
+// how it's getting on is logged once a minute
+static volatile bool status_due = false;
+
+static bool status_timer_callback(repeating_timer_t*) {
+    status_due = true;
+    return true;
+}
+
+// the packets we've passed on lately, and what's become of everything heard
+static DedupeCache seen;
+static uint32_t heard_count = 0;
+static uint32_t relayed_count = 0;
+static uint32_t hop_limited = 0;
+static uint32_t too_big = 0;
+static uint32_t bad_count = 0;
+
+// pass on an uplink, if it's one we haven't already
+static void relay_frame(Radio& radio, const uint8_t* frame, size_t len, uint32_t time_ms) {
+    if (frame[2] != EMB_RX_DATA) {
+        // the module saying it's sent what we passed on
+        return;
+    }
+    uint8_t format = len > RXDATA_HEADER_SIZE ? frame[RXDATA_HEADER_SIZE] & ~PAYLOAD_FLAG_LISTENING : 0;
+    if (format != PAYLOAD_FORMAT_RECORD && format != PAYLOAD_FORMAT_BATCH) {
+        // beacons and link feedback from the receiver, they're for the
+        // senders in earshot of it
+        return;
+    }
+    static struct rxdata rxd;
+    rxd = {};
+    if ( ! deseralise_rxdata(frame, len, &rxd) ) {
+        bad_count++;
+        LOG_WARN( "bad frame: couldn't decode, length=%zu", len );
+        return;
+    }
+    heard_count++;
+    if (seen.seen(rxd, time_ms)) {
+        LOG_DEBUG( "Duplicate from 0x%04X via 0x%04X: seq=%u", rxd.src, rxd.via, (unsigned)rxd.meta.seq );
+        return;
+    }
+
+    uint32_t wait_ms = get_rand_32() % (HORTITEL_RELAY_JITTER_MS + 1);
+    uint32_t held_ms = (uint32_t)(hal_time_us() / 1000) - time_ms + wait_ms;
+    uint8_t buf[TXDATA_MAX_SIZE];
+    RelayStatus status;
+    size_t buf_len = relay_txdata(frame, len, rxd, HORTITEL_RELAY_MAX_HOPS, held_ms, buf, &status);
+    if (buf_len == 0) {
+        if (status == RELAY_HOP_LIMIT) {
+            // it's gone far enough
+            hop_limited++;
+        } else if (status == RELAY_TOO_BIG) {
+            too_big++;
+            LOG_WARN( "0x%04X seq=%u: no room to add the relay fields, length=%zu", rxd.src,
+                    (unsigned)rxd.meta.seq, len );
+        } else {
+            bad_count++;
+            LOG_WARN( "bad frame: couldn't relay, length=%zu", len );
+        }
+        return;
+    }
+    hal_sleep_ms(wait_ms);
+    radio.transmitData(buf, buf_len);
+    relayed_count++;
+    LOG_DEBUG( "Relayed 0x%04X: seq=%u hops=%u rssi=%d", rxd.src, (unsigned)rxd.meta.seq,
+            (unsigned)(rxdata_relayed(rxd) ? rxd.meta.hops + 1 : 1), rxd.rssi );
+}
+
+// what the radio module's set to, kept through a reboot so a warm start only
+// has to send it what's changed, see radio_config.h
+static RadioConfigCache __uninitialized_ram(radio_cache);
+
+// Main function
+int main() {
+    stdio_init_all();  // Initialize all standard IO
+
+    MeloperoPerpetuo melopero;
+
+    melopero.init();  // Initialize the board and peripherals
+    MeloperoRadio radio(melopero);
+
+    melopero.led_init();
+    melopero.blink_led(4, 250);
+
+    // LoRaEMB operating mode configuration, listening all the time as the
+    // receiver does
+    EmbCommander emb(radio);
+    RadioConfig radio_cfg = radio_config_defaults();
+    radio_cfg.network_address = HORTITEL_RELAY_ADDRESS;
+    radio_cfg.energy_save = RADIO_ENERGY_SAVE_ALWAYS_ON;
+    if ( ! radio_configure(emb, radio, radio_cfg, &radio_cache) ) {
+        LOG_WARN("radio configuration incomplete, carrying on regardless");
+    }
+#if HORTITEL_DEFERRED_LOG
+    // the end of the text, from here on it's log records for hortitel_decode
+    static const uint8_t delimiter = 0;
+    printf("switching to deferred logging\n");
+    stdio_flush();
+    hal_console_write(&delimiter, 1);
+#endif
+
+    radio.start_rx_interrupt(on_rx_byte);
+    repeating_timer_t status_timer;
+    add_repeating_timer_ms(60000, status_timer_callback, nullptr, &status_timer);
+    while (1) {
+
+        ///////////////////////////////////////////////////////////////////////
+        // pass on what's come in
+        EmbFrame frame;
+        while (rx_stream.next(frame)) {
+            static uint8_t buf[EMB_MAX_FRAME];
+            // simple LED on whilst handling data
+            gpio_put(23, 1);
+            uint32_t time_ms = hal_time_us() / 1000;
+            size_t len = frame.len;
+            memcpy(buf, frame.data, len);
+            rx_stream.release(frame);
+            relay_frame(radio, buf, len, time_ms);
+            gpio_put(23, 0);
+        }
+
+        if (status_due) {
+            status_due = false;
+            LOG_INFO( "Relay 0x%04X: heard=%lu relayed=%lu duplicates=%lu hop limited=%lu too big=%lu bad=%lu "
+                    "dropped=%lu", (unsigned)HORTITEL_RELAY_ADDRESS, (unsigned long)heard_count,
+                    (unsigned long)relayed_count, (unsigned long)seen.duplicates(), (unsigned long)hop_limited,
+                    (unsigned long)too_big, (unsigned long)bad_count, (unsigned long)rx_stream.dropped() );
+        }
+
+#if HORTITEL_DEFERRED_LOG
+        log_flush();
+#endif
+
+        // sleep until either more data comes in or the status is due,
+        // interrupts are off around the check so neither can slip past
+        uint32_t save = save_and_disable_interrupts();
+        if ( rx_stream.idle() && ! status_due ) {
+            __wfi();
+        }
+        restore_interrupts(save);
+    }
+
+    // technically this is unreachable?
+    return 0;
+}
@@ -20,175 +20,207 @@
  * https://yvan.seth.id.au/tag/lora.html
  */
 #include <cstdio>
-#include <vector>
-#include <numeric>
-#include <cmath>
-#include <algorithm>
-#include <string>
+#include <cstring>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/gpio.h"
 #include "hardware/adc.h"
+#include "hardware/sync.h"
 #include "MeloperoPerpetuo.h"
+#include "pico_hal.h"
+#include "adc.h"
+#include "adr.h"
+#include "batch.h"
+#include "console.h"
+#include "emb_command.h"
+#include "log.h"
+#include "packet.h"
+#include "profile.h"
+#include "radio_config.h"
+#include "report.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include "spsc_queue.h"
+#include "tdma.h"
+
+// These can be set per node at build time, see src/CMakeLists.txt
+#ifndef HORTITEL_SENDER_ADDRESS
+#define HORTITEL_SENDER_ADDRESS 0x1234
+#endif
+// how often to report, start to start
+#ifndef HORTITEL_REPORT_PERIOD_MS
+#define HORTITEL_REPORT_PERIOD_MS 5000
+#endif
+// how many samples to collect before sending them as one batch, 1 sends
+// each one as it is taken
+#ifndef HORTITEL_BATCH_SIZE
+#define HORTITEL_BATCH_SIZE 1
+#endif
+// send every field at least this often, in between only the ones that have
+// moved by more than their deadband (see report.h), and nothing if none
+// have. 0 sends everything every time.
+#ifndef HORTITEL_HEARTBEAT_MS
+#define HORTITEL_HEARTBEAT_MS 0
+#endif
+// ADR: every HORTITEL_ADR_INTERVAL uplinks ask the receiver how well it's
+// hearing us and turn the power up or down to suit, see adr.h
+#ifndef HORTITEL_ADR
+#define HORTITEL_ADR 0
+#endif
+#ifndef HORTITEL_ADR_INTERVAL
+#define HORTITEL_ADR_INTERVAL 16
+#endif
+// how long to listen for the answer, it has to get through the receiver's
+// module twice and back over the air
+static const uint32_t ADR_LISTEN_MS = 1000;
+// TDMA: only send in our own slot of the receiver's beacon frames, see
+// tdma.h. The slot defaults to one from the address, -1, and the beacon is
+// listened for every HORTITEL_TDMA_RESYNC frames.
+#ifndef HORTITEL_TDMA
+#define HORTITEL_TDMA 0
+#endif
+#ifndef HORTITEL_TDMA_SLOT
+#define HORTITEL_TDMA_SLOT -1
+#endif
+#ifndef HORTITEL_TDMA_RESYNC
+#define HORTITEL_TDMA_RESYNC 12
+#endif
+// Pipeline mode: core1 does the sampling, on its own fixed schedule, and
+// hands each sample to core0 which looks after the radio, console and
+// everything else. Sampling times then don't depend on how long the radio
+// takes, but the chip can't go dormant between reports.
+#ifndef HORTITEL_PIPELINE
+#define HORTITEL_PIPELINE 0
+#endif
+
+// core1 samples on its own schedule, the slots would need it to follow
+// the beacons
+#if HORTITEL_TDMA && HORTITEL_PIPELINE
+#error "TDMA doesn't work with HORTITEL_PIPELINE yet"
+#endif
+
+struct SensorSample {
+    struct sensor_record readings;
+    uint32_t time_ms;
+};
 
-// The number of times to take an ADC reading to get an average ADC reading
-static const int ADC_SAMPLE_COUNT = 16;
-
-/**
- * Read a given ADC value, returns a voltage value.
- *
- * Actually reads ACD_SAMPLE_COUNT values and returns an average after an
- * outlier elimination filter. I don't know how necessary this is on the
- * RP2350 platform, but also it probably doesn't hurt aside from a little
- * more power usage I guess.
- */
-float readADCVoltage( int adc ) { std::vector<uint16_t> values;
+// how long everything takes, type "profile" at the console to see it
+static Profiler profiler;
 
-    // get ADC readings
-    adc_select_input( adc );
-    for ( int i = 0; i < ADC_SAMPLE_COUNT; ++i ) {
-        uint16_t adc_val = adc_read(); 
-        values.push_back( adc_val );
-    }
-
-    // calculate standard deviation
-    float avg = std::accumulate( values.begin(), values.end(), (float)0.0 ) / values.size();
-    float sd = 0.0;
-    for ( int i = 0; i < values.size(); ++i ) {
-        sd += pow( values[i] - avg, 2);
-    }
+// everything read each cycle, see sensors.h, new sensors go in here
+static const SensorDriver* const SENSOR_DRIVERS[] = {
+    &SENSOR_DRIVER_BOARD_ADC,
+};
 
-    std::vector<uint16_t> filtered;
-    if ( 0 == sd ) {
-        filtered = values;
-    } else {
-        // eliminate outliers here
-        std::copy_if( values.begin(), values.end(), std::back_inserter(filtered), [=](uint16_t val) {
-            bool pass = abs( (float)val - avg ) < (3 * sd);
-            if ( ! pass ) {
-                printf( "rejected: %d\n", val );
-            }
-            return pass;
-        });
+#if HORTITEL_PIPELINE
+static SpscQueue<struct SensorSample, 16> sample_queue;
+
+// core1: sample, pass it over, sleep, repeat
+static void sampler_core_main() {
+    PicoAdc adc; // so the DMA interrupt is on this core
+    PicoSensorPower vsen;
+    SensorBus bus = { adc, &profiler };
+    SensorSampler sensors(SENSOR_DRIVERS, bus, &vsen);
+    PicoPower power(false);
+    DutyCycleScheduler scheduler(power, HORTITEL_REPORT_PERIOD_MS);
+    while (1) {
+        struct SensorSample* sample = sample_queue.write_slot();
+        if (sample) {
+            sample->readings = {};
+            sensors.sample(sample->readings);
+            sample->time_ms = (uint32_t)(power.now_us() / 1000);
+            sample_queue.commit();
+            core_doorbell_ring();
+        }
+        scheduler.sleep_until_next();
     }
-
-    // calculate the average of remaining values
-    float adc_avg = std::accumulate( filtered.begin(), filtered.end(), 0.0 ) / filtered.size();
-
-    // convert to pin voltage
-    float adc_volts = adc_avg * (3.3f / (1 << 12));
-
-    return adc_volts;
 }
-
-// This is our data transfer/packet struct
-struct txdata {
-    uint16_t options; // options as defined page 42: https://www.embit.eu/wp-content/uploads/2020/10/ebi-LoRa_rev1.0.1.pdf
-    uint16_t dest; // destination id, 0xFFFF for broadcast
-    uint8_t charge_state; // the charge status as supplied by Melopero library
-    float mcu_temp; // the internal RPi temperature sensor value
-    float vbat; // battery circuit voltage - charging voltage or battery
-    float vin; // supply voltage, i.e. USB, solar, or battery
+#endif
+
+#if HORTITEL_ADR || HORTITEL_TDMA
+// what the receiver has sent us while we've been listening
+struct Downlinks {
+    PowerControl* power;
+    bool got_feedback;
+    struct LinkFeedback feedback;
+    bool got_beacon;
+    struct TdmaBeacon beacon;
+    uint64_t beacon_us; // when it arrived
 };
 
-// Serialisation functions
-uint8_t* serialise_u8(uint8_t* buf, uint8_t val) {
-    buf[0] = val;
-    return buf + 1;
-}
-uint8_t* serialise_u16(uint8_t* buf, uint16_t val) {
-    buf[0] = val >> 8;
-    buf[1] = val;
-    return buf + 2;
+static void on_downlink(const uint8_t* frame, size_t len, void* ctx) {
+    Downlinks* dl = (Downlinks*)ctx;
+    if (deserialise_link_feedback(frame, len, &dl->feedback)) {
+        dl->got_feedback = true;
+    } else if (deserialise_beacon(frame, len, &dl->beacon)) {
+        dl->got_beacon = true;
+        dl->beacon_us = dl->power->now_us();
+    }
 }
-uint8_t* serialise_u32(uint8_t* buf, uint32_t val) {
-    buf[0] = (val & 0xff000000) >> 24;
-    buf[1] = (val & 0x00ff0000) >> 16;
-    buf[2] = (val & 0x0000ff00) >> 8;
-    buf[3] = (val & 0x000000ff);
-    return buf + 4;
+
+// keep taking in whatever the radio hears until until_us, or heard() says
+// we've got what we were after. The radio has to be awake for this.
+template <typename Heard>
+static void listen_until(EmbCommander& emb, PowerControl& power, uint64_t until_us, Heard heard) {
+    ProfileSpan span(&profiler, PROFILE_LISTEN);
+    while ( ! heard() && power.now_us() < until_us ) {
+        emb.poll();
+        hal_sleep_ms(EMB_POLL_SLICE_MS);
+    }
 }
-size_t serialise_txdata(struct txdata* txd, uint8_t* buf) {
-    uint8_t* bufptr = buf;
-    bufptr = serialise_u16(bufptr, txd->options);
-    bufptr = serialise_u16(bufptr, txd->dest);
-    bufptr = serialise_u8(bufptr, txd->charge_state);
-    float mcu_temp = txd->mcu_temp;
-    bufptr = serialise_u32(bufptr, *((uint32_t*)(&mcu_temp)));
-    float vbat = txd->vbat;
-    bufptr = serialise_u32(bufptr, *((uint32_t*)(&vbat)));
-    float vin = txd->vin;
-    bufptr = serialise_u32(bufptr, *((uint32_t*)(&vin)));
-    return (bufptr - buf);
+#endif
+
+static ConsoleLine console_line;
+
+// what the radio module's set to, kept through a reboot so a warm start only
+// has to send it what's changed, see radio_config.h
+static RadioConfigCache __uninitialized_ram(radio_cache);
+
+// something typed at the console
+static void handle_command(const char* line) {
+    if (strcmp(line, "profile") == 0) {
+        profiler.print();
+    } else if (strcmp(line, "profile reset") == 0) {
+        profiler.reset();
+    } else if (line[0]) {
+        printf( "commands:\n  profile: how long everything takes\n  profile reset: start again\n" );
+    }
 }
 
 // Main function
 int main() {
+    uint64_t boot_us = hal_time_us();
     stdio_init_all();  // Initialize all standard IO
 
     MeloperoPerpetuo melopero;
     melopero.init();  // Initialize the board and peripherals
+    MeloperoRadio radio(melopero);
+#if ! HORTITEL_PIPELINE
+    PicoAdc adc;
+    PicoSensorPower vsen;
+    SensorBus bus = { adc, &profiler };
+    SensorSampler sensors(SENSOR_DRIVERS, bus, &vsen);
+#endif
 
     melopero.led_init();
     melopero.blink_led(2, 500);
 
-    melopero.sendCmd(0x01);
-    sleep_ms(500);
-    printf("response to deviceId\n");
-    melopero.printResponse();
-    
-    // LoRaEMB operating mode configuration sequence:
-    // Stop Network
-    // Set Network preferences 
-    // Set Output power
-    // Set Operating channel
-    // Set Network address
-    // Set Network ID
-    // Set Energy save mode (the default value is TX_ONLY, set RX_ALWAYS)
-    // Start Network
-
-    melopero.stopNetwork();
-    sleep_ms(500);
-    printf("response to stopNetwork\n");
-    melopero.printResponse();
-
-    melopero.setNetworkPreferences(false, false, false);
-    sleep_ms(500);
-    printf("response to setNetworkPreferences\n");
-    melopero.printResponse();
-
-    melopero.setOutputPower(0x0a);  // Example power level
-    sleep_ms(500);
-    printf("response to setOutputPower\n");
-    melopero.printResponse();
-    
-    melopero.setOperatingChannel(1, SPREADING_FACTOR_7, BANDWIDTH_125, CODING_RATE_4_5);  // Example channel
-    sleep_ms(500);
-    printf("response to setOperatingChannel\n");
-    melopero.printResponse();
-
-    uint16_t network_address = 0x1234;
-    melopero.setNetworkAddress(network_address);  // Example network address
-    sleep_ms(500);
-    printf("response to setNetworkAddress\n");
-    melopero.printResponse();
-
-    uint8_t network_id[] = {0x00, 0x01};  // Example network ID
-    melopero.setNetworkId(network_id, sizeof(network_id));
-    sleep_ms(500);
-    printf("response to setNetworkId\n");
-    melopero.printResponse();
-
-    melopero.setEnergySaveMode(ENERGY_SAVE_MODE_TX_ONLY);
-    sleep_ms(500);
-    printf("response to setEnergySaveModeRxAlways\n");
-    melopero.printResponse();
-
-    //melopero.setEnergySaveModeRxAlways();
-    melopero.startNetwork();
-    sleep_ms(500);
-    printf("response to startNetwork\n");
-    melopero.printResponse();
-
+    // LoRaEMB operating mode configuration, see radio_configure() for the
+    // sequence. Each step completes as soon as the module responds.
+    EmbCommander emb(radio);
+    RadioConfig radio_cfg = radio_config_defaults();
+    radio_cfg.network_address = HORTITEL_SENDER_ADDRESS;
+    radio_cfg.energy_save = RADIO_ENERGY_SAVE_TX_ONLY;
+    if ( ! radio_configure(emb, radio, radio_cfg, &radio_cache) ) {
+        LOG_WARN("radio configuration incomplete, carrying on regardless");
+    }
+#if HORTITEL_DEFERRED_LOG
+    // the end of the text, from here on it's log records for hortitel_decode
+    static const uint8_t delimiter = 0;
+    printf("switching to deferred logging\n");
+    stdio_flush();
+    hal_console_write(&delimiter, 1);
+#endif
 
     // and GO!
     adc_init();
@@ -196,43 +228,104 @@ int main() {
     adc_gpio_init(27);
     adc_set_temp_sensor_enabled(true);
     melopero.enablelWs2812(true);
+#if HORTITEL_PIPELINE
+    multicore_launch_core1(sampler_core_main);
+    core_doorbell_listen();
+    PicoPower power(false);
+#else
+    PicoPower power;
+    DutyCycleScheduler scheduler(power, HORTITEL_REPORT_PERIOD_MS);
+#endif
+    SampleBatch batch(HORTITEL_BATCH_SIZE);
+    ReportPolicy policy(HORTITEL_HEARTBEAT_MS);
+    // numbers each packet so the receiver can tell what it missed
+    uint16_t packet_seq = 0;
+#if HORTITEL_ADR
+    AdrController adr(radio_cfg.sf, radio_cfg.bw, radio_cfg.output_power);
+    uint32_t uplinks = 0;
+#endif
+#if HORTITEL_ADR || HORTITEL_TDMA
+    static Downlinks downlinks = {};
+    downlinks.power = &power;
+    emb.set_unsolicited_handler(on_downlink, &downlinks);
+#endif
+#if HORTITEL_TDMA
+    TdmaSync tdma(HORTITEL_SENDER_ADDRESS, HORTITEL_TDMA_SLOT, HORTITEL_TDMA_RESYNC,
+            HORTITEL_REPORT_PERIOD_MS, power.now_us());
+#endif
+#if ! HORTITEL_PIPELINE
+    // everything but the radio off whilst asleep, and back on again
+    auto sleep_peripherals = [&]{
+        melopero.enablelWs2812(false);
+        adc_set_temp_sensor_enabled(false);
+    };
+    auto wake_peripherals = [&]{
+        adc_set_temp_sensor_enabled(true);
+        melopero.enablelWs2812(true);
+    };
+    // and how long it's asleep for, as the dormant clock has it
+    auto profile_sleep = [&](auto sleep) {
+        uint64_t start_us = power.now_us();
+        sleep();
+        profiler.record(PROFILE_SLEEP, (uint32_t)(power.now_us() - start_us));
+    };
+#endif
+    profiler.record(PROFILE_BOOT, (uint32_t)(hal_time_us() - boot_us));
     while (1) {
 
+        struct SensorSample sample = {};
+#if HORTITEL_PIPELINE
+        // wait for core1 to hand over the next sample, interrupts are off
+        // around the check so the doorbell can't slip past
+        uint64_t wait_us = hal_time_us();
+        while ( ! sample_queue.pop(sample) ) {
+            uint32_t save = save_and_disable_interrupts();
+            if ( sample_queue.empty() ) {
+                __wfi();
+            }
+            restore_interrupts(save);
+        }
+        profiler.record(PROFILE_SLEEP, (uint32_t)(hal_time_us() - wait_us));
+#endif
+
         // simple LED on whilst executing the loop body
         gpio_put(23, 1); 
 
-        printf("\n============================================\n");
+        LOG_DEBUG("============================================");
 
         // the sensor data struct
         struct txdata txd = {};
         // set header values
         txd.options = 0;
         txd.dest = 0xFFFF; // broadcast "address"
+        txd.meta.seq = packet_seq;
+        txd.meta.present = 1u << PACKET_SEQ; // the rest are for relays to add
 
         ///////////////////////////////////////////////////////////////////////
         // print out the battery charging state 
-        txd.charge_state = melopero.getChargerStatus();
-        printf("Battery: %d (", txd.charge_state);
+        txd.readings.charge_state = melopero.getChargerStatus();
+        const char* charge_desc = "unknown";
         if (melopero.isCharging()) { 
-            printf("charging)\n");
+            charge_desc = "charging";
             // yellow
             melopero.setWs2812Color(255, 255, 0, 0.1);  
         } 
         else if (melopero.isFullyCharged()) {
-            printf("charged)\n");
+            charge_desc = "charged";
             // green
             melopero.setWs2812Color(0, 255, 0, 0.05); 
         } 
         else if (melopero.hasRecoverableFault()) {
-            printf("fault: recoverable)\n");
+            charge_desc = "fault: recoverable";
             // blue
             melopero.setWs2812Color(0, 0, 255, 0.05);  
         } 
         else if (melopero.hasNonRecoverableFault()) {
-            printf("fault: non-recoverable)\n");
+            charge_desc = "fault: non-recoverable";
             // red
             melopero.setWs2812Color(255, 0, 0, 0.1);  
         }
+        LOG_INFO("Battery: %u (%s)", (unsigned)txd.readings.charge_state, charge_desc);
 
         // Note: If there is no battery plugged in this just flips between
         // charging and charged status. If there it a battery but no input
@@ -246,57 +339,189 @@ int main() {
 
 
         ///////////////////////////////////////////////////////////////////////
-        // flip the enable on the VSEN on/off each iteration, this is just
-        // testing it can turn an LED on/off if you like, or enable/disable
-        // other external hardware (thus saving power, only power on sensors
-        // to read data every 5 minutes, say...)
-        int vsen = gpio_get( 0 );
-        if ( vsen ) {
-            printf("vsen off\n");
-            gpio_put( 0, 0 );
-        } else {
-            printf("vsen on\n");
-            gpio_put( 0, 1 );
+        // read sensor values, unless core1 has already done it. VSEN is only
+        // on while the sensors that need it are being read
+#if ! HORTITEL_PIPELINE
+        uint32_t got = sensors.sample( sample.readings );
+        sample.time_ms = (uint32_t)(power.now_us() / 1000);
+        LOG_DEBUG("Sensors read: 0x%02X, VSEN on %lu us", (unsigned)got, (unsigned long)sensors.rail_on_us());
+#else
+        if (sample_queue.dropped()) {
+            LOG_WARN("Samples dropped: %lu", (unsigned long)sample_queue.dropped());
         }
+#endif
+        sample.readings.charge_state = txd.readings.charge_state;
+        txd.readings = sample.readings;
 
+        ProfileSpan print_span(&profiler, PROFILE_CONSOLE);
+        // the temperature of the RP2350
+        LOG_INFO("RP2350 Temperature: %0.2f C", txd.readings.mcu_temp);
 
-        ///////////////////////////////////////////////////////////////////////
-        // read sensor values
-        // check the temperature of the RP2350
-        float voltage = readADCVoltage( 4 );
-        txd.mcu_temp = 27.0 - ((voltage - 0.706) / 0.001721);
-        printf( "RP2350 Temperature: %0.2f C\n", txd.mcu_temp );
-
-        // read voltage on ADC0 (battery voltage sense)
-        float adc0_v = readADCVoltage( 0 );
-        txd.vbat = (adc0_v * (98600 + 149100)) / 149100; // measured values of volage divider 
-        printf( "Battery Voltage: %0.2fV\n", txd.vbat );
-
-        // read voltage on ACD1 (supply voltage sense)
-        float adc1_v = readADCVoltage( 1 );
-        txd.vin = (adc1_v * (98600 + 14890)) / 14890; // measured values of volage divider 
-        printf( "Supply Voltage: %0.2fV\n", txd.vin );
+        // voltage on ADC0 (battery voltage sense)
+        LOG_INFO("Battery Voltage: %0.2fV", txd.readings.vbat);
+
+        // voltage on ACD1 (supply voltage sense)
+        LOG_INFO("Supply Voltage: %0.2fV", txd.readings.vin);
+        print_span.end();
 
         ///////////////////////////////////////////////////////////////////////
-        // send some data
-        uint8_t sendbuf[sizeof(txdata)]; // at least big enough...
-        size_t data_length = serialise_txdata(&txd, sendbuf);
-        printf( "Sending Data:\n  length=%d\n  data={", data_length );
-        for (size_t i = 0; i < data_length; i++) {
-            printf("0x%02X ", sendbuf[i]);
+        // send some data, either straight away or once we've got a batch of
+        // it. If the batch won't take another sample send what we have and
+        // start a new one. Only what has changed enough is worth sending,
+        // and if nothing has there's nothing to send.
+        // whatever the sensors managed, a failed one's fields are left out
+        txd.readings.present |= 1u << SENSOR_CHARGE_STATE;
+        ProfileSpan serialise_span(&profiler, PROFILE_SERIALISE);
+        ReportDecision report = policy.check(txd.readings, sample.time_ms);
+        uint8_t sendbuf[TXDATA_MAX_SIZE];
+        size_t data_length = 0;
+        uint32_t now_ms = (uint32_t)(power.now_us() / 1000);
+        if ( ! report.mask ) {
+            policy.skip();
+            LOG_INFO("Nothing has changed, not sending (%lu skipped)", (unsigned long)policy.skipped());
+        } else if (HORTITEL_BATCH_SIZE <= 1) {
+            struct txdata changed = txd;
+            changed.readings.present = report.mask;
+            data_length = serialise_txdata(&changed, sendbuf);
+        } else {
+            // a batch only carries the fields every sample in it has, so
+            // samples go in whole
+            policy.sent(txd.readings, SENSOR_ALL_FIELDS, sample.time_ms);
+            if ( ! batch.add(txd.readings, sample.time_ms) ) {
+                data_length = serialise_txbatch(txd.options, txd.dest, batch, now_ms, sendbuf, &txd.meta);
+                batch.clear();
+                batch.add(txd.readings, sample.time_ms);
+            } else if (batch.full() || report.urgent) {
+                // an urgent change doesn't wait for the batch to fill up
+                data_length = serialise_txbatch(txd.options, txd.dest, batch, now_ms, sendbuf, &txd.meta);
+                batch.clear();
+            } else {
+                LOG_DEBUG("Batched sample %u of %u", (unsigned)batch.count(), (unsigned)HORTITEL_BATCH_SIZE);
+            }
+        }
+        serialise_span.end();
+        if (data_length) {
+            ProfileSpan dump_span(&profiler, PROFILE_CONSOLE);
+            LOG_INFO("Sending Data: length=%zu", data_length);
+            LOG_HEX("  data", sendbuf, data_length);
+            dump_span.end();
+#if HORTITEL_ADR
+            // the radio normally sleeps as soon as it's sent something, for a
+            // link check it has to stay awake to hear the answer
+            bool link_check = ++uplinks % HORTITEL_ADR_INTERVAL == 0;
+            if (link_check) {
+                sendbuf[TXDATA_FORMAT_OFFSET] |= PAYLOAD_FLAG_LISTENING;
+                radio_set_energy_save(emb, radio, RADIO_ENERGY_SAVE_ALWAYS_ON, &radio_cache);
+            }
+#endif
+            // handing it over and waiting for it to go timed separately,
+            // the wait is mostly time on air
+            ProfileSpan tx_span(&profiler, PROFILE_TX);
+            emb.begin(EMB_CMD_SEND_DATA, EMB_TX_TIMEOUT_MS);
+            radio.transmitData(sendbuf, data_length);
+            tx_span.end();
+            ProfileSpan wait_span(&profiler, PROFILE_TX_WAIT);
+            EmbStatus tx_status = emb.wait();
+            wait_span.end();
+            // even if it failed, it might have gone
+            packet_seq++;
+            profiler.packet();
+            LOG_INFO("response to transmitData: %s (%lu us)", emb_status_str(tx_status), (unsigned long)emb.elapsed_us());
+#if HORTITEL_ADR
+            if (tx_status == EMB_OK) {
+                adr.sent(link_check);
+            }
+            if (link_check) {
+                struct LinkFeedback& fb = downlinks.feedback;
+                bool change;
+                downlinks.got_feedback = false;
+                if (tx_status == EMB_OK) {
+                    listen_until(emb, power, power.now_us() + ADR_LISTEN_MS * 1000, [&]{
+                        return downlinks.got_feedback;
+                    });
+                }
+                if (downlinks.got_feedback) {
+                    change = adr.feedback(fb);
+                    LOG_INFO("Link feedback: rssi=%d min=%d heard=%u margin=%ddB",
+                            fb.rssi, fb.rssi_min, (unsigned)fb.heard, adr.margin());
+                } else {
+                    change = adr.missed();
+                    LOG_WARN("Link feedback: no answer");
+                }
+                radio_set_energy_save(emb, radio, radio_cfg.energy_save, &radio_cache);
+                if (change) {
+                    EmbStatus status = radio_set_output_power(emb, radio, adr.power(), &radio_cache);
+                    LOG_INFO("Output power now %u dBm: %s", (unsigned)adr.power(), emb_status_str(status));
+                }
+            }
+#endif
+            if (tx_status == EMB_ERROR) {
+                // the module turning it down, it may have been reset and lost
+                // its settings, so they all go again
+                RadioConfig now_cfg = radio_cfg;
+#if HORTITEL_ADR
+                now_cfg.output_power = adr.power();
+#endif
+                radio_cache.forget();
+                radio_configure(emb, radio, now_cfg, &radio_cache);
+            }
+            // if it didn't go it's still a change next time
+            if (HORTITEL_BATCH_SIZE <= 1 && tx_status == EMB_OK) {
+                policy.sent(txd.readings, report.mask, sample.time_ms);
+            }
         }
-        printf("}\n");
-        melopero.transmitData(sendbuf, data_length);
-
-        sleep_ms(500); // seems a bit kludgy?
-        printf("response to transmitData\n");
-        melopero.printResponse();
 
         // simple LED off
         gpio_put(23, 0);
 
-        // snoozZzZzZzZzzze
-        sleep_ms(5000);
+        ///////////////////////////////////////////////////////////////////////
+        // anything typed at the console, the answer's text even when
+        // logging's deferred, a zero after it lets hortitel_decode skip it
+        int c;
+        while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+            if (console_line.push(c)) {
+                handle_command(console_line.line());
+#if HORTITEL_DEFERRED_LOG
+                stdio_flush();
+                hal_console_write(&delimiter, 1);
+#endif
+            }
+        }
+
+        // and this time round's logging, if it was deferred, before sleeping
+        ProfileSpan flush_span(&profiler, PROFILE_CONSOLE);
+        log_flush();
+        flush_span.end();
+
+#if HORTITEL_TDMA
+        // if we're due to listen for the receiver's beacon before our next
+        // slot wake up for that first, then sleep until the slot. The radio
+        // has to be kept awake to hear the beacon.
+        uint64_t send_us = tdma.next_send_us(power.now_us());
+        while (tdma.listen_at_us() < send_us) {
+            profile_sleep([&]{ scheduler.sleep_until(tdma.listen_at_us(), sleep_peripherals, wake_peripherals); });
+            downlinks.got_beacon = false;
+            radio_set_energy_save(emb, radio, RADIO_ENERGY_SAVE_ALWAYS_ON, &radio_cache);
+            listen_until(emb, power, tdma.listen_until_us(), [&]{ return downlinks.got_beacon; });
+            radio_set_energy_save(emb, radio, radio_cfg.energy_save, &radio_cache);
+            if (downlinks.got_beacon) {
+                tdma.beacon(downlinks.beacon, downlinks.beacon_us);
+                LOG_INFO("Beacon %u: slot %u of %u, clock %+ld ppm", (unsigned)downlinks.beacon.seq,
+                        (unsigned)tdma.slot(), (unsigned)downlinks.beacon.slots, (long)tdma.drift_ppm());
+            } else {
+                tdma.missed();
+                LOG_WARN("No beacon heard%s", tdma.synced() ? "" : ", out of sync");
+            }
+            send_us = tdma.next_send_us(power.now_us());
+        }
+        tdma.sending(send_us);
+        profile_sleep([&]{ scheduler.sleep_until(send_us, sleep_peripherals, wake_peripherals); });
+#elif ! HORTITEL_PIPELINE
+        // snoozZzZzZzZzzze, as deeply as we can manage until the next report
+        // is due. The radio is in TX_ONLY energy save mode so looks after
+        // itself, everything else we switch off and back on again.
+        profile_sleep([&]{ scheduler.sleep_until_next(sleep_peripherals, wake_peripherals); });
+#endif
     }
 
     return 0;
@@ -0,0 +1,56 @@
+/**
+ * Just enough of a test harness for the host build's tests.
+ *
+ * Each test is its own executable, a main() calling a function per case.
+ * CHECK() and friends print what failed and where and carry on, so one run
+ * shows everything that's wrong, and check_done() gives the exit status for
+ * ctest. Deliberately no dependencies, as with bench.h.
+ */
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+inline unsigned int check_count = 0;
+inline unsigned int check_failures = 0;
+
+static inline bool check_result(bool ok, const char* what, const char* file, int line) {
+    check_count++;
+    if (!ok) {
+        check_failures++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    }
+    return ok;
+}
+
+#define CHECK(cond) check_result((cond), #cond, __FILE__, __LINE__)
+// integers of any size, both printed if they differ
+#define CHECK_EQ(a, b) \
+    (check_result((long long)(a) == (long long)(b), #a " == " #b, __FILE__, __LINE__) \
+        || (fprintf(stderr, "    %lld != %lld\n", (long long)(a), (long long)(b)), false))
+#define CHECK_NEAR(a, b, tol) \
+    (check_result(std::fabs((double)(a) - (double)(b)) <= (tol), #a " ~= " #b, __FILE__, __LINE__) \
+        || (fprintf(stderr, "    %g != %g\n", (double)(a), (double)(b)), false))
+
+// a new empty directory for a test's files, and rid of it again
+static inline std::string check_temp_dir() {
+    std::string path = (std::filesystem::temp_directory_path() / "hortitel-test-XXXXXX").string();
+    if (!mkdtemp(&path[0])) {
+        perror("mkdtemp");
+        exit(2);
+    }
+    return path;
+}
+static inline void check_remove_dir(const std::string& path) {
+    std::error_code err;
+    std::filesystem::remove_all(path, err);
+}
+
+// the exit status for main(), after a line saying how it went
+static inline int check_done(const char* name) {
+    printf("%s: %u checks, %u failed\n", name, check_count, check_failures);
+    return check_failures ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * ADC sampling: the outlier filter, the burst sampling of several channels
+ * and the conversions to useful units.
+ */
+#include "check.h"
+#include "adc.h"
+#include "sim_hal.h"
+
+static void test_filter_steady() {
+    uint16_t samples[16];
+    AdcStats stats;
+    for (unsigned int i = 0; i < 16; i++) {
+        samples[i] = 2000;
+        stats.add(samples[i]);
+    }
+    AdcReading reading = adc_filter_samples(samples, stats);
+    CHECK_EQ(reading.rejected, 0);
+    CHECK_NEAR(reading.volts, 2000 * ADC_VOLTS_PER_COUNT, 1e-6);
+}
+
+static void test_filter_spike() {
+    // one wild reading among steady ones is thrown out and doesn't move the
+    // mean of the rest
+    uint16_t samples[16];
+    AdcStats stats;
+    for (unsigned int i = 0; i < 16; i++) {
+        samples[i] = i == 5 ? 4095 : 1000 + (i & 1);
+        stats.add(samples[i]);
+    }
+    AdcReading reading = adc_filter_samples(samples, stats);
+    CHECK_EQ(reading.rejected, 1);
+    CHECK_NEAR(reading.volts, 1000.5f * ADC_VOLTS_PER_COUNT, 1e-4);
+}
+
+static void test_filter_empty() {
+    AdcStats stats;
+    AdcReading reading = adc_filter_samples(nullptr, stats);
+    CHECK_EQ(reading.rejected, 0);
+    CHECK_EQ(reading.volts, 0);
+}
+
+static void test_sample_sim() {
+    SimAdc adc(7);
+    adc.set_channel(ADC_CHANNEL_VBAT, 1.5f, 4, 8);
+    AdcReading reading = adc_sample<64>(adc, ADC_CHANNEL_VBAT);
+    CHECK_NEAR(reading.volts, 1.5, 0.01);
+    CHECK(reading.rejected > 0);
+}
+
+static void test_burst_matches_channels() {
+    // asked for out of channel order, each answer is still the right channel's
+    SimAdc adc(3);
+    adc.set_channel(ADC_CHANNEL_VBAT, 1.0f, 0);
+    adc.set_channel(ADC_CHANNEL_VIN, 2.0f, 0);
+    adc.set_channel(ADC_CHANNEL_TEMP, 0.7f, 0);
+    const unsigned int channels[] = { ADC_CHANNEL_TEMP, ADC_CHANNEL_VBAT, ADC_CHANNEL_VIN };
+    AdcReading out[3];
+    adc_sample_burst<16>(adc, channels, out);
+    CHECK_NEAR(out[0].volts, 0.7, 0.001);
+    CHECK_NEAR(out[1].volts, 1.0, 0.001);
+    CHECK_NEAR(out[2].volts, 2.0, 0.001);
+}
+
+static void test_conversions() {
+    // 0.706V is 27C by the datasheet, and each divider scales as measured
+    CHECK_NEAR(adc_volts_to_mcu_temp(0.706f), 27.0, 0.01);
+    CHECK_NEAR(adc_volts_to_mcu_temp(0.706f - 0.001721f * 10), 37.0, 0.01);
+    CHECK_NEAR(adc_volts_to_vbat(149100.0f / (98600 + 149100)), 1.0, 1e-4);
+    CHECK_NEAR(adc_volts_to_vin(14890.0f / (98600 + 14890)), 1.0, 1e-4);
+}
+
+int main() {
+    test_filter_steady();
+    test_filter_spike();
+    test_filter_empty();
+    test_sample_sim();
+    test_burst_matches_channels();
+    test_conversions();
+    return check_done("adc");
+}
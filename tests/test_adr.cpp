@@ -0,0 +1,171 @@
+/**
+ * Adaptive power: the link feedback round trips and anything else is
+ * refused, the receiver's smoothed RSSI and minimum, and the sender turning
+ * down to its margin (but not for less than the hysteresis), backing off on
+ * loss and going to full power once link checks go unanswered, with the
+ * packet counts wrapping or the receiver restarting not mistaken for loss.
+ */
+#include <vector>
+#include "adr.h"
+#include "check.h"
+#include "frame.h"
+#include "sim_hal.h"
+
+static const uint16_t NODE = 0x2001;
+
+// at SF7 125kHz the receiver makes out -124dBm, so -114 is exactly the margin
+static const int16_t ON_TARGET = -124 + ADR_TARGET_MARGIN_DB;
+
+static struct LinkFeedback feedback(int16_t rssi_min, uint16_t heard) {
+    struct LinkFeedback fb = {};
+    fb.rssi = rssi_min + 5;
+    fb.rssi_min = rssi_min;
+    fb.heard = heard;
+    return fb;
+}
+
+// n uplinks, the last of them a link check
+static void send(AdrController& adr, int n) {
+    for (int i = 1; i <= n; i++) {
+        adr.sent(i == n);
+    }
+}
+
+static void test_codec() {
+    struct LinkFeedback fb = { -97, -112, 65535 };
+    uint8_t buf[LINK_FEEDBACK_SIZE];
+    CHECK_EQ(serialise_link_feedback(&fb, NODE, buf), LINK_FEEDBACK_SIZE);
+    std::vector<uint8_t> frame = sim_rx_data_frame(0x1235, NODE, -80, buf + 4, LINK_FEEDBACK_SIZE - 4);
+    struct LinkFeedback out = {};
+    CHECK(deserialise_link_feedback(frame.data(), frame.size(), &out));
+    CHECK_EQ(out.rssi, -97);
+    CHECK_EQ(out.rssi_min, -112);
+    CHECK_EQ(out.heard, 65535);
+
+    // cut short, damaged, or something else
+    CHECK(!deserialise_link_feedback(frame.data(), frame.size() - 1, &out));
+    std::vector<uint8_t> bad = frame;
+    bad[RXDATA_HEADER_SIZE + 2] ^= 0x10;
+    CHECK(!deserialise_link_feedback(bad.data(), bad.size(), &out));
+    buf[TXDATA_FORMAT_OFFSET] = PAYLOAD_FORMAT_BEACON;
+    bad = sim_rx_data_frame(0x1235, NODE, -80, buf + 4, LINK_FEEDBACK_SIZE - 4);
+    CHECK(!deserialise_link_feedback(bad.data(), bad.size(), &out));
+    CHECK(!deserialise_link_feedback(frame.data(), 3, &out));
+}
+
+static void test_monitor() {
+    LinkMonitor monitor;
+    struct LinkFeedback fb;
+    CHECK(!monitor.feedback(NODE, &fb));
+    monitor.heard(NODE, -100);
+    for (int i = 0; i < 100; i++) {
+        monitor.heard(NODE, -90);
+    }
+    monitor.heard(NODE, -110);
+    CHECK(monitor.feedback(NODE, &fb));
+    CHECK_NEAR(fb.rssi, -92.5, 1);
+    CHECK_EQ(fb.rssi_min, -110);
+    CHECK_EQ(fb.heard, 102);
+    // the minimum starts again from the average
+    int16_t average = fb.rssi;
+    monitor.heard(NODE, -90);
+    CHECK(monitor.feedback(NODE, &fb));
+    CHECK_EQ(fb.rssi_min, average);
+    CHECK_EQ(fb.heard, 103);
+    CHECK_EQ(monitor.nodes(), 1);
+}
+
+static void test_margin() {
+    AdrController adr(RADIO_SF_7, RADIO_BW_125, ADR_POWER_MAX);
+    // plenty to spare, all the way down
+    send(adr, 4);
+    CHECK(adr.feedback(feedback(ON_TARGET + 24, 4)));
+    CHECK_EQ(adr.margin(), 24);
+    CHECK_EQ(adr.power(), ADR_POWER_MIN);
+
+    // not far enough over to be worth turning down for
+    AdrController hold(RADIO_SF_7, RADIO_BW_125, 10);
+    send(hold, 4);
+    CHECK(!hold.feedback(feedback(ON_TARGET + ADR_HYSTERESIS_DB - 1, 4)));
+    CHECK_EQ(hold.power(), 10);
+    send(hold, 4);
+    CHECK(hold.feedback(feedback(ON_TARGET + ADR_HYSTERESIS_DB, 8)));
+    CHECK_EQ(hold.power(), 10 - ADR_HYSTERESIS_DB);
+
+    // short of it, back up by as much, whatever the hysteresis
+    send(hold, 4);
+    CHECK(hold.feedback(feedback(ON_TARGET - 1, 12)));
+    CHECK_EQ(hold.power(), 10 - ADR_HYSTERESIS_DB + 1);
+    CHECK_EQ(hold.margin(), -1);
+}
+
+static void test_loss() {
+    AdrController adr(RADIO_SF_7, RADIO_BW_125, 4);
+    send(adr, 8);
+    CHECK(!adr.feedback(feedback(ON_TARGET + 1, 8)));
+    // 5 of the next 8, on target but losing them, so up
+    send(adr, 8);
+    CHECK(adr.feedback(feedback(ON_TARGET + 1, 13)));
+    CHECK_EQ(adr.power(), 4 + ADR_BACKOFF_DB);
+    // and short of the margin as well, up by both
+    send(adr, 8);
+    CHECK(adr.feedback(feedback(ON_TARGET - 2, 17)));
+    CHECK_EQ(adr.power(), 4 + ADR_BACKOFF_DB + 2 + ADR_BACKOFF_DB);
+    // 6 of 8 is enough
+    send(adr, 8);
+    CHECK(!adr.feedback(feedback(ON_TARGET, 23)));
+}
+
+static void test_wrap() {
+    // the receiver's count wrapping isn't loss
+    AdrController adr(RADIO_SF_7, RADIO_BW_125, 8);
+    send(adr, 4);
+    adr.feedback(feedback(ON_TARGET, 65530));
+    send(adr, 8);
+    CHECK(!adr.feedback(feedback(ON_TARGET, 2)));
+    CHECK_EQ(adr.power(), 8);
+
+    // nor is it starting again from 0 after the receiver restarted
+    send(adr, 8);
+    CHECK(!adr.feedback(feedback(ON_TARGET, 1)));
+    send(adr, 8);
+    CHECK(!adr.feedback(feedback(ON_TARGET, 9)));
+    CHECK_EQ(adr.power(), 8);
+
+    // nor the sender's own count wrapping
+    AdrController sender(RADIO_SF_7, RADIO_BW_125, 8);
+    send(sender, 65530);
+    sender.feedback(feedback(ON_TARGET, 100));
+    send(sender, 10);
+    CHECK(!sender.feedback(feedback(ON_TARGET, 110)));
+    CHECK_EQ(sender.power(), 8);
+}
+
+static void test_missed() {
+    AdrController adr(RADIO_SF_7, RADIO_BW_125, 4);
+    send(adr, 4);
+    CHECK(adr.missed());
+    CHECK_EQ(adr.power(), 4 + ADR_BACKOFF_DB);
+    send(adr, 4);
+    CHECK(adr.missed());
+    CHECK_EQ(adr.power(), ADR_POWER_MAX);
+    send(adr, 4);
+    CHECK(!adr.missed());
+
+    // an answer starts the count again
+    send(adr, 4);
+    adr.feedback(feedback(ON_TARGET + 6, 4));
+    CHECK_EQ(adr.power(), ADR_POWER_MAX - 6);
+    CHECK(adr.missed());
+    CHECK_EQ(adr.power(), ADR_POWER_MAX - 6 + ADR_BACKOFF_DB);
+}
+
+int main() {
+    test_codec();
+    test_monitor();
+    test_margin();
+    test_loss();
+    test_wrap();
+    test_missed();
+    return check_done("adr");
+}
@@ -0,0 +1,141 @@
+/**
+ * Summaries: readings boil down to the right min, max, mean and last, each
+ * counts towards the period it was taken in, even when a batch brings in
+ * several periods' worth at once, and late ones are counted, not misfiled.
+ */
+#include <functional>
+#include <vector>
+#include "check.h"
+#include "aggregate.h"
+
+static const uint32_t PERIOD = 60000;
+static const uint16_t NODE = 0x2001;
+
+static struct sensor_record reading(float temp) {
+    struct sensor_record rec = {};
+    rec.mcu_temp = temp;
+    rec.present = 1u << SENSOR_MCU_TEMP;
+    return rec;
+}
+
+struct Emitted {
+    uint16_t src;
+    NodeSummary summary;
+};
+
+struct Collector {
+    std::vector<Emitted> out;
+    void operator()(uint16_t src, const NodeSummary& summary) { out.push_back({ src, summary }); }
+};
+
+static float stat(const NodeSummary& summary, HostlinkSummaryStat s) {
+    struct sensor_record rec;
+    summary.values(s, &rec);
+    return rec.mcu_temp;
+}
+
+static void test_one_period() {
+    SummaryTable table(PERIOD);
+    Collector emit;
+    const float temps[] = { 20.5f, 18.25f, 22.0f, 21.0f };
+    for (int i = 0; i < 4; i++) {
+        table.add(NODE, reading(temps[i]), 120000 + i * 5000, std::ref(emit));
+    }
+    table.close_due(120000 + PERIOD - 1, std::ref(emit));
+    CHECK_EQ(emit.out.size(), 0);
+    table.close_due(120000 + PERIOD, std::ref(emit));
+    if (!CHECK_EQ(emit.out.size(), 1)) {
+        return;
+    }
+    const NodeSummary& s = emit.out[0].summary;
+    CHECK_EQ(emit.out[0].src, NODE);
+    CHECK_EQ(s.start_ms, 120000);
+    CHECK_EQ(s.count, 4);
+    CHECK_NEAR(stat(s, HOSTLINK_STAT_MIN), 18.25, 0.005);
+    CHECK_NEAR(stat(s, HOSTLINK_STAT_MAX), 22.0, 0.005);
+    CHECK_NEAR(stat(s, HOSTLINK_STAT_MEAN), 20.44, 0.005);
+    CHECK_NEAR(stat(s, HOSTLINK_STAT_LAST), 21.0, 0.005);
+    // and it's gone
+    table.close_due(500000, std::ref(emit));
+    CHECK_EQ(emit.out.size(), 1);
+}
+
+static void test_batch_across_periods() {
+    // a batch that arrives at 190s with readings every 10s from 50s on
+    SummaryTable table(PERIOD);
+    Collector emit;
+    for (uint32_t t = 50000; t <= 190000; t += 10000) {
+        table.add(NODE, reading(t / 10000.0f), t, std::ref(emit));
+    }
+    if (!CHECK_EQ(emit.out.size(), 3)) {
+        return;
+    }
+    CHECK_EQ(emit.out[0].summary.start_ms, 0);
+    CHECK_EQ(emit.out[0].summary.count, 1);
+    CHECK_EQ(emit.out[1].summary.start_ms, 60000);
+    CHECK_EQ(emit.out[1].summary.count, 6);
+    CHECK_NEAR(stat(emit.out[1].summary, HOSTLINK_STAT_MIN), 6.0, 0.005);
+    CHECK_NEAR(stat(emit.out[1].summary, HOSTLINK_STAT_LAST), 11.0, 0.005);
+    CHECK_EQ(emit.out[2].summary.start_ms, 120000);
+    CHECK_EQ(emit.out[2].summary.count, 6);
+    table.close_due(240000, std::ref(emit));
+    if (CHECK_EQ(emit.out.size(), 4)) {
+        CHECK_EQ(emit.out[3].summary.start_ms, 180000);
+        CHECK_EQ(emit.out[3].summary.count, 2);
+    }
+    CHECK_EQ(table.late(), 0);
+}
+
+static void test_late() {
+    SummaryTable table(PERIOD);
+    Collector emit;
+    table.add(NODE, reading(20.0f), 130000, std::ref(emit));
+    // an earlier period's, while this one has readings, can't go anywhere
+    table.add(NODE, reading(99.0f), 110000, std::ref(emit));
+    CHECK_EQ(table.late(), 1);
+    table.close_due(180000, std::ref(emit));
+    if (CHECK_EQ(emit.out.size(), 1)) {
+        CHECK_EQ(emit.out[0].summary.count, 1);
+        CHECK_NEAR(stat(emit.out[0].summary, HOSTLINK_STAT_MAX), 20.0, 0.005);
+    }
+
+    // once that's gone out one for it gets a summary of its own
+    table.add(NODE, reading(21.0f), 170000, std::ref(emit));
+    table.add(NODE, reading(22.0f), 175000, std::ref(emit));
+    CHECK_EQ(table.late(), 1);
+    table.close_due(181000, std::ref(emit));
+    if (CHECK_EQ(emit.out.size(), 2)) {
+        CHECK_EQ(emit.out[1].summary.start_ms, 120000);
+        CHECK_EQ(emit.out[1].summary.count, 2);
+    }
+
+    // other nodes aren't held up by it
+    table.add(NODE + 1, reading(5.0f), 100000, std::ref(emit));
+    table.add(NODE, reading(23.0f), 185000, std::ref(emit));
+    CHECK_EQ(table.late(), 1);
+}
+
+static void test_clock_wrap() {
+    SummaryTable table(PERIOD);
+    Collector emit;
+    uint32_t t = UINT32_MAX - 1000;
+    uint32_t start = t - t % PERIOD;
+    table.add(NODE, reading(1.0f), t, std::ref(emit));
+    // still in the same period, neither over nor late
+    table.add(NODE, reading(2.0f), start + PERIOD - 1, std::ref(emit));
+    CHECK_EQ(emit.out.size(), 0);
+    CHECK_EQ(table.late(), 0);
+    table.add(NODE, reading(3.0f), start + PERIOD, std::ref(emit));
+    if (CHECK_EQ(emit.out.size(), 1)) {
+        CHECK_EQ(emit.out[0].summary.start_ms, start);
+        CHECK_EQ(emit.out[0].summary.count, 2);
+    }
+}
+
+int main() {
+    test_one_period();
+    test_batch_across_periods();
+    test_late();
+    test_clock_wrap();
+    return check_done("aggregate");
+}
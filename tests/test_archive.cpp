@@ -0,0 +1,240 @@
+/**
+ * The columnar archive: the time and Gorilla float columns round trip
+ * exactly (NaNs and all) and refuse truncated input, the vectorised reduce
+ * agrees with the plain one, and segments written, merged and read back
+ * have the right samples and rollups.
+ */
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "archive.h"
+#include "sim_hal.h"
+
+static bool same_bits(float a, float b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static void check_times(const std::vector<int64_t>& times) {
+    std::vector<uint8_t> buf;
+    archive_encode_times(times.data(), times.size(), buf);
+    std::vector<int64_t> out(times.size());
+    CHECK(archive_decode_times(buf.data(), buf.size(), out.data(), out.size()));
+    CHECK(out == times);
+}
+
+static void test_times() {
+    int64_t day = 20000 * MS_PER_DAY;
+    std::vector<int64_t> regular;
+    for (int i = 0; i < 1000; i++) {
+        regular.push_back(day + i * 5000);
+    }
+    check_times(regular);
+    std::vector<uint8_t> buf;
+    archive_encode_times(regular.data(), regular.size(), buf);
+    // a byte each after the first two
+    CHECK(buf.size() <= 8 + 3 + regular.size());
+
+    check_times({});
+    check_times({ day });
+    // jittery, gaps, going backwards and the extremes of the range
+    check_times({ day, day + 4999, day + 10003, day + 86399999, day + 86399999, day - 1, 0 });
+    check_times({ INT64_MIN / 4, INT64_MAX / 4 });
+
+    // cut short anywhere, there aren't enough to fill them all
+    std::vector<int64_t> out(regular.size());
+    for (size_t cut = 0; cut < buf.size(); cut += 97) {
+        CHECK(!archive_decode_times(buf.data(), cut, out.data(), out.size()));
+    }
+}
+
+static void check_floats(const std::vector<float>& values) {
+    std::vector<uint8_t> buf;
+    archive_encode_floats(values.data(), values.size(), buf);
+    std::vector<float> out(values.size());
+    CHECK(archive_decode_floats(buf.data(), buf.size(), out.data(), out.size()));
+    bool same = true;
+    for (size_t i = 0; i < values.size(); i++) {
+        same = same && same_bits(out[i], values[i]);
+    }
+    CHECK(same);
+}
+
+static void test_floats() {
+    // a slowly drifting reading compresses well
+    std::vector<float> drift;
+    for (int i = 0; i < 1000; i++) {
+        drift.push_back(3.9f - (i / 50) * 0.001f);
+    }
+    check_floats(drift);
+    std::vector<uint8_t> buf;
+    archive_encode_floats(drift.data(), drift.size(), buf);
+    CHECK(buf.size() < drift.size());
+
+    check_floats({});
+    check_floats({ 1.0f });
+    check_floats({ 0.0f, -0.0f, NAN, NAN, INFINITY, -INFINITY, 1e-45f, 3.4e38f, -1.0f, 1.0f });
+
+    // every xor window, from one bit to all 32
+    std::vector<float> random;
+    SimRandom rng(11);
+    for (int i = 0; i < 2000; i++) {
+        uint32_t bits = rng.next() >> rng.below(32);
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        random.push_back(v);
+    }
+    check_floats(random);
+
+    buf.clear();
+    archive_encode_floats(random.data(), random.size(), buf);
+    std::vector<float> out(random.size());
+    CHECK(!archive_decode_floats(buf.data(), 3, out.data(), out.size()));
+    CHECK(!archive_decode_floats(buf.data(), buf.size() / 2, out.data(), out.size()));
+    CHECK(!archive_decode_floats(buf.data(), buf.size() - 2, out.data(), out.size()));
+}
+
+static void test_reduce() {
+    // against adding them one at a time, at lengths either side of the
+    // vector widths, with NaNs about
+    SimRandom rng(3);
+    const size_t lengths[] = { 0, 1, 7, 8, 9, 15, 16, 17, 1000, 20000 };
+    for (size_t n : lengths) {
+        std::vector<float> values(n);
+        for (size_t i = 0; i < n; i++) {
+            values[i] = rng.below(10) == 0 ? NAN : (float)rng.below(100000) / 100 - 500;
+        }
+        ArchiveRollup fast, slow;
+        fast.clear();
+        slow.clear();
+        archive_reduce(values.data(), n, fast);
+        for (float v : values) {
+            slow.add(v);
+        }
+        CHECK_EQ(fast.count, slow.count);
+        if (slow.count) {
+            CHECK_EQ(fast.min, slow.min);
+            CHECK_EQ(fast.max, slow.max);
+            CHECK_NEAR(fast.sum, slow.sum, 1e-6 * n * 500);
+        }
+    }
+
+    // merging into one that already has something
+    ArchiveRollup acc;
+    acc.clear();
+    acc.add(-1000);
+    const float more[] = { 1, 2, 3 };
+    archive_reduce(more, 3, acc);
+    CHECK_EQ(acc.count, 4);
+    CHECK_EQ(acc.min, -1000);
+    CHECK_EQ(acc.max, 3);
+    CHECK_NEAR(acc.mean(), -994.0 / 4, 1e-9);
+}
+
+static void test_days() {
+    CHECK_EQ(archive_day_from_civil(1970, 1, 1), 0);
+    CHECK_EQ(archive_day_from_civil(2000, 3, 1), 11017);
+    CHECK_EQ(archive_day_from_civil(1969, 12, 31), -1);
+    bool ok = true;
+    for (int32_t day = -800000; day < 800000; day += 13) {
+        int y;
+        unsigned m, d;
+        archive_civil_from_day(day, &y, &m, &d);
+        ok = ok && archive_day_from_civil(y, m, d) == day && m >= 1 && m <= 12 && d >= 1 && d <= 31;
+    }
+    CHECK(ok);
+}
+
+static ArchiveSample sample(int64_t time_ms, float temp) {
+    ArchiveSample s;
+    s.time_ms = time_ms;
+    for (float& v : s.values) {
+        v = NAN;
+    }
+    s.values[ARCHIVE_MCU_TEMP] = temp;
+    s.values[ARCHIVE_VBAT] = 3.9f;
+    return s;
+}
+
+static void test_segments() {
+    std::string dir = check_temp_dir();
+    int32_t day = archive_day_from_civil(2026, 3, 21);
+    int64_t start = (int64_t)day * MS_PER_DAY;
+
+    // one an hour at 10, 11, ... degrees, then the same again with the
+    // second half different, which replaces them
+    std::vector<ArchiveSample> first, second;
+    for (int h = 0; h < 24; h++) {
+        first.push_back(sample(start + h * MS_PER_HOUR, 10 + h));
+    }
+    for (int h = 12; h < 24; h++) {
+        second.push_back(sample(start + h * MS_PER_HOUR, 100 + h));
+    }
+    second.push_back(sample(start + 23 * MS_PER_HOUR + 1, 200));
+    CHECK(archive_add_day(dir.c_str(), 0x1234, day, first));
+    CHECK(archive_add_day(dir.c_str(), 0x1234, day, second));
+    CHECK(archive_add_day(dir.c_str(), 0x1234, day + 1, { sample(start + MS_PER_DAY, 5) }));
+    CHECK(archive_add_day(dir.c_str(), 0x00AB, day, { sample(start, 5) }));
+
+    CHECK(archive_list_nodes(dir.c_str()) == std::vector<uint16_t>({ 0x00AB, 0x1234 }));
+    CHECK(archive_list_days(dir.c_str(), 0x1234) == std::vector<int32_t>({ day, day + 1 }));
+    CHECK(archive_segment_path(dir.c_str(), 0x1234, day) == dir + "/1234/20260321.seg");
+
+    ArchiveSegment seg;
+    CHECK(seg.open(archive_segment_path(dir.c_str(), 0x1234, day).c_str()));
+    const ArchiveSegmentHeader& hdr = seg.header();
+    CHECK_EQ(hdr.src, 0x1234);
+    CHECK_EQ(hdr.day, day);
+    CHECK_EQ(hdr.count, 25);
+    CHECK_EQ(hdr.first_ms, start);
+    CHECK_EQ(hdr.last_ms, start + 23 * MS_PER_HOUR + 1);
+
+    std::vector<int64_t> times;
+    std::vector<float> temps, vin;
+    CHECK(seg.times(times));
+    CHECK(seg.field(ARCHIVE_MCU_TEMP, temps));
+    CHECK(seg.field(ARCHIVE_VIN, vin));
+    CHECK_EQ(times.size(), 25);
+    CHECK_EQ(temps.size(), 25);
+    if (times.size() == 25 && temps.size() == 25) {
+        CHECK_EQ(times[11], start + 11 * MS_PER_HOUR);
+        CHECK_EQ(temps[11], 21);
+        CHECK_EQ(temps[12], 112);
+        CHECK_EQ(temps[24], 200);
+        CHECK(std::isnan(vin[0]));
+    }
+
+    // rollups: the day over everything, each hour over its own, and the
+    // fields that were never there empty
+    const ArchiveRollup& daily = hdr.daily[ARCHIVE_MCU_TEMP];
+    CHECK_EQ(daily.count, 25);
+    CHECK_EQ(daily.min, 10);
+    CHECK_EQ(daily.max, 200);
+    CHECK_EQ(hdr.hourly[5][ARCHIVE_MCU_TEMP].count, 1);
+    CHECK_EQ(hdr.hourly[5][ARCHIVE_MCU_TEMP].max, 15);
+    CHECK_EQ(hdr.hourly[23][ARCHIVE_MCU_TEMP].count, 2);
+    CHECK_NEAR(hdr.hourly[23][ARCHIVE_MCU_TEMP].mean(), (123 + 200) / 2.0, 1e-6);
+    CHECK_EQ(hdr.daily[ARCHIVE_VBAT].count, 25);
+    CHECK_EQ(hdr.daily[ARCHIVE_VIN].count, 0);
+    seg.close();
+
+    // something that isn't a segment doesn't open
+    std::string junk = dir + "/junk.seg";
+    FILE* f = fopen(junk.c_str(), "wb");
+    std::vector<uint8_t> zeros(sizeof(ArchiveSegmentHeader) + 10);
+    fwrite(zeros.data(), 1, zeros.size(), f);
+    fclose(f);
+    CHECK(!seg.open(junk.c_str()));
+    CHECK(!seg.open((dir + "/missing.seg").c_str()));
+    check_remove_dir(dir);
+}
+
+int main() {
+    test_times();
+    test_floats();
+    test_reduce();
+    test_days();
+    test_segments();
+    return check_done("archive");
+}
@@ -0,0 +1,192 @@
+/**
+ * Batched payloads: samples and their ages round trip, including across the
+ * millisecond clock wrapping, the batch stops taking samples when it's full
+ * or too big, and malformed or truncated batches are refused.
+ */
+#include <cstring>
+#include "check.h"
+#include "batch.h"
+#include "packet.h"
+#include "sim_hal.h"
+
+static struct sensor_record reading(int i) {
+    struct sensor_record rec = {};
+    rec.charge_state = 1;
+    rec.mcu_temp = 20.0f + i * 0.25f;
+    rec.vbat = 4.1f - i * 0.003f;
+    rec.vin = 5.0f;
+    rec.present = SENSOR_ALL_FIELDS;
+    return rec;
+}
+
+static void check_round_trip(const uint32_t* times, size_t n, uint32_t now_ms) {
+    SampleBatch batch;
+    for (size_t i = 0; i < n; i++) {
+        CHECK(batch.add(reading(i), times[i]));
+    }
+    struct packet_meta meta = {};
+    meta.seq = 1234;
+    meta.present = 1u << PACKET_SEQ;
+    uint8_t buf[BATCH_MAX_PAYLOAD];
+    size_t len = batch.encode(now_ms, buf, &meta);
+    CHECK(len <= BATCH_MAX_PAYLOAD);
+
+    struct sensor_record out[BATCH_MAX_SAMPLES];
+    uint32_t ages[BATCH_MAX_SAMPLES];
+    struct packet_meta out_meta = {};
+    CHECK_EQ(deserialise_batch(buf, len, out, ages, BATCH_MAX_SAMPLES, &out_meta), n);
+    for (size_t i = 0; i < n; i++) {
+        struct sensor_record expected = reading(i);
+        CHECK_EQ(ages[i], now_ms - times[i]);
+        CHECK_EQ(out[i].present, SENSOR_ALL_FIELDS);
+        CHECK_EQ(out[i].charge_state, 1);
+        CHECK_NEAR(out[i].mcu_temp, expected.mcu_temp, 0.005);
+        CHECK_NEAR(out[i].vbat, expected.vbat, 0.0005);
+        CHECK_NEAR(out[i].vin, 5.0, 0.0005);
+    }
+    CHECK_EQ(out_meta.present, 1u << PACKET_SEQ);
+    CHECK_EQ(out_meta.seq, 1234);
+}
+
+static void test_even_spacing() {
+    uint32_t times[BATCH_MAX_SAMPLES];
+    for (size_t i = 0; i < BATCH_MAX_SAMPLES; i++) {
+        times[i] = 100000 + i * 5000;
+    }
+    check_round_trip(times, BATCH_MAX_SAMPLES, times[BATCH_MAX_SAMPLES - 1] + 20);
+
+    // each more evenly spaced sample of the same readings costs a byte for
+    // its age and a byte a column
+    uint8_t buf[BATCH_MAX_PAYLOAD];
+    SampleBatch batch;
+    size_t len[5];
+    for (size_t i = 0; i < 5; i++) {
+        batch.add(reading(0), times[i]);
+        len[i] = batch.encode(times[4], buf);
+    }
+    CHECK_EQ(len[3] - len[2], 1 + SENSOR_FIELD_COUNT);
+    CHECK_EQ(len[4] - len[3], 1 + SENSOR_FIELD_COUNT);
+}
+
+static void test_uneven_spacing() {
+    const uint32_t times[] = { 1000, 1001, 7000, 7500, 60000, 60001 };
+    check_round_trip(times, sizeof(times) / sizeof(times[0]), 60001);
+}
+
+static void test_clock_wrap() {
+    // the sender's millisecond clock wraps between samples and sending
+    const uint32_t times[] = { 0xFFFFD8F0u, 0xFFFFEC78u, 0u, 5000u };
+    check_round_trip(times, 4, 5100);
+}
+
+static void test_single_and_empty() {
+    const uint32_t times[] = { 42 };
+    check_round_trip(times, 1, 42);
+
+    // an empty batch encodes, but isn't a batch to a receiver
+    SampleBatch batch;
+    uint8_t buf[BATCH_MAX_PAYLOAD];
+    size_t len = batch.encode(0, buf);
+    struct sensor_record out[BATCH_MAX_SAMPLES];
+    uint32_t ages[BATCH_MAX_SAMPLES];
+    CHECK_EQ(deserialise_batch(buf, len, out, ages, BATCH_MAX_SAMPLES), 0);
+}
+
+static void test_missing_fields_dropped() {
+    // only fields every sample has go in
+    SampleBatch batch;
+    struct sensor_record a = reading(0);
+    struct sensor_record b = reading(1);
+    b.present &= ~(1u << SENSOR_VIN);
+    batch.add(a, 0);
+    batch.add(b, 10);
+    uint8_t buf[BATCH_MAX_PAYLOAD];
+    size_t len = batch.encode(10, buf);
+    struct sensor_record out[BATCH_MAX_SAMPLES];
+    uint32_t ages[BATCH_MAX_SAMPLES];
+    CHECK_EQ(deserialise_batch(buf, len, out, ages, BATCH_MAX_SAMPLES), 2);
+    CHECK_EQ(out[0].present, SENSOR_ALL_FIELDS & ~(1u << SENSOR_VIN));
+    CHECK_EQ(out[1].present, SENSOR_ALL_FIELDS & ~(1u << SENSOR_VIN));
+}
+
+static void test_capacity() {
+    SampleBatch small(3);
+    for (int i = 0; i < 3; i++) {
+        CHECK(small.add(reading(i), i * 1000));
+    }
+    CHECK(small.full());
+    CHECK(!small.add(reading(3), 3000));
+    CHECK_EQ(small.count(), 3);
+
+    // samples that don't compress, wild values and irregular times, stop
+    // going in before the payload outgrows BATCH_MAX_PAYLOAD
+    SampleBatch batch;
+    SimRandom rng(5);
+    uint32_t t = 0;
+    size_t added = 0;
+    for (size_t i = 0; i < BATCH_MAX_SAMPLES; i++) {
+        struct sensor_record rec = reading(0);
+        rec.mcu_temp = (float)rng.below(2000000) - 1000000;
+        rec.vbat = (float)rng.below(2000000);
+        rec.vin = (float)rng.below(2000000);
+        t += rng.below(1u << 30);
+        if (!batch.add(rec, t)) {
+            break;
+        }
+        added++;
+    }
+    CHECK(added < BATCH_MAX_SAMPLES);
+    uint8_t buf[BATCH_MAX_PAYLOAD];
+    CHECK(batch.encode(t, buf) + PACKET_META_MAX_SIZE <= BATCH_MAX_PAYLOAD);
+}
+
+static void test_malformed_refused() {
+    SampleBatch batch;
+    for (int i = 0; i < 5; i++) {
+        batch.add(reading(i), i * 5000);
+    }
+    uint8_t buf[BATCH_MAX_PAYLOAD];
+    size_t len = batch.encode(20000, buf);
+    struct sensor_record out[BATCH_MAX_SAMPLES];
+    uint32_t ages[BATCH_MAX_SAMPLES];
+
+    // more samples than the caller has room for
+    CHECK_EQ(deserialise_batch(buf, len, out, ages, 4), 0);
+    // not a batch
+    uint8_t other[BATCH_MAX_PAYLOAD];
+    memcpy(other, buf, len);
+    other[0] = PAYLOAD_FORMAT_RECORD;
+    CHECK_EQ(deserialise_batch(other, len, out, ages, BATCH_MAX_SAMPLES), 0);
+    // a column that isn't length prefixed
+    memcpy(other, buf, len);
+    const uint8_t* column = other + 2;
+    uint64_t val;
+    for (int i = 0; i < 5; i++) {
+        column = varint_get(column, other + len, &val);
+    }
+    size_t first_column = column - other;
+    CHECK_EQ(other[first_column] & 0x07, WIRE_BYTES);
+    other[first_column] = (other[first_column] & ~0x07) | WIRE_VARINT;
+    CHECK_EQ(deserialise_batch(other, len, out, ages, BATCH_MAX_SAMPLES), 0);
+
+    // cut short it's refused, or where it's cut between columns, decodes
+    // without the columns that were lost
+    for (size_t cut = 0; cut < len; cut++) {
+        size_t n = deserialise_batch(buf, cut, out, ages, BATCH_MAX_SAMPLES);
+        if (n) {
+            CHECK_EQ(n, 5);
+            CHECK(out[0].present != SENSOR_ALL_FIELDS);
+        }
+    }
+}
+
+int main() {
+    test_even_spacing();
+    test_uneven_spacing();
+    test_clock_wrap();
+    test_single_and_empty();
+    test_missing_fields_dropped();
+    test_capacity();
+    test_malformed_refused();
+    return check_done("batch");
+}
@@ -0,0 +1,107 @@
+/**
+ * LoRaEMB command completion: a response is OK or an error by its status
+ * byte, nothing back in time is a timeout, and anything else the module
+ * sends while a command is outstanding, received data or a response to some
+ * other command, goes to the handler rather than being taken as the answer.
+ */
+#include <vector>
+#include "check.h"
+#include "emb_command.h"
+#include "sim_hal.h"
+
+// the frame types the handler was given
+static void collect(const uint8_t* frame, size_t len, void* ctx) {
+    CHECK(len >= EMB_FRAME_OVERHEAD);
+    static_cast<std::vector<uint8_t>*>(ctx)->push_back(frame[2]);
+}
+
+static void test_ok() {
+    SimRadio radio;
+    EmbCommander emb(radio);
+    CHECK_EQ(emb.run(EMB_CMD_OUTPUT_POWER, [&]{ radio.setOutputPower(10); }), EMB_OK);
+    CHECK_EQ(emb.response_len(), EMB_FRAME_OVERHEAD + 1);
+    CHECK_EQ(emb.response()[2], EMB_CMD_OUTPUT_POWER | EMB_RESPONSE_FLAG);
+    CHECK_EQ(emb.response()[3], 0);
+    // the sim answers straight away
+    CHECK_EQ(emb.elapsed_us(), 0);
+}
+
+static void test_error() {
+    SimRadio radio;
+    EmbCommander emb(radio);
+    radio.set_ack_status(2);
+    CHECK_EQ(emb.run(EMB_CMD_NETWORK_STOP, [&]{ radio.stopNetwork(); }), EMB_ERROR);
+    CHECK_EQ(emb.response()[3], 2);
+    // the device info has no status, whatever it leads with
+    CHECK_EQ(emb.run(EMB_CMD_DEVICE_INFO, [&]{ radio.sendCmd(EMB_CMD_DEVICE_INFO); }), EMB_OK);
+    radio.set_ack_status(0);
+    CHECK_EQ(emb.run(EMB_CMD_NETWORK_STOP, [&]{ radio.stopNetwork(); }), EMB_OK);
+}
+
+static void test_timeout() {
+    SimRadio radio;
+    EmbCommander emb(radio);
+    radio.set_mute(true);
+    uint64_t start = hal_time_us();
+    CHECK_EQ(emb.run(EMB_CMD_NETWORK_START, [&]{ radio.startNetwork(); }, 50), EMB_TIMEOUT);
+    CHECK(emb.elapsed_us() >= 50000 && emb.elapsed_us() < 50000 + 2 * EMB_POLL_SLICE_MS * 1000);
+    CHECK_EQ(hal_time_us() - start, emb.elapsed_us());
+    CHECK_EQ(emb.response_len(), 0);
+
+    // and an answer turning up late isn't taken for the next command's
+    radio.set_mute(false);
+    radio.setNetworkAddress(0x2001);
+    radio.set_mute(true);
+    std::vector<uint8_t> other;
+    emb.set_unsolicited_handler(collect, &other);
+    CHECK_EQ(emb.run(EMB_CMD_OUTPUT_POWER, [&]{ radio.setOutputPower(10); }, 10), EMB_TIMEOUT);
+    CHECK(other == std::vector<uint8_t>({ EMB_CMD_NETWORK_ADDRESS | EMB_RESPONSE_FLAG }));
+}
+
+static void test_unsolicited() {
+    SimRadio radio;
+    EmbCommander emb(radio);
+    std::vector<uint8_t> other;
+    emb.set_unsolicited_handler(collect, &other);
+
+    // data arriving after the command's gone but before its answer
+    uint8_t data[] = { 0x01, 0x02, 0x03 };
+    emb.begin(EMB_CMD_OUTPUT_POWER);
+    radio.inject_rx_data(0x2001, 0xFFFF, -90, data, sizeof(data));
+    radio.inject_rx_data(0x2002, 0xFFFF, -91, data, sizeof(data));
+    radio.setOutputPower(10);
+    CHECK_EQ(emb.poll(), EMB_PENDING);
+    CHECK_EQ(emb.poll(), EMB_PENDING);
+    CHECK_EQ(emb.poll(), EMB_OK);
+    CHECK(other == std::vector<uint8_t>({ EMB_RX_DATA, EMB_RX_DATA }));
+    CHECK_EQ(emb.response()[2], EMB_CMD_OUTPUT_POWER | EMB_RESPONSE_FLAG);
+
+    // the answer in pieces with received data in between
+    other.clear();
+    std::vector<uint8_t> rx = sim_rx_data_frame(0x2003, 0xFFFF, -92, data, sizeof(data));
+    uint8_t ack[EMB_FRAME_OVERHEAD + 1];
+    uint8_t ok = 0;
+    size_t ack_len = emb_build_frame(EMB_CMD_NETWORK_ID | EMB_RESPONSE_FLAG, &ok, 1, ack);
+    emb.begin(EMB_CMD_NETWORK_ID);
+    radio.inject_raw(rx.data(), rx.size());
+    radio.inject_raw(ack, 2);
+    radio.inject_raw(ack + 2, ack_len - 2);
+    CHECK_EQ(emb.wait(), EMB_OK);
+    CHECK(other == std::vector<uint8_t>({ EMB_RX_DATA }));
+
+    // and with nothing outstanding everything goes to the handler
+    radio.inject_rx_data(0x2004, 0xFFFF, -93, data, sizeof(data));
+    radio.stopNetwork();
+    CHECK_EQ(emb.poll(), EMB_OK);
+    CHECK_EQ(emb.poll(), EMB_OK);
+    CHECK(other == std::vector<uint8_t>({ EMB_RX_DATA, EMB_RX_DATA, EMB_CMD_NETWORK_STOP | EMB_RESPONSE_FLAG }));
+    CHECK_EQ(emb.response()[2], EMB_CMD_NETWORK_ID | EMB_RESPONSE_FLAG);
+}
+
+int main() {
+    test_ok();
+    test_error();
+    test_timeout();
+    test_unsolicited();
+    return check_done("emb_command");
+}
@@ -0,0 +1,276 @@
+/**
+ * The receiver's store-and-forward flash log: records come back in order
+ * with how long they were held, survive a restart once they're in a page,
+ * the ring wraps evenly, fills up by losing the oldest, and a page torn by
+ * losing power is skipped. And a held record sent on later still dates
+ * its reading right.
+ */
+#include <algorithm>
+#include <cstring>
+#include "check.h"
+#include "flash_log.h"
+#include "hostlink_decoder.h"
+#include "sim_hal.h"
+
+static const size_t RECORD_LEN = 40;
+
+static void append_record(FlashLog& log, uint32_t now_ms, uint32_t n) {
+    uint8_t record[RECORD_LEN];
+    memset(record, (uint8_t)n, sizeof(record));
+    serialise_u32(record, n);
+    log.append(now_ms, record, sizeof(record));
+}
+
+// the next record's number, or -1 if there isn't one or it's damaged
+static int64_t next_record(FlashLog& log, uint32_t now_ms, uint32_t* held_ms = nullptr) {
+    const uint8_t* record;
+    size_t len;
+    uint32_t held;
+    if (!log.next(now_ms, &record, &len, &held)) {
+        return -1;
+    }
+    uint32_t n;
+    deserialise_u32(record, &n);
+    if (len != RECORD_LEN || record[RECORD_LEN - 1] != (uint8_t)n) {
+        return -1;
+    }
+    if (held_ms) {
+        *held_ms = held;
+    }
+    return n;
+}
+
+static void test_ram_only() {
+    // nothing reaches flash until there's a page of it
+    SimFlash flash(4 * FlashStore::SECTOR_SIZE);
+    FlashLog log(flash);
+    log.mount(0);
+    for (uint32_t n = 0; n < 3; n++) {
+        append_record(log, 1000 + n * 100, n);
+    }
+    CHECK_EQ(log.pending(), 3);
+    CHECK_EQ(flash.programs, 0);
+    uint32_t held;
+    CHECK_EQ(next_record(log, 2000, &held), 0);
+    CHECK_EQ(held, 1000);
+    CHECK_EQ(next_record(log, 2000, &held), 1);
+    CHECK_EQ(held, 900);
+    CHECK_EQ(next_record(log, 2000), 2);
+    CHECK_EQ(next_record(log, 2000), -1);
+    CHECK(log.empty());
+}
+
+static void test_pages_in_order() {
+    SimFlash flash(4 * FlashStore::SECTOR_SIZE);
+    FlashLog log(flash);
+    log.mount(0);
+    for (uint32_t n = 0; n < 150; n++) {
+        append_record(log, n * 10, n);
+        while (log.service_due(n * 10, 60000)) {
+            log.service(n * 10, 60000);
+        }
+    }
+    CHECK(log.pages_written() > 20);
+    CHECK_EQ(log.stalls(), 0);
+    CHECK_EQ(log.lost(), 0);
+    CHECK_EQ(log.pending(), 150);
+    uint32_t n = 0;
+    uint32_t held;
+    for (int64_t got; (got = next_record(log, 5000, &held)) >= 0; n++) {
+        if (!CHECK_EQ(got, n)) {
+            break;
+        }
+        CHECK_EQ(held, 5000 - n * 10);
+    }
+    CHECK_EQ(n, 150);
+    CHECK(log.empty());
+    CHECK_EQ(log.flash_errors(), 0);
+}
+
+static void test_restart() {
+    SimFlash flash(4 * FlashStore::SECTOR_SIZE);
+    {
+        FlashLog log(flash);
+        log.mount(0);
+        for (uint32_t n = 0; n < 60; n++) {
+            append_record(log, 10000 + n, n);
+        }
+        // send the first few pages' worth, then write out the rest
+        for (uint32_t n = 0; n < 22; n++) {
+            CHECK_EQ(next_record(log, 20000), n);
+        }
+        log.service(20000, 0);
+        log.service(20000, 0);
+    }
+
+    // back up 500ms after, the log's clock carries on from the newest record
+    // and a page that was part sent comes round again in full
+    FlashLog log(flash);
+    log.mount(500);
+    CHECK_EQ(log.pending(), 60 - 20);
+    uint32_t held;
+    CHECK_EQ(next_record(log, 500, &held), 20);
+    CHECK_EQ(held, 59 - 20);
+    uint32_t n = 21;
+    for (int64_t got; (got = next_record(log, 600)) >= 0; n++) {
+        if (!CHECK_EQ(got, n)) {
+            break;
+        }
+    }
+    CHECK_EQ(n, 60);
+
+    // and once everything's been sent a restart has nothing for the host
+    FlashLog again(flash);
+    again.mount(0);
+    CHECK_EQ(again.pending(), 0);
+    CHECK_EQ(next_record(again, 0), -1);
+}
+
+static void test_wrap_wears_evenly() {
+    // round and round a small ring, the host reading every hundred records
+    SimFlash flash(4 * FlashStore::SECTOR_SIZE);
+    FlashLog log(flash);
+    log.mount(0);
+    uint32_t read = 0;
+    bool in_order = true;
+    for (uint32_t n = 0; n < 3000; n++) {
+        append_record(log, n, n);
+        log.service(n, 1000);
+        if (n % 100 == 99) {
+            for (int64_t got; (got = next_record(log, n)) >= 0; read++) {
+                in_order = in_order && got == read;
+            }
+        }
+    }
+    CHECK(in_order);
+    CHECK(read > 2900);
+    CHECK_EQ(log.lost(), 0);
+    CHECK_EQ(log.stalls(), 0);
+    uint32_t most = *std::max_element(flash.erase_counts.begin(), flash.erase_counts.end());
+    uint32_t least = *std::min_element(flash.erase_counts.begin(), flash.erase_counts.end());
+    CHECK(least >= 5);
+    CHECK(most - least <= 1);
+}
+
+static void test_full_ring() {
+    // nobody reading, the oldest sector goes each time it comes round
+    SimFlash flash(4 * FlashStore::SECTOR_SIZE);
+    FlashLog log(flash);
+    log.mount(0);
+    const uint32_t total = 2000;
+    for (uint32_t n = 0; n < total; n++) {
+        append_record(log, n, n);
+        log.service(n, 60000);
+    }
+    CHECK(log.lost() > 0);
+    CHECK_EQ(log.pending() + log.lost(), total);
+    // what's left is the newest, unbroken
+    uint32_t pending = log.pending();
+    uint32_t n = total - pending;
+    for (int64_t got; (got = next_record(log, total)) >= 0; n++) {
+        if (!CHECK_EQ(got, n)) {
+            break;
+        }
+    }
+    CHECK_EQ(n, total);
+    CHECK(log.empty());
+    // it still held most of the ring
+    CHECK(pending * (FLASH_LOG_ENTRY_HEADER + RECORD_LEN) > 2 * FlashStore::SECTOR_SIZE);
+}
+
+static void test_stall_without_service() {
+    // with no idle time to erase ahead the erase happens when it's needed
+    SimFlash flash(4 * FlashStore::SECTOR_SIZE);
+    FlashLog log(flash);
+    log.mount(0);
+    for (uint32_t n = 0; n < 200; n++) {
+        append_record(log, n, n);
+    }
+    CHECK(log.stalls() > 0);
+    CHECK_EQ(log.lost(), 0);
+    CHECK_EQ(next_record(log, 200), 0);
+}
+
+static void test_torn_page() {
+    SimFlash flash(4 * FlashStore::SECTOR_SIZE);
+    {
+        FlashLog log(flash);
+        log.mount(0);
+        for (uint32_t n = 0; n < 30; n++) {
+            append_record(log, n, n);
+        }
+        log.service(100, 0);
+        log.service(100, 0);
+    }
+    // the newest page only half programmed when the power went
+    size_t newest = 0;
+    for (size_t page = 0; page * FlashStore::PAGE_SIZE < flash.contents.size(); page++) {
+        if (flash.contents[page * FlashStore::PAGE_SIZE] != 0xFF) {
+            newest = page;
+        }
+    }
+    uint8_t* torn = &flash.contents[newest * FlashStore::PAGE_SIZE];
+    memset(torn + FlashStore::PAGE_SIZE / 2, 0xFF, FlashStore::PAGE_SIZE / 2);
+
+    FlashLog log(flash);
+    log.mount(0);
+    uint32_t pending = log.pending();
+    CHECK(pending > 0 && pending < 30);
+    // what's there is good, and new records go after the torn page
+    append_record(log, 0, 1000);
+    uint32_t n = 0;
+    for (int64_t got; (got = next_record(log, 0)) >= 0 && got != 1000; n++) {
+        if (!CHECK_EQ(got, n)) {
+            break;
+        }
+    }
+    CHECK_EQ(n, pending);
+    CHECK(log.empty());
+}
+
+static void test_restamp() {
+    struct rxdata rxd = {};
+    rxd.src = 0x1234;
+    rxd.count = 1;
+    rxd.readings[0].vbat = 3.8f;
+    rxd.readings[0].present = 1u << SENSOR_VBAT;
+    rxd.age_ms[0] = 2000;
+    uint8_t record[HOSTLINK_RECORD_MAX];
+    size_t len = hostlink_record_reading(&rxd, 0, 1000, record);
+
+    // held 50s, sent at 51000: still sampled at 1000 - 2000
+    uint8_t frame[HOSTLINK_FRAME_MAX];
+    size_t frame_len = hostlink_restamp_record(record, len, 51000, 50000, frame);
+    struct HostRecord rec;
+    CHECK(frame_len > 0 && hostlink_decode(frame, frame_len - 1, &rec));
+    CHECK_EQ(rec.time_ms, 51000);
+    CHECK_EQ(rec.age_ms, 52000);
+    CHECK_EQ(rec.src, 0x1234);
+    CHECK_NEAR(rec.readings.vbat, 3.8, 0.0005);
+
+    // ages top out rather than wrap
+    frame_len = hostlink_restamp_record(record, len, 0, UINT32_MAX, frame);
+    CHECK(frame_len > 0 && hostlink_decode(frame, frame_len - 1, &rec));
+    CHECK(rec.age_ms == UINT32_MAX);
+
+    // a damaged record, or one that isn't a reading or summary, isn't
+    record[6] ^= 1;
+    CHECK_EQ(hostlink_restamp_record(record, len, 0, 0, frame), 0);
+    struct HostlinkStatus status = {};
+    len = hostlink_encode_status(&status, 0, frame);
+    uint8_t status_record[HOSTLINK_RECORD_MAX];
+    len = cobs_decode(frame, len - 1, status_record);
+    CHECK_EQ(hostlink_restamp_record(status_record, len, 0, 0, frame), 0);
+}
+
+int main() {
+    test_ram_only();
+    test_pages_in_order();
+    test_restart();
+    test_wrap_wears_evenly();
+    test_full_ring();
+    test_stall_without_service();
+    test_torn_page();
+    test_restamp();
+    return check_done("flash_log");
+}
@@ -0,0 +1,144 @@
+/**
+ * LoRaEMB frames: building them, picking them out of the byte stream from
+ * the module (whole, in pieces, among garbage) and a packet from a sender
+ * through the simulated radios to the receiver.
+ */
+#include <cstring>
+#include <vector>
+#include "check.h"
+#include "frame.h"
+#include "frame_stream.h"
+#include "packet.h"
+#include "sim_hal.h"
+
+static void test_build_frame() {
+    const uint8_t payload[] = { 0x01, 0x02, 0x03 };
+    uint8_t out[16];
+    size_t len = emb_build_frame(EMB_CMD_NETWORK_ADDRESS, payload, sizeof(payload), out);
+    CHECK_EQ(len, sizeof(payload) + EMB_FRAME_OVERHEAD);
+    CHECK_EQ(out[0], 0);
+    CHECK_EQ(out[1], len);
+    CHECK_EQ(out[2], EMB_CMD_NETWORK_ADDRESS);
+    CHECK(memcmp(out + 3, payload, sizeof(payload)) == 0);
+    CHECK_EQ(out[len - 1], (0 + 7 + 0x21 + 1 + 2 + 3) & 0xFF);
+    CHECK_EQ(out[len - 1], emb_checksum(out, len - 1));
+}
+
+static void test_parser_resync() {
+    // garbage, a frame with a bad checksum, then a good one
+    const uint8_t payload[] = { 0xAA, 0x55 };
+    uint8_t good[8];
+    size_t good_len = emb_build_frame(EMB_RX_DATA, payload, sizeof(payload), good);
+    uint8_t bad[8];
+    memcpy(bad, good, good_len);
+    bad[good_len - 1] ^= 0xFF;
+
+    std::vector<uint8_t> bytes = { 0xFF, 0x00 };
+    bytes.insert(bytes.end(), bad, bad + good_len);
+    bytes.insert(bytes.end(), good, good + good_len);
+
+    EmbFrameParser parser;
+    int frames = 0;
+    for (uint8_t byte : bytes) {
+        if (parser.push(byte)) {
+            frames++;
+            CHECK_EQ(parser.frame_len(), good_len);
+            CHECK(memcmp(parser.frame(), good, good_len) == 0);
+        }
+    }
+    CHECK_EQ(frames, 1);
+    CHECK(parser.errors() > 0);
+}
+
+static void test_stream_split_frames() {
+    // two frames back to back, arriving a byte at a time with a partial
+    // third still to come
+    const uint8_t a[] = { 1, 2, 3, 4, 5 };
+    const uint8_t b[] = { 9 };
+    uint8_t fa[16], fb[16];
+    size_t la = emb_build_frame(EMB_RX_DATA, a, sizeof(a), fa);
+    size_t lb = emb_build_frame(EMB_CMD_SEND_DATA | EMB_RESPONSE_FLAG, b, sizeof(b), fb);
+
+    EmbFrameStream<512> stream;
+    EmbFrame frame;
+    for (size_t i = 0; i < la; i++) {
+        CHECK(!stream.next(frame));
+        stream.push(fa[i]);
+    }
+    for (size_t i = 0; i < lb; i++) {
+        stream.push(fb[i]);
+    }
+    stream.push(fa[0]);
+    stream.push(fa[1]);
+
+    CHECK(stream.next(frame));
+    CHECK_EQ(frame.len, la);
+    CHECK(memcmp(frame.data, fa, la) == 0);
+    stream.release(frame);
+    CHECK(stream.next(frame));
+    CHECK_EQ(frame.len, lb);
+    CHECK_EQ(frame.data[2], EMB_CMD_SEND_DATA | EMB_RESPONSE_FLAG);
+    stream.release(frame);
+    CHECK(!stream.next(frame));
+    CHECK_EQ(stream.frames(), 2);
+    CHECK_EQ(stream.errors(), 0);
+}
+
+static void test_stream_overflow() {
+    // more than fits is dropped and counted, not wrapped over what's there
+    EmbFrameStream<512> stream;
+    for (int i = 0; i < 600; i++) {
+        stream.push(0);
+    }
+    CHECK(stream.dropped() > 0);
+}
+
+static void test_sender_to_receiver() {
+    SimRadio sender, receiver;
+    sender.link(&receiver, -87);
+    sender.setNetworkAddress(0x1234);
+
+    struct txdata txd = {};
+    txd.dest = 0xFFFF;
+    txd.readings.charge_state = 2;
+    txd.readings.mcu_temp = 21.5f;
+    txd.readings.vbat = 3.912f;
+    txd.readings.vin = 5.05f;
+    txd.readings.present = SENSOR_ALL_FIELDS;
+    txd.meta.seq = 41;
+    txd.meta.present = 1u << PACKET_SEQ;
+    uint8_t buf[TXDATA_MAX_SIZE];
+    sender.transmitData(buf, serialise_txdata(&txd, buf));
+
+    uint8_t frame[EMB_MAX_FRAME];
+    size_t len = collect_rx_frame(receiver, frame, sizeof(frame), 10);
+    CHECK(len > RXDATA_HEADER_SIZE);
+    CHECK_EQ(frame[2], EMB_RX_DATA);
+
+    struct rxdata rxd = {};
+    CHECK(deseralise_rxdata(frame, len, &rxd));
+    CHECK_EQ(rxd.src, 0x1234);
+    CHECK_EQ(rxd.via, 0x1234);
+    CHECK_EQ(rxd.rssi, -87);
+    CHECK_EQ(rxd.count, 1);
+    CHECK_EQ(rxd.readings[0].present, SENSOR_ALL_FIELDS);
+    CHECK_EQ(rxd.readings[0].charge_state, 2);
+    CHECK_NEAR(rxd.readings[0].mcu_temp, 21.5, 0.01);
+    CHECK_NEAR(rxd.readings[0].vbat, 3.912, 0.001);
+    CHECK_NEAR(rxd.readings[0].vin, 5.05, 0.001);
+    CHECK_EQ(rxd.meta.seq, 41);
+
+    // and a bit flipped anywhere gets it thrown out by the checksum
+    frame[len / 2] ^= 0x10;
+    rxd = {};
+    CHECK(!deseralise_rxdata(frame, len, &rxd));
+}
+
+int main() {
+    test_build_frame();
+    test_parser_resync();
+    test_stream_split_frames();
+    test_stream_overflow();
+    test_sender_to_receiver();
+    return check_done("frame");
+}
@@ -0,0 +1,183 @@
+/**
+ * The receiver's binary output: COBS and the CRC, readings and status
+ * records through to the host decoder, and the decoder getting past damaged,
+ * cut short and overlong records to the next good one.
+ */
+#include <cstring>
+#include <vector>
+#include "check.h"
+#include "hostlink.h"
+#include "hostlink_decoder.h"
+
+static void check_cobs(const std::vector<uint8_t>& in) {
+    std::vector<uint8_t> enc(in.size() + in.size() / 254 + 1);
+    size_t len = cobs_encode(in.data(), in.size(), enc.data());
+    CHECK(len <= enc.size());
+    CHECK(memchr(enc.data(), 0, len) == nullptr);
+    std::vector<uint8_t> dec(len);
+    size_t dec_len = cobs_decode(enc.data(), len, dec.data());
+    CHECK_EQ(dec_len, in.size());
+    CHECK(memcmp(dec.data(), in.data(), in.size()) == 0);
+}
+
+static void test_cobs() {
+    // around the 254 byte blocks, and all or no zeros
+    const size_t sizes[] = { 1, 2, 253, 254, 255, 508, 600 };
+    for (size_t size : sizes) {
+        std::vector<uint8_t> ones(size, 0x11);
+        check_cobs(ones);
+        std::vector<uint8_t> zeros(size, 0);
+        check_cobs(zeros);
+        std::vector<uint8_t> mixed(size);
+        for (size_t i = 0; i < size; i++) {
+            mixed[i] = i % 7 == 0 ? 0 : (uint8_t)i;
+        }
+        check_cobs(mixed);
+    }
+
+    // a zero inside, or a block running past the end, isn't COBS
+    uint8_t out[8];
+    const uint8_t zero_inside[] = { 3, 1, 0 };
+    CHECK_EQ(cobs_decode(zero_inside, sizeof(zero_inside), out), 0);
+    const uint8_t too_long[] = { 5, 1, 2 };
+    CHECK_EQ(cobs_decode(too_long, sizeof(too_long), out), 0);
+}
+
+static void test_crc() {
+    // the standard check value for CRC-16/CCITT-FALSE
+    const char* check = "123456789";
+    CHECK_EQ(crc16_ccitt((const uint8_t*)check, 9), 0x29B1);
+    // and run over its own crc it comes to zero, as the flash log relies on
+    uint8_t buf[11];
+    memcpy(buf, check, 9);
+    serialise_u16(buf + 9, crc16_ccitt(buf, 9));
+    CHECK_EQ(crc16_ccitt(buf, 11), 0);
+}
+
+static struct rxdata batch_packet() {
+    struct rxdata rxd = {};
+    rxd.src = 0x1234;
+    rxd.dst = 0xFFFF;
+    rxd.rssi = -112;
+    rxd.count = 2;
+    for (int i = 0; i < 2; i++) {
+        rxd.readings[i].charge_state = 4;
+        rxd.readings[i].mcu_temp = -3.5f + i;
+        rxd.readings[i].vbat = 3.65f;
+        rxd.readings[i].vin = 0.25f;
+        rxd.readings[i].present = SENSOR_ALL_FIELDS;
+        rxd.age_ms[i] = 5000 * (1 - i);
+    }
+    return rxd;
+}
+
+static void test_reading_round_trip() {
+    struct rxdata rxd = batch_packet();
+    for (size_t i = 0; i < rxd.count; i++) {
+        uint8_t frame[HOSTLINK_FRAME_MAX];
+        size_t len = hostlink_encode_reading(&rxd, i, 0xFFFFFFF0u, frame);
+        CHECK(len <= HOSTLINK_FRAME_MAX);
+        CHECK_EQ(frame[len - 1], 0);
+
+        struct HostRecord rec;
+        CHECK(hostlink_decode(frame, len - 1, &rec));
+        CHECK_EQ(rec.type, HOSTLINK_READING);
+        CHECK(rec.time_ms == 0xFFFFFFF0u);
+        CHECK_EQ(rec.src, 0x1234);
+        CHECK_EQ(rec.dst, 0xFFFF);
+        CHECK_EQ(rec.rssi, -112);
+        CHECK_EQ(rec.age_ms, rxd.age_ms[i]);
+        CHECK_EQ(rec.readings.present, SENSOR_ALL_FIELDS);
+        CHECK_EQ(rec.readings.charge_state, 4);
+        CHECK_NEAR(rec.readings.mcu_temp, rxd.readings[i].mcu_temp, 0.005);
+        CHECK_NEAR(rec.readings.vbat, 3.65, 0.0005);
+        CHECK_NEAR(rec.readings.vin, 0.25, 0.0005);
+    }
+}
+
+static void test_status_round_trip() {
+    struct HostlinkStatus status = {};
+    status.rx_frames = 100000;
+    status.rx_errors = 3;
+    status.rx_dropped = 0;
+    status.charge_state = 2;
+    status.mcu_temp = 31.25f;
+    status.present = (1u << HOSTLINK_STATUS_LOG_PENDING) - 1;
+    uint8_t frame[HOSTLINK_FRAME_MAX];
+    size_t len = hostlink_encode_status(&status, 1000, frame);
+
+    struct HostRecord rec;
+    CHECK(hostlink_decode(frame, len - 1, &rec));
+    CHECK_EQ(rec.type, HOSTLINK_STATUS);
+    CHECK_EQ(rec.time_ms, 1000);
+    CHECK_EQ(rec.status.present, status.present);
+    CHECK_EQ(rec.status.rx_frames, 100000);
+    CHECK_EQ(rec.status.rx_errors, 3);
+    CHECK_EQ(rec.status.rx_dropped, 0);
+    CHECK_EQ(rec.status.charge_state, 2);
+    CHECK_NEAR(rec.status.mcu_temp, 31.25, 0.005);
+}
+
+static void test_decoder_recovers() {
+    // text before the first record, then a good record, a corrupted one,
+    // one cut short, one too long to be a record and a last good one
+    struct rxdata rxd = batch_packet();
+    std::vector<uint8_t> stream;
+    const char* text = "booting\n";
+    stream.insert(stream.end(), text, text + strlen(text));
+    stream.push_back(0);
+
+    uint8_t frame[HOSTLINK_FRAME_MAX];
+    size_t len = hostlink_encode_reading(&rxd, 0, 1, frame);
+    stream.insert(stream.end(), frame, frame + len);
+
+    len = hostlink_encode_reading(&rxd, 1, 2, frame);
+    frame[len / 2] ^= 0x04;
+    if (frame[len / 2] == 0) {
+        frame[len / 2] = 0x04;
+    }
+    stream.insert(stream.end(), frame, frame + len);
+
+    len = hostlink_encode_reading(&rxd, 1, 3, frame);
+    stream.insert(stream.end(), frame, frame + len / 2);
+    stream.push_back(0);
+
+    stream.insert(stream.end(), HOSTLINK_FRAME_MAX + 10, 0x55);
+    stream.push_back(0);
+
+    len = hostlink_encode_reading(&rxd, 1, 4, frame);
+    stream.insert(stream.end(), frame, frame + len);
+
+    HostlinkDecoder decoder;
+    std::vector<uint32_t> times;
+    for (uint8_t byte : stream) {
+        struct HostRecord rec;
+        if (decoder.push(byte, rec)) {
+            times.push_back(rec.time_ms);
+        }
+    }
+    CHECK_EQ(times.size(), 2);
+    CHECK(times.size() == 2 && times[0] == 1 && times[1] == 4);
+    CHECK_EQ(decoder.records(), 2);
+    CHECK_EQ(decoder.errors(), 4);
+}
+
+static void test_unknown_type() {
+    // a record type from a newer receiver is skipped, not misread
+    uint8_t record[16];
+    uint8_t* recptr = serialise_u8(record, 0x7F);
+    recptr = serialise_u32(recptr, 5);
+    recptr = serialise_u16(recptr, crc16_ccitt(record, recptr - record));
+    struct HostRecord rec;
+    CHECK(!hostlink_parse(record, recptr - record, &rec));
+}
+
+int main() {
+    test_cobs();
+    test_crc();
+    test_reading_round_trip();
+    test_status_round_trip();
+    test_decoder_recovers();
+    test_unknown_type();
+    return check_done("hostlink");
+}
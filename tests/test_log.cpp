@@ -0,0 +1,70 @@
+/**
+ * Deferred logging: arguments encoded as the board does come back out of
+ * log_format() as printf would have put them, conversions that aren't
+ * integers as such (%c) included, and a record cut short says so.
+ */
+#include <string>
+#include "check.h"
+#include "log.h"
+#include "log_format.h"
+
+// the arguments as a log record carries them, formatted on the host
+template <typename... Args>
+static std::string deferred(const char* fmt, const Args&... args) {
+    uint8_t buf[LOG_RECORD_MAX];
+    const uint8_t* end = buf + sizeof(buf);
+    uint8_t* p = buf;
+    ((p = log_put(p, end, args)), ...);
+    CHECK(p != nullptr);
+    return log_format(fmt, buf, p ? p - buf : 0);
+}
+
+static bool check_text(const std::string& got, const char* want) {
+    if (got != want) {
+        printf("    got \"%s\", want \"%s\"\n", got.c_str(), want);
+        return CHECK(got == want);
+    }
+    return CHECK(true);
+}
+
+static void test_integers() {
+    check_text(deferred("%d %i %u", -12345, 7, 4000000000u), "-12345 7 4000000000");
+    check_text(deferred("%5d|%-5d|%05u", -42, 42, 42u), "  -42|42   |00042");
+    check_text(deferred("0x%04X 0x%02x %o", 0xBEEFu, 0xABu, 8u), "0xBEEF 0xab 10");
+    check_text(deferred("%lu %zu %hu", (unsigned long)123456, (size_t)99, (unsigned short)65535), "123456 99 65535");
+    check_text(deferred("%lld", (long long)INT64_MIN), "-9223372036854775808");
+    check_text(deferred("%d%%", 50), "50%");
+}
+
+static void test_chars() {
+    check_text(deferred("[%c]", (unsigned)'A'), "[A]");
+    check_text(deferred("[%3c][%-3c]", (unsigned)'x', (unsigned)'y'), "[  x][y  ]");
+    check_text(deferred("%c%c%c", (uint8_t)'a', (uint8_t)'b', (uint8_t)'c'), "abc");
+    // a byte, not a wide character
+    check_text(deferred("%c", (uint8_t)0xB0), "\xB0");
+}
+
+static void test_others() {
+    check_text(deferred("%.2f %g", 3.14159f, 0.5), "3.14 0.5");
+    check_text(deferred("%s and %8s", "this", "that"), "this and     that");
+    const uint8_t bytes[] = { 0x01, 0xAB, 0xFF };
+    check_text(deferred("data={%H}", LogHex{ bytes, sizeof(bytes) }), "data={0x01 0xAB 0xFF }");
+}
+
+static void test_short() {
+    // the record ran out of room after the first
+    uint8_t buf[8];
+    uint8_t* p = log_put(buf, buf + sizeof(buf), 5u);
+    check_text(log_format("%u %u %s", buf, p - buf), "5 <?> <?>");
+    check_text(log_format("%u", buf, 0), "<?>");
+    // and a conversion the board wouldn't have sent
+    check_text(log_format("%p %u", buf, p - buf), "<?> 5");
+}
+
+int main() {
+    test_integers();
+    test_chars();
+    test_others();
+    test_short();
+    return check_done("log");
+}
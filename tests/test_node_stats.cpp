@@ -0,0 +1,190 @@
+/**
+ * Per-sender stats: gaps in the sequence numbers count as lost, late
+ * arrivals and repeats are told apart from them, a sender restarting or its
+ * numbers wrapping doesn't look like loss, the interval and jitter follow
+ * the arrivals, and senders past the table's capacity are counted.
+ */
+#include "check.h"
+#include "node_stats.h"
+
+static const uint16_t NODE = 0x2001;
+
+static struct rxdata packet(uint16_t src, uint16_t seq, int16_t rssi = -90) {
+    struct rxdata rxd = {};
+    rxd.src = src;
+    rxd.via = src;
+    rxd.rssi = rssi;
+    rxd.meta.seq = seq;
+    rxd.meta.present = 1u << PACKET_SEQ;
+    return rxd;
+}
+
+// seqs heard from NODE in that order, 5s apart
+static const NodeStats* hear(NodeStatsTable& table, const uint16_t* seqs, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        table.heard(packet(NODE, seqs[i]), 1000 + i * 5000);
+    }
+    return table.find(NODE);
+}
+
+static void test_gap() {
+    NodeStatsTable table;
+    const uint16_t seqs[] = { 10, 11, 14, 15 };
+    const NodeStats* s = hear(table, seqs, 4);
+    if (!CHECK(s)) {
+        return;
+    }
+    CHECK_EQ(s->packets, 4);
+    CHECK_EQ(s->lost, 2);
+    CHECK_EQ(s->duplicates, 0);
+    CHECK_EQ(s->last_seq, 15);
+    CHECK_NEAR(s->loss_percent(), 100.0 * 2 / 6, 0.01);
+}
+
+static void test_reordered() {
+    NodeStatsTable table;
+    // 3 turns up after 4, and then 4 and 3 again
+    const uint16_t seqs[] = { 1, 2, 4, 3, 4, 3 };
+    const NodeStats* s = hear(table, seqs, 6);
+    if (!CHECK(s)) {
+        return;
+    }
+    CHECK_EQ(s->lost, 0);
+    CHECK_EQ(s->late, 1);
+    CHECK_EQ(s->duplicates, 2);
+    // and it's still 4 that the next is counted from
+    CHECK_EQ(s->last_seq, 4);
+    table.heard(packet(NODE, 6), 100000);
+    CHECK_EQ(s->lost, 1);
+    CHECK_EQ(s->loss_percent(), 100.0f * 1 / 6);
+}
+
+static void test_restart_and_wrap() {
+    NodeStatsTable table;
+    // round past 65535 is just the next one
+    const uint16_t seqs[] = { 65534, 65535, 0, 2, 3 };
+    const NodeStats* s = hear(table, seqs, 5);
+    if (!CHECK(s)) {
+        return;
+    }
+    CHECK_EQ(s->lost, 1);
+    CHECK_EQ(s->restarts, 0);
+    CHECK_EQ(s->last_seq, 3);
+    // but a sender that starts again soon after can't be told from a late one
+    table.heard(packet(NODE, 1), 100000);
+    CHECK_EQ(s->lost, 0);
+    CHECK_EQ(s->late, 1);
+    CHECK_EQ(s->restarts, 0);
+
+    NodeStatsTable restarted;
+    const uint16_t later[] = { 500, 501, 0, 1, 2 };
+    s = hear(restarted, later, 5);
+    if (CHECK(s)) {
+        CHECK_EQ(s->restarts, 1);
+        CHECK_EQ(s->lost, 0);
+        CHECK_EQ(s->last_seq, 2);
+    }
+}
+
+static void test_no_seq() {
+    NodeStatsTable table;
+    for (int i = 0; i < 3; i++) {
+        struct rxdata rxd = packet(NODE, 0);
+        rxd.meta.present = 0;
+        table.heard(rxd, i * 1000);
+    }
+    const NodeStats* s = table.find(NODE);
+    if (CHECK(s)) {
+        CHECK_EQ(s->packets, 3);
+        CHECK(!s->have_seq);
+        CHECK_EQ(s->duplicates, 0);
+        CHECK_EQ(s->lost, 0);
+    }
+}
+
+static void test_interval_jitter() {
+    NodeStatsTable table;
+    uint32_t t = 1000;
+    for (uint16_t seq = 0; seq < 50; seq++) {
+        table.heard(packet(NODE, seq), t);
+        t += 5000;
+    }
+    const NodeStats* s = table.find(NODE);
+    if (!CHECK(s)) {
+        return;
+    }
+    CHECK_EQ(s->interval_x16 / 16, 5000);
+    CHECK_EQ(s->jitter_x16, 0);
+    CHECK_EQ(s->first_seen_ms, 1000);
+
+    // now 4s and 6s apart in turn, it averages out the same but is 1s off
+    // every time
+    for (uint16_t seq = 50; seq < 250; seq++) {
+        table.heard(packet(NODE, seq), t);
+        t += seq % 2 ? 4000 : 6000;
+    }
+    CHECK_NEAR(s->interval_x16 / 16.0, 5000, 100);
+    CHECK_NEAR(s->jitter_x16 / 16.0, 1000, 100);
+    CHECK_EQ(s->lost, 0);
+}
+
+static void test_rssi_and_relayed() {
+    NodeStatsTable table;
+    table.heard(packet(NODE, 1, -80), 1000);
+    table.heard(packet(NODE, 2, -125), 2000);
+    table.heard(packet(NODE, 3, -95), 3000);
+    // a relay's signal strength isn't the sender's
+    struct rxdata relayed = packet(NODE, 4, -40);
+    relayed.via = 0x12F0;
+    relayed.meta.hops = 1;
+    relayed.meta.present |= 1u << PACKET_HOPS;
+    table.heard(relayed, 4000);
+
+    const NodeStats* s = table.find(NODE);
+    if (!CHECK(s)) {
+        return;
+    }
+    CHECK_EQ(s->relayed, 1);
+    CHECK_EQ(s->rssi_last, -95);
+    CHECK_EQ(s->rssi_min, -125);
+    CHECK_EQ(s->rssi_max, -80);
+    CHECK_EQ(s->rssi_hist[0], 1); // below -120
+    CHECK_EQ(s->rssi_hist[3], 1); // -100 to -90
+    CHECK_EQ(s->rssi_hist[5], 1); // -80 to -70
+    CHECK_EQ(s->lost, 0);
+}
+
+static void test_full() {
+    static NodeStatsTable table;
+    for (uint32_t i = 0; i < HORTITEL_MAX_NODES; i++) {
+        table.heard(packet(0x1000 + i, 1), 1000);
+    }
+    CHECK_EQ(table.nodes(), HORTITEL_MAX_NODES);
+    CHECK_EQ(table.untracked(), 0);
+    // no room for another, but those already in carry on
+    table.heard(packet(0x1000 + HORTITEL_MAX_NODES, 1), 2000);
+    table.heard(packet(0x1000 + HORTITEL_MAX_NODES, 2), 3000);
+    table.heard(packet(0x1000, 2), 3000);
+    CHECK_EQ(table.nodes(), HORTITEL_MAX_NODES);
+    CHECK_EQ(table.untracked(), 2);
+    CHECK(!table.find(0x1000 + HORTITEL_MAX_NODES));
+    const NodeStats* s = table.find(0x1000);
+    if (CHECK(s)) {
+        CHECK_EQ(s->packets, 2);
+    }
+    s = table.find(0x1000 + HORTITEL_MAX_NODES - 1);
+    if (CHECK(s)) {
+        CHECK_EQ(s->packets, 1);
+    }
+}
+
+int main() {
+    test_gap();
+    test_reordered();
+    test_restart_and_wrap();
+    test_no_seq();
+    test_interval_jitter();
+    test_rssi_and_relayed();
+    test_full();
+    return check_done("node_stats");
+}
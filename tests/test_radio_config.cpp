@@ -0,0 +1,141 @@
+/**
+ * Radio configuration: from cold, or with a cache that can't be trusted, or
+ * when the module doesn't answer the device info query, it's the whole
+ * sequence; warm, only the settings that changed go, and only network
+ * settings stop and start the network.
+ */
+#include <cstring>
+#include <vector>
+#include "check.h"
+#include "radio_config.h"
+#include "sim_hal.h"
+
+static const std::vector<uint8_t> COLD = {
+    EMB_CMD_DEVICE_INFO,
+    EMB_CMD_NETWORK_STOP,
+    EMB_CMD_NETWORK_PREFERENCES,
+    EMB_CMD_OUTPUT_POWER,
+    EMB_CMD_OPERATING_CHANNEL,
+    EMB_CMD_NETWORK_ADDRESS,
+    EMB_CMD_NETWORK_ID,
+    EMB_CMD_ENERGY_SAVE,
+    EMB_CMD_NETWORK_START,
+};
+
+static RadioConfig config() {
+    RadioConfig cfg = radio_config_defaults();
+    cfg.network_address = 0x2001;
+    return cfg;
+}
+
+static bool same(const RadioConfig* a, const RadioConfig& b) {
+    return a && radio_config_hash(*a) == radio_config_hash(b);
+}
+
+// configure with cache already holding what the module has, returning the
+// commands that needed sending
+static std::vector<uint8_t> reconfigure(const RadioConfig& cfg, RadioConfigCache* cache) {
+    SimRadio radio;
+    EmbCommander emb(radio);
+    CHECK(radio_configure(emb, radio, cfg, cache));
+    CHECK(same(cache->get(), cfg));
+    return radio.commands();
+}
+
+static void test_cold() {
+    SimRadio radio;
+    EmbCommander emb(radio);
+    CHECK(radio_configure(emb, radio, config()));
+    CHECK(radio.commands() == COLD);
+    CHECK_EQ(radio.address(), 0x2001);
+
+    RadioConfigCache cache;
+    cache.forget();
+    CHECK(cache.get() == nullptr);
+    CHECK(reconfigure(config(), &cache) == COLD);
+}
+
+static void test_warm() {
+    RadioConfigCache cache;
+    cache.put(config());
+    // nothing changed, just checking the module's there
+    CHECK(reconfigure(config(), &cache) == std::vector<uint8_t>({ EMB_CMD_DEVICE_INFO }));
+
+    // power and energy saving don't need the network stopped
+    RadioConfig cfg = config();
+    cfg.output_power = 14;
+    CHECK(reconfigure(cfg, &cache) == std::vector<uint8_t>({ EMB_CMD_DEVICE_INFO, EMB_CMD_OUTPUT_POWER }));
+    cfg.energy_save = RADIO_ENERGY_SAVE_ALWAYS_ON;
+    CHECK(reconfigure(cfg, &cache) == std::vector<uint8_t>({ EMB_CMD_DEVICE_INFO, EMB_CMD_ENERGY_SAVE }));
+
+    // the rest do
+    cfg.sf = RADIO_SF_9;
+    CHECK(reconfigure(cfg, &cache) == std::vector<uint8_t>({
+        EMB_CMD_DEVICE_INFO, EMB_CMD_NETWORK_STOP, EMB_CMD_OPERATING_CHANNEL, EMB_CMD_NETWORK_START }));
+    cfg.network_address = 0x2002;
+    cfg.network_id[1] = 0x02;
+    CHECK(reconfigure(cfg, &cache) == std::vector<uint8_t>({
+        EMB_CMD_DEVICE_INFO, EMB_CMD_NETWORK_STOP, EMB_CMD_NETWORK_ADDRESS, EMB_CMD_NETWORK_ID, EMB_CMD_NETWORK_START }));
+    cfg.cca = true;
+    cfg.output_power = 8;
+    CHECK(reconfigure(cfg, &cache) == std::vector<uint8_t>({
+        EMB_CMD_DEVICE_INFO, EMB_CMD_NETWORK_STOP, EMB_CMD_NETWORK_PREFERENCES, EMB_CMD_OUTPUT_POWER, EMB_CMD_NETWORK_START }));
+
+    // and what changes as the node runs keeps the cache in step
+    SimRadio radio;
+    EmbCommander emb(radio);
+    CHECK_EQ(radio_set_output_power(emb, radio, 4, &cache), EMB_OK);
+    CHECK_EQ(radio_set_energy_save(emb, radio, RADIO_ENERGY_SAVE_TX_ONLY, &cache), EMB_OK);
+    cfg.output_power = 4;
+    cfg.energy_save = RADIO_ENERGY_SAVE_TX_ONLY;
+    CHECK(same(cache.get(), cfg));
+    CHECK(reconfigure(cfg, &cache) == std::vector<uint8_t>({ EMB_CMD_DEVICE_INFO }));
+}
+
+static void test_bad_cache() {
+    // a power cut leaves garbage
+    RadioConfigCache cache;
+    memset(&cache, 0xA5, sizeof(cache));
+    CHECK(cache.get() == nullptr);
+    CHECK(reconfigure(config(), &cache) == COLD);
+
+    // or the settings not matching their hash, the first of them is
+    // straight after the magic and hash
+    cache.put(config());
+    reinterpret_cast<uint8_t*>(&cache)[8] ^= 0x01;
+    CHECK(cache.get() == nullptr);
+    CHECK(reconfigure(config(), &cache) == COLD);
+}
+
+static void test_no_device_info() {
+    RadioConfigCache cache;
+    cache.put(config());
+    // the module not answering might mean it was reset, so it all goes
+    // again, and while the rest went through the query still failed so the
+    // cache isn't trusted next time either
+    SimRadio radio;
+    EmbCommander emb(radio);
+    radio.set_ignore(EMB_CMD_DEVICE_INFO);
+    CHECK(!radio_configure(emb, radio, config(), &cache));
+    CHECK(radio.commands() == COLD);
+    CHECK(cache.get() == nullptr);
+
+    // same for a step being turned down
+    cache.put(config());
+    RadioConfig cfg = config();
+    cfg.channel = 3;
+    SimRadio refusing;
+    EmbCommander refused(refusing);
+    refusing.set_ack_status(1);
+    CHECK(!radio_configure(refused, refusing, cfg, &cache));
+    CHECK(cache.get() == nullptr);
+    CHECK(reconfigure(cfg, &cache) == COLD);
+}
+
+int main() {
+    test_cold();
+    test_warm();
+    test_bad_cache();
+    test_no_device_info();
+    return check_done("radio_config");
+}
@@ -0,0 +1,213 @@
+/**
+ * Relaying: the dedupe cache forgets packets after its window and the least
+ * recently seen when it's full, a relayed record or batch decodes as the
+ * sender's with a hop more and its ages moved on, and what can't be relayed
+ * says why.
+ */
+#include <cstring>
+#include <vector>
+#include "check.h"
+#include "batch.h"
+#include "packet.h"
+#include "relay.h"
+#include "sim_hal.h"
+
+static const uint16_t SENDER = 0x2001;
+static const uint16_t RELAY = 0x12F0;
+
+static struct rxdata packet(uint16_t src, uint16_t seq) {
+    struct rxdata rxd = {};
+    rxd.src = src;
+    rxd.meta.seq = seq;
+    rxd.meta.present = 1u << PACKET_SEQ;
+    return rxd;
+}
+
+static struct sensor_record reading(int i) {
+    struct sensor_record rec = {};
+    rec.charge_state = 1;
+    rec.mcu_temp = 20.0f + i * 0.25f;
+    rec.vbat = 4.1f - i * 0.003f;
+    rec.vin = 5.0f;
+    rec.present = SENSOR_ALL_FIELDS;
+    return rec;
+}
+
+// the frame a receiver or relay would get for txdata buf of len bytes
+static std::vector<uint8_t> heard(uint16_t src, const uint8_t* buf, size_t len) {
+    return sim_rx_data_frame(src, 0xFFFF, -90, buf + TXDATA_HEADER_SIZE, len - TXDATA_HEADER_SIZE);
+}
+
+static void test_dedupe_window() {
+    DedupeCache cache;
+    struct rxdata rxd = packet(SENDER, 7);
+    CHECK(!cache.seen(rxd, 1000));
+    CHECK(cache.seen(rxd, 1000 + DEDUPE_WINDOW_MS - 1));
+    // the window runs from when it was last seen
+    CHECK(cache.seen(rxd, 1000 + 2 * DEDUPE_WINDOW_MS - 2));
+    CHECK(!cache.seen(rxd, 1000 + 3 * DEDUPE_WINDOW_MS));
+    CHECK_EQ(cache.duplicates(), 2);
+
+    // another sender's or sequence number is another packet
+    CHECK(!cache.seen(packet(SENDER + 1, 7), 100000));
+    CHECK(!cache.seen(packet(SENDER, 8), 100000));
+
+    // and one without can't be told apart so is never a duplicate
+    struct rxdata no_seq = packet(SENDER, 7);
+    no_seq.meta.present = 0;
+    CHECK(!cache.seen(no_seq, 100000));
+    CHECK(!cache.seen(no_seq, 100000));
+    CHECK_EQ(cache.duplicates(), 2);
+
+    // across the clock wrapping
+    DedupeCache wrap;
+    CHECK(!wrap.seen(rxd, UINT32_MAX - 100));
+    CHECK(wrap.seen(rxd, 100));
+}
+
+static void test_dedupe_full() {
+    DedupeCache cache;
+    for (uint16_t i = 0; i < DEDUPE_ENTRIES; i++) {
+        CHECK(!cache.seen(packet(SENDER, i), 1000 + i));
+    }
+    // seeing the first again makes the second the least recently seen
+    CHECK(cache.seen(packet(SENDER, 0), 2000));
+    CHECK(!cache.seen(packet(SENDER, 1000), 2001));
+    CHECK(cache.seen(packet(SENDER, 0), 2002));
+    CHECK(cache.seen(packet(SENDER, 2), 2003));
+    CHECK(!cache.seen(packet(SENDER, 1), 2004));
+    CHECK(cache.seen(packet(SENDER, 1000), 2005));
+}
+
+static void test_relay_record() {
+    struct txdata txd = {};
+    txd.dest = 0xFFFF;
+    txd.readings = reading(3);
+    txd.meta.seq = 4321;
+    txd.meta.present = 1u << PACKET_SEQ;
+    uint8_t buf[TXDATA_MAX_SIZE];
+    size_t len = serialise_txdata(&txd, buf);
+    buf[TXDATA_FORMAT_OFFSET] |= PAYLOAD_FLAG_LISTENING;
+    std::vector<uint8_t> frame = heard(SENDER, buf, len);
+    struct rxdata rxd = {};
+    CHECK(deseralise_rxdata(frame.data(), frame.size(), &rxd));
+    CHECK(rxd.listening);
+
+    // relayed twice, each time decoding as the sender's
+    for (uint8_t hop = 1; hop <= 2; hop++) {
+        uint8_t out[TXDATA_MAX_SIZE];
+        RelayStatus status = RELAY_MALFORMED;
+        size_t out_len = relay_txdata(frame.data(), frame.size(), rxd, 2, 500, out, &status);
+        CHECK_EQ(status, RELAY_OK);
+        CHECK(out_len > 0 && out_len <= TXDATA_MAX_SIZE);
+        frame = heard(RELAY + hop, out, out_len);
+        rxd = {};
+        CHECK(deseralise_rxdata(frame.data(), frame.size(), &rxd));
+        CHECK_EQ(rxd.src, SENDER);
+        CHECK_EQ(rxd.via, RELAY + hop);
+        CHECK(rxdata_relayed(rxd));
+        CHECK_EQ(rxd.meta.hops, hop);
+        CHECK_EQ(rxd.meta.seq, 4321);
+        CHECK(!rxd.listening);
+        CHECK_EQ(rxd.format, PAYLOAD_FORMAT_RECORD);
+        CHECK_EQ(rxd.count, 1);
+        CHECK_NEAR(rxd.readings[0].mcu_temp, txd.readings.mcu_temp, 0.005);
+        CHECK_NEAR(rxd.readings[0].vbat, txd.readings.vbat, 0.0005);
+    }
+
+    // and no further
+    uint8_t out[TXDATA_MAX_SIZE];
+    RelayStatus status = RELAY_OK;
+    CHECK_EQ(relay_txdata(frame.data(), frame.size(), rxd, 2, 500, out, &status), 0);
+    CHECK_EQ(status, RELAY_HOP_LIMIT);
+    CHECK(relay_txdata(frame.data(), frame.size(), rxd, RELAY_MAX_HOPS, 500, out) > 0);
+    rxd.meta.hops = RELAY_MAX_HOPS;
+    CHECK_EQ(relay_txdata(frame.data(), frame.size(), rxd, 255, 500, out, &status), 0);
+    CHECK_EQ(status, RELAY_HOP_LIMIT);
+}
+
+static void test_relay_batch() {
+    SampleBatch batch;
+    for (int i = 0; i < 4; i++) {
+        CHECK(batch.add(reading(i), 10000 + i * 5000));
+    }
+    struct packet_meta meta = {};
+    meta.seq = 99;
+    meta.present = 1u << PACKET_SEQ;
+    uint8_t buf[TXDATA_MAX_SIZE];
+    size_t len = serialise_txbatch(0, 0xFFFF, batch, 30000, buf, &meta);
+    std::vector<uint8_t> frame = heard(SENDER, buf, len);
+    struct rxdata rxd = {};
+    CHECK(deseralise_rxdata(frame.data(), frame.size(), &rxd));
+
+    uint8_t out[TXDATA_MAX_SIZE];
+    RelayStatus status = RELAY_MALFORMED;
+    size_t out_len = relay_txdata(frame.data(), frame.size(), rxd, 2, 750, out, &status);
+    CHECK_EQ(status, RELAY_OK);
+    frame = heard(RELAY, out, out_len);
+    struct rxdata relayed = {};
+    CHECK(deseralise_rxdata(frame.data(), frame.size(), &relayed));
+    CHECK_EQ(relayed.src, SENDER);
+    CHECK_EQ(relayed.via, RELAY);
+    CHECK_EQ(relayed.meta.hops, 1);
+    CHECK_EQ(relayed.meta.seq, 99);
+    CHECK_EQ(relayed.format, PAYLOAD_FORMAT_BATCH);
+    CHECK_EQ(relayed.count, 4);
+    // every sample is as much older as the relay held on to it
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(relayed.age_ms[i], rxd.age_ms[i] + 750);
+        CHECK_NEAR(relayed.readings[i].mcu_temp, reading(i).mcu_temp, 0.005);
+    }
+}
+
+static void test_relay_refused() {
+    struct txdata txd = {};
+    txd.dest = 0xFFFF;
+    txd.readings = reading(0);
+    uint8_t buf[TXDATA_MAX_SIZE];
+    size_t len = serialise_txdata(&txd, buf);
+    std::vector<uint8_t> frame = heard(SENDER, buf, len);
+    struct rxdata rxd = {};
+    CHECK(deseralise_rxdata(frame.data(), frame.size(), &rxd));
+    uint8_t out[TXDATA_MAX_SIZE];
+    RelayStatus status = RELAY_OK;
+
+    // a field that doesn't make sense
+    std::vector<uint8_t> bad = frame;
+    bad[RXDATA_HEADER_SIZE + 1] |= 0x07;
+    CHECK_EQ(relay_txdata(bad.data(), bad.size(), rxd, 2, 0, out, &status), 0);
+    CHECK_EQ(status, RELAY_MALFORMED);
+    status = RELAY_OK;
+    CHECK_EQ(relay_txdata(frame.data(), RXDATA_HEADER_SIZE + 1, rxd, 2, 0, out, &status), 0);
+    CHECK_EQ(status, RELAY_MALFORMED);
+
+    // not an uplink
+    struct rxdata link = rxd;
+    link.format = PAYLOAD_FORMAT_LINK;
+    CHECK_EQ(relay_txdata(frame.data(), frame.size(), link, 2, 0, out, &status), 0);
+    CHECK_EQ(status, RELAY_NOT_UPLINK);
+
+    // a payload, from some newer sender with a field we don't know, that
+    // fills the frame so there's no room left for the relay fields
+    uint8_t* end = buf + len;
+    size_t pad = TXDATA_MAX_SIZE - len - 3;
+    *end++ = 20 << 3 | WIRE_BYTES;
+    end = varint_put(end, pad);
+    memset(end, 0x55, pad);
+    len = TXDATA_MAX_SIZE;
+    frame = heard(SENDER, buf, len);
+    rxd = {};
+    CHECK(deseralise_rxdata(frame.data(), frame.size(), &rxd));
+    status = RELAY_OK;
+    CHECK_EQ(relay_txdata(frame.data(), frame.size(), rxd, 2, 0, out, &status), 0);
+    CHECK_EQ(status, RELAY_TOO_BIG);
+}
+
+int main() {
+    test_dedupe_window();
+    test_dedupe_full();
+    test_relay_record();
+    test_relay_batch();
+    test_relay_refused();
+    return check_done("relay");
+}
@@ -0,0 +1,205 @@
+/**
+ * Change-driven reporting: a field goes when it has moved past its deadband
+ * from what was last sent, crossing a threshold or turning up for the first
+ * time is urgent, the heartbeat sends the lot, a change that didn't get sent
+ * is still a change, and the receiver fills in what wasn't sent from what it
+ * last heard.
+ */
+#include "check.h"
+#include "report.h"
+
+static const uint32_t HEARTBEAT = 60000;
+static const uint16_t NODE = 0x2001;
+
+static const uint32_t TEMP = 1u << SENSOR_MCU_TEMP;
+static const uint32_t VBAT = 1u << SENSOR_VBAT;
+static const uint32_t VIN = 1u << SENSOR_VIN;
+
+static struct sensor_record reading(float temp, float vbat) {
+    struct sensor_record rec = {};
+    rec.charge_state = 1;
+    rec.mcu_temp = temp;
+    rec.vbat = vbat;
+    rec.vin = 5.0f;
+    rec.present = SENSOR_ALL_FIELDS;
+    return rec;
+}
+
+// the first sample, sent in full at time 0
+static ReportPolicy started(const struct sensor_record& rec) {
+    ReportPolicy policy(HEARTBEAT);
+    ReportDecision first = policy.check(rec, 0);
+    CHECK_EQ(first.mask, rec.present);
+    CHECK(!first.urgent);
+    policy.sent(rec, first.mask, 0);
+    return policy;
+}
+
+static void test_deadband() {
+    ReportPolicy policy = started(reading(20.0f, 4.0f));
+    CHECK_EQ(policy.check(reading(20.0f, 4.0f), 1000).mask, 0);
+    // it's from what was last sent, so creeping up doesn't get past it...
+    CHECK_EQ(policy.check(reading(20.6f, 4.0f), 2000).mask, 0);
+    CHECK_EQ(policy.check(reading(20.9f, 4.0f), 3000).mask, 0);
+    CHECK_EQ(policy.check(reading(19.1f, 3.96f), 3000).mask, 0);
+    // ...until it has moved far enough altogether, either way
+    ReportDecision d = policy.check(reading(21.0f, 4.0f), 4000);
+    CHECK_EQ(d.mask, TEMP);
+    CHECK(!d.urgent);
+    CHECK_EQ(policy.check(reading(19.0f, 3.95f), 4000).mask, TEMP | VBAT);
+    policy.sent(reading(21.0f, 4.0f), TEMP, 4000);
+    CHECK_EQ(policy.check(reading(21.5f, 4.0f), 5000).mask, 0);
+    CHECK_EQ(policy.check(reading(20.0f, 4.0f), 5000).mask, TEMP);
+
+    // the charger's state is urgent on any change
+    struct sensor_record charging = reading(21.0f, 4.0f);
+    charging.charge_state = 2;
+    d = policy.check(charging, 6000);
+    CHECK_EQ(d.mask, 1u << SENSOR_CHARGE_STATE);
+    CHECK(d.urgent);
+}
+
+static void test_threshold() {
+    ReportPolicy policy = started(reading(20.0f, 3.43f));
+    // inside the deadband but dropping below 3.4V
+    ReportDecision d = policy.check(reading(20.0f, 3.39f), 1000);
+    CHECK_EQ(d.mask, VBAT);
+    CHECK(d.urgent);
+    policy.sent(reading(20.0f, 3.39f), d.mask, 1000);
+    // staying below isn't
+    d = policy.check(reading(20.0f, 3.30f), 2000);
+    CHECK_EQ(d.mask, VBAT);
+    CHECK(!d.urgent);
+    CHECK_EQ(policy.check(reading(20.0f, 3.36f), 2000).mask, 0);
+    // and coming back up is
+    d = policy.check(reading(20.0f, 3.41f), 3000);
+    CHECK_EQ(d.mask, VBAT);
+    CHECK(d.urgent);
+
+    // the supply going away, with the temperature moving too
+    struct sensor_record unplugged = reading(22.0f, 3.39f);
+    unplugged.vin = 0.2f;
+    d = policy.check(unplugged, 4000);
+    CHECK_EQ(d.mask, TEMP | VIN);
+    CHECK(d.urgent);
+}
+
+static void test_heartbeat() {
+    ReportPolicy policy = started(reading(20.0f, 4.0f));
+    CHECK_EQ(policy.check(reading(20.0f, 4.0f), HEARTBEAT - 1).mask, 0);
+    ReportDecision d = policy.check(reading(20.0f, 4.0f), HEARTBEAT);
+    CHECK_EQ(d.mask, SENSOR_ALL_FIELDS);
+    CHECK(!d.urgent);
+
+    // sending some of it doesn't put off the heartbeat...
+    policy.sent(reading(21.0f, 4.0f), TEMP, HEARTBEAT - 10);
+    CHECK_EQ(policy.check(reading(21.0f, 4.0f), HEARTBEAT).mask, SENSOR_ALL_FIELDS);
+    // ...all of it does
+    policy.sent(reading(21.0f, 4.0f), SENSOR_ALL_FIELDS, HEARTBEAT);
+    CHECK_EQ(policy.check(reading(21.0f, 4.0f), 2 * HEARTBEAT - 1).mask, 0);
+    CHECK_EQ(policy.check(reading(21.0f, 4.0f), 2 * HEARTBEAT).mask, SENSOR_ALL_FIELDS);
+
+    // across the clock wrapping
+    ReportPolicy wrap(HEARTBEAT);
+    wrap.sent(reading(20.0f, 4.0f), SENSOR_ALL_FIELDS, UINT32_MAX - 1000);
+    CHECK_EQ(wrap.check(reading(20.0f, 4.0f), HEARTBEAT - 2000).mask, 0);
+    CHECK_EQ(wrap.check(reading(20.0f, 4.0f), HEARTBEAT).mask, SENSOR_ALL_FIELDS);
+}
+
+static void test_new_field() {
+    struct sensor_record rec = reading(20.0f, 4.0f);
+    rec.present &= ~VIN;
+    ReportPolicy policy = started(rec);
+    CHECK_EQ(policy.check(rec, 1000).mask, 0);
+    // the supply sensor turning up
+    rec.present |= VIN;
+    ReportDecision d = policy.check(rec, 2000);
+    CHECK_EQ(d.mask, VIN);
+    CHECK(d.urgent);
+    policy.sent(rec, d.mask, 2000);
+    CHECK_EQ(policy.check(rec, 3000).mask, 0);
+
+    // and one that goes missing isn't sent, or forgotten
+    rec.present &= ~TEMP;
+    CHECK_EQ(policy.check(rec, 4000).mask, 0);
+    rec.present |= TEMP;
+    CHECK_EQ(policy.check(rec, 5000).mask, 0);
+}
+
+static void test_not_sent() {
+    ReportPolicy policy = started(reading(20.0f, 4.0f));
+    ReportDecision d = policy.check(reading(21.0f, 4.0f), 1000);
+    CHECK_EQ(d.mask, TEMP);
+    // it didn't go, so sent() isn't called and it's still a change
+    d = policy.check(reading(21.0f, 4.0f), 2000);
+    CHECK_EQ(d.mask, TEMP);
+    policy.sent(reading(21.0f, 4.0f), d.mask, 2000);
+    CHECK_EQ(policy.check(reading(21.0f, 4.0f), 3000).mask, 0);
+
+    // an urgent one stays urgent too
+    d = policy.check(reading(21.0f, 3.3f), 4000);
+    CHECK(d.urgent);
+    CHECK(policy.check(reading(21.0f, 3.3f), 5000).urgent);
+
+    // and until anything has been sent it's all of it every time
+    ReportPolicy fresh(HEARTBEAT);
+    CHECK_EQ(fresh.check(reading(20.0f, 4.0f), 0).mask, SENSOR_ALL_FIELDS);
+    CHECK_EQ(fresh.check(reading(20.0f, 4.0f), 1000).mask, SENSOR_ALL_FIELDS);
+
+    CHECK_EQ(policy.skipped(), 0);
+    policy.skip();
+    CHECK_EQ(policy.skipped(), 1);
+}
+
+static void test_last_known() {
+    LastKnownValues last;
+    // nothing to go on for the first
+    struct sensor_record rec = reading(20.0f, 4.0f);
+    CHECK_EQ(last.fill(NODE, rec), 0);
+    CHECK_EQ(rec.present, SENSOR_ALL_FIELDS);
+
+    struct sensor_record partial = {};
+    partial.mcu_temp = 21.0f;
+    partial.present = TEMP;
+    CHECK_EQ(last.fill(NODE, partial), SENSOR_ALL_FIELDS & ~TEMP);
+    CHECK_EQ(partial.present, SENSOR_ALL_FIELDS);
+    CHECK_NEAR(partial.mcu_temp, 21.0f, 0.005);
+    CHECK_NEAR(partial.vbat, 4.0f, 0.0005);
+    CHECK_NEAR(partial.vin, 5.0f, 0.0005);
+    CHECK_EQ(partial.charge_state, 1);
+
+    // another node's are its own
+    struct sensor_record other = {};
+    other.vbat = 3.7f;
+    other.present = VBAT;
+    CHECK_EQ(last.fill(NODE + 1, other), 0);
+    CHECK_EQ(other.present, VBAT);
+    CHECK_EQ(last.nodes(), 2);
+
+    // a batch fills in oldest first, each from the one before
+    struct rxdata rxd = {};
+    rxd.src = NODE;
+    rxd.count = 3;
+    rxd.readings[0].vbat = 3.9f;
+    rxd.readings[0].present = VBAT;
+    rxd.readings[1].mcu_temp = 22.0f;
+    rxd.readings[1].present = TEMP;
+    rxd.readings[2] = reading(23.0f, 3.8f);
+    last.fill(rxd);
+    CHECK_EQ(rxd.carried[0], SENSOR_ALL_FIELDS & ~VBAT);
+    CHECK_NEAR(rxd.readings[0].mcu_temp, 21.0f, 0.005);
+    CHECK_EQ(rxd.carried[1], SENSOR_ALL_FIELDS & ~TEMP);
+    CHECK_NEAR(rxd.readings[1].vbat, 3.9f, 0.0005);
+    CHECK_EQ(rxd.carried[2], 0);
+    CHECK_NEAR(rxd.readings[2].vbat, 3.8f, 0.0005);
+}
+
+int main() {
+    test_deadband();
+    test_threshold();
+    test_heartbeat();
+    test_new_field();
+    test_not_sent();
+    test_last_known();
+    return check_done("report");
+}
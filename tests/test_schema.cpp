@@ -0,0 +1,183 @@
+/**
+ * The schema-driven payload encoding: varints, fields round trip at their
+ * scales, unknown tags skipped, and malformed or truncated input refused
+ * rather than read past.
+ */
+#include <cstring>
+#include <vector>
+#include "check.h"
+#include "packet.h"
+#include "schema.h"
+#include "sim_hal.h"
+
+static void test_varint_round_trip() {
+    const uint64_t values[] = { 0, 1, 127, 128, 300, 16383, 16384, 0xFFFFFFFFull, UINT64_MAX };
+    for (uint64_t v : values) {
+        uint8_t buf[16];
+        uint8_t* end = varint_put(buf, v);
+        uint64_t out = 1;
+        CHECK(varint_get(buf, end, &out) == end);
+        CHECK(out == v);
+    }
+    uint8_t buf[16];
+    CHECK_EQ(varint_put(buf, 127) - buf, 1);
+    CHECK_EQ(varint_put(buf, 128) - buf, 2);
+    CHECK_EQ(varint_put(buf, UINT64_MAX) - buf, 10);
+}
+
+static void test_zigzag() {
+    const int64_t values[] = { 0, -1, 1, -64, 63, INT32_MIN, INT64_MIN, INT64_MAX };
+    for (int64_t v : values) {
+        CHECK(zigzag_decode(zigzag_encode(v)) == v);
+    }
+    // small either way stays small
+    CHECK_EQ(zigzag_encode(-1), 1);
+    CHECK_EQ(zigzag_encode(1), 2);
+}
+
+static void test_varint_malformed() {
+    uint64_t val;
+    // runs off the end
+    const uint8_t cut[] = { 0x80, 0x80 };
+    CHECK(varint_get(cut, cut + sizeof(cut), &val) == nullptr);
+    CHECK(varint_get(cut, cut, &val) == nullptr);
+    // more continuation bytes than a 64 bit value has
+    uint8_t overlong[11];
+    memset(overlong, 0x80, sizeof(overlong));
+    overlong[10] = 0x01;
+    CHECK(varint_get(overlong, overlong + sizeof(overlong), &val) == nullptr);
+}
+
+static void test_record_round_trip() {
+    struct sensor_record rec = {};
+    rec.charge_state = 3;
+    rec.mcu_temp = -12.34f;
+    rec.vbat = 4.199f;
+    rec.vin = 0.0f;
+    uint8_t buf[SENSOR_FIELD_COUNT * SCHEMA_MAX_FIELD_SIZE];
+    size_t len = schema_encode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, &rec, SENSOR_ALL_FIELDS, buf);
+    // a key and a byte or two each, far smaller than the structs
+    CHECK(len <= 2 + 3 + 3 + 2);
+
+    struct sensor_record out = {};
+    uint32_t present = 0;
+    CHECK(schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, buf, len, &out, &present));
+    CHECK_EQ(present, SENSOR_ALL_FIELDS);
+    CHECK_EQ(out.charge_state, 3);
+    CHECK_NEAR(out.mcu_temp, -12.34, 0.005);
+    CHECK_NEAR(out.vbat, 4.199, 0.0005);
+    CHECK_EQ(out.vin, 0);
+}
+
+static void test_partial_mask() {
+    struct sensor_record rec = {};
+    rec.vbat = 3.7f;
+    rec.vin = 5.0f;
+    uint8_t buf[SENSOR_FIELD_COUNT * SCHEMA_MAX_FIELD_SIZE];
+    size_t len = schema_encode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, &rec, 1u << SENSOR_VBAT, buf);
+
+    struct sensor_record out = {};
+    out.vin = 1.25f; // left alone as it isn't in the data
+    uint32_t present = 0;
+    CHECK(schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, buf, len, &out, &present));
+    CHECK_EQ(present, 1u << SENSOR_VBAT);
+    CHECK_NEAR(out.vbat, 3.7, 0.0005);
+    CHECK_EQ(out.vin, 1.25);
+}
+
+static void test_unknown_tags_skipped() {
+    // a newer sender's fields, of every wire type we can skip, around one
+    // we know
+    std::vector<uint8_t> buf;
+    buf.push_back(20 << 3 | WIRE_VARINT);
+    buf.push_back(0x96);
+    buf.push_back(0x01);
+    buf.push_back(21 << 3 | WIRE_FIXED32);
+    buf.insert(buf.end(), { 1, 2, 3, 4 });
+    buf.push_back(1 << 3 | WIRE_VARINT);
+    buf.push_back(zigzag_encode(2));
+    buf.push_back(22 << 3 | WIRE_BYTES);
+    buf.push_back(3);
+    buf.insert(buf.end(), { 9, 9, 9 });
+
+    struct sensor_record out = {};
+    uint32_t present = 0;
+    CHECK(schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, buf.data(), buf.size(), &out, &present));
+    CHECK_EQ(present, 1u << SENSOR_CHARGE_STATE);
+    CHECK_EQ(out.charge_state, 2);
+}
+
+static void test_malformed_refused() {
+    struct sensor_record out = {};
+    uint32_t present = 0;
+    // a wire type that can't be skipped
+    const uint8_t bad_wire[] = { 1 << 3 | 5, 0 };
+    CHECK(!schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, bad_wire, sizeof(bad_wire), &out, &present));
+    // bytes longer than what's left
+    const uint8_t bad_bytes[] = { 22 << 3 | WIRE_BYTES, 5, 1, 2 };
+    CHECK(!schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, bad_bytes, sizeof(bad_bytes), &out, &present));
+    const uint8_t bad_fixed[] = { 21 << 3 | WIRE_FIXED32, 1, 2, 3 };
+    CHECK(!schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, bad_fixed, sizeof(bad_fixed), &out, &present));
+
+    // every truncation of a good payload is refused, or decodes only what's
+    // whole
+    struct sensor_record rec = {};
+    rec.mcu_temp = 300.0f;
+    rec.vbat = 4.0f;
+    uint8_t buf[SENSOR_FIELD_COUNT * SCHEMA_MAX_FIELD_SIZE];
+    uint32_t mask = (1u << SENSOR_MCU_TEMP) | (1u << SENSOR_VBAT);
+    size_t len = schema_encode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, &rec, mask, buf);
+    for (size_t cut = 1; cut < len; cut++) {
+        present = 0;
+        out = {};
+        if (schema_decode(SENSOR_FIELDS, SENSOR_FIELD_COUNT, buf, cut, &out, &present)) {
+            CHECK(present != mask);
+        }
+    }
+}
+
+static void test_packet_round_trip() {
+    // with the sequence number and relay fields, through a received frame
+    struct txdata txd = {};
+    txd.dest = 0xFFFF;
+    txd.readings.vbat = 3.3f;
+    txd.readings.present = 1u << SENSOR_VBAT;
+    txd.meta.seq = 0xFFFF;
+    txd.meta.origin = 0x2001;
+    txd.meta.hops = 2;
+    txd.meta.present = PACKET_ALL_FIELDS;
+    uint8_t buf[TXDATA_MAX_SIZE];
+    size_t len = serialise_txdata(&txd, buf);
+    std::vector<uint8_t> frame = sim_rx_data_frame(0x12F0, 0xFFFF, -101, buf + 4, len - 4);
+
+    struct rxdata rxd = {};
+    CHECK(deseralise_rxdata(frame.data(), frame.size(), &rxd));
+    CHECK_EQ(rxd.format, PAYLOAD_FORMAT_RECORD);
+    CHECK_EQ(rxd.count, 1);
+    CHECK_EQ(rxd.readings[0].present, 1u << SENSOR_VBAT);
+    CHECK_NEAR(rxd.readings[0].vbat, 3.3, 0.0005);
+    CHECK_EQ(rxd.meta.present, PACKET_ALL_FIELDS);
+    CHECK_EQ(rxd.meta.seq, 0xFFFF);
+    CHECK_EQ(rxd.src, 0x2001);
+    CHECK_EQ(rxd.via, 0x12F0);
+    CHECK_EQ(rxd.meta.hops, 2);
+    CHECK_EQ(rxd.rssi, -101);
+
+    // cut short anywhere it's refused, the frame's length no longer adds up
+    for (size_t cut = 0; cut < frame.size(); cut++) {
+        rxd = {};
+        CHECK(!deseralise_rxdata(frame.data(), cut, &rxd));
+    }
+}
+
+int main() {
+    test_varint_round_trip();
+    test_zigzag();
+    test_varint_malformed();
+    test_record_round_trip();
+    test_partial_mask();
+    test_unknown_tags_skipped();
+    test_malformed_refused();
+    test_packet_round_trip();
+    return check_done("schema");
+}
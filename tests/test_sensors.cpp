@@ -0,0 +1,189 @@
+/**
+ * Sensor sampling: VSEN goes on first, each powered sensor is started once
+ * it has warmed up and read once its conversion is done, earliest first so
+ * they overlap, the ones off VSEN are read while the rest warm up, and VSEN
+ * goes off as soon as the last powered sensor has been read.
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "sensors.h"
+#include "sim_hal.h"
+
+struct Event {
+    std::string what;
+    uint64_t at_us; // since the sample started
+    bool rail;
+};
+
+static std::vector<Event> events;
+static uint64_t start_us;
+static bool rail_on;
+
+static void happened(const std::string& what) {
+    events.push_back({ what, hal_time_us() - start_us, rail_on });
+}
+
+class RecordingPower : public SimSensorPower {
+public:
+    void set(bool on_now) override {
+        rail_on = on_now;
+        happened(on_now ? "on" : "off");
+        SimSensorPower::set(on_now);
+    }
+};
+
+// a DS18B20, slow to warm up and slower to convert
+static uint32_t slow_start(SensorBus&) {
+    happened("slow start");
+    return 750000;
+}
+static bool slow_read(SensorBus&, struct sensor_record& rec) {
+    happened("slow read");
+    rec.charge_state = 1;
+    return true;
+}
+static const SensorDriver SLOW = {
+    "slow", 1u << SENSOR_CHARGE_STATE, true, 10000, slow_start, slow_read,
+};
+
+// an SHT3x
+static bool quick_fails = false;
+static uint32_t quick_start(SensorBus&) {
+    happened("quick start");
+    return 15000;
+}
+static bool quick_read(SensorBus&, struct sensor_record& rec) {
+    happened("quick read");
+    rec.vin = 5.0f;
+    return !quick_fails;
+}
+static const SensorDriver QUICK = {
+    "quick", 1u << SENSOR_VIN, true, 2000, quick_start, quick_read,
+};
+
+// something on the board, not on VSEN, read in one go
+static bool board_read(SensorBus&, struct sensor_record& rec) {
+    happened("board read");
+    rec.mcu_temp = 20.0f;
+    return true;
+}
+static const SensorDriver BOARD = {
+    "board", 1u << SENSOR_MCU_TEMP, false, 0, nullptr, board_read,
+};
+
+static void begin() {
+    events.clear();
+    rail_on = false;
+    start_us = hal_time_us();
+}
+
+static bool same(const std::vector<Event>& got, const std::vector<Event>& want) {
+    bool ok = CHECK_EQ(got.size(), want.size());
+    for (size_t i = 0; ok && i < want.size(); i++) {
+        ok &= CHECK(got[i].what == want[i].what);
+        ok &= CHECK_EQ(got[i].at_us, want[i].at_us);
+        ok &= CHECK_EQ(got[i].rail, want[i].rail);
+    }
+    if (!ok) {
+        for (const Event& e : got) {
+            printf("  %8llu %s%s\n", (unsigned long long)e.at_us, e.what.c_str(), e.rail ? " (VSEN on)" : "");
+        }
+    }
+    return ok;
+}
+
+static void test_order() {
+    SimAdc adc;
+    SensorBus bus = { adc, nullptr };
+    RecordingPower power;
+    // in no particular order in the table
+    static const SensorDriver* const drivers[] = { &SLOW, &QUICK, &BOARD };
+    SensorSampler sampler(drivers, bus, &power);
+
+    begin();
+    struct sensor_record rec = {};
+    CHECK_EQ(sampler.sample(rec), (1u << SENSOR_CHARGE_STATE) | (1u << SENSOR_VIN) | (1u << SENSOR_MCU_TEMP));
+    CHECK_EQ(rec.present, (1u << SENSOR_CHARGE_STATE) | (1u << SENSOR_VIN) | (1u << SENSOR_MCU_TEMP));
+    same(events, {
+        { "on", 0, true },
+        { "board read", 0, true },
+        { "quick start", 2000, true },
+        { "slow start", 10000, true },
+        { "quick read", 2000 + 15000, true },
+        { "slow read", 10000 + 750000, true },
+        { "off", 10000 + 750000, false },
+    });
+    CHECK_EQ(sampler.rail_on_us(), 760000);
+    CHECK_EQ(power.switched_on, 1);
+    CHECK_EQ(power.on_us, 760000);
+    CHECK_EQ(hal_time_us() - start_us, 760000);
+    CHECK_EQ(sampler.failures(), 0);
+
+    // a reading failing isn't present, and the rest carry on as before
+    quick_fails = true;
+    begin();
+    rec = {};
+    CHECK_EQ(sampler.sample(rec), (1u << SENSOR_CHARGE_STATE) | (1u << SENSOR_MCU_TEMP));
+    CHECK_EQ(rec.present, (1u << SENSOR_CHARGE_STATE) | (1u << SENSOR_MCU_TEMP));
+    CHECK(events.back().what == "off");
+    CHECK_EQ(events.back().at_us, 760000);
+    CHECK_EQ(sampler.failures(), 1);
+    CHECK_EQ(power.switched_on, 2);
+    quick_fails = false;
+}
+
+static void test_rail_early_off() {
+    // VSEN goes off with the last powered sensor, not the last sensor
+    SimAdc adc;
+    SensorBus bus = { adc, nullptr };
+    RecordingPower power;
+    static const SensorDriver* const drivers[] = { &QUICK, &BOARD };
+    SensorSampler sampler(drivers, bus, &power);
+    begin();
+    struct sensor_record rec = {};
+    sampler.sample(rec);
+    same(events, {
+        { "on", 0, true },
+        { "board read", 0, true },
+        { "quick start", 2000, true },
+        { "quick read", 17000, true },
+        { "off", 17000, false },
+    });
+    CHECK_EQ(sampler.rail_on_us(), 17000);
+}
+
+static void test_unpowered() {
+    // nothing needs VSEN, so it never goes on
+    SimAdc adc;
+    SensorBus bus = { adc, nullptr };
+    RecordingPower power;
+    static const SensorDriver* const drivers[] = { &BOARD };
+    SensorSampler sampler(drivers, bus, &power);
+    begin();
+    struct sensor_record rec = {};
+    CHECK_EQ(sampler.sample(rec), 1u << SENSOR_MCU_TEMP);
+    same(events, { { "board read", 0, false } });
+    CHECK_EQ(power.switched_on, 0);
+    CHECK_EQ(sampler.rail_on_us(), 0);
+
+    // nor with no supply to switch, the timing is the same
+    static const SensorDriver* const powered[] = { &SLOW, &BOARD };
+    SensorSampler unswitched(powered, bus, nullptr);
+    begin();
+    rec = {};
+    unswitched.sample(rec);
+    same(events, {
+        { "board read", 0, false },
+        { "slow start", 10000, false },
+        { "slow read", 760000, false },
+    });
+}
+
+int main() {
+    test_order();
+    test_rail_early_off();
+    test_unpowered();
+    return check_done("sensors");
+}
@@ -0,0 +1,206 @@
+/**
+ * TDMA: beacons round trip, and a sender whose clock runs fast or slow
+ * against the receiver's works out by how much, listens when the beacons
+ * come and sends inside its own slot, through the frame number wrapping and
+ * the beacons stopping for a while.
+ */
+#include <vector>
+#include "check.h"
+#include "frame.h"
+#include "sim_hal.h"
+#include "tdma.h"
+
+static void test_beacon_round_trip() {
+    struct TdmaBeacon beacon = tdma_beacon(65535, 5000, 16);
+    CHECK_EQ(beacon.slot_ms, 5000 / 17);
+    uint8_t buf[TDMA_BEACON_SIZE];
+    CHECK_EQ(serialise_beacon(&beacon, buf), TDMA_BEACON_SIZE);
+    std::vector<uint8_t> frame = sim_rx_data_frame(0x1230, 0xFFFF, -80, buf + 4, TDMA_BEACON_SIZE - 4);
+
+    struct TdmaBeacon out = {};
+    CHECK(deserialise_beacon(frame.data(), frame.size(), &out));
+    CHECK_EQ(out.seq, 65535);
+    CHECK_EQ(out.frame_ms, 5000);
+    CHECK_EQ(out.slot_ms, beacon.slot_ms);
+    CHECK_EQ(out.slots, 16);
+
+    // cut short, damaged or not a beacon
+    CHECK(!deserialise_beacon(frame.data(), frame.size() - 1, &out));
+    std::vector<uint8_t> bad = frame;
+    bad[RXDATA_HEADER_SIZE + 2] ^= 1;
+    CHECK(!deserialise_beacon(bad.data(), bad.size(), &out));
+    buf[TXDATA_FORMAT_OFFSET] = PAYLOAD_FORMAT_RECORD;
+    bad = sim_rx_data_frame(0x1230, 0xFFFF, -80, buf + 4, TDMA_BEACON_SIZE - 4);
+    CHECK(!deserialise_beacon(bad.data(), bad.size(), &out));
+
+    // or a schedule that doesn't fit in the frame
+    beacon.slot_ms = 1000;
+    serialise_beacon(&beacon, buf);
+    bad = sim_rx_data_frame(0x1230, 0xFFFF, -80, buf + 4, TDMA_BEACON_SIZE - 4);
+    CHECK(!deserialise_beacon(bad.data(), bad.size(), &out));
+    beacon = tdma_beacon(1, 5000, 16);
+    beacon.slots = 0;
+    serialise_beacon(&beacon, buf);
+    bad = sim_rx_data_frame(0x1230, 0xFFFF, -80, buf + 4, TDMA_BEACON_SIZE - 4);
+    CHECK(!deserialise_beacon(bad.data(), bad.size(), &out));
+}
+
+static void test_slot_choice() {
+    TdmaSync by_address(0x1236, -1, 12, 5000, 0);
+    by_address.beacon(tdma_beacon(0, 5000, 16), 0);
+    CHECK_EQ(by_address.slot(), 0x1236 % 16);
+    TdmaSync fixed(0x1236, 3, 12, 5000, 0);
+    fixed.beacon(tdma_beacon(0, 5000, 16), 0);
+    CHECK_EQ(fixed.slot(), 3);
+    // a fixed slot past the end wraps
+    TdmaSync past(0x1236, 20, 12, 5000, 0);
+    past.beacon(tdma_beacon(0, 5000, 16), 0);
+    CHECK_EQ(past.slot(), 4);
+}
+
+/*
+ * A receiver beaconing every FRAME_MS from true time 0, and a sender whose
+ * clock runs drift_ppm fast, played out together. Beacons from frame
+ * stop_from up to resume_at don't go out.
+ */
+struct Scenario {
+    static const uint32_t FRAME_MS = 5000;
+    static const uint8_t SLOTS = 16;
+
+    int32_t drift_ppm;
+    uint16_t first_seq = 0;
+    uint32_t frames = 200;
+    uint32_t stop_from = UINT32_MAX;
+    uint32_t resume_at = UINT32_MAX;
+
+    // results
+    uint32_t heard = 0;
+    uint32_t sends = 0;
+    // of those sent in sync once two beacons have given it the drift, until
+    // then it can be out by the drift over the slot's offset
+    uint32_t sends_in_slot = 0;
+    uint32_t synced_sends = 0;
+    uint32_t lost_sync_at = UINT32_MAX;
+    uint64_t longest_gap_us = 0; // between sends, by the true clock
+    int32_t final_drift = 0;
+
+    uint64_t local_us(uint64_t true_us) const {
+        return true_us + (int64_t)true_us * drift_ppm / 1000000;
+    }
+    uint64_t true_us(uint64_t local) const {
+        return local * 1000000 / (1000000 + drift_ppm);
+    }
+
+    void run() {
+        // started up part way through a frame
+        const uint64_t start_us = 1700000;
+        TdmaSync sync(0x1236, -1, 12, FRAME_MS, local_us(start_us));
+        const uint64_t frame_us = FRAME_MS * 1000ull;
+        const uint64_t slot_us = (FRAME_MS / (SLOTS + 1)) * 1000ull;
+        uint64_t now = local_us(start_us);
+        uint64_t last_send = 0;
+        uint32_t heard_in_sync = 0;
+        for (uint32_t k = 1; k < frames;) {
+            uint64_t beacon_at = local_us(k * frame_us);
+            uint64_t send_at = sync.next_send_us(now);
+            if (send_at < beacon_at) {
+                // where in which frame it went out, as the receiver sees it
+                uint64_t t = true_us(send_at);
+                if (sends > 0 && t - last_send > longest_gap_us) {
+                    longest_gap_us = t - last_send;
+                }
+                last_send = t;
+                sends++;
+                if (sync.synced() && heard_in_sync >= 2) {
+                    synced_sends++;
+                    uint64_t in_frame = t % frame_us;
+                    uint64_t slot_start = (sync.slot() + 1) * slot_us;
+                    // a little early is fine, the guard covers it
+                    if (in_frame + 10000 >= slot_start && in_frame < slot_start + slot_us) {
+                        sends_in_slot++;
+                    }
+                }
+                sync.sending(send_at);
+                now = send_at + 1;
+                continue;
+            }
+            bool sent = k < stop_from || k >= resume_at;
+            while (sync.listen_until_us() < beacon_at) {
+                bool was_synced = sync.synced();
+                sync.missed();
+                if (was_synced && !sync.synced()) {
+                    heard_in_sync = 0;
+                    if (lost_sync_at == UINT32_MAX) {
+                        lost_sync_at = k;
+                    }
+                }
+            }
+            if (sent && sync.listen_at_us() <= beacon_at) {
+                sync.beacon(tdma_beacon(first_seq + k, FRAME_MS, SLOTS), beacon_at);
+                heard++;
+                heard_in_sync++;
+            }
+            now = beacon_at;
+            k++;
+        }
+        final_drift = sync.drift_ppm();
+    }
+};
+
+static void test_fast_clock() {
+    Scenario s;
+    s.drift_ppm = 20000;
+    s.run();
+    CHECK_NEAR(s.final_drift, 20000, 500);
+    CHECK(s.synced_sends > 150);
+    CHECK_EQ(s.sends_in_slot, s.synced_sends);
+    // listening one frame in twelve, give or take the first few
+    CHECK(s.heard >= 200 / 12 && s.heard < 200 / 12 + 10);
+    CHECK_EQ(s.lost_sync_at, UINT32_MAX);
+}
+
+static void test_slow_clock() {
+    Scenario s;
+    s.drift_ppm = -35000;
+    s.run();
+    CHECK_NEAR(s.final_drift, -35000, 500);
+    CHECK(s.synced_sends > 150);
+    CHECK_EQ(s.sends_in_slot, s.synced_sends);
+    CHECK_EQ(s.lost_sync_at, UINT32_MAX);
+}
+
+static void test_seq_wraps() {
+    Scenario s;
+    s.drift_ppm = 10000;
+    s.first_seq = 65500;
+    s.run();
+    CHECK_NEAR(s.final_drift, 10000, 500);
+    CHECK_EQ(s.sends_in_slot, s.synced_sends);
+    CHECK_EQ(s.lost_sync_at, UINT32_MAX);
+}
+
+static void test_beacons_stop() {
+    // the receiver goes away for a while: the sender keeps reporting on its
+    // own clock, drops out of sync, and gets back in once they return
+    Scenario s;
+    s.drift_ppm = 15000;
+    s.frames = 400;
+    s.stop_from = 100;
+    s.resume_at = 250;
+    s.run();
+    CHECK(s.lost_sync_at >= 100 && s.lost_sync_at < 250);
+    CHECK(s.sends > 390);
+    CHECK(s.longest_gap_us < 2 * Scenario::FRAME_MS * 1000ull);
+    CHECK_NEAR(s.final_drift, 15000, 500);
+    CHECK_EQ(s.sends_in_slot, s.synced_sends);
+}
+
+int main() {
+    test_beacon_round_trip();
+    test_slot_choice();
+    test_fast_clock();
+    test_slow_clock();
+    test_seq_wraps();
+    test_beacons_stop();
+    return check_done("tdma");
+}
@@ -0,0 +1,201 @@
+/**
+ * The ingest daemon's write-ahead log: entries read back in order across
+ * segments, a reader carrying on from a saved position, and a torn or
+ * damaged tail cut off on reopening without losing anything before it.
+ */
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "check.h"
+#include "hostlink.h"
+#include "wal.h"
+
+// a record of len bytes (crc and all, as the receiver would send) made from n
+static size_t make_record(uint32_t n, uint8_t* record) {
+    size_t len = 5 + n % 20;
+    record[0] = HOSTLINK_READING;
+    serialise_u32(record + 1, n);
+    for (size_t i = 5; i < len; i++) {
+        record[i] = (uint8_t)(n + i);
+    }
+    serialise_u16(record + len, crc16_ccitt(record, len));
+    return len + 2;
+}
+
+// read everything from the reader, checking it's entries first..last in order
+static uint32_t read_all(WalReader& reader, uint32_t first) {
+    uint32_t n = first;
+    uint64_t host_ms;
+    const uint8_t* record;
+    size_t len;
+    while (reader.next(&host_ms, &record, &len)) {
+        uint8_t expected[64];
+        size_t expected_len = make_record(n, expected);
+        CHECK_EQ(host_ms, 1700000000000ull + n);
+        if (!CHECK_EQ(len, expected_len) || !CHECK(memcmp(record, expected, len) == 0)) {
+            break;
+        }
+        n++;
+    }
+    return n - first;
+}
+
+static void append_range(WalWriter& wal, uint32_t first, uint32_t count) {
+    for (uint32_t n = first; n < first + count; n++) {
+        uint8_t record[64];
+        size_t len = make_record(n, record);
+        wal.append(1700000000000ull + n, record, len);
+        if (n % 7 == 6) {
+            CHECK(wal.commit());
+        }
+    }
+    CHECK(wal.commit());
+}
+
+static std::string last_segment(const std::string& dir) {
+    char name[32];
+    snprintf(name, sizeof(name), "/wal-%08u.log", wal_list_segments(dir.c_str()).back());
+    return dir + name;
+}
+
+static void test_round_trip() {
+    std::string dir = check_temp_dir();
+    WalWriter wal;
+    CHECK(wal.open(dir.c_str()));
+    append_range(wal, 0, 100);
+    CHECK_EQ(wal.entries(), 100);
+    CHECK_EQ(wal.pending(), 0);
+    wal.close();
+
+    WalReader reader;
+    CHECK(reader.open(dir.c_str()));
+    CHECK_EQ(read_all(reader, 0), 100);
+    check_remove_dir(dir);
+}
+
+static void test_segments_and_resume() {
+    // small segments so it rolls over several times
+    std::string dir = check_temp_dir();
+    WalWriter wal;
+    CHECK(wal.open(dir.c_str(), 512));
+    append_range(wal, 0, 60);
+    CHECK(wal_list_segments(dir.c_str()).size() > 3);
+
+    // a reader part way through carries on where it left off, into what was
+    // written after it stopped
+    WalReader reader;
+    CHECK(reader.open(dir.c_str()));
+    uint64_t host_ms;
+    const uint8_t* record;
+    size_t len;
+    for (int i = 0; i < 25; i++) {
+        CHECK(reader.next(&host_ms, &record, &len));
+    }
+    uint32_t segment = reader.segment();
+    size_t offset = reader.offset();
+
+    append_range(wal, 60, 40);
+    wal.close();
+    WalReader resumed;
+    CHECK(resumed.open(dir.c_str(), segment, offset));
+    CHECK_EQ(read_all(resumed, 25), 75);
+
+    // and reopening for writing carries on in the last segment
+    size_t segments = wal_list_segments(dir.c_str()).size();
+    CHECK(wal.open(dir.c_str(), 512));
+    CHECK_EQ(wal.torn_bytes(), 0);
+    append_range(wal, 100, 1);
+    wal.close();
+    CHECK_EQ(wal_list_segments(dir.c_str()).size(), segments);
+    CHECK(reader.open(dir.c_str()));
+    CHECK_EQ(read_all(reader, 0), 101);
+    check_remove_dir(dir);
+}
+
+static void test_torn_tail() {
+    std::string dir = check_temp_dir();
+    WalWriter wal;
+    CHECK(wal.open(dir.c_str()));
+    append_range(wal, 0, 10);
+    wal.close();
+
+    // a crash part way through writing the last entry
+    std::string path = last_segment(dir);
+    off_t size = std::filesystem::file_size(path);
+    CHECK(truncate(path.c_str(), size - 3) == 0);
+
+    // a reader stops short of it
+    WalReader reader;
+    CHECK(reader.open(dir.c_str()));
+    CHECK_EQ(read_all(reader, 0), 9);
+
+    // reopening cuts it off and what's appended after follows on
+    CHECK(wal.open(dir.c_str()));
+    CHECK(wal.torn_bytes() > 0);
+    CHECK_EQ(std::filesystem::file_size(path), (uintmax_t)size - wal.torn_bytes() - 3);
+    append_range(wal, 9, 5);
+    wal.close();
+    CHECK(reader.open(dir.c_str()));
+    CHECK_EQ(read_all(reader, 0), 14);
+    check_remove_dir(dir);
+}
+
+static void test_damaged_tail() {
+    // garbage written over the end rather than cut short
+    std::string dir = check_temp_dir();
+    WalWriter wal;
+    CHECK(wal.open(dir.c_str()));
+    append_range(wal, 0, 10);
+    wal.close();
+
+    std::string path = last_segment(dir);
+    FILE* f = fopen(path.c_str(), "r+b");
+    CHECK(f != nullptr);
+    if (f) {
+        fseek(f, -4, SEEK_END);
+        fputc(0xA5, f);
+        fseek(f, 0, SEEK_END);
+        fputs("junk", f);
+        fclose(f);
+    }
+    CHECK(wal.open(dir.c_str()));
+    CHECK(wal.torn_bytes() > 4);
+    append_range(wal, 9, 1);
+    wal.close();
+    WalReader reader;
+    CHECK(reader.open(dir.c_str()));
+    CHECK_EQ(read_all(reader, 0), 10);
+    check_remove_dir(dir);
+}
+
+static void test_valid_length() {
+    uint8_t data[256];
+    CHECK_EQ(wal_valid_length(data, 0), 0);
+    CHECK_EQ(wal_valid_length(data, WAL_ENTRY_HEADER - 1), 0);
+    // an entry claiming more than there is
+    memset(data, 0, sizeof(data));
+    serialise_u16(data, 1000);
+    CHECK_EQ(wal_valid_length(data, sizeof(data)), 0);
+}
+
+static void test_empty() {
+    std::string dir = check_temp_dir();
+    WalWriter wal;
+    CHECK(wal.open(dir.c_str()));
+    CHECK(wal.commit());
+    wal.close();
+    WalReader reader;
+    CHECK(reader.open(dir.c_str()));
+    CHECK_EQ(read_all(reader, 0), 0);
+    check_remove_dir(dir);
+}
+
+int main() {
+    test_round_trip();
+    test_segments_and_resume();
+    test_torn_tail();
+    test_damaged_tail();
+    test_valid_length();
+    test_empty();
+    return check_done("wal");
+}